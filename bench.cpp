@@ -0,0 +1,401 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "tinyjson.h"
+
+/*
+ * tinyjson_bench [--format=csv|json] [--scale=N] [--min-time=SECONDS] [--filter=CORPUS]
+ *
+ * The corpus is generated in memory from a fixed seed, so every run and every
+ * build measures the same bytes. Configure with -DCMAKE_BUILD_TYPE=Release
+ * for meaningful numbers.
+ */
+
+struct corpus {
+    const char* name;
+    std::vector<std::string> docs;   /* one entry per document, NDJSON is split by line */
+    size_t bytes;
+};
+
+struct result {
+    const char* corpus;
+    const char* operation;
+    size_t bytes;
+    size_t docs;
+    size_t iterations;
+    double seconds;
+};
+
+static unsigned long long rng_state;
+
+static unsigned rng_next() {
+    rng_state = rng_state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (unsigned)(rng_state >> 33);
+}
+
+static unsigned rng_range(unsigned n) {
+    return rng_next() % n;
+}
+
+static double rng_double(double lo, double hi) {
+    return lo + (hi - lo) * (rng_next() / 2147483648.0);
+}
+
+static void append_double(std::string& s, double d) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.15g", d);
+    s += buf;
+}
+
+static void append_uint(std::string& s, unsigned long long n) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%llu", n);
+    s += buf;
+}
+
+/* mixes ASCII words, multi-byte UTF-8 and escape sequences */
+static void append_text(std::string& s, unsigned words) {
+    static const char* pieces[] = {
+        "hello", "world", "json", "parser", "\\u00e9t\\u00e9", "\xe4\xbd\xa0\xe5\xa5\xbd",
+        "\xe3\x81\x93\xe3\x82\x93\xe3\x81\xab\xe3\x81\xa1\xe3\x81\xaf", "\\ud83d\\ude00", "\xf0\x9f\x8e\x89",
+        "line\\nbreak", "\\\"quoted\\\"", "tab\\tbed", "http:\\/\\/t.co\\/x", "#tag", "@user"
+    };
+    s += '"';
+    for (unsigned i = 0; i < words; i++) {
+        if (i)
+            s += ' ';
+        s += pieces[rng_range(sizeof(pieces) / sizeof(pieces[0]))];
+    }
+    s += '"';
+}
+
+/* canada.json-like: one polygon with long rings of coordinate pairs */
+static std::string gen_numbers(unsigned scale) {
+    std::string s = "{\"type\":\"FeatureCollection\",\"features\":[{\"type\":\"Feature\","
+        "\"properties\":{\"name\":\"Canada\"},\"geometry\":{\"type\":\"Polygon\",\"coordinates\":[";
+    for (unsigned ring = 0; ring < 40 * scale; ring++) {
+        if (ring)
+            s += ',';
+        s += '[';
+        for (unsigned i = 0; i < 1000; i++) {
+            if (i)
+                s += ',';
+            s += '[';
+            append_double(s, rng_double(-141.0, -52.0));
+            s += ',';
+            append_double(s, rng_double(41.0, 83.0));
+            s += ']';
+        }
+        s += ']';
+    }
+    s += "]}}]}";
+    return s;
+}
+
+/* twitter.json-like: statuses with unicode text and nested user/entity objects */
+static std::string gen_strings(unsigned scale) {
+    std::string s = "{\"statuses\":[";
+    for (unsigned i = 0; i < 2000 * scale; i++) {
+        if (i)
+            s += ',';
+        s += "{\"id\":";
+        append_uint(s, 500000000000000000ULL + rng_next());
+        s += ",\"text\":";
+        append_text(s, 8 + rng_range(16));
+        s += ",\"lang\":\"ja\",\"retweeted\":false,\"in_reply_to\":null,\"user\":{\"name\":";
+        append_text(s, 2);
+        s += ",\"screen_name\":\"user";
+        append_uint(s, rng_range(100000));
+        s += "\",\"description\":";
+        append_text(s, 4 + rng_range(12));
+        s += ",\"followers_count\":";
+        append_uint(s, rng_range(1000000));
+        s += "},\"entities\":{\"hashtags\":[";
+        for (unsigned h = 0, n = rng_range(4); h < n; h++) {
+            if (h)
+                s += ',';
+            s += "{\"text\":";
+            append_text(s, 1);
+            s += ",\"indices\":[";
+            append_uint(s, rng_range(100));
+            s += ',';
+            append_uint(s, 100 + rng_range(40));
+            s += "]}";
+        }
+        s += "],\"urls\":[]}}";
+    }
+    s += "]}";
+    return s;
+}
+
+/* many chains of alternating arrays and objects, each 256 levels deep */
+static std::string gen_nested(unsigned scale) {
+    std::string s = "[";
+    for (unsigned chain = 0; chain < 200 * scale; chain++) {
+        if (chain)
+            s += ',';
+        for (unsigned d = 0; d < 128; d++)
+            s += "{\"k\":[";
+        append_uint(s, rng_range(1000));
+        for (unsigned d = 0; d < 128; d++)
+            s += "]}";
+    }
+    s += ']';
+    return s;
+}
+
+/* one object with tens of thousands of members of mixed types */
+static std::string gen_wide(unsigned scale) {
+    std::string s = "{";
+    for (unsigned i = 0; i < 50000 * scale; i++) {
+        if (i)
+            s += ',';
+        s += "\"field_";
+        append_uint(s, i);
+        s += "\":";
+        switch (rng_range(5)) {
+        case 0: append_double(s, rng_double(-1e6, 1e6)); break;
+        case 1: append_text(s, 1); break;
+        case 2: s += rng_range(2) ? "true" : "false"; break;
+        case 3: s += "null"; break;
+        default: append_uint(s, rng_next()); break;
+        }
+    }
+    s += '}';
+    return s;
+}
+
+/* NDJSON log records, one document per line */
+static std::vector<std::string> gen_ndjson(unsigned scale) {
+    static const char* levels[] = { "\"debug\"", "\"info\"", "\"warn\"", "\"error\"" };
+    std::vector<std::string> lines;
+    for (unsigned i = 0; i < 20000 * scale; i++) {
+        std::string s = "{\"ts\":";
+        append_uint(s, 1700000000000ULL + i * 37ULL);
+        s += ",\"level\":";
+        s += levels[rng_range(4)];
+        s += ",\"msg\":";
+        append_text(s, 3 + rng_range(6));
+        s += ",\"latency_ms\":";
+        append_double(s, rng_double(0.0, 250.0));
+        s += ",\"tags\":[\"api\",\"v2\"],\"ok\":";
+        s += rng_range(10) ? "true" : "false";
+        s += '}';
+        lines.push_back(s);
+    }
+    return lines;
+}
+
+static void add_corpus(std::vector<corpus>& out, const char* name, std::vector<std::string> docs) {
+    corpus c;
+    c.name = name;
+    c.docs = docs;
+    c.bytes = 0;
+    for (size_t i = 0; i < docs.size(); i++)
+        c.bytes += docs[i].size();
+    out.push_back(c);
+}
+
+static double now_seconds() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void fail(const char* corpus, const char* what, int status) {
+    fprintf(stderr, "%s: %s failed with status %d\n", corpus, what, status);
+    exit(1);
+}
+
+static void bench_corpus(const corpus& c, double min_time, std::vector<result>& results) {
+    size_t n = c.docs.size();
+    std::vector<jsonValue> values(n);
+    std::vector<char*> outputs(n);
+    double parse = 0.0, stringify = 0.0, release = 0.0, roundtrip = 0.0;
+    size_t iterations = 0, roundtrips = 0;
+    double t;
+
+    do {
+        t = now_seconds();
+        for (size_t i = 0; i < n; i++) {
+            int ret = ParseJsonString(&values[i], c.docs[i].c_str());
+            if (ret != PARSE_OK)
+                fail(c.name, "ParseJsonString", ret);
+        }
+        parse += now_seconds() - t;
+
+        t = now_seconds();
+        for (size_t i = 0; i < n; i++) {
+            size_t length;
+            Stringify(&values[i], &outputs[i], &length);
+        }
+        stringify += now_seconds() - t;
+        for (size_t i = 0; i < n; i++)
+            free(outputs[i]);
+
+        t = now_seconds();
+        for (size_t i = 0; i < n; i++)
+            FreeValue(&values[i]);
+        release += now_seconds() - t;
+
+        iterations++;
+    } while (parse + stringify + release < min_time);
+
+    do {
+        t = now_seconds();
+        for (size_t i = 0; i < n; i++) {
+            jsonValue v;
+            char* json;
+            size_t length;
+            ParseJsonString(&v, c.docs[i].c_str());
+            Stringify(&v, &json, &length);
+            free(json);
+            FreeValue(&v);
+        }
+        roundtrip += now_seconds() - t;
+        roundtrips++;
+    } while (roundtrip < min_time / 3);
+
+    result r = { c.name, "parse", c.bytes, n, iterations, parse };
+    results.push_back(r);
+    r.operation = "stringify"; r.seconds = stringify;
+    results.push_back(r);
+    r.operation = "free"; r.seconds = release;
+    results.push_back(r);
+    r.operation = "roundtrip"; r.seconds = roundtrip; r.iterations = roundtrips;
+    results.push_back(r);
+}
+
+struct query_sum {
+    double sum;
+    size_t matches;
+};
+
+static bool add_match(void* userData, size_t, const jsonValue* match) {
+    query_sum* q = (query_sum*)userData;
+    if (GetValueType(match) == TYPE_NUMBER)
+        q->sum += GetValueNumber(match);
+    q->matches++;
+    return true;
+}
+
+/* one field out of every record: full parse and lookup against the compiled query, on one thread and on all */
+static void bench_query(const corpus& c, const char* query, double min_time, std::vector<result>& results) {
+    std::string text;
+    for (size_t i = 0; i < c.docs.size(); i++) {
+        text += c.docs[i];
+        text += '\n';
+    }
+    jsonPath* path;
+    int ret = CompilePath(&path, query);
+    if (ret != PARSE_OK)
+        fail(c.name, "CompilePath", ret);
+    const char* key = strrchr(query, '.') + 1;
+    size_t keyLen = strlen(key);
+
+    double seconds[3] = { 0.0, 0.0, 0.0 };
+    size_t iterations[3] = { 0, 0, 0 };
+    for (int op = 0; op < 3; op++) {
+        do {
+            query_sum q = { 0.0, 0 };
+            double t = now_seconds();
+            if (op == 0) {
+                for (size_t i = 0; i < c.docs.size(); i++) {
+                    jsonValue v;
+                    if ((ret = ParseJsonString(&v, c.docs[i].c_str())) != PARSE_OK)
+                        fail(c.name, "ParseJsonString", ret);
+                    for (size_t m = 0; m < GetValueObjectSize(&v); m++)
+                        if (GetValueObjectKeyLength(&v, m) == keyLen && memcmp(GetValueObjectKey(&v, m), key, keyLen) == 0)
+                            add_match(&q, i, GetValueObjectValue(&v, m));
+                    FreeValue(&v);
+                }
+            }
+            else if ((ret = QueryNdjson(path, text.c_str(), op == 1 ? 1 : 0, add_match, &q)) != PARSE_OK)
+                fail(c.name, "QueryNdjson", ret);
+            seconds[op] += now_seconds() - t;
+            iterations[op]++;
+        } while (seconds[op] < min_time / 3);
+    }
+    FreePath(path);
+
+    static const char* names[] = { "parse_lookup", "query", "query_threads" };
+    for (int op = 0; op < 3; op++) {
+        result r = { c.name, names[op], c.bytes, c.docs.size(), iterations[op], seconds[op] };
+        results.push_back(r);
+    }
+}
+
+static void print_csv(const std::vector<result>& results) {
+    printf("corpus,operation,bytes,documents,iterations,seconds,mb_per_s,docs_per_s\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        const result& r = results[i];
+        printf("%s,%s,%zu,%zu,%zu,%.6f,%.2f,%.1f\n", r.corpus, r.operation, r.bytes, r.docs, r.iterations, r.seconds,
+            r.bytes * r.iterations / r.seconds / 1e6, r.docs * r.iterations / r.seconds);
+    }
+}
+
+static void print_json(const std::vector<result>& results) {
+    printf("[\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        const result& r = results[i];
+        printf("  {\"corpus\":\"%s\",\"operation\":\"%s\",\"bytes\":%zu,\"documents\":%zu,\"iterations\":%zu,"
+            "\"seconds\":%.6f,\"mb_per_s\":%.2f,\"docs_per_s\":%.1f}%s\n",
+            r.corpus, r.operation, r.bytes, r.docs, r.iterations, r.seconds,
+            r.bytes * r.iterations / r.seconds / 1e6, r.docs * r.iterations / r.seconds,
+            i + 1 < results.size() ? "," : "");
+    }
+    printf("]\n");
+}
+
+int main(int argc, char** argv) {
+    const char* format = "csv";
+    const char* filter = NULL;
+    unsigned scale = 1;
+    double min_time = 1.0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--format=", 9) == 0)
+            format = argv[i] + 9;
+        else if (strncmp(argv[i], "--scale=", 8) == 0)
+            scale = (unsigned)atoi(argv[i] + 8);
+        else if (strncmp(argv[i], "--min-time=", 11) == 0)
+            min_time = atof(argv[i] + 11);
+        else if (strncmp(argv[i], "--filter=", 9) == 0)
+            filter = argv[i] + 9;
+        else {
+            fprintf(stderr, "usage: %s [--format=csv|json] [--scale=N] [--min-time=SECONDS] [--filter=CORPUS]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (scale == 0)
+        scale = 1;
+
+#ifndef NDEBUG
+    fprintf(stderr, "warning: assertions are enabled, build with -DCMAKE_BUILD_TYPE=Release\n");
+#endif
+
+    std::vector<corpus> corpora;
+    rng_state = 20240601ULL;
+    add_corpus(corpora, "numbers", std::vector<std::string>(1, gen_numbers(scale)));
+    add_corpus(corpora, "strings", std::vector<std::string>(1, gen_strings(scale)));
+    add_corpus(corpora, "nested", std::vector<std::string>(1, gen_nested(scale)));
+    add_corpus(corpora, "wide", std::vector<std::string>(1, gen_wide(scale)));
+    add_corpus(corpora, "ndjson", gen_ndjson(scale));
+
+    std::vector<result> results;
+    for (size_t i = 0; i < corpora.size(); i++) {
+        if (filter && strcmp(filter, corpora[i].name) != 0)
+            continue;
+        bench_corpus(corpora[i], min_time, results);
+        if (strcmp(corpora[i].name, "ndjson") == 0)
+            bench_query(corpora[i], "$.latency_ms", min_time, results);
+    }
+
+    if (strcmp(format, "json") == 0)
+        print_json(results);
+    else
+        print_csv(results);
+    return 0;
+}
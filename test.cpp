@@ -1,8 +1,16 @@
 ﻿#include <stdio.h>
+#include <math.h>
 #include <stdlib.h>
 #include <string.h>
+#include <thread>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/uio.h>
+#endif
 
 #include "tinyjson.h"
+#include "tinyjson.hpp"
+#include "tinyjson_bind.hpp"
+#include "tinyjson_literal.hpp"
 
 static int main_ret = 0;
 static int test_count = 0;
@@ -232,7 +240,7 @@ static void test_access_string() {
 
 static void test_parse_valid_unicode_hex()
 {   
-    char c[5] = { 0xf0, 0x9d, 0x84, 0x9e, '\0'};
+    char c[5] = { (char)0xf0, (char)0x9d, (char)0x84, (char)0x9e, '\0'};
     TEST_STRING(c, "\"\\uD834\\uDD1E\"");
 }
 
@@ -329,6 +337,192 @@ static void test_parse_miss_comma_or_curly_bracket() {
     TEST_ERROR(PARSE_ERR_MISS_COMMA_OR_CURLY_BRACKET, "{\"a\":{}");
 }
 
+static void test_parse_depth_exceeded() {
+    std::string ok = std::string(1024, '[') + std::string(1024, ']');
+    std::string deep = std::string(1025, '[') + std::string(1025, ']');
+    jsonValue v;
+    EXPECT_EQ_INT(PARSE_OK, ParseJsonString(&v, ok.c_str()));
+    FreeValue(&v);
+    TEST_ERROR(PARSE_ERR_DEPTH_EXCEEDED, deep.c_str());
+
+    /* no recursion anywhere: parse, stringify, copy and free a very deep tree */
+    jsonParser p;
+    jsonValue copy;
+    char* json;
+    size_t length;
+    InitParser(&p);
+    SetParserMaxDepth(&p, 0);
+    deep = std::string(1000000, '[') + "{\"a\":1}" + std::string(1000000, ']');
+    EXPECT_EQ_INT(PARSE_OK, ParseJsonStringWith(&p, &v, deep.c_str()));
+    InitValue(&copy);
+    CopyValue(&copy, &v);
+    FreeValue(&v);
+    EXPECT_EQ_INT(STRINGIFY_OK, Stringify(&copy, &json, &length));
+    EXPECT_TRUE(length == deep.size() && memcmp(json, deep.c_str(), length) == 0);
+    free(json);
+    FreeValue(&copy);
+
+    SetParserMaxDepth(&p, 3);
+    EXPECT_EQ_INT(PARSE_OK, ParseJsonStringWith(&p, &v, "{\"a\":[{},[\"x\"]]}"));
+    FreeValue(&v);
+    EXPECT_EQ_INT(PARSE_ERR_DEPTH_EXCEEDED, ParseJsonStringWith(&p, &v, "{\"a\":[\"x\",{\"b\":[1]}]}"));
+    EXPECT_EQ_INT(TYPE_NULL, GetValueType(&v));
+    FreeParser(&p);
+}
+
+static void test_parse_lazy_strings() {
+    const char* json = "[\"plain\",\"\",\"a\\tb\\u00e9\\ud834\\udd1e\",{\"k\\n\":\"v\\/\"}]";
+    jsonParser p;
+    jsonValue v, copy;
+    char* out;
+    size_t length;
+
+    InitParser(&p);
+    SetParserFlags(&p, PARSE_LAZY_STRINGS);
+    EXPECT_EQ_INT(PARSE_OK, ParseJsonStringWith(&p, &v, json));
+
+    /* untouched slices are re-emitted as they were written */
+    EXPECT_EQ_INT(STRINGIFY_OK, Stringify(&v, &out, &length));
+    EXPECT_EQ_STRING("[\"plain\",\"\",\"a\\tb\\u00e9\\ud834\\udd1e\",{\"k\\n\":\"v\\/\"}]", out, length);
+    free(out);
+
+    jsonValue* plain = GetValueArrayElement(&v, 0);
+    EXPECT_TRUE((GetValueStringLength(plain) == 5 && GetValueString(plain) == json + 2));
+    EXPECT_EQ_SIZE_T(0, GetValueStringLength(GetValueArrayElement(&v, 1)));
+
+    InitValue(&copy);
+    CopyValue(&copy, &v);
+    EXPECT_EQ_STRING("v/", GetValueString(GetValueObjectValue(GetValueArrayElement(&copy, 3), 0)),
+        GetValueStringLength(GetValueObjectValue(GetValueArrayElement(&copy, 3), 0)));
+    EXPECT_EQ_STRING("k\n", GetValueObjectKey(GetValueArrayElement(&v, 3), 0), GetValueObjectKeyLength(GetValueArrayElement(&v, 3), 0));
+
+    jsonValue* escaped = GetValueArrayElement(&v, 2);
+    EXPECT_EQ_STRING("a\tb\xc3\xa9\xf0\x9d\x84\x9e", GetValueString(escaped), GetValueStringLength(escaped));
+    EXPECT_EQ_INT(STRINGIFY_OK, Stringify(&v, &out, &length));
+    EXPECT_EQ_STRING("[\"plain\",\"\",\"a\\tb\xc3\xa9\xf0\x9d\x84\x9e\",{\"k\\n\":\"v\\/\"}]", out, length);
+    free(out);
+    FreeValue(&copy);
+    FreeValue(&v);
+
+    /* validation is not deferred */
+    EXPECT_EQ_INT(PARSE_ERR_INVALID_ESCAPE_CHAR, ParseJsonStringWith(&p, &v, "[\"a\\x\"]"));
+    EXPECT_EQ_INT(PARSE_ERR_INVALID_UNICODE_SURROGATE, ParseJsonStringWith(&p, &v, "\"\\uD800\\uE000\""));
+    EXPECT_EQ_INT(PARSE_ERR_CONTROL_CHAR, ParseJsonStringWith(&p, &v, "\"\x01\""));
+    EXPECT_EQ_INT(PARSE_ERR_MISS_QUOTATION_MARK, ParseJsonStringWith(&p, &v, "{\"a\":\"b}"));
+    FreeParser(&p);
+}
+
+static void test_parse_raw_numbers() {
+    const char* json = "[1.0,0.1,-0,12345678901234567890,1e309,{\"n\":2.50}]";
+    jsonParser p;
+    jsonValue v, copy;
+    char* out;
+    size_t length;
+
+    InitParser(&p);
+    SetParserFlags(&p, PARSE_RAW_NUMBERS);
+    EXPECT_EQ_INT(PARSE_OK, ParseJsonStringWith(&p, &v, json));
+    EXPECT_EQ_INT(STRINGIFY_OK, Stringify(&v, &out, &length));
+    EXPECT_EQ_STRING("[1.0,0.1,-0,12345678901234567890,1e309,{\"n\":2.50}]", out, length);
+    free(out);
+
+    EXPECT_EQ_DOUBLE(1.0, GetValueNumber(GetValueArrayElement(&v, 0)));
+    EXPECT_EQ_DOUBLE(0.1, GetValueNumber(GetValueArrayElement(&v, 1)));
+    EXPECT_EQ_DOUBLE(1.2345678901234567e19, GetValueNumber(GetValueArrayElement(&v, 3)));
+    EXPECT_EQ_DOUBLE(HUGE_VAL, GetValueNumber(GetValueArrayElement(&v, 4)));
+    const char* text = GetValueNumberText(GetValueArrayElement(&v, 3), &length);
+    EXPECT_EQ_STRING("12345678901234567890", text, length);
+
+    InitValue(&copy);
+    CopyValue(&copy, &v);
+    FreeValue(&v);
+    text = GetValueNumberText(GetValueObjectValue(GetValueArrayElement(&copy, 5), 0), &length);
+    EXPECT_EQ_STRING("2.50", text, length);
+    EXPECT_EQ_DOUBLE(2.5, GetValueNumber(GetValueObjectValue(GetValueArrayElement(&copy, 5), 0)));
+    SetValueNumber(GetValueArrayElement(&copy, 0), 3.0);
+    EXPECT_TRUE(GetValueNumberText(GetValueArrayElement(&copy, 0), &length) == nullptr);
+    EXPECT_EQ_INT(STRINGIFY_OK, Stringify(&copy, &out, &length));
+    EXPECT_EQ_STRING("[3,0.1,-0,12345678901234567890,1e309,{\"n\":2.50}]", out, length);
+    free(out);
+    FreeValue(&copy);
+
+    EXPECT_EQ_INT(PARSE_ERR_INVALID_VALUE, ParseJsonStringWith(&p, &v, "[1.]"));
+    EXPECT_EQ_INT(PARSE_ERR_ROOT_NOT_SINGULAR, ParseJsonStringWith(&p, &v, "0123"));
+    FreeParser(&p);
+}
+
+static void test_parse_exact_size() {
+    static const char* docs[] = {
+        "[]", "{}", "[[],{},[[]]]", "[1,\"a,b]\",[2,3],{\"k,}\":[4],\"e\":{}}]",
+        "{\"s\":\"\\\"[,\",\"t\":[ ],\"u\":[ 1 , 2 ]}", "[\"\\\\\",\"x\"]"
+    };
+    jsonParser p;
+    jsonValue v, expect;
+    InitParser(&p);
+    SetParserFlags(&p, PARSE_EXACT_SIZE);
+    for (size_t i = 0; i < sizeof(docs) / sizeof(docs[0]); i++) {
+        InitValue(&expect);
+        EXPECT_EQ_INT(PARSE_OK, ParseJsonString(&expect, docs[i]));
+        EXPECT_EQ_INT(PARSE_OK, ParseJsonStringWith(&p, &v, docs[i]));
+        EXPECT_TRUE(EqualValue(&v, &expect));
+        FreeValue(&v);
+        FreeValue(&expect);
+    }
+
+    /* counts taken from broken input never overrun, the parse fails either way */
+    EXPECT_TRUE(ParseJsonStringWith(&p, &v, "[1,2") != PARSE_OK);
+    EXPECT_TRUE(ParseJsonStringWith(&p, &v, "[1 2]") != PARSE_OK);
+    EXPECT_TRUE(ParseJsonStringWith(&p, &v, "[[1],[2,]") != PARSE_OK);
+    EXPECT_TRUE(ParseJsonStringWith(&p, &v, "{\"a\":[1,\"x\"],}") != PARSE_OK);
+    EXPECT_TRUE(ParseJsonStringWith(&p, &v, "[\"a\\\"]") != PARSE_OK);
+    EXPECT_TRUE(ParseJsonStringWith(&p, &v, "[{\"a\":1 \"b\":2}]") != PARSE_OK);
+    EXPECT_EQ_INT(PARSE_ERR_MISS_COMMA_OR_SQUARE_BRACKET, ParseJsonStringWith(&p, &v, "[1}"));
+    FreeParser(&p);
+}
+
+static void test_parse_strict_utf8() {
+    static const char* valid[] = {
+        "\"\xC2\xA2\"", "\"\xE2\x82\xAC\"", "\"\xF0\x9D\x84\x9E\"", "\"\xED\x9F\xBF\xEE\x80\x80\xF4\x8F\xBF\xBF\"",
+        "\"0123456789abcdef\xE4\xBD\xA0\xE5\xA5\xBD\xF0\x9F\x8E\x89 0123456789abcdef\xC3\xA9\"",
+        "{\"\xE3\x81\x93\xE3\x82\x93\":[\"\xC3\xA9t\xC3\xA9\\n\xC3\xA9\",\"\\u00e9\\ud834\\udd1e\"]}"
+    };
+    static const char* invalid[] = {
+        "\"\xC0\x80\"", "\"\xC1\xBF\"", "\"\xE0\x80\x80\"", "\"\xED\xA0\x80\"", "\"\xF0\x80\x80\x80\"",
+        "\"\xF4\x90\x80\x80\"", "\"\xF5\x80\x80\x80\"", "\"\xFF\"", "\"\x80\"", "\"\xE2\x82\"", "\"\xE2\x82\\n\"",
+        "\"0123456789abcdef0123456789\x80\"", "\"0123456789abcdef01234567\xE2\x82\"",
+        "\"0123456789abcde\xE2\x82\xAC\xE2\x82\x41 0123456789abcdef\"", "{\"\xC0\xAF\":1}"
+    };
+    jsonParser p;
+    jsonValue v, expect;
+    InitParser(&p);
+    SetParserFlags(&p, PARSE_STRICT_UTF8);
+    for (size_t i = 0; i < sizeof(valid) / sizeof(valid[0]); i++) {
+        InitValue(&expect);
+        EXPECT_EQ_INT(PARSE_OK, ParseJsonString(&expect, valid[i]));
+        EXPECT_EQ_INT(PARSE_OK, ParseJsonStringWith(&p, &v, valid[i]));
+        EXPECT_TRUE(EqualValue(&v, &expect));
+        FreeValue(&v);
+        FreeValue(&expect);
+    }
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        EXPECT_EQ_INT(PARSE_ERR_INVALID_UTF8, ParseJsonStringWith(&p, &v, invalid[i]));
+        /* without the flag the bytes pass through */
+        InitValue(&v);
+        EXPECT_EQ_INT(PARSE_OK, ParseJsonString(&v, invalid[i]));
+        FreeValue(&v);
+    }
+    EXPECT_EQ_INT(PARSE_ERR_INVALID_UNICODE_SURROGATE, ParseJsonStringWith(&p, &v, "\"\\udc00\""));
+    EXPECT_EQ_INT(PARSE_ERR_CONTROL_CHAR, ParseJsonStringWith(&p, &v, "\"\xC3\xA9\x01\""));
+
+    SetParserFlags(&p, PARSE_STRICT_UTF8 | PARSE_LAZY_STRINGS);
+    EXPECT_EQ_INT(PARSE_OK, ParseJsonStringWith(&p, &v, valid[5]));
+    FreeValue(&v);
+    EXPECT_EQ_INT(PARSE_ERR_INVALID_UTF8, ParseJsonStringWith(&p, &v, invalid[13]));
+    EXPECT_EQ_INT(PARSE_ERR_INVALID_UTF8, ParseJsonStringWith(&p, &v, "[\"\xE2\x82\\n\"]"));
+    EXPECT_EQ_INT(PARSE_ERR_INVALID_UNICODE_SURROGATE, ParseJsonStringWith(&p, &v, "[\"\\udfff\"]"));
+    FreeParser(&p);
+}
+
 static void test_parse_object() {
     jsonValue v;
     size_t i;
@@ -457,6 +651,11 @@ static void test_parse() {
     test_parse_miss_key();
     test_parse_miss_colon();
     test_parse_miss_comma_or_curly_bracket();
+    test_parse_depth_exceeded();
+    test_parse_lazy_strings();
+    test_parse_raw_numbers();
+    test_parse_exact_size();
+    test_parse_strict_utf8();
 }
 
 static void test_access() {
@@ -497,6 +696,7 @@ static void test_stringify_string() {
     TEST_ROUNDTRIP("\"Hello\\u0000World\"");
     TEST_ROUNDTRIP("\"Hello\\u0010World\"");
     TEST_ROUNDTRIP("\"Hello\\u0010\\u0000World\"");
+    TEST_ROUNDTRIP("\"\xe4\xbd\xa0\xe5\xa5\xbd\"");
 }
 
 static void test_stringify_array() {
@@ -520,6 +720,2000 @@ static void test_stringify() {
     test_stringify_string();
 }
 
+static bool test_same_json(const jsonValue* lhs, const jsonValue* rhs) {
+    char* json1;
+    char* json2;
+    size_t length1, length2;
+    Stringify(lhs, &json1, &length1);
+    Stringify(rhs, &json2, &length2);
+    bool same = length1 == length2 && memcmp(json1, json2, length1) == 0;
+    free(json1);
+    free(json2);
+    return same;
+}
+
+static void test_copy() {
+    jsonValue v1, v2;
+    InitValue(&v1);
+    ParseJsonString(&v1, "{\"t\":true,\"f\":false,\"n\":null,\"d\":1.5,\"a\":[1,2,3],\"s\":\"abc\",\"o\":{\"e\":[],\"x\":{}}}");
+    InitValue(&v2);
+    SetValueString(&v2, "old", 3);
+    CopyValue(&v2, &v1);
+    EXPECT_TRUE(test_same_json(&v1, &v2));
+    EXPECT_TRUE(GetValueString(GetValueObjectValue(&v1, 5)) != GetValueString(GetValueObjectValue(&v2, 5)));
+
+    /* a child copied over its own parent */
+    CopyValue(&v2, GetValueObjectValue(GetValueObjectValue(&v2, 6), 0));
+    EXPECT_EQ_INT(TYPE_ARRAY, GetValueType(&v2));
+    EXPECT_EQ_SIZE_T(0, GetValueArraySize(&v2));
+    ParseJsonString(&v2, "[[1,2,3],\"x\"]");
+    CopyValue(&v2, GetValueArrayElement(&v2, 0));
+    EXPECT_EQ_SIZE_T(3, GetValueArraySize(&v2));
+    EXPECT_EQ_DOUBLE(3.0, GetValueNumber(GetValueArrayElement(&v2, 2)));
+    FreeValue(&v1);
+    FreeValue(&v2);
+}
+
+static void test_move() {
+    jsonValue v1, v2, v3;
+    InitValue(&v1);
+    ParseJsonString(&v1, "{\"t\":true,\"f\":false,\"n\":null,\"d\":1.5,\"a\":[1,2,3]}");
+    InitValue(&v2);
+    CopyValue(&v2, &v1);
+    InitValue(&v3);
+    SetValueNumber(&v3, 1.0);
+    MoveValue(&v3, &v2);
+    EXPECT_EQ_INT(TYPE_NULL, GetValueType(&v2));
+    EXPECT_TRUE(test_same_json(&v3, &v1));
+
+    /* unwrapping: a child moved into its own parent */
+    ParseJsonString(&v2, "[[1,2,3],\"x\"]");
+    MoveValue(&v2, GetValueArrayElement(&v2, 0));
+    EXPECT_EQ_SIZE_T(3, GetValueArraySize(&v2));
+    EXPECT_EQ_DOUBLE(3.0, GetValueNumber(GetValueArrayElement(&v2, 2)));
+    MoveValue(GetValueObjectValue(&v3, 4), GetValueArrayElement(GetValueObjectValue(&v3, 4), 1));
+    EXPECT_EQ_DOUBLE(2.0, GetValueNumber(GetValueObjectValue(&v3, 4)));
+    FreeValue(&v1);
+    FreeValue(&v2);
+    FreeValue(&v3);
+}
+
+static void test_swap() {
+    jsonValue v1, v2;
+    InitValue(&v1);
+    InitValue(&v2);
+    SetValueString(&v1, "Hello",  5);
+    SetValueString(&v2, "World!", 6);
+    SwapValue(&v1, &v2);
+    EXPECT_EQ_STRING("World!", GetValueString(&v1), GetValueStringLength(&v1));
+    EXPECT_EQ_STRING("Hello",  GetValueString(&v2), GetValueStringLength(&v2));
+    SwapValue(&v1, &v1);
+    EXPECT_EQ_STRING("World!", GetValueString(&v1), GetValueStringLength(&v1));
+    FreeValue(&v1);
+    FreeValue(&v2);
+}
+
+#define TEST_STRINGIFY(expect, v)\
+    do {\
+        char* json;\
+        size_t length;\
+        EXPECT_EQ_INT(STRINGIFY_OK, Stringify(v, &json, &length));\
+        EXPECT_EQ_STRING(expect, json, length);\
+        free(json);\
+    } while(0)
+
+static void test_stringify_cache() {
+    jsonValue v;
+    InitValue(&v);
+    EXPECT_EQ_INT(PARSE_OK, ParseJsonString(&v, "{\"a\":[1,[2,3],{\"x\":\"y\"}],\"b\":{\"c\":[true,false]},\"d\":\"s\"}"));
+    EnableStringifyCache(&v);
+    TEST_STRINGIFY("{\"a\":[1,[2,3],{\"x\":\"y\"}],\"b\":{\"c\":[true,false]},\"d\":\"s\"}", &v);
+    TEST_STRINGIFY("{\"a\":[1,[2,3],{\"x\":\"y\"}],\"b\":{\"c\":[true,false]},\"d\":\"s\"}", &v);
+
+    jsonValue* a = GetValueObjectValue(&v, 0);
+    SetValueNumber(GetValueArrayElement(GetValueArrayElement(a, 1), 0), 4.0);
+    TEST_STRINGIFY("{\"a\":[1,[4,3],{\"x\":\"y\"}],\"b\":{\"c\":[true,false]},\"d\":\"s\"}", &v);
+
+    MoveValue(GetValueArrayElement(a, 2), GetValueObjectValue(&v, 1));
+    TEST_STRINGIFY("{\"a\":[1,[4,3],{\"c\":[true,false]}],\"b\":null,\"d\":\"s\"}", &v);
+
+    SwapValue(GetValueArrayElement(a, 1), GetValueArrayElement(a, 2));
+    TEST_STRINGIFY("{\"a\":[1,{\"c\":[true,false]},[4,3]],\"b\":null,\"d\":\"s\"}", &v);
+
+    SetValueBoolean(GetValueArrayElement(GetValueObjectValue(GetValueArrayElement(a, 1), 0), 0), false);
+    TEST_STRINGIFY("{\"a\":[1,{\"c\":[false,false]},[4,3]],\"b\":null,\"d\":\"s\"}", &v);
+
+    /* the copy is not cached until enabled again, either way the output is the same */
+    CopyValue(GetValueObjectValue(&v, 2), a);
+    TEST_STRINGIFY("{\"a\":[1,{\"c\":[false,false]},[4,3]],\"b\":null,\"d\":[1,{\"c\":[false,false]},[4,3]]}", &v);
+    EnableStringifyCache(&v);
+    SetValueString(GetValueArrayElement(a, 0), "z", 1);
+    TEST_STRINGIFY("{\"a\":[\"z\",{\"c\":[false,false]},[4,3]],\"b\":null,\"d\":[1,{\"c\":[false,false]},[4,3]]}", &v);
+    TEST_STRINGIFY("[1,{\"c\":[false,false]},[4,3]]", GetValueObjectValue(&v, 2));
+    FreeValue(&v);
+}
+
+#define TEST_EQUAL(json1, json2, equality)\
+    do {\
+        jsonValue v1, v2;\
+        InitValue(&v1);\
+        InitValue(&v2);\
+        EXPECT_EQ_INT(PARSE_OK, ParseJsonString(&v1, json1));\
+        EXPECT_EQ_INT(PARSE_OK, ParseJsonString(&v2, json2));\
+        EXPECT_EQ_INT(equality, EqualValue(&v1, &v2));\
+        EXPECT_EQ_INT(equality, EqualValue(&v2, &v1));\
+        if (equality)\
+            EXPECT_TRUE(HashValue(&v1) == HashValue(&v2));\
+        FreeValue(&v1);\
+        FreeValue(&v2);\
+    } while(0)
+
+static void test_hash_equal() {
+    TEST_EQUAL("true", "true", 1);
+    TEST_EQUAL("true", "false", 0);
+    TEST_EQUAL("1.0", "1", 1);
+    TEST_EQUAL("-0", "0", 1);
+    TEST_EQUAL("1", "2", 0);
+    TEST_EQUAL("\"a\\u0062c\"", "\"abc\"", 1);
+    TEST_EQUAL("\"abc\"", "\"abd\"", 0);
+    TEST_EQUAL("[1,2,3]", "[1,2,3]", 1);
+    TEST_EQUAL("[1,2,3]", "[3,2,1]", 0);
+    TEST_EQUAL("[1,2]", "[1,2,3]", 0);
+    TEST_EQUAL("{\"a\":1,\"b\":[true,{}]}", "{\"b\":[true,{}],\"a\":1}", 1);
+    TEST_EQUAL("{\"a\":1,\"b\":2}", "{\"a\":2,\"b\":1}", 0);
+    TEST_EQUAL("{\"a\":1,\"b\":2}", "{\"a\":1,\"c\":2}", 0);
+    TEST_EQUAL("[{\"a\":[]}]", "[{\"a\":{}}]", 0);
+    /* repeated keys: each member is matched once, by key and value */
+    TEST_EQUAL("{\"k\":1,\"k\":1}", "{\"k\":1,\"j\":5}", 0);
+    TEST_EQUAL("{\"k\":1,\"k\":2}", "{\"k\":2,\"k\":1}", 1);
+    TEST_EQUAL("{\"k\":1,\"j\":0,\"k\":2}", "{\"j\":0,\"k\":1,\"k\":2}", 1);
+    TEST_EQUAL("{\"k\":[1],\"k\":[1],\"k\":{\"a\":2}}", "{\"k\":{\"a\":2},\"k\":[1],\"k\":[1]}", 1);
+    TEST_EQUAL("{\"k\":1,\"k\":1,\"k\":2}", "{\"k\":1,\"k\":2,\"k\":2}", 0);
+
+    /* larger objects look their keys up in an index, in linear time */
+    TEST_EQUAL("{\"a\":1,\"b\":2,\"c\":3,\"d\":4,\"e\":5,\"k\":1,\"f\":6,\"k\":2,\"g\":7,\"h\":8}",
+        "{\"k\":2,\"h\":8,\"g\":7,\"f\":6,\"e\":5,\"d\":4,\"c\":3,\"b\":2,\"a\":1,\"k\":1}", 1);
+    TEST_EQUAL("{\"a\":1,\"b\":2,\"c\":3,\"d\":4,\"e\":5,\"k\":1,\"f\":6,\"k\":1,\"g\":7,\"h\":8}",
+        "{\"k\":2,\"h\":8,\"g\":7,\"f\":6,\"e\":5,\"d\":4,\"c\":3,\"b\":2,\"a\":1,\"k\":1}", 0);
+    {
+        std::string forward = "{", backward = "{", changed;
+        for (int i = 0; i < 200000; i++) {
+            forward += (i ? ",\"m" : "\"m") + std::to_string(i) + "\":" + std::to_string(i);
+            backward += (i ? ",\"m" : "\"m") + std::to_string(199999 - i) + "\":" + std::to_string(199999 - i);
+        }
+        forward += "}";
+        backward += "}";
+        changed = forward;
+        changed.replace(changed.size() - 7, 6, "-1");
+        TEST_EQUAL(forward.c_str(), forward.c_str(), 1);
+        TEST_EQUAL(forward.c_str(), backward.c_str(), 1);
+        TEST_EQUAL(changed.c_str(), backward.c_str(), 0);
+    }
+
+    /* lazy and raw values compare like their decoded counterparts */
+    jsonParser p;
+    jsonValue v1, v2;
+    const char* json = "{\"s\":\"x\\ty\",\"n\":[1.50,2e3]}";
+    InitParser(&p);
+    SetParserFlags(&p, PARSE_LAZY_STRINGS | PARSE_RAW_NUMBERS);
+    InitValue(&v1);
+    InitValue(&v2);
+    EXPECT_EQ_INT(PARSE_OK, ParseJsonStringWith(&p, &v1, json));
+    EXPECT_EQ_INT(PARSE_OK, ParseJsonString(&v2, "{\"n\":[1.5,2000],\"s\":\"x\\ty\"}"));
+    EXPECT_TRUE(EqualValue(&v1, &v2));
+    EXPECT_TRUE(HashValue(&v1) == HashValue(&v2));
+    FreeValue(&v1);
+
+    /* cached hashes follow changes made through the setters */
+    EnableStringifyCache(&v2);
+    size_t h = HashValue(&v2);
+    EXPECT_TRUE(HashValue(&v2) == h);
+    SetValueNumber(GetValueArrayElement(GetValueObjectValue(&v2, 0), 1), 3.0);
+    EXPECT_TRUE(HashValue(&v2) != h);
+    EXPECT_EQ_INT(PARSE_OK, ParseJsonString(&v1, "{\"n\":[1.5,3],\"s\":\"x\\ty\"}"));
+    EXPECT_TRUE(HashValue(&v1) == HashValue(&v2));
+    EnableStringifyCache(&v1);
+    HashValue(&v1);
+    EXPECT_TRUE(EqualValue(&v1, &v2));
+    SetValueNumber(GetValueArrayElement(GetValueObjectValue(&v1, 0), 0), 0.0);
+    HashValue(&v1);
+    EXPECT_FALSE(EqualValue(&v1, &v2));
+    FreeValue(&v1);
+    FreeValue(&v2);
+    FreeParser(&p);
+
+    tinyjson::Document d1, d2;
+    d1.parse("[1,{\"k\":null}]");
+    d2.parse("[1.0,{\"k\":null}]");
+    EXPECT_TRUE(d1.root() == d2.root());
+    EXPECT_TRUE(d1[0] != d2[1]);
+    EXPECT_TRUE(d1.root().hash() == d2.root().hash());
+}
+
+static void test_binary() {
+    const char* json = "{\"n\":null,\"b\":[true,false],\"i\":[0,-1,9007199254740992,-0,1.5,1e300],"
+        "\"s\":[\"\",\"plain\",\"tab\\there\",\"\\u4f60\\u597d\"],\"o\":{\"\":{},\"k\":[[]]}}";
+    jsonValue v, v2;
+    char* data;
+    size_t length;
+    InitValue(&v);
+    InitValue(&v2);
+    EXPECT_EQ_INT(PARSE_OK, ParseJsonString(&v, json));
+    EXPECT_EQ_INT(STRINGIFY_OK, EncodeBinary(&v, &data, &length));
+    EXPECT_EQ_INT(PARSE_OK, DecodeBinary(&v2, data, length));
+    EXPECT_TRUE(EqualValue(&v, &v2));
+    EXPECT_TRUE(test_same_json(&v, &v2));
+    FreeValue(&v2);
+
+    /* borrowed strings point into the buffer, escaped ones are still copied */
+    EXPECT_EQ_INT(PARSE_OK, DecodeBinary(&v2, data, length, PARSE_LAZY_STRINGS));
+    EXPECT_TRUE(EqualValue(&v, &v2));
+    const jsonValue* plain = GetValueArrayElement(GetValueObjectValue(&v2, 3), 1);
+    EXPECT_TRUE(GetValueString(plain) > data && GetValueString(plain) < data + length);
+    EXPECT_EQ_INT('\0', GetValueString(plain)[GetValueStringLength(plain)]);
+    EXPECT_TRUE(GetValueObjectKey(&v2, 0) > data && GetValueObjectKey(&v2, 0) < data + length);
+    EXPECT_EQ_STRING("tab\there", GetValueString(GetValueArrayElement(GetValueObjectValue(&v2, 3), 2)), 8);
+    EXPECT_TRUE(test_same_json(&v, &v2));
+    FreeValue(&v2);
+
+    /* every truncation is rejected, without leaking what was built */
+    for (size_t i = 0; i < length; i++)
+        EXPECT_TRUE(DecodeBinary(&v2, data, i) != PARSE_OK);
+    free(data);
+    FreeValue(&v);
+
+    /* raw numbers keep their text */
+    jsonParser p;
+    InitParser(&p);
+    SetParserFlags(&p, PARSE_RAW_NUMBERS);
+    EXPECT_EQ_INT(PARSE_OK, ParseJsonStringWith(&p, &v, "[1.0,12345678901234567890]"));
+    EXPECT_EQ_INT(STRINGIFY_OK, EncodeBinary(&v, &data, &length));
+    EXPECT_EQ_INT(PARSE_OK, DecodeBinary(&v2, data, length));
+    TEST_STRINGIFY("[1.0,12345678901234567890]", &v2);
+    FreeValue(&v2);
+    EXPECT_EQ_INT(PARSE_OK, DecodeBinary(&v2, data, length, PARSE_LAZY_STRINGS));
+    TEST_STRINGIFY("[1.0,12345678901234567890]", &v2);
+    EXPECT_EQ_DOUBLE(1.0, GetValueNumber(GetValueArrayElement(&v2, 0)));
+    FreeValue(&v2);
+    free(data);
+    FreeValue(&v);
+    FreeParser(&p);
+
+    EXPECT_EQ_INT(PARSE_ERR_INVALID_VALUE, DecodeBinary(&v2, "null", 4));
+    EXPECT_EQ_INT(PARSE_ERR_INVALID_VALUE, DecodeBinary(&v2, "TJB\1\x7f", 5));
+    EXPECT_EQ_INT(PARSE_ERR_INVALID_VALUE, DecodeBinary(&v2, "TJB\1\x08\xff\xff\xff\x7f", 9));
+    EXPECT_EQ_INT(PARSE_ERR_ROOT_NOT_SINGULAR, DecodeBinary(&v2, "TJB\1\x00\x00", 6));
+    EXPECT_EQ_INT(TYPE_NULL, GetValueType(&v2));
+
+    /* a damaged buffer: a plain string holding a quote is still escaped, and number text must be a number */
+    const char damaged[] = "TJB\1\x08\x01\x06\x03" "a\"b";
+    EXPECT_EQ_INT(PARSE_OK, DecodeBinary(&v2, damaged, sizeof(damaged), PARSE_LAZY_STRINGS));
+    TEST_STRINGIFY("[\"a\\\"b\"]", &v2);
+    FreeValue(&v2);
+    EXPECT_EQ_INT(PARSE_OK, DecodeBinary(&v2, damaged, sizeof(damaged)));
+    TEST_STRINGIFY("[\"a\\\"b\"]", &v2);
+    FreeValue(&v2);
+    const char* numbers[] = { "1x", "", "-", "01", "1.", ".5", "1e", "1e+", "+1", "1]" };
+    for (size_t i = 0; i < sizeof(numbers) / sizeof(numbers[0]); i++) {
+        std::string bad = std::string("TJB\1\x05", 5) + (char)strlen(numbers[i]) + numbers[i] + '\0';
+        EXPECT_EQ_INT(PARSE_ERR_INVALID_VALUE, DecodeBinary(&v2, bad.data(), bad.size()));
+        EXPECT_EQ_INT(PARSE_ERR_INVALID_VALUE, DecodeBinary(&v2, bad.data(), bad.size(), PARSE_LAZY_STRINGS));
+    }
+    const double special[] = { NAN, INFINITY, -INFINITY };
+    for (size_t i = 0; i < sizeof(special) / sizeof(special[0]); i++) {
+        std::string bad = std::string("TJB\1\x03", 5) + std::string((const char*)&special[i], sizeof(double));
+        EXPECT_EQ_INT(PARSE_ERR_INVALID_VALUE, DecodeBinary(&v2, bad.data(), bad.size()));
+        bad = std::string("TJB\1\x08\x01\x03", 7) + std::string((const char*)&special[i], sizeof(double));
+        EXPECT_EQ_INT(PARSE_ERR_INVALID_VALUE, DecodeBinary(&v2, bad.data(), bad.size()));
+        EXPECT_EQ_INT(TYPE_NULL, GetValueType(&v2));
+    }
+    std::string good = std::string("TJB\1\x05", 5) + '\x07' + "-0.5E+3" + '\0';
+    EXPECT_EQ_INT(PARSE_OK, DecodeBinary(&v2, good.data(), good.size(), PARSE_LAZY_STRINGS));
+    TEST_STRINGIFY("-0.5E+3", &v2);
+    FreeValue(&v2);
+}
+
+static void test_msgpack() {
+    static const unsigned char expect[] = {
+        0x82, 0xa1, 'a', 0x96, 0x01, 0xff, 0xcb, 0x3f, 0xf8, 0, 0, 0, 0, 0, 0, 0xc0, 0xc3, 0xa1, 'x',
+        0xa1, 'b', 0x94, 0xcd, 0x01, 0x2c, 0xd1, 0xff, 0x38, 0xcf, 0, 0, 0x01, 0, 0, 0, 0, 0, 0xc2 };
+    const char* json = "{\"a\":[1,-1,1.5,null,true,\"x\"],\"b\":[300,-200,1099511627776,false]}";
+    jsonValue v, v2;
+    char* data;
+    size_t length, used;
+    InitValue(&v);
+    InitValue(&v2);
+    EXPECT_EQ_INT(PARSE_OK, ParseJsonString(&v, json));
+    EXPECT_EQ_INT(STRINGIFY_OK, EncodeMsgPack(&v, &data, &length));
+    EXPECT_EQ_SIZE_T(sizeof(expect), length);
+    EXPECT_TRUE(length == sizeof(expect) && memcmp(data, expect, length) == 0);
+    EXPECT_EQ_INT(PARSE_OK, DecodeMsgPack(&v2, data, length));
+    EXPECT_TRUE(EqualValue(&v, &v2));
+    FreeValue(&v2);
+    for (size_t i = 0; i < length; i++)
+        EXPECT_EQ_INT(PARSE_ERR_EXPECT_VALUE, DecodeMsgPack(&v2, data, i));
+
+    /* both directions without a tree */
+    jsonReader r;
+    jsonWriter w;
+    const char* out;
+    size_t outLength;
+    InitWriter(&w);
+    EXPECT_EQ_INT(PARSE_OK, TranscodeMsgPackToJson(data, length, &used, &w));
+    EXPECT_EQ_SIZE_T(length, used);
+    out = GetWriterOutput(&w, &outLength);
+    EXPECT_EQ_STRING("{\"a\":[1,-1,1.5,null,true,\"x\"],\"b\":[300,-200,1099511627776,false]}", out, outLength);
+    free(data);
+    FreeValue(&v);
+
+    ResetWriter(&w);
+    InitReader(&r, "[{\"k\":\"a\\u00e9\",\"e\":[]},{},2.5]");
+    EXPECT_EQ_INT(PARSE_OK, TranscodeJsonToMsgPack(&r, &w));
+    out = GetWriterOutput(&w, &outLength);
+    EXPECT_EQ_INT(0xdd, (unsigned char)out[0]);
+    EXPECT_EQ_INT(PARSE_OK, DecodeMsgPack(&v2, out, outLength));
+    EXPECT_EQ_INT(PARSE_OK, ParseJsonString(&v, "[{\"k\":\"a\\u00e9\",\"e\":[]},{},2.5]"));
+    EXPECT_TRUE(EqualValue(&v, &v2));
+    FreeValue(&v);
+    FreeValue(&v2);
+    EXPECT_EQ_INT(PARSE_ERR_EXPECT_VALUE, TranscodeJsonToMsgPack(&r, &w));
+    FreeReader(&r);
+
+    /* back-to-back messages */
+    ResetWriter(&w);
+    EXPECT_EQ_INT(PARSE_OK, TranscodeMsgPackToJson("\x92\xc0\x81\xa1k\xa0\x2a", 7, &used, &w));
+    EXPECT_EQ_SIZE_T(6, used);
+    out = GetWriterOutput(&w, &outLength);
+    EXPECT_EQ_STRING("[null,{\"k\":\"\"}]", out, outLength);
+    EXPECT_EQ_INT(PARSE_OK, DecodeMsgPack(&v, "\x92\xc0\x81\xa1k\xa0\x2a", 7, &used));
+    EXPECT_EQ_SIZE_T(6, used);
+    FreeValue(&v);
+    EXPECT_EQ_INT(PARSE_ERR_ROOT_NOT_SINGULAR, DecodeMsgPack(&v, "\x92\xc0\x81\xa1k\xa0\x2a", 7));
+    EXPECT_EQ_INT(PARSE_ERR_ROOT_NOT_SINGULAR, TranscodeMsgPackToJson("\xc0\xc0", 2, nullptr, &w));
+    /* JSON has no NaN or infinities */
+    EXPECT_EQ_INT(PARSE_ERR_INVALID_VALUE, TranscodeMsgPackToJson("\x92\xca\x7f\x80\x00\x00\xc0", 7, nullptr, &w));
+    EXPECT_EQ_INT(PARSE_ERR_INVALID_VALUE, TranscodeMsgPackToJson("\x91\xcb\x7f\xf8\x00\x00\x00\x00\x00\x00", 10, nullptr, &w));
+    FreeWriter(&w);
+    EXPECT_EQ_INT(PARSE_ERR_INVALID_VALUE, DecodeMsgPack(&v, "\x92\xca\x7f\x80\x00\x00\xc0", 7));
+    EXPECT_EQ_INT(PARSE_ERR_INVALID_VALUE, DecodeMsgPack(&v, "\xca\xff\xc0\x00\x00", 5));
+    EXPECT_EQ_INT(PARSE_ERR_INVALID_VALUE, DecodeMsgPack(&v, "\xcb\xff\xf0\x00\x00\x00\x00\x00\x00", 9));
+
+    EXPECT_EQ_INT(PARSE_ERR_INVALID_VALUE, DecodeMsgPack(&v, "\xc1", 1));
+    EXPECT_EQ_INT(PARSE_ERR_INVALID_VALUE, DecodeMsgPack(&v, "\x91\xc4\x00", 3));
+    EXPECT_EQ_INT(PARSE_ERR_MISS_KEY, DecodeMsgPack(&v, "\x81\x01\x02", 3));
+    EXPECT_EQ_INT(PARSE_ERR_EXPECT_VALUE, DecodeMsgPack(&v, "\xdd\xff\xff\xff\xff", 5));
+    EXPECT_EQ_INT(PARSE_OK, DecodeMsgPack(&v, "\xca\x3f\xc0\x00\x00", 5));
+    EXPECT_EQ_DOUBLE(1.5, GetValueNumber(&v));
+    EXPECT_EQ_INT(PARSE_OK, DecodeMsgPack(&v, "\xd0\x80", 2));
+    EXPECT_EQ_DOUBLE(-128.0, GetValueNumber(&v));
+}
+
+static void test_cpp_document() {
+    tinyjson::Document d;
+    EXPECT_EQ_INT(PARSE_OK, d.parse("{\"n\":null,\"b\":true,\"a\":[1,2,3],\"s\":\"abc\"}"));
+    EXPECT_TRUE(d.root().isObject());
+    EXPECT_EQ_SIZE_T(4, d.root().size());
+    EXPECT_TRUE(d["n"].isNull());
+    EXPECT_TRUE(d["b"].getBool());
+    EXPECT_TRUE(d["s"].getString() == "abc");
+    EXPECT_FALSE(d.root().find("missing"));
+
+    double sum = 0.0;
+    for (tinyjson::Value e : d["a"].elements())
+        sum += e.getNumber();
+    EXPECT_EQ_DOUBLE(6.0, sum);
+
+    size_t keys = 0;
+    for (tinyjson::Member m : d.root().members())
+        keys += m.key.size();
+    EXPECT_EQ_SIZE_T(4, keys);
+
+    d["a"][1].setNumber(5.0);
+    EXPECT_EQ_DOUBLE(5.0, d["a"][1].getNumber());
+    d["s"].setString("xyz");
+    EXPECT_TRUE(d["s"].getString() == "xyz");
+
+    tinyjson::Document copy = d.clone();
+    tinyjson::Document moved = std::move(d);
+    EXPECT_EQ_INT(TYPE_NULL, GetValueType(d.get()));
+    EXPECT_TRUE(test_same_json(copy.get(), moved.get()));
+}
+
+static void test_boxed() {
+    const char* json = "{\"n\":null,\"t\":true,\"f\":false,\"d\":-0.5,\"s\":\"a\\u0000b\","
+        "\"a\":[1,[],{},\"xyz\",[2,3]],\"o\":{\"k\":{\"deep\":[null]}}}";
+    jsonValue v, back;
+    jsonBoxedDoc d;
+    size_t len;
+    InitValue(&v);
+    EXPECT_EQ_INT(PARSE_OK, ParseJsonString(&v, json));
+    BoxValue(&d, &v);
+    EXPECT_EQ_INT(TYPE_OBJECT, GetBoxType(d.root));
+    EXPECT_EQ_SIZE_T(7, GetBoxSize(&d, d.root));
+    const char* s = GetBoxKey(&d, d.root, 0, &len);
+    EXPECT_EQ_STRING("n", s, len);
+    EXPECT_EQ_INT(TYPE_NULL, GetBoxType(GetBoxMember(&d, d.root, 0)));
+    EXPECT_EQ_INT(TYPE_TRUE, GetBoxType(GetBoxMember(&d, d.root, 1)));
+    EXPECT_EQ_INT(TYPE_FALSE, GetBoxType(GetBoxMember(&d, d.root, 2)));
+    EXPECT_EQ_DOUBLE(-0.5, GetBoxNumber(GetBoxMember(&d, d.root, 3)));
+    s = GetBoxString(&d, GetBoxMember(&d, d.root, 4), &len);
+    EXPECT_EQ_STRING("a\0b", s, len);
+    jsonBox a = GetBoxMember(&d, d.root, 5);
+    EXPECT_EQ_SIZE_T(5, GetBoxSize(&d, a));
+    EXPECT_EQ_SIZE_T(0, GetBoxSize(&d, GetBoxElement(&d, a, 1)));
+    EXPECT_EQ_INT(TYPE_OBJECT, GetBoxType(GetBoxElement(&d, a, 2)));
+    EXPECT_EQ_DOUBLE(3.0, GetBoxNumber(GetBoxElement(&d, GetBoxElement(&d, a, 4), 1)));
+
+    /* 8 bytes a value, 16 a member, text padded to 8, each distinct key once */
+    EXPECT_EQ_SIZE_T(9 * 16 + (8 + 7 * 16) + 16 + (8 + 5 * 8) + 8 + 8 + 16 + (8 + 2 * 8) + (8 + 16) + (8 + 16) + (8 + 8), d.size);
+
+    UnboxValue(&back, &d, d.root);
+    EXPECT_TRUE(EqualValue(&v, &back));
+    FreeValue(&back);
+    FreeBoxedDoc(&d);
+    FreeValue(&v);
+
+    /* packed and raw numbers become plain doubles */
+    jsonParser p;
+    InitParser(&p);
+    SetParserFlags(&p, PARSE_PACKED_NUMBERS);
+    EXPECT_EQ_INT(PARSE_OK, ParseJsonStringWith(&p, &v, "[[1.5,2],[\"x\"]]"));
+    BoxValue(&d, &v);
+    EXPECT_EQ_DOUBLE(2.0, GetBoxNumber(GetBoxElement(&d, GetBoxElement(&d, d.root, 0), 1)));
+    FreeBoxedDoc(&d);
+    FreeValue(&v);
+    SetParserFlags(&p, PARSE_RAW_NUMBERS);
+    EXPECT_EQ_INT(PARSE_OK, ParseJsonStringWith(&p, &v, "1e2"));
+    BoxValue(&d, &v);
+    EXPECT_EQ_DOUBLE(100.0, GetBoxNumber(d.root));
+    FreeBoxedDoc(&d);
+    FreeValue(&v);
+    FreeParser(&p);
+
+    tinyjson::Document doc;
+    EXPECT_EQ_INT(PARSE_OK, doc.parse(json));
+    tinyjson::BoxedDocument boxed(doc);
+    EXPECT_TRUE(boxed["t"].getBool());
+    EXPECT_TRUE(boxed["a"][3].getString() == "xyz");
+    EXPECT_TRUE(boxed["o"]["k"]["deep"][0].isNull());
+    EXPECT_FALSE(boxed.root().find("missing"));
+    tinyjson::BoxedDocument moved = std::move(boxed);
+    EXPECT_TRUE(moved.unbox().root() == doc.root());
+}
+
+static void test_reader() {
+    static const tokenType expect[] = {
+        TOKEN_OBJECT_BEGIN, TOKEN_KEY, TOKEN_ARRAY_BEGIN, TOKEN_NUMBER, TOKEN_STRING, TOKEN_ARRAY_END,
+        TOKEN_KEY, TOKEN_OBJECT_BEGIN, TOKEN_OBJECT_END, TOKEN_KEY, TOKEN_NULL, TOKEN_OBJECT_END, TOKEN_END
+    };
+    jsonReader r;
+    jsonToken t;
+    size_t i;
+
+    InitReader(&r, " { \"a\" : [ 1.5 , \"x\\ny\" ] , \"o\" : { } , \"n\" : null } ");
+    for (i = 0; i < sizeof(expect) / sizeof(expect[0]); i++) {
+        EXPECT_EQ_INT(PARSE_OK, ReadToken(&r, &t));
+        EXPECT_EQ_INT(expect[i], t.type);
+        if (i == 3)
+            EXPECT_EQ_DOUBLE(1.5, t.num);
+        if (i == 4)
+            EXPECT_EQ_STRING("x\ny", t.str.s, t.str.len);
+    }
+    FreeReader(&r);
+
+    InitReader(&r, "{\"skip\":[{\"a\":[1,2]},3],\"v\":[true]}");
+    EXPECT_EQ_INT(PARSE_OK, ReadToken(&r, &t));
+    EXPECT_EQ_INT(PARSE_OK, ReadToken(&r, &t));
+    EXPECT_EQ_INT(PARSE_OK, SkipValue(&r));
+    EXPECT_EQ_INT(PARSE_OK, ReadToken(&r, &t));
+    EXPECT_EQ_STRING("v", t.str.s, t.str.len);
+    {
+        jsonValue v;
+        EXPECT_EQ_INT(PARSE_OK, ReadValue(&r, &v));
+        EXPECT_EQ_INT(TYPE_ARRAY, GetValueType(&v));
+        FreeValue(&v);
+    }
+    EXPECT_EQ_INT(PARSE_OK, ReadToken(&r, &t));
+    EXPECT_EQ_INT(TOKEN_OBJECT_END, t.type);
+    FreeReader(&r);
+
+    /* skipped strings and numbers are validated as if they were read */
+    {
+        static const struct { const char* json; parseStatus ret; } skips[] = {
+            { "[\"a\\u00e9\",{\"k\" : -0.5e-3}, 123456789012345678901234567890]", PARSE_OK },
+            { "[\"\\x\"]", PARSE_ERR_INVALID_ESCAPE_CHAR },
+            { "{\"k\" 1}", PARSE_ERR_MISS_COLON },
+            { "[1e400]", PARSE_ERR_NUMBER_OVERFLOW },
+            { "[1.]", PARSE_ERR_INVALID_VALUE }
+        };
+        for (size_t i = 0; i < sizeof(skips) / sizeof(skips[0]); i++) {
+            InitReader(&r, skips[i].json);
+            EXPECT_EQ_INT(skips[i].ret, SkipValue(&r));
+            FreeReader(&r);
+        }
+    }
+
+    InitReader(&r, "[1 2]");
+    EXPECT_EQ_INT(PARSE_OK, ReadToken(&r, &t));
+    EXPECT_EQ_INT(PARSE_OK, ReadToken(&r, &t));
+    EXPECT_EQ_INT(PARSE_ERR_MISS_COMMA_OR_SQUARE_BRACKET, ReadToken(&r, &t));
+    FreeReader(&r);
+
+    InitReader(&r, "1 2");
+    EXPECT_EQ_INT(PARSE_OK, ReadToken(&r, &t));
+    EXPECT_EQ_INT(PARSE_ERR_ROOT_NOT_SINGULAR, ReadToken(&r, &t));
+    FreeReader(&r);
+}
+
+static void test_writer() {
+    jsonWriter w;
+    size_t length;
+
+    InitWriter(&w);
+    WriteRaw(&w, "[", 1);
+    WriteString(&w, "a\"b", 3);
+    WriteRaw(&w, ",", 1);
+    WriteNumber(&w, 1.5);
+    WriteRaw(&w, "]", 1);
+    const char* json = GetWriterOutput(&w, &length);
+    EXPECT_EQ_STRING("[\"a\\\"b\",1.5]", json, length);
+    ResetWriter(&w);
+    WriteNumber(&w, 2);
+    char* taken = TakeWriterOutput(&w, &length);
+    EXPECT_EQ_STRING("2", taken, length);
+    free(taken);
+    FreeWriter(&w);
+}
+/* the pieces, put together, must be what Stringify() writes */
+static std::string JoinIovec(const jsonIovec* pieces, size_t count) {
+    std::string s;
+    for (size_t i = 0; i < count; i++)
+        s.append((const char*)pieces[i].base, pieces[i].len);
+    return s;
+}
+
+static void test_stringify_iovec_match(jsonWriter* w, const jsonValue* v, size_t inPlace) {
+    char* json;
+    size_t length, count, total;
+    EXPECT_EQ_INT(STRINGIFY_OK, Stringify(v, &json, &length));
+    const jsonIovec* pieces = StringifyIovec(w, v, &count, &total, inPlace);
+    std::string joined = JoinIovec(pieces, count);
+    EXPECT_EQ_SIZE_T(length, total);
+    EXPECT_EQ_BASE(joined == json, json, joined.c_str(), "%s");
+    free(json);
+}
+
+static void test_stringify_iovec() {
+    jsonWriter w;
+    jsonValue v;
+    jsonParser p;
+    size_t count, length;
+    const jsonIovec* pieces;
+    std::string blob(300, 'b');
+    std::string doc = "{\"a\":\"" + blob + "\",\"n\":[1,2.5,true,null,{}],\"s\":\"short\"}";
+
+    InitWriter(&w);
+    EXPECT_EQ_INT(PARSE_OK, ParseJsonString(&v, doc.c_str()));
+    pieces = StringifyIovec(&w, &v, &count, &length);
+    /* the blob is the string in the tree, everything around it comes from the buffer */
+    EXPECT_EQ_SIZE_T(3, count);
+    EXPECT_EQ_SIZE_T(doc.size(), length);
+    EXPECT_TRUE(pieces[1].base == GetValueString(GetValueObjectValue(&v, 0)) && pieces[1].len == 300);
+    EXPECT_EQ_STRING("{\"a\":\"", (const char*)pieces[0].base, pieces[0].len);
+    EXPECT_TRUE(JoinIovec(pieces, count) == doc);
+    /* nothing is long enough */
+    StringifyIovec(&w, &v, &count, nullptr, 301);
+    EXPECT_EQ_SIZE_T(1, count);
+    /* every run of at least 5 bytes, keys included */
+    StringifyIovec(&w, &v, &count, nullptr, 5);
+    EXPECT_EQ_SIZE_T(5, count);
+    FreeValue(&v);
+
+    /* escapes split a string into referenced runs */
+    std::string escaped = "[\"" + blob + "\\n" + blob + "\\u0001\\\"" + blob + "\"]";
+    EXPECT_EQ_INT(PARSE_OK, ParseJsonString(&v, escaped.c_str()));
+    pieces = StringifyIovec(&w, &v, &count, &length);
+    EXPECT_EQ_SIZE_T(7, count);
+    EXPECT_EQ_STRING("\\u0001\\\"", (const char*)pieces[4].base, pieces[4].len);
+    test_stringify_iovec_match(&w, &v, 256);
+    test_stringify_iovec_match(&w, &v, 1);
+    test_stringify_iovec_match(&w, &v, 0);
+    FreeValue(&v);
+
+    const char* docs[] = {
+        "null", "\"\"", "[]", "{}", "[\"a\\tb\",\"\\u00e9\",{\"k\\n\":[[],{}]},-1.5e+300]",
+        "{\"nested\":{\"deeper\":{\"deepest\":[\"one\",\"two\",\"three\",\"four\"]}}}"
+    };
+    for (size_t i = 0; i < sizeof(docs) / sizeof(docs[0]); i++) {
+        EXPECT_EQ_INT(PARSE_OK, ParseJsonString(&v, docs[i]));
+        test_stringify_iovec_match(&w, &v, 256);
+        test_stringify_iovec_match(&w, &v, 2);
+        FreeValue(&v);
+    }
+
+    /* lazy strings are referenced in the input, still escaped */
+    InitParser(&p);
+    SetParserFlags(&p, PARSE_LAZY_STRINGS);
+    EXPECT_EQ_INT(PARSE_OK, ParseJsonStringWith(&p, &v, escaped.c_str()));
+    pieces = StringifyIovec(&w, &v, &count, nullptr);
+    EXPECT_EQ_SIZE_T(3, count);
+    EXPECT_TRUE(pieces[1].base == escaped.c_str() + 2);
+    EXPECT_TRUE(JoinIovec(pieces, count) == escaped);
+    FreeValue(&v);
+    FreeParser(&p);
+
+    /* a clean cache goes out whole, a dirty one is written piece by piece and left to Stringify() */
+    EXPECT_EQ_INT(PARSE_OK, ParseJsonString(&v, doc.c_str()));
+    EnableStringifyCache(&v);
+    test_stringify_iovec_match(&w, &v, 256);
+    StringifyIovec(&w, &v, &count, nullptr);
+    EXPECT_EQ_SIZE_T(1, count);
+    SetValueString(GetValueObjectValue(&v, 2), "changed", 7);
+    pieces = StringifyIovec(&w, &v, &count, nullptr);
+    EXPECT_EQ_SIZE_T(3, count);
+    EXPECT_TRUE(JoinIovec(pieces, count) == "{\"a\":\"" + blob + "\",\"n\":[1,2.5,true,null,{}],\"s\":\"changed\"}");
+    test_stringify_iovec_match(&w, &v, 256);
+    StringifyIovec(&w, &v, &count, nullptr);
+    EXPECT_EQ_SIZE_T(1, count);
+    FreeValue(&v);
+
+    /* many pieces, handed to writev() in IOV_MAX batches */
+    std::string big = "[";
+    for (int i = 0; i < 3000; i++)
+        big += (i ? ",\"" : "\"") + blob + "\"";
+    big += "]";
+    EXPECT_EQ_INT(PARSE_OK, ParseJsonString(&v, big.c_str()));
+    pieces = StringifyIovec(&w, &v, &count, &length);
+    EXPECT_EQ_SIZE_T(6001, count);
+    EXPECT_EQ_SIZE_T(big.size(), length);
+#if defined(__unix__) || defined(__APPLE__)
+    FILE* f = tmpfile();
+    for (size_t i = 0; i < count; i += 1024)
+        writev(fileno(f), (const struct iovec*)(pieces + i), (int)(count - i < 1024 ? count - i : 1024));
+    std::string back(length, '\0');
+    rewind(f);
+    EXPECT_EQ_SIZE_T(length, fread(&back[0], 1, length, f));
+    EXPECT_TRUE(back == big);
+    fclose(f);
+#endif
+    FreeValue(&v);
+    FreeWriter(&w);
+}
+
+struct BindPoint {
+    double x;
+    double y;
+};
+
+struct BindShape {
+    std::string name;
+    int sides;
+    bool closed;
+    std::vector<BindPoint> points;
+    std::optional<std::string> note;
+};
+
+template <> struct tinyjson::Binding<BindPoint> {
+    static constexpr auto fields = std::make_tuple(JSON_FIELD(BindPoint, x), JSON_FIELD(BindPoint, y));
+};
+
+template <> struct tinyjson::Binding<BindShape> {
+    static constexpr auto fields = std::make_tuple(
+        JSON_FIELD(BindShape, name), JSON_FIELD(BindShape, sides), JSON_FIELD(BindShape, closed),
+        JSON_FIELD(BindShape, points), JSON_FIELD(BindShape, note));
+};
+
+static void test_bind() {
+    BindShape shape;
+    char* json;
+    size_t length;
+
+    EXPECT_EQ_INT(PARSE_OK, tinyjson::ParseInto(shape,
+        "{ \"name\" : \"tri\\u00e9\", \"extra\" : { \"a\" : [1, {}] }, \"sides\" : 3, \"closed\" : true,"
+        "  \"points\" : [ {\"x\":0,\"y\":0}, {\"y\":2,\"x\":1,\"z\":9}, {\"x\":2,\"y\":0} ], \"note\" : null }"));
+    EXPECT_TRUE(shape.name == "tri\xc3\xa9");
+    EXPECT_EQ_INT(3, shape.sides);
+    EXPECT_TRUE(shape.closed);
+    EXPECT_EQ_SIZE_T(3, shape.points.size());
+    EXPECT_EQ_DOUBLE(1.0, shape.points[1].x);
+    EXPECT_EQ_DOUBLE(2.0, shape.points[1].y);
+    EXPECT_FALSE(shape.note.has_value());
+
+    shape.note = "n";
+    shape.points.resize(1);
+    EXPECT_EQ_INT(STRINGIFY_OK, tinyjson::StringifyFrom(shape, &json, &length));
+    EXPECT_EQ_STRING("{\"name\":\"tri\xc3\xa9\",\"sides\":3,\"closed\":true,\"points\":[{\"x\":0,\"y\":0}],\"note\":\"n\"}", json, length);
+    free(json);
+
+    BindPoint p;
+    EXPECT_EQ_INT(PARSE_ERR_TYPE_MISMATCH, tinyjson::ParseInto(p, "{\"x\":\"1\"}"));
+    EXPECT_EQ_INT(PARSE_ERR_TYPE_MISMATCH, tinyjson::ParseInto(p, "[]"));
+    EXPECT_EQ_INT(PARSE_ERR_MISS_COLON, tinyjson::ParseInto(p, "{\"x\" 1}"));
+    EXPECT_EQ_INT(PARSE_ERR_ROOT_NOT_SINGULAR, tinyjson::ParseInto(p, "{} x"));
+
+    /* numbers the member type cannot hold */
+    int i = 7;
+    unsigned u = 7;
+    unsigned char byte = 7;
+    long long ll = 7;
+    float f = 7.0f;
+    EXPECT_EQ_INT(PARSE_ERR_TYPE_MISMATCH, tinyjson::ParseInto(shape, "{\"sides\":3.5}"));
+    EXPECT_EQ_INT(PARSE_ERR_TYPE_MISMATCH, tinyjson::ParseInto(i, "1e20"));
+    EXPECT_EQ_INT(PARSE_ERR_TYPE_MISMATCH, tinyjson::ParseInto(i, "2147483648"));
+    EXPECT_EQ_INT(PARSE_ERR_TYPE_MISMATCH, tinyjson::ParseInto(u, "-1"));
+    EXPECT_EQ_INT(PARSE_ERR_TYPE_MISMATCH, tinyjson::ParseInto(byte, "256"));
+    EXPECT_EQ_INT(PARSE_ERR_TYPE_MISMATCH, tinyjson::ParseInto(ll, "9223372036854775808"));
+    EXPECT_EQ_INT(PARSE_ERR_TYPE_MISMATCH, tinyjson::ParseInto(f, "1e39"));
+    EXPECT_EQ_INT(7, i);
+    EXPECT_EQ_INT(7, (int)u);
+    EXPECT_EQ_INT(PARSE_OK, tinyjson::ParseInto(i, "-2147483648"));
+    EXPECT_TRUE(i == -2147483647 - 1);
+    EXPECT_EQ_INT(PARSE_OK, tinyjson::ParseInto(u, "4294967295"));
+    EXPECT_TRUE(u == 4294967295u);
+    EXPECT_EQ_INT(PARSE_OK, tinyjson::ParseInto(byte, "-0"));
+    EXPECT_EQ_INT(0, byte);
+    EXPECT_EQ_INT(PARSE_OK, tinyjson::ParseInto(ll, "-9223372036854775808"));
+    EXPECT_TRUE(ll == -9223372036854775807LL - 1);
+    EXPECT_EQ_INT(PARSE_OK, tinyjson::ParseInto(f, "1.5e38"));
+    EXPECT_EQ_DOUBLE(1.5e38f, f);
+}
+
+struct CountingHeap {
+    size_t live;
+    size_t blocks;
+    size_t calls;
+    size_t sizeMismatches;
+};
+
+/* stores the size in front of each block to check what the library hands back */
+static void* CountingMalloc(void* userData, size_t size) {
+    CountingHeap* h = (CountingHeap*)userData;
+    size_t* p = (size_t*)malloc(sizeof(size_t) + size);
+    *p = size;
+    h->live += size;
+    h->blocks++;
+    h->calls++;
+    return p + 1;
+}
+
+static void CountingFree(void* userData, void* ptr, size_t size) {
+    CountingHeap* h = (CountingHeap*)userData;
+    size_t* p = (size_t*)ptr - 1;
+    if (*p != size)
+        h->sizeMismatches++;
+    h->live -= *p;
+    h->blocks--;
+    free(p);
+}
+
+static void* CountingRealloc(void* userData, void* ptr, size_t oldSize, size_t newSize) {
+    void* ret = CountingMalloc(userData, newSize);
+    memcpy(ret, ptr, oldSize < newSize ? oldSize : newSize);
+    CountingFree(userData, ptr, oldSize);
+    return ret;
+}
+
+static void test_allocator() {
+    CountingHeap heap = { 0, 0, 0, 0 };
+    jsonAllocator alloc = { CountingMalloc, CountingRealloc, CountingFree, &heap };
+    jsonValue v, copy;
+    char* json;
+    size_t length;
+
+    InitValue(&v);
+    InitValue(&copy);
+    EXPECT_EQ_INT(PARSE_OK, ParseJsonString(&v, "{\"a\":[1,\"x\",{\"b\":null}],\"s\":\"\\u00e9\"}", nullptr, &alloc));
+    EXPECT_TRUE(heap.blocks > 0);
+    CopyValue(&copy, &v, &alloc);
+    SetValueString(GetValueObjectValue(&copy, 1), "yz", 2, &alloc);
+    EXPECT_EQ_INT(STRINGIFY_OK, Stringify(&copy, &json, &length, nullptr, &alloc));
+    EXPECT_EQ_STRING("{\"a\":[1,\"x\",{\"b\":null}],\"s\":\"yz\"}", json, length);
+    CountingFree(&heap, json, length + 1);
+    FreeValue(&copy, &alloc);
+    FreeValue(&v, &alloc);
+    EXPECT_EQ_SIZE_T(0, heap.live);
+    EXPECT_EQ_SIZE_T(0, heap.blocks);
+
+    /* error paths release everything they took */
+    EXPECT_EQ_INT(PARSE_ERR_MISS_COMMA_OR_CURLY_BRACKET, ParseJsonString(&v, "{\"a\":[\"x\"],\"b\":{\"c\":\"d\"} \"e\"", nullptr, &alloc));
+    EXPECT_EQ_INT(PARSE_ERR_ROOT_NOT_SINGULAR, ParseJsonString(&v, "[\"x\"] 1", nullptr, &alloc));
+    EXPECT_EQ_SIZE_T(0, heap.blocks);
+
+    jsonReader r;
+    jsonToken t;
+    InitReader(&r, "[\"long enough to need the stack\", {\"k\": [1]}]", &alloc);
+    EXPECT_EQ_INT(PARSE_OK, SkipValue(&r));
+    EXPECT_EQ_INT(PARSE_OK, ReadToken(&r, &t));
+    EXPECT_EQ_INT(TOKEN_END, t.type);
+    FreeReader(&r);
+
+    jsonWriter w;
+    InitWriter(&w, &alloc);
+    WriteString(&w, "abc", 3);
+    json = TakeWriterOutput(&w, &length);
+    EXPECT_EQ_STRING("\"abc\"", json, length);
+    FreeWriter(&w);
+    CountingFree(&heap, json, length + 1);
+
+    {
+        tinyjson::Document doc(&alloc);
+        EXPECT_EQ_INT(PARSE_OK, doc.parse("{\"a\":[1,2]}"));
+        doc["a"][0].setString("one");
+        tinyjson::Document other = doc.clone();
+        EXPECT_TRUE(other.allocator() == &alloc);
+        EXPECT_TRUE(other["a"][0].getString() == "one");
+    }
+    EXPECT_EQ_SIZE_T(0, heap.live);
+    EXPECT_EQ_SIZE_T(0, heap.blocks);
+    EXPECT_EQ_SIZE_T(0, heap.sizeMismatches);
+
+    /* the default allocator is used wherever none is passed */
+    size_t calls = heap.calls;
+    SetDefaultAllocator(&alloc);
+    EXPECT_TRUE(GetDefaultAllocator() == &alloc);
+    EXPECT_EQ_INT(PARSE_OK, ParseJsonString(&v, "[\"x\"]"));
+    FreeValue(&v);
+    SetDefaultAllocator(nullptr);
+    EXPECT_TRUE(heap.calls > calls);
+    EXPECT_EQ_SIZE_T(0, heap.blocks);
+
+    /* lazily decoded strings come from the tree's allocator, whatever the default is by then */
+    CountingHeap other = { 0, 0, 0, 0 };
+    jsonAllocator otherAlloc = { CountingMalloc, CountingRealloc, CountingFree, &other };
+    jsonParser p;
+    InitParser(&p, &alloc);
+    SetParserFlags(&p, PARSE_LAZY_STRINGS);
+    EXPECT_EQ_INT(PARSE_OK, ParseJsonStringWith(&p, &v, "[\"a\\\\\",\"b\\\"c\",\"\\u00e9\"]"));
+    FreeParser(&p);
+    EXPECT_EQ_INT(STRINGIFY_OK, Stringify(&v, &json, &length));
+    EXPECT_EQ_STRING("[\"a\\\\\",\"b\\\"c\",\"\\u00e9\"]", json, length);
+    free(json);
+    size_t blocks = heap.blocks;
+    SetDefaultAllocator(&otherAlloc);
+    EXPECT_EQ_STRING("a\\", GetValueString(GetValueArrayElement(&v, 0)), 2);
+    EXPECT_EQ_SIZE_T(3, GetValueStringLength(GetValueArrayElement(&v, 1)));
+    EXPECT_EQ_SIZE_T(blocks + 2, heap.blocks);
+    SetDefaultAllocator(nullptr);
+    InitValue(&copy);
+    CopyValue(&copy, &v, &alloc);
+    EXPECT_EQ_STRING("\xc3\xa9", GetValueString(GetValueArrayElement(&copy, 2)), 2);
+    FreeValue(&copy, &alloc);
+    FreeValue(&v, &alloc);
+    EXPECT_EQ_SIZE_T(0, other.calls);
+    EXPECT_EQ_SIZE_T(0, heap.blocks);
+    EXPECT_EQ_SIZE_T(0, heap.sizeMismatches);
+}
+
+static void test_reuse() {
+    CountingHeap heap = { 0, 0, 0, 0 };
+    jsonAllocator alloc = { CountingMalloc, CountingRealloc, CountingFree, &heap };
+    /* deep and long enough to grow the stack several times */
+    std::string doc = std::string(100, '[') + "\"" + std::string(400, 's') + "\"" + std::string(100, ']');
+    jsonParser p;
+    jsonValue v;
+
+    InitParser(&p, &alloc);
+    EXPECT_EQ_INT(PARSE_OK, ParseJsonStringWith(&p, &v, doc.c_str()));
+    FreeValue(&v, &alloc);
+    size_t warm = heap.blocks;
+    size_t calls = heap.calls;
+    EXPECT_EQ_INT(PARSE_OK, ParseJsonStringWith(&p, &v, doc.c_str()));
+    /* the warm stack is not touched again, only the tree is allocated */
+    EXPECT_EQ_SIZE_T(heap.blocks - warm, heap.calls - calls);
+    FreeValue(&v, &alloc);
+    EXPECT_EQ_SIZE_T(warm, heap.blocks);
+
+    SetParserTrimSize(&p, 0);
+    EXPECT_EQ_INT(PARSE_ERR_MISS_COMMA_OR_SQUARE_BRACKET, ParseJsonStringWith(&p, &v, "[[1}"));
+    EXPECT_EQ_SIZE_T(1, heap.blocks);
+    FreeParser(&p);
+    EXPECT_EQ_SIZE_T(0, heap.blocks);
+
+    jsonWriter w;
+    size_t length;
+    InitWriter(&w, &alloc);
+    ParseJsonString(&v, "{\"k\":[true,\"v\"]}");
+    const char* json = StringifyWith(&w, &v, &length);
+    EXPECT_EQ_STRING("{\"k\":[true,\"v\"]}", json, length);
+    calls = heap.calls;
+    json = StringifyWith(&w, &v, &length);
+    EXPECT_EQ_STRING("{\"k\":[true,\"v\"]}", json, length);
+    EXPECT_EQ_SIZE_T(calls, heap.calls);
+    SetWriterTrimSize(&w, 0);
+    ResetWriter(&w);
+    EXPECT_EQ_SIZE_T(1, heap.blocks);
+    FreeWriter(&w);
+    FreeValue(&v);
+    EXPECT_EQ_SIZE_T(0, heap.blocks);
+    EXPECT_EQ_SIZE_T(0, heap.sizeMismatches);
+}
+
+static void test_packed_numbers() {
+    const char* json = "{\"c\":[[1.5,-2],[3,4e2]],\"m\":[1,null],\"e\":[],\"s\":[\"x\"]}";
+    CountingHeap heap = { 0, 0, 0, 0 };
+    jsonAllocator alloc = { CountingMalloc, CountingRealloc, CountingFree, &heap };
+    jsonParser p;
+    jsonValue v, plain, copy;
+    char* data;
+    char* expect;
+    size_t length, expectLength;
+    InitValue(&plain);
+    InitValue(&copy);
+    EXPECT_EQ_INT(PARSE_OK, ParseJsonString(&plain, json));
+
+    InitParser(&p, &alloc);
+    for (unsigned flags = PARSE_PACKED_NUMBERS; flags <= (PARSE_PACKED_NUMBERS | PARSE_EXACT_SIZE); flags += PARSE_EXACT_SIZE) {
+        SetParserFlags(&p, flags);
+        EXPECT_EQ_INT(PARSE_OK, ParseJsonStringWith(&p, &v, json));
+        jsonValue* c = GetValueObjectValue(&v, 0);
+        EXPECT_TRUE(GetValueArrayNumbers(c) == nullptr);
+        const double* nums = GetValueArrayNumbers(GetValueArrayElement(c, 1));
+        EXPECT_TRUE(nums != nullptr);
+        if (nums) {
+            EXPECT_EQ_DOUBLE(3.0, nums[0]);
+            EXPECT_EQ_DOUBLE(400.0, nums[1]);
+        }
+        EXPECT_TRUE(GetValueArrayNumbers(GetValueObjectValue(&v, 1)) == nullptr);
+        EXPECT_TRUE(GetValueArrayNumbers(GetValueObjectValue(&v, 2)) == nullptr);
+        EXPECT_TRUE(GetValueArrayNumbers(GetValueObjectValue(&v, 3)) == nullptr);
+        FreeValue(&v, &alloc);
+    }
+
+    /* packed and unpacked trees look the same from the outside */
+    EXPECT_EQ_INT(PARSE_OK, ParseJsonStringWith(&p, &v, json));
+    EXPECT_TRUE(EqualValue(&v, &plain));
+    EXPECT_TRUE(EqualValue(&plain, &v));
+    EXPECT_TRUE(HashValue(&v) == HashValue(&plain));
+    EXPECT_EQ_INT(STRINGIFY_OK, Stringify(&plain, &expect, &expectLength));
+    EXPECT_EQ_INT(STRINGIFY_OK, Stringify(&v, &data, &length, nullptr, &alloc));
+    EXPECT_TRUE(length == expectLength && memcmp(data, expect, length) == 0);
+    alloc.Free(alloc.userData, data, length + 1);
+    free(expect);
+    EXPECT_EQ_INT(STRINGIFY_OK, EncodeBinary(&plain, &expect, &expectLength));
+    EXPECT_EQ_INT(STRINGIFY_OK, EncodeBinary(&v, &data, &length, &alloc));
+    EXPECT_TRUE(length == expectLength && memcmp(data, expect, length) == 0);
+    alloc.Free(alloc.userData, data, length);
+    free(expect);
+    EXPECT_EQ_INT(STRINGIFY_OK, EncodeMsgPack(&plain, &expect, &expectLength));
+    EXPECT_EQ_INT(STRINGIFY_OK, EncodeMsgPack(&v, &data, &length, &alloc));
+    EXPECT_TRUE(length == expectLength && memcmp(data, expect, length) == 0);
+    alloc.Free(alloc.userData, data, length);
+    free(expect);
+
+    CopyValue(&copy, &v, &alloc);
+    EXPECT_TRUE(GetValueArrayNumbers(GetValueArrayElement(GetValueObjectValue(&copy, 0), 0)) != nullptr);
+    EXPECT_TRUE(EqualValue(&copy, &v));
+    FreeValue(&copy, &alloc);
+
+    /* element access unpacks, with the tree's allocator, and the cache notices */
+    EnableStringifyCache(&v, &alloc);
+    TEST_STRINGIFY("{\"c\":[[1.5,-2],[3,400]],\"m\":[1,null],\"e\":[],\"s\":[\"x\"]}", &v);
+    jsonValue* row = GetValueArrayElement(GetValueObjectValue(&v, 0), 0);
+    jsonValue* e = GetValueArrayElement(row, 1);
+    EXPECT_TRUE(GetValueArrayNumbers(row) == nullptr);
+    EXPECT_EQ_DOUBLE(-2.0, GetValueNumber(e));
+    SetValueNumber(e, 7.0, &alloc);
+    TEST_STRINGIFY("{\"c\":[[1.5,7],[3,400]],\"m\":[1,null],\"e\":[],\"s\":[\"x\"]}", &v);
+    FreeValue(&v, &alloc);
+
+    /* raw numbers keep their text */
+    SetParserFlags(&p, PARSE_PACKED_NUMBERS | PARSE_RAW_NUMBERS);
+    EXPECT_EQ_INT(PARSE_OK, ParseJsonStringWith(&p, &v, "[1.0,2]"));
+    EXPECT_TRUE(GetValueArrayNumbers(&v) == nullptr);
+    FreeValue(&v, &alloc);
+    FreeParser(&p);
+    FreeValue(&plain);
+    EXPECT_EQ_SIZE_T(0, heap.blocks);
+    EXPECT_EQ_SIZE_T(0, heap.sizeMismatches);
+}
+
+static void test_check_columns(const jsonColumns* c) {
+    const jsonColumn* col;
+    const char* s;
+    size_t len;
+    EXPECT_EQ_SIZE_T(4, c->rows);
+    EXPECT_EQ_SIZE_T(5, c->count);
+    if (c->count != 5)
+        return;
+    EXPECT_EQ_STRING("x", c->columns[4].name, c->columns[4].nameLen);
+    EXPECT_EQ_INT(COLUMN_NULL, c->columns[4].type);
+    EXPECT_TRUE(IsColumnNull(&c->columns[4], 0) && IsColumnNull(&c->columns[4], 3));
+
+    /* a number column that met a string keeps jsonValues */
+    col = FindColumn(c, "id", 2);
+    EXPECT_EQ_INT(COLUMN_VALUE, col->type);
+    EXPECT_EQ_DOUBLE(2.0, GetValueNumber(&col->values[1]));
+    EXPECT_EQ_STRING("3", GetValueString(&col->values[2]), GetValueStringLength(&col->values[2]));
+    EXPECT_TRUE(IsColumnNull(col, 3));
+    EXPECT_FALSE(IsColumnNull(col, 2));
+
+    col = FindColumn(c, "name", 4);
+    EXPECT_EQ_INT(COLUMN_STRING, col->type);
+    s = GetColumnString(col, 1, &len);
+    EXPECT_EQ_STRING("b\nc", s, len);
+    s = GetColumnString(col, 2, &len);
+    EXPECT_EQ_SIZE_T(0, len);
+    EXPECT_TRUE(IsColumnNull(col, 2));
+    s = GetColumnString(col, 3, &len);
+    EXPECT_EQ_STRING("", s, len);
+    EXPECT_FALSE(IsColumnNull(col, 3));
+
+    col = FindColumn(c, "ok", 2);
+    EXPECT_EQ_INT(COLUMN_BOOLEAN, col->type);
+    EXPECT_EQ_INT(1, col->booleans[0] & 1);
+    EXPECT_EQ_INT(0, col->booleans[0] & 4);
+    EXPECT_TRUE(IsColumnNull(col, 1));
+    EXPECT_FALSE(IsColumnNull(col, 2));
+
+    col = FindColumn(c, "tags", 4);
+    EXPECT_EQ_INT(COLUMN_VALUE, col->type);
+    EXPECT_EQ_SIZE_T(2, GetValueArraySize(&col->values[0]));
+    EXPECT_TRUE(FindColumn(c, "missing", 7) == nullptr);
+}
+
+static size_t FootprintBytes(const jsonFootprint& f) {
+    return f.strings + f.keys + f.arrays + f.objects + f.overhead;
+}
+
+/* frees v and checks that it gave back exactly what MeasureValue() said it held */
+static void test_footprint_freed(jsonValue* v, const jsonAllocator* alloc, const CountingHeap* heap) {
+    jsonFootprint f;
+    size_t blocks = heap->blocks, live = heap->live;
+    MeasureValue(v, &f);
+    FreeValue(v, alloc);
+    EXPECT_EQ_SIZE_T(f.allocations, blocks - heap->blocks);
+    EXPECT_EQ_SIZE_T(FootprintBytes(f), live - heap->live);
+}
+
+static void test_footprint() {
+    CountingHeap heap = { 0, 0, 0, 0 };
+    jsonAllocator alloc = { CountingMalloc, CountingRealloc, CountingFree, &heap };
+    jsonParser p;
+    jsonValue v;
+    jsonFootprint f;
+    char* json;
+    size_t length;
+
+    InitValue(&v);
+    MeasureValue(&v, &f);
+    EXPECT_EQ_SIZE_T(0, FootprintBytes(f));
+    EXPECT_EQ_SIZE_T(0, f.allocations);
+
+    EXPECT_EQ_INT(PARSE_OK, ParseJsonString(&v, "{\"name\":\"abc\",\"list\":[1,2,\"x\"],\"o\":{},\"e\":[]}", nullptr, &alloc));
+    MeasureValue(&v, &f);
+    EXPECT_EQ_SIZE_T(4 + 2, f.strings);
+    EXPECT_EQ_SIZE_T(5 + 5 + 2 + 2, f.keys);
+    EXPECT_EQ_SIZE_T(3 * sizeof(jsonValue), f.arrays);
+    EXPECT_EQ_SIZE_T(4 * sizeof(jsonMap), f.objects);
+    EXPECT_EQ_SIZE_T(0, f.overhead);
+    EXPECT_EQ_SIZE_T(heap.blocks, f.allocations);
+    EXPECT_EQ_SIZE_T(heap.live, FootprintBytes(f));
+
+    /* cache headers and the cached output are the tree's too */
+    EnableStringifyCache(&v, &alloc);
+    EXPECT_EQ_INT(STRINGIFY_OK, Stringify(&v, &json, &length, nullptr, &alloc));
+    MeasureValue(&v, &f);
+    EXPECT_TRUE(f.overhead > length);
+    EXPECT_EQ_SIZE_T(heap.blocks - 1, f.allocations);
+    EXPECT_EQ_SIZE_T(heap.live - (length + 1), FootprintBytes(f));
+    alloc.Free(alloc.userData, json, length + 1);
+    FreeValue(&v, &alloc);
+
+    InitParser(&p, &alloc);
+    SetParserFlags(&p, PARSE_PACKED_NUMBERS);
+    EXPECT_EQ_INT(PARSE_OK, ParseJsonStringWith(&p, &v, "[[1,2,3],\"s\"]"));
+    MeasureValue(&v, &f);
+    EXPECT_EQ_SIZE_T(2 * sizeof(jsonValue) + 3 * sizeof(double), f.arrays);
+    EXPECT_EQ_SIZE_T(sizeof(void*), f.overhead);
+    test_footprint_freed(&v, &alloc, &heap);
+
+    /* borrowed text belongs to the input */
+    SetParserFlags(&p, PARSE_LAZY_STRINGS);
+    EXPECT_EQ_INT(PARSE_OK, ParseJsonStringWith(&p, &v, "{\"key\":\"value\"}"));
+    MeasureValue(&v, &f);
+    EXPECT_EQ_SIZE_T(0, f.strings);
+    EXPECT_EQ_SIZE_T(sizeof(jsonMap), f.objects);
+    test_footprint_freed(&v, &alloc, &heap);
+    FreeParser(&p);
+    EXPECT_EQ_SIZE_T(0, heap.blocks);
+}
+
+static void test_compact() {
+    const char* text = "{\"id\":7,\"tags\":[\"a\",\"bc\",[]],\"nested\":{\"k\":[true,null,{\"deep\":\"x\"}]},\"n\":[1.5,2]}";
+    CountingHeap heap = { 0, 0, 0, 0 };
+    jsonAllocator alloc = { CountingMalloc, CountingRealloc, CountingFree, &heap };
+    jsonParser p;
+    jsonValue v, expect, outer;
+    jsonFootprint before, after;
+    char* json;
+    size_t length;
+
+    InitValue(&expect);
+    EXPECT_EQ_INT(PARSE_OK, ParseJsonString(&expect, text));
+    EXPECT_EQ_INT(PARSE_OK, ParseJsonString(&v, text, nullptr, &alloc));
+    MeasureValue(&v, &before);
+    CompactValue(&v, &alloc);
+    EXPECT_EQ_SIZE_T(1, heap.blocks);
+    EXPECT_TRUE(EqualValue(&expect, &v));
+    MeasureValue(&v, &after);
+    EXPECT_EQ_SIZE_T(1, after.allocations);
+    EXPECT_EQ_SIZE_T(heap.live, FootprintBytes(after));
+    EXPECT_EQ_SIZE_T(before.strings, after.strings);
+    EXPECT_EQ_SIZE_T(before.keys, after.keys);
+    EXPECT_EQ_SIZE_T(before.arrays, after.arrays);
+    EXPECT_EQ_SIZE_T(before.objects, after.objects);
+    EXPECT_EQ_INT(STRINGIFY_OK, Stringify(&v, &json, &length));
+    EXPECT_EQ_STRING("{\"id\":7,\"tags\":[\"a\",\"bc\",[]],\"nested\":{\"k\":[true,null,{\"deep\":\"x\"}]},\"n\":[1.5,2]}", json, length);
+    free(json);
+
+    /* depth first: each container's elements, then the keys and subtrees of its members in order */
+    const char* id = GetValueObjectKey(&v, 0);
+    const char* tags = GetValueObjectKey(&v, 1);
+    jsonValue* tagValues = GetValueArrayElement(GetValueObjectValue(&v, 1), 0);
+    EXPECT_TRUE(id < tags && tags < (const char*)tagValues && (const char*)tagValues < GetValueString(tagValues));
+    EXPECT_TRUE(GetValueString(tagValues) < GetValueObjectKey(&v, 2));
+
+    /* compacting again finds nothing left to gather */
+    CompactValue(&v, &alloc);
+    CompactValue(GetValueObjectValue(&v, 2), &alloc);
+    EXPECT_EQ_SIZE_T(1, heap.blocks);
+
+    /* values written to later get blocks of their own, which go with the root */
+    SetValueString(GetValueObjectValue(&v, 0), "seven", 5, &alloc);
+    FreeValue(GetValueArrayElement(GetValueObjectValue(GetValueObjectValue(&v, 2), 0), 2), &alloc);
+    CopyValue(GetValueArrayElement(GetValueObjectValue(&v, 1), 2), &expect, &alloc);
+    EXPECT_TRUE(heap.blocks > 2);
+    MeasureValue(&v, &after);
+    EXPECT_EQ_SIZE_T(heap.blocks, after.allocations);
+    EXPECT_EQ_SIZE_T(heap.live, FootprintBytes(after));
+    EXPECT_EQ_STRING("seven", GetValueString(GetValueObjectValue(&v, 0)), 5);
+    CompactValue(&v, &alloc);
+    EXPECT_EQ_SIZE_T(1, heap.blocks);
+    EXPECT_TRUE(EqualValue(&expect, GetValueArrayElement(GetValueObjectValue(&v, 1), 2)));
+
+    /* a compacted tree moved into a plain one is released with it */
+    EXPECT_EQ_INT(PARSE_OK, ParseJsonString(&outer, "[0,{\"a\":1}]", nullptr, &alloc));
+    MoveValue(GetValueArrayElement(&outer, 0), &v, &alloc);
+    MoveValue(GetValueObjectValue(GetValueArrayElement(&outer, 1), 0), GetValueArrayElement(&outer, 0), &alloc);
+    MeasureValue(&outer, &after);
+    EXPECT_EQ_SIZE_T(heap.blocks, after.allocations);
+    EXPECT_EQ_SIZE_T(heap.live, FootprintBytes(after));
+    FreeValue(&outer, &alloc);
+    EXPECT_EQ_SIZE_T(0, heap.blocks);
+    EXPECT_EQ_SIZE_T(0, heap.live);
+
+    /* nothing to gather */
+    SetValueNumber(&v, 1.0, &alloc);
+    CompactValue(&v, &alloc);
+    EXPECT_EQ_SIZE_T(0, heap.blocks);
+    EXPECT_EQ_INT(PARSE_OK, ParseJsonString(&v, "[]", nullptr, &alloc));
+    CompactValue(&v, &alloc);
+    EXPECT_EQ_SIZE_T(0, heap.blocks);
+
+    /* packed arrays are copied packed, and unpack out of the block */
+    InitParser(&p, &alloc);
+    SetParserFlags(&p, PARSE_PACKED_NUMBERS);
+    EXPECT_EQ_INT(PARSE_OK, ParseJsonStringWith(&p, &v, "[1,2,3]"));
+    CompactValue(&v, &alloc);
+    MeasureValue(&v, &after);
+    EXPECT_EQ_SIZE_T(1, after.allocations);
+    EXPECT_EQ_DOUBLE(3.0, GetValueArrayNumbers(&v)[2]);
+    EXPECT_EQ_DOUBLE(2.0, GetValueNumber(GetValueArrayElement(&v, 1)));
+    MeasureValue(&v, &after);
+    EXPECT_EQ_SIZE_T(1, after.allocations);
+    EXPECT_EQ_SIZE_T(3 * sizeof(jsonValue), FootprintBytes(after));
+    test_footprint_freed(&v, &alloc, &heap);
+    EXPECT_EQ_INT(PARSE_OK, ParseJsonStringWith(&p, &v, "{\"n\":[1,2,3],\"s\":\"x\"}"));
+    CompactValue(&v, &alloc);
+    EXPECT_EQ_DOUBLE(3.0, GetValueNumber(GetValueArrayElement(GetValueObjectValue(&v, 0), 2)));
+    MeasureValue(&v, &after);
+    EXPECT_EQ_SIZE_T(2, after.allocations);
+    test_footprint_freed(&v, &alloc, &heap);
+
+    /* borrowed text is copied in, decoded, and the input can go */
+    size_t size = strlen(text) + 1;
+    char* input = (char*)malloc(size);
+    memcpy(input, "[\"a\\tb\",{\"k\":\"plain\"},12.50]", 29);
+    SetParserFlags(&p, PARSE_LAZY_STRINGS | PARSE_RAW_NUMBERS);
+    EXPECT_EQ_INT(PARSE_OK, ParseJsonStringWith(&p, &v, input));
+    CompactValue(&v, &alloc);
+    memset(input, 'x', size - 1);
+    free(input);
+    EXPECT_EQ_STRING("a\tb", GetValueString(GetValueArrayElement(&v, 0)), 3);
+    EXPECT_EQ_STRING("plain", GetValueString(GetValueObjectValue(GetValueArrayElement(&v, 1), 0)), 5);
+    EXPECT_EQ_DOUBLE(12.5, GetValueNumber(GetValueArrayElement(&v, 2)));
+    EXPECT_EQ_INT(STRINGIFY_OK, Stringify(&v, &json, &length));
+    EXPECT_EQ_STRING("[\"a\\tb\",{\"k\":\"plain\"},12.50]", json, length);
+    free(json);
+    MeasureValue(&v, &after);
+    EXPECT_EQ_SIZE_T(1, after.allocations);
+    test_footprint_freed(&v, &alloc, &heap);
+    FreeParser(&p);
+
+    /* deeper than the walk's first stack, and left uncached */
+    std::string deep(300, '[');
+    deep += "\"x\"" + std::string(300, ']');
+    EXPECT_EQ_INT(PARSE_OK, ParseJsonString(&v, deep.c_str(), nullptr, &alloc));
+    CompactValue(&v, &alloc);
+    EnableStringifyCache(&v, &alloc);
+    EXPECT_EQ_SIZE_T(1, heap.blocks);
+    EXPECT_EQ_INT(STRINGIFY_OK, Stringify(&v, &json, &length));
+    EXPECT_TRUE(length == deep.size() && memcmp(json, deep.c_str(), length) == 0);
+    free(json);
+    FreeValue(&v, &alloc);
+    EXPECT_EQ_SIZE_T(0, heap.blocks);
+    EXPECT_EQ_SIZE_T(0, heap.sizeMismatches);
+
+    tinyjson::Document doc(&alloc);
+    EXPECT_EQ_INT(PARSE_OK, doc.parse(text));
+    doc.compact();
+    EXPECT_EQ_SIZE_T(1, doc.footprint().allocations);
+    EXPECT_TRUE(EqualValue(&expect, doc.get()));
+    FreeValue(&expect);
+}
+static void test_share_reader(const jsonValue* shared, const char* expect, int* ok) {
+    for (int i = 0; i < 50; i++) {
+        jsonValue mine, variant;
+        char* json;
+        size_t length;
+        InitValue(&mine);
+        InitValue(&variant);
+        CopyValue(&mine, shared);
+        CopyValue(&variant, &mine);
+        SetValueNumber(EditValue(&variant, "/nested/k/0"), i);
+        if (Stringify(&mine, &json, &length) != STRINGIFY_OK || strcmp(json, expect) != 0)
+            *ok = 0;
+        free(json);
+        if (GetValueNumber(GetValueArrayElement(GetValueObjectValue(GetValueObjectValue(&variant, 2), 0), 0)) != i)
+            *ok = 0;
+        FreeValue(&mine);
+        FreeValue(&variant);
+    }
+}
+
+static void test_share() {
+    const char* text = "{\"id\":7,\"tags\":[\"a\",\"bc\",[]],\"nested\":{\"k\":[true,null,{\"deep\":\"x\"}]},\"n\":[1.5,2]}";
+    CountingHeap heap = { 0, 0, 0, 0 };
+    jsonAllocator alloc = { CountingMalloc, CountingRealloc, CountingFree, &heap };
+    jsonParser p;
+    jsonValue v, expect, copy, old;
+    jsonFootprint f;
+    char* json;
+    size_t length, blocks;
+
+    EXPECT_EQ_INT(PARSE_OK, ParseJsonString(&expect, text));
+    EXPECT_EQ_INT(PARSE_OK, ParseJsonString(&v, text, nullptr, &alloc));
+    ShareValue(&v, &alloc);
+    /* one block per non-empty container, with its keys and text */
+    EXPECT_EQ_SIZE_T(6, heap.blocks);
+    EXPECT_TRUE(EqualValue(&expect, &v));
+    EXPECT_TRUE((v.flags & VALUE_SHARED) != 0);
+    MeasureValue(&v, &f);
+    EXPECT_EQ_SIZE_T(6, f.allocations);
+    EXPECT_EQ_SIZE_T(heap.live, FootprintBytes(f));
+    EXPECT_EQ_INT(STRINGIFY_OK, Stringify(&v, &json, &length));
+    EXPECT_EQ_STRING("{\"id\":7,\"tags\":[\"a\",\"bc\",[]],\"nested\":{\"k\":[true,null,{\"deep\":\"x\"}]},\"n\":[1.5,2]}", json, length);
+    free(json);
+
+    /* copies are references, and outlive the value they were copied from */
+    InitValue(&copy);
+    InitValue(&old);
+    CopyValue(&copy, &v, &alloc);
+    CopyValue(&old, GetValueObjectValue(&v, 2), &alloc);
+    EXPECT_EQ_SIZE_T(6, heap.blocks);
+    EXPECT_TRUE(copy.obj.maps == v.obj.maps);
+    FreeValue(&v, &alloc);
+    EXPECT_EQ_SIZE_T(6, heap.blocks);
+    EXPECT_TRUE(EqualValue(&expect, &copy));
+
+    /* editing copies the path down to the value, and the value's own level */
+    CopyValue(&v, &copy, &alloc);
+    blocks = heap.blocks;
+    jsonValue* deep = EditValue(&v, "/nested/k/2", &alloc);
+    EXPECT_TRUE(deep != nullptr);
+    SetValueString(GetValueObjectValue(deep, 0), "y", 1, &alloc);
+    EXPECT_EQ_STRING("x", GetValueString(GetValueObjectValue(GetValueArrayElement(GetValueObjectValue(GetValueObjectValue(&copy, 2), 0), 2), 0)), 1);
+    EXPECT_EQ_STRING("y", GetValueString(GetValueObjectValue(GetValueArrayElement(GetValueObjectValue(GetValueObjectValue(&v, 2), 0), 2), 0)), 1);
+    EXPECT_TRUE(GetValueObjectValue(&v, 1)->arr.values == GetValueObjectValue(&copy, 1)->arr.values);
+    EXPECT_TRUE(GetValueObjectValue(&v, 3)->arr.values == GetValueObjectValue(&copy, 3)->arr.values);
+    EXPECT_TRUE(EqualValue(&expect, &copy));
+    EXPECT_TRUE(EqualValue(&old, GetValueObjectValue(&copy, 2)));
+    /* members and keys of the root, of nested, k's elements, then deep's member, key and "y" */
+    EXPECT_EQ_SIZE_T(blocks + 5 + 2 + 1 + 3, heap.blocks);
+
+    /* refreezing keeps what is still shared */
+    ShareValue(&v, &alloc);
+    EXPECT_EQ_SIZE_T(blocks + 4, heap.blocks);
+    EXPECT_TRUE(GetValueObjectValue(&v, 1)->arr.values == GetValueObjectValue(&copy, 1)->arr.values);
+    EXPECT_TRUE((GetValueObjectValue(&v, 2)->flags & VALUE_SHARED) != 0);
+    EXPECT_FALSE(EqualValue(&v, &copy));
+
+    /* pointers that name nothing */
+    EXPECT_TRUE(EditValue(&v, "", &alloc) == &v);
+    EXPECT_TRUE(EditValue(&v, "tags", &alloc) == nullptr);
+    EXPECT_TRUE(EditValue(&v, "/missing", &alloc) == nullptr);
+    EXPECT_TRUE(EditValue(&v, "/tags/3", &alloc) == nullptr);
+    EXPECT_TRUE(EditValue(&v, "/tags/01", &alloc) == nullptr);
+    EXPECT_TRUE(EditValue(&v, "/tags/-", &alloc) == nullptr);
+    EXPECT_TRUE(EditValue(&v, "/tags/99999999999999999999999", &alloc) == nullptr);
+    EXPECT_TRUE(EditValue(&v, "/id/0", &alloc) == nullptr);
+    EXPECT_TRUE(EditValue(&v, "/tags/1", &alloc) == GetValueArrayElement(GetValueObjectValue(&v, 1), 1));
+    FreeValue(&v, &alloc);
+    FreeValue(&copy, &alloc);
+    FreeValue(&old, &alloc);
+    EXPECT_EQ_SIZE_T(0, heap.blocks);
+    EXPECT_EQ_SIZE_T(0, heap.live);
+    EXPECT_EQ_SIZE_T(0, heap.sizeMismatches);
+
+    /* keys with / and ~ */
+    EXPECT_EQ_INT(PARSE_OK, ParseJsonString(&v, "{\"a/b\":{\"m~n\":[0,1]}}", nullptr, &alloc));
+    ShareValue(&v, &alloc);
+    deep = EditValue(&v, "/a~1b/m~0n/1", &alloc);
+    EXPECT_TRUE(deep != nullptr);
+    EXPECT_EQ_DOUBLE(1.0, GetValueNumber(deep));
+    test_footprint_freed(&v, &alloc, &heap);
+
+    /* nothing to share */
+    EXPECT_EQ_INT(PARSE_OK, ParseJsonString(&v, "[]", nullptr, &alloc));
+    ShareValue(&v, &alloc);
+    EXPECT_EQ_INT(0, (int)v.flags);
+    SetValueString(&v, "text", 4, &alloc);
+    ShareValue(&v, &alloc);
+    EXPECT_EQ_INT(0, (int)v.flags);
+    FreeValue(&v, &alloc);
+
+    /* lazy text is decoded and packed arrays expanded, so that reading writes nothing */
+    InitParser(&p, &alloc);
+    SetParserFlags(&p, PARSE_LAZY_STRINGS | PARSE_PACKED_NUMBERS);
+    std::string input = "{\"s\":\"tab\\there\",\"n\":[1,2,3]}";
+    EXPECT_EQ_INT(PARSE_OK, ParseJsonStringWith(&p, &v, input.c_str()));
+    ShareValue(&v, &alloc);
+    input.assign(input.size(), ' ');
+    EXPECT_TRUE((GetValueObjectValue(&v, 0)->flags & VALUE_ESCAPED) == 0);
+    EXPECT_EQ_STRING("tab\there", GetValueString(GetValueObjectValue(&v, 0)), 8);
+    EXPECT_TRUE(GetValueArrayNumbers(GetValueObjectValue(&v, 1)) == nullptr);
+    EXPECT_EQ_DOUBLE(3.0, GetValueNumber(GetValueArrayElement(GetValueObjectValue(&v, 1), 2)));
+    EnableStringifyCache(&v, &alloc);
+    EXPECT_TRUE((v.flags & VALUE_CACHED) == 0);
+    FreeValue(&v, &alloc);
+    FreeParser(&p);
+    EXPECT_EQ_SIZE_T(0, heap.blocks);
+
+    /* a shared tree inside a plain or compacted one is released with it */
+    EXPECT_EQ_INT(PARSE_OK, ParseJsonString(&v, text, nullptr, &alloc));
+    ShareValue(&v, &alloc);
+    EXPECT_EQ_INT(PARSE_OK, ParseJsonString(&copy, "[0,[1]]", nullptr, &alloc));
+    CopyValue(GetValueArrayElement(&copy, 0), &v, &alloc);
+    CompactValue(&copy, &alloc);
+    CopyValue(GetValueArrayElement(GetValueArrayElement(&copy, 1), 0), &v, &alloc);
+    MeasureValue(&copy, &f);
+    FreeValue(&v, &alloc);
+    EXPECT_TRUE(EqualValue(&expect, GetValueArrayElement(&copy, 0)));
+    EXPECT_TRUE(EqualValue(&expect, GetValueArrayElement(GetValueArrayElement(&copy, 1), 0)));
+    EXPECT_EQ_SIZE_T(heap.blocks, f.allocations);
+    EXPECT_EQ_SIZE_T(heap.live, FootprintBytes(f));
+    FreeValue(&copy, &alloc);
+    EXPECT_EQ_SIZE_T(0, heap.blocks);
+    EXPECT_EQ_SIZE_T(0, heap.sizeMismatches);
+
+    /* read, copied, edited and freed from many threads at once */
+    EXPECT_EQ_INT(PARSE_OK, ParseJsonString(&v, text));
+    ShareValue(&v);
+    int ok[8];
+    std::thread workers[8];
+    for (int i = 0; i < 8; i++) {
+        ok[i] = 1;
+        workers[i] = std::thread(test_share_reader, &v, text, &ok[i]);
+    }
+    for (int i = 0; i < 8; i++) {
+        workers[i].join();
+        EXPECT_EQ_INT(1, ok[i]);
+    }
+    EXPECT_TRUE(EqualValue(&expect, &v));
+    FreeValue(&v);
+
+    /* no recursion: a very deep tree is shared, and released with its last reference */
+    std::string nested;
+    for (int i = 0; i < 500000; i++)
+        nested += "{\"k\":[";
+    nested += "\"x\\ty\"";
+    for (int i = 0; i < 500000; i++)
+        nested += "]}";
+    InitParser(&p);
+    SetParserMaxDepth(&p, 0);
+    SetParserFlags(&p, PARSE_LAZY_STRINGS);
+    EXPECT_EQ_INT(PARSE_OK, ParseJsonStringWith(&p, &v, nested.c_str()));
+    FreeParser(&p);
+    ShareValue(&v);
+    EXPECT_TRUE(v.flags & VALUE_SHARED);
+    CopyValue(&copy, &v);
+    FreeValue(&v);
+    EXPECT_EQ_INT(STRINGIFY_OK, Stringify(&copy, &json, &length));
+    EXPECT_TRUE(length == nested.size() && memcmp(json, nested.c_str(), length) == 0);
+    free(json);
+    FreeValue(&copy);
+
+    /* the wrapper */
+    tinyjson::Document doc;
+    EXPECT_EQ_INT(PARSE_OK, doc.parse(text));
+    doc.share();
+    tinyjson::Document fork = doc.clone();
+    EXPECT_TRUE(fork.get()->obj.maps == doc.get()->obj.maps);
+    fork.edit("/tags/0").setString("z");
+    EXPECT_FALSE(fork.edit("/none"));
+    EXPECT_TRUE(fork["tags"][0].getString() == "z");
+    EXPECT_TRUE(doc["tags"][0].getString() == "a");
+    FreeValue(&expect);
+}
+
+static void test_columns() {
+    const char* json = "[{\"id\":1,\"name\":\"a\",\"ok\":true,\"tags\":[1,{}]},{\"name\":\"b\\nc\",\"id\":2,\"x\":null},"
+        "{\"id\":\"3\",\"ok\":false,\"id\":4},{\"name\":\"\"}]";
+    CountingHeap heap = { 0, 0, 0, 0 };
+    jsonAllocator alloc = { CountingMalloc, CountingRealloc, CountingFree, &heap };
+    jsonColumns c;
+    jsonValue v;
+    InitValue(&v);
+    EXPECT_EQ_INT(PARSE_OK, ParseJsonString(&v, json, nullptr, &alloc));
+    EXPECT_EQ_INT(PARSE_OK, ColumnsFromValue(&c, &v, &alloc));
+    test_check_columns(&c);
+    FreeColumns(&c);
+    FreeValue(&v, &alloc);
+    EXPECT_EQ_INT(PARSE_OK, ParseColumns(&c, json, &alloc));
+    test_check_columns(&c);
+    FreeColumns(&c);
+
+    /* many rows: the arrays grow, the late string turns the column into jsonValues */
+    std::string big = "[";
+    for (int i = 0; i < 1000; i++)
+        big += i ? ",{\"n\":" + std::to_string(i) + "}" : "{\"n\":0}";
+    big += ",{\"n\":\"last\"}]";
+    EXPECT_EQ_INT(PARSE_OK, ParseColumns(&c, big.c_str(), &alloc));
+    EXPECT_EQ_SIZE_T(1001, c.rows);
+    EXPECT_EQ_INT(COLUMN_VALUE, c.columns[0].type);
+    EXPECT_EQ_DOUBLE(999.0, GetValueNumber(&c.columns[0].values[999]));
+    FreeColumns(&c);
+    big.erase(big.rfind(','));
+    big += "]";
+    EXPECT_EQ_INT(PARSE_OK, ParseColumns(&c, big.c_str(), &alloc));
+    EXPECT_EQ_INT(COLUMN_NUMBER, c.columns[0].type);
+    double sum = 0.0;
+    for (size_t i = 0; i < c.rows; i++)
+        sum += c.columns[0].numbers[i];
+    EXPECT_EQ_DOUBLE(499500.0, sum);
+    FreeColumns(&c);
+
+    /* a string column that starts late and never comes back still gets all its rows */
+    EXPECT_EQ_INT(PARSE_OK, ParseColumns(&c, "[{\"a\":1},{\"b\":\"x\"},{\"a\":2},{\"a\":3},{\"a\":4},{\"a\":5}]", &alloc));
+    EXPECT_EQ_SIZE_T(6, c.rows);
+    EXPECT_EQ_INT(COLUMN_STRING, c.columns[1].type);
+    EXPECT_TRUE(IsColumnNull(&c.columns[1], 0) && !IsColumnNull(&c.columns[1], 1) && IsColumnNull(&c.columns[1], 5));
+    size_t len;
+    const char* s = GetColumnString(&c.columns[1], 1, &len);
+    EXPECT_EQ_STRING("x", s, len);
+    s = GetColumnString(&c.columns[1], 5, &len);
+    EXPECT_EQ_SIZE_T(0, len);
+    FreeColumns(&c);
+
+    EXPECT_EQ_INT(PARSE_ERR_TYPE_MISMATCH, ParseColumns(&c, "{}", &alloc));
+    EXPECT_EQ_INT(PARSE_ERR_TYPE_MISMATCH, ParseColumns(&c, "[{\"a\":\"x\"},1]", &alloc));
+    EXPECT_EQ_INT(PARSE_ERR_ROOT_NOT_SINGULAR, ParseColumns(&c, "[] 1", &alloc));
+    EXPECT_TRUE(ParseColumns(&c, "[{\"a\":\"x\",\"b\":[1,}]", &alloc) != PARSE_OK);
+    EXPECT_EQ_INT(PARSE_OK, ParseColumns(&c, "[]", &alloc));
+    EXPECT_EQ_SIZE_T(0, c.count);
+    FreeColumns(&c);
+    EXPECT_EQ_SIZE_T(0, heap.blocks);
+    EXPECT_EQ_SIZE_T(0, heap.sizeMismatches);
+}
+
+struct QueryResults {
+    std::string text;   /* the matches' JSON, separated by spaces */
+    size_t calls;
+    size_t stopAfter;   /* 0 for never */
+    size_t record;      /* of the last match */
+};
+
+static bool CollectMatch(void* userData, size_t record, const jsonValue* match) {
+    QueryResults* r = (QueryResults*)userData;
+    char* json;
+    size_t length;
+    Stringify(match, &json, &length);
+    if (r->calls++)
+        r->text += ' ';
+    r->text.append(json, length);
+    free(json);
+    r->record = record;
+    return r->calls != r->stopAfter;
+}
+
+/* the tree and the streaming evaluation must agree */
+static void test_query_path(const char* expect, const char* path, const char* json) {
+    QueryResults tree = { "", 0, 0, 0 }, stream = { "", 0, 0, 0 };
+    jsonPath* p;
+    jsonReader r;
+    jsonValue v;
+    EXPECT_EQ_INT(PARSE_OK, CompilePath(&p, path));
+    EXPECT_EQ_INT(PARSE_OK, ParseJsonString(&v, json));
+    QueryValue(p, &v, CollectMatch, &tree);
+    InitReader(&r, json);
+    EXPECT_EQ_INT(PARSE_OK, QueryReader(p, &r, CollectMatch, &stream));
+    FreeReader(&r);
+    EXPECT_EQ_BASE(tree.text == expect, expect, tree.text.c_str(), "%s");
+    EXPECT_EQ_BASE(stream.text == expect, expect, stream.text.c_str(), "%s");
+    FreeValue(&v);
+    FreePath(p);
+}
+
+static void test_query_invalid(const char* path) {
+    CountingHeap heap = { 0, 0, 0, 0 };
+    jsonAllocator alloc = { CountingMalloc, CountingRealloc, CountingFree, &heap };
+    jsonPath* p = (jsonPath*)&heap;
+    EXPECT_EQ_INT(PARSE_ERR_INVALID_PATH, CompilePath(&p, path, &alloc));
+    EXPECT_TRUE(p == nullptr);
+    EXPECT_EQ_SIZE_T(0, heap.blocks);
+}
+
+static void test_query() {
+    const char* store = "{\"store\":{\"book\":[{\"title\":\"A\",\"price\":8,\"tags\":[\"x\"]},"
+        "{\"title\":\"B\",\"price\":12,\"isbn\":\"1\"},{\"title\":\"C\",\"price\":15.5,\"isbn\":\"2\"}],"
+        "\"bike\":{\"color\":\"red\",\"price\":20}},\"n\":[1,2,3]}";
+    test_query_path("\"A\" \"B\" \"C\"", "$.store.book[*].title", store);
+    test_query_path("\"B\"", "$.store.book[1].title", store);
+    test_query_path("\"red\"", "$['store'][\"bike\"][ 'color' ]", store);
+    test_query_path("[1,2,3]", "$.n", store);
+    test_query_path("", "$.n[3]", store);
+    test_query_path("", "$.missing.title", store);
+    test_query_path("8 12 15.5 20", "$..price", store);
+    test_query_path("\"B\" \"C\"", "$.store.book[?(@.price > 10)].title", store);
+    test_query_path("12 15.5", "$.store.book[?(@.isbn)].price", store);
+    test_query_path("\"A\" \"C\"", "$.store.book[?(@.price < 10 || @.title == 'C')].title", store);
+    test_query_path("\"A\"", "$.store.book[?(!(@.price >= 10) && @['tags'][0] == \"x\")].title", store);
+    test_query_path("12 15.5", "$.store.book[?(@.title >= 'B')].price", store);
+    test_query_path("\"red\"", "$.store[?(@.price == 20)].color", store);
+    test_query_path("2 3", "$.n[?(@ >= 2)]", store);
+    test_query_path("", "$.n[?(@ == '1')]", store);
+    test_query_path("1 2 3", "$.n[?(@ != '1')]", store);
+    test_query_path("{\"a\":1}", "$[?(@ == {\"a\":1})]", "[1,{\"a\":1},{\"a\":2}]");
+    test_query_path("[1,{\"b\":2}] 1 {\"b\":2} 2", "$..*", "{\"a\":[1,{\"b\":2}]}");
+    test_query_path("[1,2] 1 [3] 3", "$..[0]", "[[1,2],[[3]]]");
+    test_query_path("[{\"a\":{\"a\":1}}] {\"a\":1} 1", "$..a", "{\"a\":[{\"a\":{\"a\":1}}]}");
+    test_query_path("\"it's\"", "$['it\\'s']", "{\"it's\":\"it's\"}");
+
+    /* packed arrays are read in place */
+    {
+        QueryResults res = { "", 0, 0, 0 };
+        jsonParser parser;
+        jsonPath* p;
+        jsonValue v;
+        InitParser(&parser);
+        SetParserFlags(&parser, PARSE_PACKED_NUMBERS);
+        EXPECT_EQ_INT(PARSE_OK, ParseJsonStringWith(&parser, &v, store));
+        EXPECT_EQ_INT(PARSE_OK, CompilePath(&p, "$.n[?(@ > 1)]"));
+        QueryValue(p, &v, CollectMatch, &res);
+        EXPECT_TRUE(res.text == "2 3");
+        EXPECT_TRUE(GetValueArrayNumbers(GetValueObjectValue(&v, 1)) != nullptr);
+        FreePath(p);
+        FreeValue(&v);
+        FreeParser(&parser);
+    }
+
+    /* returning false stops at once, the reader is left where it was */
+    {
+        QueryResults res = { "", 0, 2, 0 };
+        jsonPath* p;
+        jsonReader r;
+        EXPECT_EQ_INT(PARSE_OK, CompilePath(&p, "$..price"));
+        InitReader(&r, store);
+        EXPECT_EQ_INT(PARSE_OK, QueryReader(p, &r, CollectMatch, &res));
+        EXPECT_EQ_SIZE_T(2, res.calls);
+        FreeReader(&r);
+        InitReader(&r, "{\"price\":1,\"x\":[1,}");
+        EXPECT_EQ_INT(PARSE_ERR_INVALID_VALUE, QueryReader(p, &r, CollectMatch, &res));
+        FreeReader(&r);
+        FreePath(p);
+    }
+
+    test_query_invalid("");
+    test_query_invalid("store");
+    test_query_invalid("$.");
+    test_query_invalid("$..");
+    test_query_invalid("$[");
+    test_query_invalid("$[1");
+    test_query_invalid("$['a");
+    test_query_invalid("$['a'");
+    test_query_invalid("$[-1]");
+    test_query_invalid("$.a b");
+    test_query_invalid("$[?(@.a >)]");
+    test_query_invalid("$[?(1)]");
+    test_query_invalid("$[?(@.a]");
+    test_query_invalid("$[?(@.a == 'x' &&)]");
+    test_query_invalid("$[?(@.*)]");
+    test_query_invalid("$[?(@[*])]");
+    test_query_invalid("$[?(@.a == tru)]");
+    test_query_invalid("$[?(@.a == 1)].b[\"c]");
+    test_query_invalid("$[99999999999999999999999]");
+    test_query_invalid(("$[?(" + std::string(40, '(') + "@" + std::string(40, ')') + ")]").c_str());
+    {
+        std::string steps;
+        for (int i = 0; i < 62; i++)
+            steps += ".a";
+        CountingHeap heap = { 0, 0, 0, 0 };
+        jsonAllocator alloc = { CountingMalloc, CountingRealloc, CountingFree, &heap };
+        jsonPath* p;
+        EXPECT_EQ_INT(PARSE_OK, CompilePath(&p, ("$" + steps + "[?(@.a.b[0] == 'x' || !@['c'])]").c_str(), &alloc));
+        FreePath(p);
+        EXPECT_EQ_SIZE_T(0, heap.blocks);
+        test_query_invalid(("$" + steps + ".a.a").c_str());
+    }
+}
+
+static void test_query_ndjson() {
+    CountingHeap heap = { 0, 0, 0, 0 };
+    jsonAllocator alloc = { CountingMalloc, CountingRealloc, CountingFree, &heap };
+    QueryResults res = { "", 0, 0, 0 };
+    jsonPath* p;
+    size_t records;
+
+    EXPECT_EQ_INT(PARSE_OK, CompilePath(&p, "$.v[*]", &alloc));
+    EXPECT_EQ_INT(PARSE_OK, QueryNdjson(p, "{\"id\":1,\"v\":[1,2]}\n\n{\"id\":2,\"v\":[]}\r\n  {\"id\":3,\"v\":[3]}\n", 1,
+        CollectMatch, &res, &records));
+    EXPECT_TRUE(res.text == "1 2 3");
+    EXPECT_EQ_SIZE_T(2, res.record);
+    EXPECT_EQ_SIZE_T(3, records);
+    res = { "", 0, 0, 0 };
+    EXPECT_EQ_INT(PARSE_ERR_MISS_KEY, QueryNdjson(p, "{\"v\":[1]}\n{\"v\":[2],}\n{\"v\":[3]}", 1, CollectMatch, &res, &records));
+    EXPECT_EQ_SIZE_T(1, records);
+    EXPECT_TRUE(res.text == "1 2");
+    EXPECT_EQ_INT(PARSE_ERR_ROOT_NOT_SINGULAR, QueryNdjson(p, "{\"v\":[1]} {}\n", 1, CollectMatch, &res, &records));
+    EXPECT_EQ_INT(PARSE_ERR_ROOT_NOT_SINGULAR, QueryNdjson(p, "{\"v\":\n[1]}\n", 1, CollectMatch, &res, &records));
+    EXPECT_EQ_SIZE_T(0, records);
+    EXPECT_EQ_INT(PARSE_OK, QueryNdjson(p, " \n", 1, CollectMatch, &res, &records));
+    EXPECT_EQ_SIZE_T(0, records);
+    FreePath(p);
+    EXPECT_EQ_SIZE_T(0, heap.blocks);
+
+    /* slices on their own threads hand over the same matches in the same order */
+    std::string lines;
+    for (int i = 0; i < 5000; i++)
+        lines += "{\"i\":" + std::to_string(i) + ",\"w\":[{\"odd\":" + (i % 2 ? "true" : "false") + ",\"i\":" + std::to_string(i) + "}]}\n";
+    QueryResults one = { "", 0, 0, 0 }, four = { "", 0, 0, 0 };
+    EXPECT_EQ_INT(PARSE_OK, CompilePath(&p, "$.w[?(@.odd == true)].i"));
+    EXPECT_EQ_INT(PARSE_OK, QueryNdjson(p, lines.c_str(), 1, CollectMatch, &one, &records));
+    EXPECT_EQ_SIZE_T(5000, records);
+    EXPECT_EQ_INT(PARSE_OK, QueryNdjson(p, lines.c_str(), 4, CollectMatch, &four, &records));
+    EXPECT_EQ_SIZE_T(5000, records);
+    EXPECT_EQ_SIZE_T(2500, four.calls);
+    EXPECT_EQ_SIZE_T(4999, four.record);
+    EXPECT_TRUE(one.text == four.text);
+
+    four = { "", 0, 2000, 0 };
+    EXPECT_EQ_INT(PARSE_OK, QueryNdjson(p, lines.c_str(), 4, CollectMatch, &four, &records));
+    EXPECT_EQ_SIZE_T(2000, four.calls);
+    EXPECT_EQ_SIZE_T(3999, four.record);
+    EXPECT_EQ_SIZE_T(3999, records);
+
+    four = { "", 0, 0, 0 };
+    lines += "{\"i\":5000,\"w\":[{\"odd\":true,\"i\":5000}]\n{}\n";
+    EXPECT_EQ_INT(PARSE_ERR_MISS_COMMA_OR_CURLY_BRACKET, QueryNdjson(p, lines.c_str(), 4, CollectMatch, &four, &records));
+    EXPECT_EQ_SIZE_T(5000, records);
+    EXPECT_TRUE(one.text + " 5000" == four.text);
+    FreePath(p);
+}
+
+/* reads to the end of the array and returns what stopped it */
+static parseStatus DrainElements(jsonElements* e, size_t* count, double* sum = nullptr, CountingHeap* heap = nullptr,
+                                 size_t* peak = nullptr) {
+    jsonValue v;
+    bool end = false;
+    parseStatus ret;
+    InitValue(&v);
+    *count = 0;
+    while ((ret = NextElement(e, &v, &end)) == PARSE_OK && !end) {
+        (*count)++;
+        if (sum && GetValueType(&v) == TYPE_NUMBER)
+            *sum += GetValueNumber(&v);
+        if (heap && heap->live > *peak)
+            *peak = heap->live;
+    }
+    FreeValue(&v);
+    return ret;
+}
+
+static void test_elements_status(parseStatus expect, size_t count, const char* json, const char* pointer = nullptr) {
+    jsonElements e;
+    size_t n = 0;
+    /* an exact copy without a NUL, so reading past the end shows up under a sanitizer */
+    size_t length = strlen(json);
+    char* copy = (char*)malloc(length + 1);
+    memcpy(copy, json, length);
+    parseStatus ret = OpenElements(&e, copy, length, pointer);
+    if (ret == PARSE_OK) {
+        ret = DrainElements(&e, &n);
+        CloseElements(&e);
+    }
+    EXPECT_EQ_INT(expect, ret);
+    EXPECT_EQ_SIZE_T(count, n);
+    free(copy);
+}
+
+static void test_elements() {
+    jsonElements e;
+    jsonValue v;
+    bool end;
+    size_t n;
+    double sum = 0.0;
+
+    const char* json = "[1, {\"a\":[2,\"x]\"]}, \"s\\\"]\", true, null, [] ]";
+    EXPECT_EQ_INT(PARSE_OK, OpenElements(&e, json, strlen(json)));
+    InitValue(&v);
+    EXPECT_EQ_INT(PARSE_OK, NextElement(&e, &v, &end));
+    EXPECT_FALSE(end);
+    EXPECT_EQ_DOUBLE(1.0, GetValueNumber(&v));
+    EXPECT_EQ_INT(PARSE_OK, NextElement(&e, &v, &end));
+    EXPECT_EQ_INT(TYPE_OBJECT, GetValueType(&v));
+    EXPECT_EQ_INT(PARSE_OK, NextElement(&e, &v, &end));
+    EXPECT_EQ_STRING("s\"]", GetValueString(&v), GetValueStringLength(&v));
+    EXPECT_EQ_INT(PARSE_OK, DrainElements(&e, &n));
+    EXPECT_EQ_SIZE_T(3, n);
+    EXPECT_EQ_INT(PARSE_OK, NextElement(&e, &v, &end));
+    EXPECT_TRUE(end);
+    EXPECT_EQ_INT(TYPE_NULL, GetValueType(&v));
+    CloseElements(&e);
+
+    test_elements_status(PARSE_OK, 0, " [ ] ");
+    test_elements_status(PARSE_OK, 3, "[1,\"a\",[true]]");
+    test_elements_status(PARSE_ERR_INVALID_VALUE, 1, "[1,]");
+    test_elements_status(PARSE_ERR_MISS_COMMA_OR_SQUARE_BRACKET, 1, "[1 2]");
+    test_elements_status(PARSE_ERR_MISS_COMMA_OR_SQUARE_BRACKET, 0, "[1x]");
+    test_elements_status(PARSE_ERR_MISS_COMMA_OR_SQUARE_BRACKET, 0, "[1");
+    test_elements_status(PARSE_ERR_EXPECT_VALUE, 1, "[1,");
+    test_elements_status(PARSE_ERR_MISS_QUOTATION_MARK, 0, "[\"ab");
+    test_elements_status(PARSE_ERR_MISS_COMMA_OR_CURLY_BRACKET, 0, "[{\"a\":1]");
+    test_elements_status(PARSE_ERR_MISS_COMMA_OR_SQUARE_BRACKET, 0, "[[1,2}");
+    test_elements_status(PARSE_ERR_NUMBER_OVERFLOW, 0, "[1e400]");
+    test_elements_status(PARSE_ERR_ROOT_NOT_SINGULAR, 1, "[1] x");
+    test_elements_status(PARSE_ERR_TYPE_MISMATCH, 0, "{}");
+    test_elements_status(PARSE_ERR_EXPECT_VALUE, 0, " ");
+
+    /* everything before the array is skipped without being parsed */
+    const char* doc = "{\"skip\":{\"items\":[9]},\"data\":[{\"items\":[0]},{\"x\":\"}\",\"a/b\":[7],\"items\":[1,2,3]}],\"m~n\":[5]}";
+    test_elements_status(PARSE_OK, 3, doc, "/data/1/items");
+    test_elements_status(PARSE_OK, 1, doc, "/data/1/a~1b");
+    test_elements_status(PARSE_OK, 1, doc, "/m~0n");
+    test_elements_status(PARSE_OK, 2, doc, "/data");
+    test_elements_status(PARSE_OK, 2, "{\"data\":[1,2]} trailing bytes are not read", "/data");
+    test_elements_status(PARSE_ERR_INVALID_PATH, 0, doc, "/nope");
+    test_elements_status(PARSE_ERR_INVALID_PATH, 0, doc, "/data/2");
+    test_elements_status(PARSE_ERR_INVALID_PATH, 0, doc, "/data/01");
+    test_elements_status(PARSE_ERR_INVALID_PATH, 0, doc, "/data/x");
+    test_elements_status(PARSE_ERR_INVALID_PATH, 0, doc, "/skip/items/0/x");
+    test_elements_status(PARSE_ERR_INVALID_PATH, 0, doc, "data");
+    test_elements_status(PARSE_ERR_TYPE_MISMATCH, 0, doc, "/skip");
+    test_elements_status(PARSE_ERR_TYPE_MISMATCH, 0, doc, "/data/0/items/0");
+    test_elements_status(PARSE_ERR_MISS_COLON, 0, "{\"a\" 1}", "/b");
+
+    /* a descriptor is read in chunks, memory follows the largest element rather than the array */
+    {
+        CountingHeap heap = { 0, 0, 0, 0 };
+        jsonAllocator alloc = { CountingMalloc, CountingRealloc, CountingFree, &heap };
+        size_t peak = 0;
+        FILE* f = tmpfile();
+        fputs("{\"meta\":{\"note\":\"]\"},\"rows\":[", f);
+        for (int i = 0; i < 100000; i++)
+            fprintf(f, "%s{\"id\":%d,\"tags\":[\"a\",\"b\"]}", i ? "," : "", i);
+        fputs("]}", f);
+        rewind(f);
+        EXPECT_EQ_INT(PARSE_OK, OpenElementsFd(&e, fileno(f), "/rows", &alloc));
+        EXPECT_EQ_INT(PARSE_OK, DrainElements(&e, &n, nullptr, &heap, &peak));
+        EXPECT_EQ_SIZE_T(100000, n);
+        EXPECT_TRUE(peak < 256 * 1024);
+        CloseElements(&e);
+        EXPECT_EQ_SIZE_T(0, heap.blocks);
+
+        /* one element bigger than the buffer, which grows to hold it */
+        rewind(f);
+        std::string big(300000, 'x');
+        fprintf(f, "[1,\"%s\",2]", big.c_str());
+        fflush(f);
+        rewind(f);
+        EXPECT_EQ_INT(PARSE_OK, OpenElementsFd(&e, fileno(f)));
+        InitValue(&v);
+        EXPECT_EQ_INT(PARSE_OK, NextElement(&e, &v, &end));
+        EXPECT_EQ_INT(PARSE_OK, NextElement(&e, &v, &end));
+        EXPECT_EQ_SIZE_T(300000, GetValueStringLength(&v));
+        EXPECT_EQ_INT(PARSE_OK, NextElement(&e, &v, &end));
+        EXPECT_EQ_DOUBLE(2.0, GetValueNumber(&v));
+        /* the rest of the file is the older, longer array: only the pointer-less root is checked for trailing bytes */
+        EXPECT_EQ_INT(PARSE_ERR_ROOT_NOT_SINGULAR, NextElement(&e, &v, &end));
+        EXPECT_EQ_INT(PARSE_ERR_ROOT_NOT_SINGULAR, NextElement(&e, &v, &end));
+        CloseElements(&e);
+        fclose(f);
+    }
+
+#if defined(__unix__) || defined(__APPLE__)
+    {
+        char path[] = "/tmp/tinyjson_elements_XXXXXX";
+        int fd = mkstemp(path);
+        FILE* f = fdopen(fd, "w");
+        fputs("{\"rows\":[", f);
+        for (int i = 0; i < 50000; i++)
+            fprintf(f, "%s%d", i ? ",\n" : "", i);
+        fputs("]}\n", f);
+        fclose(f);
+        EXPECT_EQ_INT(PARSE_OK, OpenElementsFile(&e, path, "/rows"));
+        EXPECT_EQ_INT(PARSE_OK, DrainElements(&e, &n, &sum));
+        EXPECT_EQ_SIZE_T(50000, n);
+        EXPECT_EQ_DOUBLE(1249975000.0, sum);
+        CloseElements(&e);
+        remove(path);
+        EXPECT_EQ_INT(PARSE_ERR_IO, OpenElementsFile(&e, path));
+        EXPECT_TRUE(e.state == nullptr);
+    }
+#endif
+
+    {
+        tinyjson::ElementStream s;
+        const char* rows = "{\"rows\":[{\"n\":1},{\"n\":2},{\"n\":3},4]}";
+        double total = 0.0;
+        EXPECT_EQ_INT(PARSE_OK, s.open(rows, strlen(rows), "/rows"));
+#ifdef TINYJSON_COROUTINES
+        for (tinyjson::Value row : s.elements())
+            total += row.isObject() ? row["n"].getNumber() : row.getNumber();
+#else
+        while (s.next())
+            total += s.value().isObject() ? s.value()["n"].getNumber() : s.value().getNumber();
+#endif
+        EXPECT_EQ_DOUBLE(10.0, total);
+        EXPECT_EQ_INT(PARSE_OK, s.status());
+        EXPECT_EQ_INT(PARSE_ERR_INVALID_PATH, s.open(rows, strlen(rows), "/cols"));
+        EXPECT_FALSE(s.next());
+        EXPECT_EQ_INT(PARSE_ERR_INVALID_PATH, s.status());
+    }
+}
+
+#ifdef TINYJSON_LITERALS
+using namespace tinyjson::literals;
+
+template <tinyjson::LiteralText Text>
+constexpr parseStatus LiteralStatus() {
+    return tinyjson::detail::MeasureLiteral(Text).status;
+}
+
+/* the literal must match what ParseJsonString() makes of the same text, and write out as it */
+#define TEST_LITERAL(json)\
+    do {\
+        jsonValue parsed, reparsed;\
+        char* out;\
+        size_t length;\
+        EXPECT_EQ_INT(PARSE_OK, ParseJsonString(&parsed, json));\
+        EXPECT_TRUE(EqualValue(&parsed, json##_json));\
+        EXPECT_EQ_INT(STRINGIFY_OK, Stringify(json##_json, &out, &length));\
+        EXPECT_EQ_INT(PARSE_OK, ParseJsonString(&reparsed, out));\
+        EXPECT_TRUE(EqualValue(&parsed, &reparsed));\
+        free(out);\
+        FreeValue(&parsed);\
+        FreeValue(&reparsed);\
+    } while(0)
+
+/* fails to compile as a literal, with the status the parser gives it */
+#define TEST_LITERAL_ERROR(error, json)\
+    do {\
+        jsonValue parsed;\
+        EXPECT_EQ_INT(error, LiteralStatus<json>());\
+        EXPECT_EQ_INT(error, ParseJsonString(&parsed, json));\
+    } while(0)
+
+static void test_literal() {
+    /* built by the compiler, usable in constant expressions */
+    constexpr const jsonValue* config = R"( {"retries": 3, "hosts": ["a", "b"], "limits": {"rate": 2.5}} )"_json;
+    static_assert(config->type == TYPE_OBJECT && config->obj.size == 3);
+    static_assert(config->obj.maps[1].value.arr.size == 2);
+    EXPECT_EQ_DOUBLE(3.0, GetValueNumber(GetValueObjectValue(config, 0)));
+    EXPECT_EQ_STRING("hosts", GetValueObjectKey(config, 1), GetValueObjectKeyLength(config, 1));
+    EXPECT_EQ_STRING("b", GetValueString(GetValueArrayElement(GetValueObjectValue(config, 1), 1)), 1);
+    EXPECT_EQ_DOUBLE(2.5, GetValueNumber(GetValueObjectValue(GetValueObjectValue(config, 2), 0)));
+    EXPECT_TRUE(config == R"( {"retries": 3, "hosts": ["a", "b"], "limits": {"rate": 2.5}} )"_json);
+
+    TEST_LITERAL("null");
+    TEST_LITERAL("[true,false,null,[],{},\"\",[[1]]]");
+    TEST_LITERAL("{\"a\":{\"b\":[1,{\"c\":\"d\"}]},\"e\":[]}");
+    TEST_LITERAL("[0,-0,1.5,-2.25,100,0.1,123456789,1e+22,1.7976931348623157e+308,5e-324,4.9406564584124654e-324]");
+    TEST_LITERAL("[\"\\\"\\\\/\\b\\f\\n\\r\\t\",\"\\u00e9\\u20AC\\ud834\\udd1e\\udc00\"]");
+
+    /* exact at compile time, or kept as text and converted when read */
+    const jsonValue* numbers = "[0.1,1e22,3.14159e-5,12345678901234567890,1e-300,2.2250738585072014e-308,-0]"_json;
+    size_t length;
+    EXPECT_TRUE(GetValueNumberText(GetValueArrayElement(numbers, 0), &length) == nullptr);
+    EXPECT_TRUE(GetValueNumberText(GetValueArrayElement(numbers, 1), &length) == nullptr);
+    EXPECT_EQ_DOUBLE(0.1, GetValueNumber(GetValueArrayElement(numbers, 0)));
+    EXPECT_EQ_DOUBLE(3.14159e-5, GetValueNumber(GetValueArrayElement(numbers, 2)));
+    EXPECT_EQ_DOUBLE(12345678901234567890.0, GetValueNumber(GetValueArrayElement(numbers, 3)));
+    EXPECT_EQ_STRING("1e-300", GetValueNumberText(GetValueArrayElement(numbers, 4), &length), 6);
+    EXPECT_EQ_DOUBLE(1e-300, GetValueNumber(GetValueArrayElement(numbers, 4)));
+    EXPECT_EQ_DOUBLE(2.2250738585072014e-308, GetValueNumber(GetValueArrayElement(numbers, 5)));
+    EXPECT_TRUE(signbit(GetValueNumber(GetValueArrayElement(numbers, 6))));
+
+    /* nothing on the heap, copies are ordinary trees */
+    CountingHeap heap = { 0, 0, 0, 0 };
+    jsonAllocator alloc = { CountingMalloc, CountingRealloc, CountingFree, &heap };
+    jsonFootprint f;
+    jsonValue copy;
+    MeasureValue(config, &f);
+    EXPECT_EQ_SIZE_T(0, f.allocations);
+    InitValue(&copy);
+    CopyValue(&copy, config, &alloc);
+    SetValueString(GetValueArrayElement(GetValueObjectValue(&copy, 1), 0), "c", 1, &alloc);
+    EXPECT_EQ_STRING("a", GetValueString(GetValueArrayElement(GetValueObjectValue(config, 1), 0)), 1);
+    FreeValue(&copy, &alloc);
+    EXPECT_EQ_SIZE_T(0, heap.blocks);
+
+    TEST_LITERAL_ERROR(PARSE_ERR_EXPECT_VALUE, " ");
+    TEST_LITERAL_ERROR(PARSE_ERR_INVALID_VALUE, "nul");
+    TEST_LITERAL_ERROR(PARSE_ERR_INVALID_VALUE, "[1,]");
+    TEST_LITERAL_ERROR(PARSE_ERR_ROOT_NOT_SINGULAR, "01.");
+    TEST_LITERAL_ERROR(PARSE_ERR_INVALID_VALUE, "1.");
+    TEST_LITERAL_ERROR(PARSE_ERR_INVALID_VALUE, "1e");
+    TEST_LITERAL_ERROR(PARSE_ERR_INVALID_VALUE, "+1");
+    TEST_LITERAL_ERROR(PARSE_ERR_ROOT_NOT_SINGULAR, "0123");
+    TEST_LITERAL_ERROR(PARSE_ERR_ROOT_NOT_SINGULAR, "[] x");
+    TEST_LITERAL_ERROR(PARSE_ERR_NUMBER_OVERFLOW, "1e309");
+    TEST_LITERAL_ERROR(PARSE_ERR_NUMBER_OVERFLOW, "-0.5e311");
+    /* between DBL_MAX and 1e309 it depends on the digits: half an ulp above DBL_MAX rounds up */
+    TEST_LITERAL_ERROR(PARSE_ERR_NUMBER_OVERFLOW, "[9e308]");
+    TEST_LITERAL_ERROR(PARSE_ERR_NUMBER_OVERFLOW, "-1.7976931348623159e308");
+    TEST_LITERAL_ERROR(PARSE_ERR_NUMBER_OVERFLOW, "0.179769313486231580793728971405303415079934132710037826936173778980444968292764750946649017977587207096330286416692887910946555547851940402630657488671505820681908902000708383676273854845817711531764475730270069855571366959622842914819860834936475292719074168444365510704342711559699508093042880177904174497792e309");
+    TEST_LITERAL_ERROR(PARSE_ERR_NUMBER_OVERFLOW, "1797693134862315807937289714053034150799341327100378269361737789804449682927647509466490179775872070963302864166928879109465555478519404026306574886715058206819089020007083836762738548458177115317644757302700698555713669596228429148198608349364752927190741684443655107043427115596995080930428801779041744977921");
+    TEST_LITERAL("[1.7976931348623158e308,-0.017976931348623158e310]");
+    TEST_LITERAL("179769313486231580793728971405303415079934132710037826936173778980444968292764750946649017977587207096330286416692887910946555547851940402630657488671505820681908902000708383676273854845817711531764475730270069855571366959622842914819860834936475292719074168444365510704342711559699508093042880177904174497791");
+    TEST_LITERAL(" 0.000001e-400 ");
+    TEST_LITERAL_ERROR(PARSE_ERR_MISS_QUOTATION_MARK, "\"abc");
+    TEST_LITERAL_ERROR(PARSE_ERR_INVALID_ESCAPE_CHAR, "\"\\v\"");
+    TEST_LITERAL_ERROR(PARSE_ERR_CONTROL_CHAR, "\"\x01\"");
+    TEST_LITERAL_ERROR(PARSE_ERR_INVALID_UNICODE_HEX, "\"\\u01G0\"");
+    TEST_LITERAL_ERROR(PARSE_ERR_INVALID_UNICODE_SURROGATE, "\"\\uD800\"");
+    TEST_LITERAL_ERROR(PARSE_ERR_INVALID_UNICODE_SURROGATE, "\"\\uD800\\u0041\"");
+    TEST_LITERAL_ERROR(PARSE_ERR_MISS_COMMA_OR_SQUARE_BRACKET, "[1 2]");
+    TEST_LITERAL_ERROR(PARSE_ERR_MISS_KEY, "{1:1}");
+    TEST_LITERAL_ERROR(PARSE_ERR_MISS_KEY, "{\"a\":1,}");
+    TEST_LITERAL_ERROR(PARSE_ERR_MISS_COLON, "{\"a\" 1}");
+    TEST_LITERAL_ERROR(PARSE_ERR_MISS_COMMA_OR_CURLY_BRACKET, "{\"a\":1]");
+}
+#endif
+
+#ifdef TINYJSON_STATS
+static void test_stats() {
+    jsonStats stats;
+    jsonParser p;
+    jsonValue v;
+    char* json;
+    size_t length;
+
+    /* a fresh parser, so the stack growth is counted */
+    memset(&stats, 0, sizeof(stats));
+    InitParser(&p);
+    EXPECT_EQ_INT(PARSE_OK, ParseJsonStringWith(&p, &v, " {\"a\":[1,2,[true]],\"s\":\"x\",\"n\":null} ", &stats));
+    FreeParser(&p);
+    EXPECT_EQ_SIZE_T(37, stats.parseBytes);
+    EXPECT_EQ_SIZE_T(1, stats.values[TYPE_OBJECT]);
+    EXPECT_EQ_SIZE_T(2, stats.values[TYPE_ARRAY]);
+    EXPECT_EQ_SIZE_T(2, stats.values[TYPE_NUMBER]);
+    EXPECT_EQ_SIZE_T(1, stats.values[TYPE_TRUE]);
+    EXPECT_EQ_SIZE_T(1, stats.values[TYPE_STRING]);
+    EXPECT_EQ_SIZE_T(1, stats.values[TYPE_NULL]);
+    EXPECT_EQ_SIZE_T(3, stats.maxDepth);
+    EXPECT_EQ_SIZE_T(2, stats.stackGrowths);
+    EXPECT_TRUE(stats.peakStack > 0);
+    /* 3 keys, 1 string, 2 arrays, 1 object and the stack twice */
+    EXPECT_EQ_SIZE_T(9, stats.allocations);
+
+    EXPECT_EQ_INT(STRINGIFY_OK, Stringify(&v, &json, &length, &stats));
+    EXPECT_EQ_SIZE_T(length, stats.stringifyBytes);
+    EXPECT_EQ_SIZE_T(10, stats.allocations);
+    free(json);
+    FreeValue(&v);
+}
+#endif
+
 int main() {
     test_parse();
     test_access();
@@ -527,6 +2721,40 @@ int main() {
 
     test_stringify();
 
+    test_copy();
+    test_move();
+    test_swap();
+    test_stringify_cache();
+    test_hash_equal();
+    test_binary();
+    test_msgpack();
+
+    test_cpp_document();
+    test_boxed();
+
+    test_reader();
+    test_writer();
+    test_stringify_iovec();
+    test_bind();
+
+    test_allocator();
+    test_reuse();
+    test_packed_numbers();
+    test_footprint();
+    test_compact();
+    test_share();
+    test_columns();
+    test_query();
+    test_query_ndjson();
+    test_elements();
+#ifdef TINYJSON_LITERALS
+    test_literal();
+#endif
+
+#ifdef TINYJSON_STATS
+    test_stats();
+#endif
+
     printf("%d/%d (%3.2f%%) passed\n", test_pass, test_count, test_pass * 100.0 / test_count);
 
     system("pause");
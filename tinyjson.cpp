@@ -2,24 +2,166 @@
 #include <stdio.h>
 #include <assert.h>
 #include <errno.h>
+#include <float.h>
 #include <cmath>
+#include <cstddef>
 #include <cstring>
+#include <cstdint>
+#include <atomic>
+#include <new>
+#include <thread>
+#ifdef TINYJSON_STATS
+#include <chrono>
+#endif
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define TINYJSON_X86_DISPATCH
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#define TINYJSON_POSIX
+#elif defined(_WIN32)
+#include <fcntl.h>
+#include <io.h>
+#include <limits.h>
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define NO_SANITIZE_ADDRESS __attribute__((no_sanitize_address))
+#else
+#define NO_SANITIZE_ADDRESS
+#endif
 
 #define ISDIGIT(ch) ((ch) >= '0' && (ch) <= '9')
 
 #define STACK_INIT_SIZE 256
 #define PARSE_STRINGIFY_INIT_SIZE 256
+#define SCRATCH_TRIM_SIZE (64 * 1024)
+#define PARSE_MAX_DEPTH 1024
+#define WALK_STACK_INIT_SIZE 32
+#define EQUAL_SCAN_MEMBERS 8 // EqualValue() matches the keys of larger objects through a hashed index
+#define PATH_MAX_STEPS 63 // the states of a plan fit in 64 bits, the top one marking a match
+#define PATH_MAX_NESTING 32
+#define PATH_NONE ((size_t)-1)
+#define NDJSON_MIN_SLICE (64 * 1024)
+#define ELEMENTS_READ_SIZE (64 * 1024)
+#define ELEMENTS_RELEASE_SIZE (1024 * 1024)
+#define BINARY_MAGIC "TJB\1"
+#define BINARY_MAGIC_SIZE 4
+#define BINARY_INT_LIMIT 9007199254740992.0 // 2^53, every integer up to it is exact in a double
+
+// jsonValue::flags bits owned by the slot a value sits in, see blockHeader
+#define SLOT_BIT (1u << 9)
+#define SLOT_IN_OBJECT (1u << 10)
+#define SLOT_INDEX_SHIFT 11
+#define SLOT_INDEX_MAX (~0u >> SLOT_INDEX_SHIFT)
+#define SLOT_MASK (~0u << 9)
 
 #define STRING_ERROR(ret) { c->top = head; return ret; }
 
+#ifdef TINYJSON_STATS
+#define STATS(c, stmt) do { if ((c)->stats) { stmt; } } while (0)
+#define STATS_ALLOC(c, n) STATS(c, (c)->stats->allocations++; (c)->stats->allocatedBytes += (n))
+#else
+#define STATS(c, stmt) do { } while (0)
+#define STATS_ALLOC(c, n) do { } while (0)
+#endif
+
+static void* DefaultMalloc(void*, size_t size)
+{
+	return malloc(size);
+}
+
+static void* DefaultRealloc(void*, void* ptr, size_t, size_t newSize)
+{
+	return realloc(ptr, newSize);
+}
+
+static void DefaultFree(void*, void* ptr, size_t)
+{
+	free(ptr);
+}
+
+static const jsonAllocator mallocAllocator = { DefaultMalloc, DefaultRealloc, DefaultFree, nullptr };
+static const jsonAllocator* defaultAllocator = &mallocAllocator;
+
+void SetDefaultAllocator(const jsonAllocator* a)
+{
+	defaultAllocator = a ? a : &mallocAllocator;
+}
+
+const jsonAllocator* GetDefaultAllocator()
+{
+	return defaultAllocator;
+}
+
+static inline const jsonAllocator* ResolveAllocator(const jsonAllocator* a)
+{
+	return a ? a : defaultAllocator;
+}
+
+static inline void* JsonMalloc(const jsonAllocator* a, size_t size)
+{
+	void* ptr = a->Malloc(a->userData, size);
+	assert(ptr);
+	return ptr;
+}
+
+static inline void* JsonRealloc(const jsonAllocator* a, void* ptr, size_t oldSize, size_t newSize)
+{
+	if (!ptr)
+	{
+		return JsonMalloc(a, newSize);
+	}
+	ptr = a->Realloc(a->userData, ptr, oldSize, newSize);
+	assert(ptr);
+	return ptr;
+}
+
+static inline void JsonFree(const jsonAllocator* a, void* ptr, size_t size)
+{
+	if (ptr)
+	{
+		a->Free(a->userData, ptr, size);
+	}
+}
+
+enum readerState {
+	READER_VALUE,
+	READER_FIRST_VALUE,
+	READER_KEY,
+	READER_FIRST_KEY,
+	READER_NEXT
+};
+
+struct gatherState;
+
 struct parserContext {
 	const char* json;
 	char* stack;
 	size_t size, top;
+	readerState state; // jsonReader only, open scopes are the '[' / '{' bytes on the stack
+	jsonStats* stats;
+	size_t maxDepth; // open arrays and objects allowed in one value, 0 for no limit
+	unsigned flags;  // parseFlag
+	const jsonAllocator* alloc;
+	size_t trimSize; // scratch kept between calls by reusable contexts
+	gatherState* gather = nullptr; // StringifyIovec() only
 
 	~parserContext()
 	{
-		free(this->stack);
+		JsonFree(this->alloc, this->stack, this->size);
+	}
+
+	void* Malloc(size_t sz)
+	{
+		STATS_ALLOC(this, sz);
+		return JsonMalloc(this->alloc, sz);
 	}
 
 	// return old top
@@ -29,18 +171,20 @@ struct parserContext {
 		char* ret;
 
 		if (this->top + sz >= this->size) {
+			size_t oldSize = this->size;
 			if (this->size == 0) {
 				this->size = STACK_INIT_SIZE;
 			}
 			while (this->top + sz >= this->size) {
 				this->size += this->size >> 1;
 			}
-			void* ptr = realloc(this->stack, this->size);
-			assert(ptr);
-			this->stack = (char*)ptr;
+			this->stack = (char*)JsonRealloc(this->alloc, this->stack, oldSize, this->size);
+			STATS_ALLOC(this, this->size);
+			STATS(this, this->stats->stackGrowths++);
 		}
 		ret = this->stack + this->top;
 		this->top += sz;
+		STATS(this, if (this->top > this->stats->peakStack) this->stats->peakStack = this->top);
 
 		return ret;
 	}
@@ -60,626 +204,6703 @@ struct parserContext {
 		assert(this->top >= sz);
 		return this->stack + (this->top -= sz);
 	}
+
+	// empties the stack and gives back whatever it grew beyond trimSize
+	void Trim()
+	{
+		this->top = 0;
+		if (this->size > this->trimSize) {
+			if (this->trimSize == 0) {
+				JsonFree(this->alloc, this->stack, this->size);
+				this->stack = nullptr;
+			}
+			else {
+				this->stack = (char*)JsonRealloc(this->alloc, this->stack, this->size, this->trimSize);
+			}
+			this->size = this->trimSize;
+		}
+	}
 };
 
-static parseStatus ParseValue(parserContext* c, jsonValue* v);
+// scratch for ParseJsonString() and Stringify() on this thread, zero-initialized
+static thread_local parserContext threadScratch;
 
-void InitValue(jsonValue* v)
+// the thread's warm context when alloc is the built-in one, otherwise the caller's local one
+static parserContext* ScratchContext(const jsonAllocator* alloc, parserContext* local)
 {
-	v->type = TYPE_NULL;
+	local->stack = nullptr;
+	local->size = local->top = 0;
+	local->alloc = alloc;
+	local->trimSize = 0;
+	local->maxDepth = PARSE_MAX_DEPTH;
+	local->flags = 0;
+	if (alloc != &mallocAllocator) {
+		return local;
+	}
+	if (!threadScratch.alloc) {
+		threadScratch.alloc = &mallocAllocator;
+		threadScratch.trimSize = SCRATCH_TRIM_SIZE;
+		threadScratch.maxDepth = PARSE_MAX_DEPTH;
+	}
+	return &threadScratch;
 }
 
-void FreeValue(jsonValue* v)
-{
-	assert(v);
-	switch (v->type)
+struct walkFrame {
+	const jsonValue* v;
+	size_t next; // index of the next child to visit
+};
+
+// open arrays and objects of a depth-first walk, on the C stack until it gets deep
+template <class Frame>
+struct walkStack {
+	Frame* frames;
+	size_t top, size;
+	const jsonAllocator* alloc;
+	Frame local[WALK_STACK_INIT_SIZE];
+
+	walkStack(const jsonAllocator* a) : frames(local), top(0), size(WALK_STACK_INIT_SIZE), alloc(a) {}
+
+	~walkStack()
 	{
-		case TYPE_STRING:
-			free(v->str.s);
-			break;
-		case TYPE_ARRAY:
-			for (size_t i = 0; i < v->arr.size; i++)
-			{
-				FreeValue(&v->arr.values[i]);
-			}
-			free(v->arr.values);
-			break;
-		case TYPE_OBJECT:
-			for (size_t i = 0; i < v->obj.size; i++)
-			{
-				free(v->obj.maps[i].key);
-				FreeValue(&v->obj.maps[i].value);
+		if (this->frames != this->local) {
+			JsonFree(this->alloc, this->frames, this->size * sizeof(Frame));
+		}
+	}
+
+	// the new frame is left for the caller to fill in
+	Frame* Push()
+	{
+		if (this->top == this->size) {
+			Frame* frames = (Frame*)JsonMalloc(this->alloc, this->size * 2 * sizeof(Frame));
+			memcpy(frames, this->frames, this->size * sizeof(Frame));
+			if (this->frames != this->local) {
+				JsonFree(this->alloc, this->frames, this->size * sizeof(Frame));
 			}
-			free(v->obj.maps);
-			break;
-	default:
-		break;
+			this->frames = frames;
+			this->size *= 2;
+		}
+		return &this->frames[this->top++];
 	}
+};
 
-	v->type = TYPE_NULL;
-}
+enum blockState {
+	BLOCK_DIRTY = 1, // something below changed since the last Stringify()
+	BLOCK_STALE = 2, // moved since, the offsets below refer to another output
+	BLOCK_HASHED = 4 // hash is current, and so are the hashes of the headers below
+};
+
+/*
+ * Precedes the element block of a VALUE_CACHED array or object and remembers
+ * where the container was in the last output. Its children carry their index
+ * in the slot bits of their flags, which is how a setter finds this header and
+ * marks it, and every header above it, dirty. HashValue() keeps its result
+ * here as well.
+ */
+struct blockHeader {
+	blockHeader* parent;         // header of the block this container sits in
+	const jsonAllocator* alloc;
+	char* json;                  // topmost cached container only: the last output
+	size_t offset;               // fragment start, relative to the parent's fragment
+	size_t len;                  // fragment length, and the size of json
+	size_t hash;
+	unsigned state;              // blockState
+};
 
-void SetValueString(jsonValue* v, const char* s, size_t len)
+// packed arrays hold no jsonValues and are treated as leaves
+static inline bool IsContainer(const jsonValue* v)
 {
-	assert(v && (s || len == 0));
-	FreeValue(v);
-	v->str.s = (char*)malloc(len + 1);
-	memcpy(v->str.s, s, len);
-	v->str.s[len] = '\0';
-	v->str.len = len;
-	v->type = TYPE_STRING;
+	return (v->type == TYPE_ARRAY && !(v->flags & VALUE_PACKED)) || v->type == TYPE_OBJECT;
 }
 
-static void ParseWhitespace(parserContext* c) {
-	const char* p = c->json;
-	while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')
-		p++;
-	c->json = p;
+static inline bool IsPacked(const jsonValue* v)
+{
+	return v->type == TYPE_ARRAY && (v->flags & VALUE_PACKED);
 }
 
-static const char* ParseHex4(const char* p, unsigned* u)
+// precedes the doubles of a VALUE_PACKED array, so that GetValueArrayElement() can unpack it
+struct packedHeader {
+	const jsonAllocator* alloc;
+};
+
+static double* NewPacked(const jsonAllocator* alloc, size_t size)
 {
-	*u = 0;
-	for (int i = 0; i < 4; i++) {
-		char c = *p;
-		p++;
-		*u <<= 4;
-		if (c >= '0' && c <= '9') {
-			*u |= c - '0';
-		}
-		else if (c >= 'A' && c <= 'F') {
-			*u |= c - ('A' - 10);
-		}
-		else if (c >= 'a' && c <= 'f') {
-			*u |= c - ('a' - 10);
-		}
-		else return nullptr;
-	}
-	return p;
+	packedHeader* h = (packedHeader*)JsonMalloc(alloc, sizeof(packedHeader) + size * sizeof(double));
+	h->alloc = alloc;
+	return (double*)(h + 1);
 }
 
-static void EncodeUtf8(parserContext* c, unsigned u) {
-	if (u <= 0x7F)
-		c->PushChar(u & 0xff);
-	else if (u <= 0x7FF) {
-		c->PushChar(0xC0 | ((u >> 6) & 0xFF));
-		c->PushChar(0x80 | (u & 0x3F));
-	}
-	else if (u <= 0xFFFF) {
-		c->PushChar(0xE0 | ((u >> 12) & 0xFF));
-		c->PushChar(0x80 | ((u >> 6) & 0x3F));
-		c->PushChar(0x80 | (u & 0x3F));
-	}
-	else {
-		assert(u <= 0x10FFFF);
-		c->PushChar(0xF0 | ((u >> 18) & 0xFF));
-		c->PushChar(0x80 | ((u >> 12) & 0x3F));
-		c->PushChar(0x80 | ((u >> 6) & 0x3F));
-		c->PushChar(0x80 | (u & 0x3F));
+static void FreePacked(const jsonValue* v, const jsonAllocator* alloc)
+{
+	if (!(v->flags & VALUE_FIXED))
+	{
+		JsonFree(alloc, (packedHeader*)v->nums.values - 1, sizeof(packedHeader) + v->nums.size * sizeof(double));
 	}
 }
 
-static parseStatus ParseStringRaw(parserContext* c, char** str, size_t& len)
+// starts the block of a CompactValue() tree, the payload of its root comes right after
+struct alignas(jsonValue) compactHeader {
+	size_t size;
+};
+
+static compactHeader* CompactBlock(const jsonValue* v)
 {
-	assert(*c->json == '\"');
-	c->json++;
+	assert(v->flags & VALUE_COMPACT);
+	const void* payload;
+	if (IsPacked(v))
+		payload = (packedHeader*)v->nums.values - 1;
+	else if (v->type == TYPE_ARRAY)
+		payload = v->arr.values;
+	else if (v->type == TYPE_OBJECT)
+		payload = v->obj.maps;
+	else
+		payload = v->str.s;
+	return (compactHeader*)payload - 1;
+}
 
-	size_t head = c->top;
+// starts the block of a ShareValue() container: its elements, then their keys and text
+struct alignas(jsonValue) sharedHeader {
+	std::atomic<size_t> refs;
+	size_t size;
+	const jsonAllocator* alloc;
+};
 
-	const char* p = c->json;
-	while (1) {
-		char ch = *(p++);
-		switch (ch) {
-		case '\\':
-			switch (*(p++)) {
-			case 'n':  c->PushChar('\n'); break;
-			case '\"': c->PushChar('\"'); break;
-			case '\\': c->PushChar('\\'); break;
-			case '/':  c->PushChar('/');  break;
-			case 'b':  c->PushChar('\b'); break;
-			case 'f':  c->PushChar('\f'); break;
-			case 'r':  c->PushChar('\r'); break;
-			case 't':  c->PushChar('\t'); break;
-			case 'u':
-			{
-				unsigned H = 0, L = 0, codePoint = 0;
-				if (!(p = ParseHex4(p, &H)))
-					STRING_ERROR(PARSE_ERR_INVALID_UNICODE_HEX);
-				if (H >= 0xD800 && H <= 0xDBFF) { /* surrogate pair */
-					if (*p++ != '\\')
-						STRING_ERROR(PARSE_ERR_INVALID_UNICODE_SURROGATE);
-					if (*p++ != 'u')
-						STRING_ERROR(PARSE_ERR_INVALID_UNICODE_SURROGATE);
-					if (!(p = ParseHex4(p, &L)))
-						STRING_ERROR(PARSE_ERR_INVALID_UNICODE_HEX);
-					if (L < 0xDC00 || L > 0xDFFF)
-						STRING_ERROR(PARSE_ERR_INVALID_UNICODE_SURROGATE);
-					codePoint = (((H - 0xD800) << 10) | (L - 0xDC00)) + 0x10000;
-					//EncodeUtf8(c, codePoint);
-				}
-				else {
-					codePoint = H;
-				}
-				EncodeUtf8(c, codePoint);
-				break;
-			}
-			default:
-				STRING_ERROR(PARSE_ERR_INVALID_ESCAPE_CHAR);
-			}
-			break;
-		case '\"':
-			len = c->top - head;
-			c->json = p;
-			*str = (char*)c->Pop(len);
-			return PARSE_OK;
-		case '\0':
-			STRING_ERROR(PARSE_ERR_MISS_QUOTATION_MARK);
-		default:
-			// if ch is control characters
-			if ((unsigned char)ch < 0x20) {
-				STRING_ERROR(PARSE_ERR_CONTROL_CHAR);
-			}
-			c->PushChar(ch);
-		}
-	}
+static inline sharedHeader* SharedBlock(const jsonValue* v)
+{
+	assert(IsContainer(v) && (v->flags & VALUE_SHARED));
+	return (sharedHeader*)(v->type == TYPE_ARRAY ? (void*)v->arr.values : (void*)v->obj.maps) - 1;
 }
 
-static parseStatus ParseString(parserContext* c, jsonValue* v)
+static inline void RetainShared(const jsonValue* v)
 {
-	parseStatus ret;
-
-	char* s;
-	size_t len;
-	if ((ret = ParseStringRaw(c, &s, len)) == PARSE_OK) {
-		SetValueString(v, s, len);
-	}
-	return ret;
+	SharedBlock(v)->refs.fetch_add(1, std::memory_order_relaxed);
 }
 
-static parseStatus ParseObject(parserContext* c, jsonValue* v)
+static inline bool DropShared(const jsonValue* v)
 {
-	assert(*c->json == '{');
-	c->json++;
-
-	parseStatus ret = PARSE_OK;
-	size_t size = 0;
-	jsonMap m;
-	m.key = nullptr;
+	return SharedBlock(v)->refs.fetch_sub(1, std::memory_order_acq_rel) == 1;
+}
 
-	ParseWhitespace(c);
-	if (*c->json == '}')
+// the last reference releases the references the elements hold, then the block;
+// blocks losing their last reference on the way are walked without recursion
+static void ReleaseShared(const jsonValue* v)
+{
+	if (!DropShared(v))
 	{
-		c->json++;
-		v->type = TYPE_OBJECT;
-		v->obj.maps = nullptr;
-		v->obj.size = 0;
-		return PARSE_OK;
+		return;
 	}
-
-	while (1)
+	walkStack<walkFrame> s(SharedBlock(v)->alloc);
+	*s.Push() = { v, 0 };
+	while (s.top)
 	{
-		InitValue(&m.value);
-
-		char* str;
-
-		if (*c->json != '"')
-		{
-			ret = PARSE_ERR_MISS_KEY;
-			break;
-		}
-		if ((ret = ParseStringRaw(c, &str, m.keyLen)) != PARSE_OK)
+		walkFrame* f = &s.frames[s.top - 1];
+		const jsonValue* p = f->v;
+		bool array = p->type == TYPE_ARRAY;
+		size_t size = array ? p->arr.size : p->obj.size;
+		const jsonValue* child = nullptr;
+		while (!child && f->next < size)
 		{
-			break;
+			const jsonValue* e = array ? &p->arr.values[f->next] : &p->obj.maps[f->next].value;
+			f->next++;
+			if ((e->flags & VALUE_SHARED) && DropShared(e))
+			{
+				child = e;
+			}
 		}
-		void* ptr = realloc(m.key, m.keyLen + 1);
-		assert(ptr);
-		m.key = (char*)ptr;
-		memcpy(m.key, str, m.keyLen);
-		m.key[m.keyLen] = '\0';
-
-		ParseWhitespace(c);
-		if (*c->json != ':')
+		if (child)
 		{
-			ret = PARSE_ERR_MISS_COLON;
-			break;
+			*s.Push() = { child, 0 };
 		}
-
-		c->json++;
-		ParseWhitespace(c);
-
-		if ((ret = ParseValue(c, &m.value)) != PARSE_OK)
+		else
 		{
-			break;
+			sharedHeader* h = SharedBlock(p);
+			const jsonAllocator* alloc = h->alloc;
+			size_t bytes = h->size;
+			h->~sharedHeader();
+			JsonFree(alloc, h, bytes);
+			s.top--;
 		}
-		memcpy(c->PushSz(sizeof(jsonMap)), &m, sizeof(jsonMap));
+	}
+}
 
-		size++;
-		m.key = nullptr;
+static inline blockHeader* BlockHeader(const jsonValue* v)
+{
+	assert(IsContainer(v) && (v->flags & VALUE_CACHED));
+	return (blockHeader*)(v->type == TYPE_ARRAY ? (void*)v->arr.values : (void*)v->obj.maps) - 1;
+}
 
-		ParseWhitespace(c);
+// the header of the block v sits in, v must carry SLOT_BIT
+static inline blockHeader* SlotHeader(const jsonValue* v)
+{
+	size_t index = v->flags >> SLOT_INDEX_SHIFT;
+	if (v->flags & SLOT_IN_OBJECT)
+	{
+		const jsonMap* m = (const jsonMap*)((const char*)v - offsetof(jsonMap, value));
+		return (blockHeader*)(m - index) - 1;
+	}
+	return (blockHeader*)(v - index) - 1;
+}
 
-		if (*c->json == ',')
-		{
-			c->json++;
-			ParseWhitespace(c);
-		}
-		else if (*c->json == '}')
-		{
-			size_t copySz = sizeof(jsonMap) * size;
-			c->json++;
-			v->type = TYPE_OBJECT;
-			v->obj.size = size;
-			memcpy(v->obj.maps = (jsonMap*)malloc(copySz), c->Pop(copySz), copySz);
-			return PARSE_OK;
-		}
-		else
+// stops at the first header that is already dirty and unhashed, all above it are too
+static void MarkDirty(const jsonValue* v)
+{
+	if (v->flags & SLOT_BIT)
+	{
+		for (blockHeader* h = SlotHeader(v); h && (h->state & (BLOCK_DIRTY | BLOCK_HASHED)) != BLOCK_DIRTY; h = h->parent)
 		{
-			ret = PARSE_ERR_MISS_COMMA_OR_CURLY_BRACKET;
-			break;
+			h->state = (h->state | BLOCK_DIRTY) & ~BLOCK_HASHED;
 		}
 	}
+}
 
-	free(m.key);
-	for (size_t i = 0; i < size; i++)
+// v now sits somewhere else: if it is cached, link it to its new parent and forget its fragments
+static void AttachValue(jsonValue* v)
+{
+	MarkDirty(v);
+	if (IsContainer(v) && (v->flags & VALUE_CACHED))
 	{
-		jsonMap* m = (jsonMap*)c->Pop(sizeof(jsonMap));
-		free(m->key);
-		FreeValue(&m->value);
+		blockHeader* h = BlockHeader(v);
+		JsonFree(h->alloc, h->json, h->len);
+		h->json = nullptr;
+		h->parent = (v->flags & SLOT_BIT) ? SlotHeader(v) : nullptr;
+		h->state = BLOCK_DIRTY | BLOCK_STALE | (h->state & BLOCK_HASHED);
 	}
-	v->type = TYPE_NULL;
-
-	return ret;
 }
 
-static parseStatus ParseLiteral(parserContext* c, jsonValue* v, const char* literal, valueType type)
+// the element block of p, with its header if it has one
+static void FreeBlock(const jsonValue* p, const jsonAllocator* alloc)
 {
-	assert(*c->json == literal[0]);
-	c->json++;
+	if (p->flags & VALUE_FIXED)
+	{
+		return;
+	}
+	size_t size = p->type == TYPE_ARRAY ? p->arr.size * sizeof(jsonValue) : p->obj.size * sizeof(jsonMap);
+	void* block = p->type == TYPE_ARRAY ? (void*)p->arr.values : (void*)p->obj.maps;
+	if (p->flags & VALUE_CACHED)
+	{
+		blockHeader* h = BlockHeader(p);
+		JsonFree(h->alloc, h->json, h->len);
+		block = h;
+		size += sizeof(blockHeader);
+	}
+	JsonFree(alloc, block, size);
+}
 
-	size_t i;
+static parseStatus ParseValue(parserContext* c, jsonValue* v);
+
+void InitValue(jsonValue* v)
+{
+	v->type = TYPE_NULL;
+	v->flags = 0;
+}
+
+// the str payload of strings and raw numbers; borrowed slices belong to the
+// source text, lazily decoded ones to the default allocator
+static inline bool HasText(const jsonValue* v)
+{
+	return v->type == TYPE_STRING || (v->flags & VALUE_RAW);
+}
+
+static inline void FreeString(const jsonValue* v, const jsonAllocator* alloc)
+{
+	if (v->flags & (VALUE_BORROWED | VALUE_FIXED))
+	{
+		return;
+	}
+	JsonFree(alloc, v->str.s, v->str.len + 1);
+}
+
+// a container's block is released after all of its children, without recursion;
+// a compacted tree is still walked for the payloads given to it since
+void FreeValue(jsonValue* v, const jsonAllocator* alloc)
+{
+	assert(v);
+	alloc = ResolveAllocator(alloc);
+	MarkDirty(v);
+	compactHeader* compact = (v->flags & VALUE_COMPACT) ? CompactBlock(v) : nullptr;
+	if (HasText(v))
+	{
+		FreeString(v, alloc);
+	}
+	else if (IsPacked(v))
+	{
+		FreePacked(v, alloc);
+	}
+	else if (v->flags & VALUE_SHARED)
+	{
+		ReleaseShared(v);
+	}
+	else if (v->type == TYPE_ARRAY || v->type == TYPE_OBJECT)
+	{
+		walkStack<walkFrame> s(alloc);
+		*s.Push() = { v, 0 };
+		while (s.top)
+		{
+			walkFrame* f = &s.frames[s.top - 1];
+			const jsonValue* p = f->v;
+			const jsonValue* child = nullptr;
+			if (p->type == TYPE_ARRAY)
+			{
+				while (!child && f->next < p->arr.size)
+				{
+					const jsonValue* e = &p->arr.values[f->next++];
+					if (e->flags & (VALUE_COMPACT | VALUE_SHARED))
+						FreeValue(const_cast<jsonValue*>(e), alloc); // a compacted tree moved in, or a shared reference
+					else if (HasText(e))
+						FreeString(e, alloc);
+					else if (IsPacked(e))
+						FreePacked(e, alloc);
+					else if (e->type == TYPE_ARRAY || e->type == TYPE_OBJECT)
+						child = e;
+				}
+				if (!child)
+					FreeBlock(p, alloc);
+			}
+			else
+			{
+				while (!child && f->next < p->obj.size)
+				{
+					const jsonMap* m = &p->obj.maps[f->next++];
+					if (!(p->flags & (VALUE_BORROWED | VALUE_FIXED)))
+						JsonFree(alloc, m->key, m->keyLen + 1);
+					if (m->value.flags & (VALUE_COMPACT | VALUE_SHARED))
+						FreeValue(&const_cast<jsonMap*>(m)->value, alloc);
+					else if (HasText(&m->value))
+						FreeString(&m->value, alloc);
+					else if (IsPacked(&m->value))
+						FreePacked(&m->value, alloc);
+					else if (m->value.type == TYPE_ARRAY || m->value.type == TYPE_OBJECT)
+						child = &m->value;
+				}
+				if (!child)
+					FreeBlock(p, alloc);
+			}
+			if (child)
+				*s.Push() = { child, 0 };
+			else
+				s.top--;
+		}
+	}
+	if (compact)
+	{
+		JsonFree(alloc, compact, compact->size);
+	}
+
+	v->type = TYPE_NULL;
+	v->flags &= SLOT_MASK;
+}
+
+static size_t DecodeString(const char* p, size_t len, char* out);
+
+// raw length of an escaped lazy string, whose len holds its allocator instead
+static inline size_t RawLength(const jsonValue* v)
+{
+	const char* p = v->lazy.raw;
+	while (*p != '"')
+	{
+		p += (*p == '\\') ? 2 : 1;
+	}
+	return p - v->lazy.raw;
+}
+
+// decoded length of the str payload
+static inline size_t TextLength(const jsonValue* v)
+{
+	return (v->flags & VALUE_ESCAPED) ? DecodeString(v->lazy.raw, RawLength(v), nullptr) : v->str.len;
+}
+
+struct copyFrame {
+	const jsonValue* src;
+	jsonValue* dst;
+	size_t next;
+};
+
+// dst is uninitialized storage and gets src with its own payload and keys copied, true when
+// the elements are left to the caller; a shared src is referenced unless share is false
+static bool CopyPayload(jsonValue* dst, const jsonValue* src, const jsonAllocator* alloc, bool share)
+{
+	if (share && (src->flags & VALUE_SHARED))
+	{
+		RetainShared(src);
+		memcpy(dst, src, sizeof(jsonValue));
+		dst->flags = VALUE_SHARED;
+		return false;
+	}
+	bool elements = false;
+	switch (src->type)
+	{
+		case TYPE_STRING:
+			if (src->flags & VALUE_ESCAPED)
+			{
+				size_t raw = RawLength(src);
+				dst->str.len = DecodeString(src->lazy.raw, raw, nullptr);
+				dst->str.s = (char*)JsonMalloc(alloc, dst->str.len + 1);
+				DecodeString(src->lazy.raw, raw, dst->str.s);
+			}
+			else
+			{
+				dst->str.len = src->str.len;
+				dst->str.s = (char*)JsonMalloc(alloc, src->str.len + 1);
+				memcpy(dst->str.s, src->str.s, src->str.len);
+			}
+			dst->str.s[dst->str.len] = '\0';
+			break;
+		case TYPE_ARRAY:
+			dst->arr.size = src->arr.size;
+			dst->arr.values = nullptr;
+			if (src->flags & VALUE_PACKED)
+			{
+				dst->nums.values = NewPacked(alloc, src->nums.size);
+				memcpy(dst->nums.values, src->nums.values, src->nums.size * sizeof(double));
+			}
+			else if (src->arr.size)
+			{
+				dst->arr.values = (jsonValue*)JsonMalloc(alloc, src->arr.size * sizeof(jsonValue));
+				elements = true;
+			}
+			break;
+		case TYPE_OBJECT:
+			dst->obj.size = src->obj.size;
+			dst->obj.maps = nullptr;
+			if (src->obj.size)
+			{
+				dst->obj.maps = (jsonMap*)JsonMalloc(alloc, src->obj.size * sizeof(jsonMap));
+				for (size_t i = 0; i < src->obj.size; i++)
+				{
+					const jsonMap* s = &src->obj.maps[i];
+					jsonMap* d = &dst->obj.maps[i];
+					d->key = (char*)JsonMalloc(alloc, s->keyLen + 1);
+					memcpy(d->key, s->key, s->keyLen);
+					d->key[s->keyLen] = '\0';
+					d->keyLen = s->keyLen;
+				}
+				elements = true;
+			}
+			break;
+		case TYPE_NUMBER:
+			if (src->flags & VALUE_RAW)
+			{
+				dst->str.len = src->str.len;
+				dst->str.s = (char*)JsonMalloc(alloc, src->str.len + 1);
+				memcpy(dst->str.s, src->str.s, src->str.len);
+				dst->str.s[src->str.len] = '\0';
+			}
+			else
+			{
+				dst->num = src->num;
+			}
+			break;
+	default:
+		break;
+	}
+
+	dst->type = src->type;
+	dst->flags = src->flags & (VALUE_RAW | VALUE_PACKED); // copies always own their payload
+	return elements;
+}
+
+// dst is uninitialized storage; a shared src is referenced unless share is false,
+// then only its own level is copied and its members are referenced
+static void CopyValueRaw(jsonValue* dst, const jsonValue* src, const jsonAllocator* alloc, bool share = true)
+{
+	if (!CopyPayload(dst, src, alloc, share))
+	{
+		return;
+	}
+	walkStack<copyFrame> s(alloc);
+	*s.Push() = { src, dst, 0 };
+	while (s.top)
+	{
+		copyFrame* f = &s.frames[s.top - 1];
+		bool array = f->src->type == TYPE_ARRAY;
+		size_t size = array ? f->src->arr.size : f->src->obj.size;
+		const jsonValue* e = nullptr;
+		jsonValue* d = nullptr;
+		while (!e && f->next < size)
+		{
+			size_t i = f->next++;
+			const jsonValue* child = array ? &f->src->arr.values[i] : &f->src->obj.maps[i].value;
+			jsonValue* copy = array ? &f->dst->arr.values[i] : &f->dst->obj.maps[i].value;
+			if (CopyPayload(copy, child, alloc, true))
+			{
+				e = child;
+				d = copy;
+			}
+		}
+		if (e)
+		{
+			*s.Push() = { e, d, 0 };
+		}
+		else
+		{
+			s.top--;
+		}
+	}
+}
+
+// slot bits stay where they are in the three functions below, only the values move;
+// src is taken before dst is freed, so it may sit anywhere inside dst
+
+void CopyValue(jsonValue* dst, const jsonValue* src, const jsonAllocator* alloc)
+{
+	assert(dst && src && dst != src);
+	alloc = ResolveAllocator(alloc);
+	jsonValue copy;
+	CopyValueRaw(&copy, src, alloc);
+	FreeValue(dst, alloc);
+	unsigned slot = dst->flags;
+	memcpy(dst, &copy, sizeof(jsonValue));
+	dst->flags |= slot;
+}
+
+void MoveValue(jsonValue* dst, jsonValue* src, const jsonAllocator* alloc)
+{
+	assert(dst && src && dst != src);
+	jsonValue moved;
+	memcpy(&moved, src, sizeof(jsonValue));
+	src->type = TYPE_NULL;
+	src->flags &= SLOT_MASK;
+	MarkDirty(src);
+	FreeValue(dst, alloc);
+	unsigned slot = dst->flags;
+	memcpy(dst, &moved, sizeof(jsonValue));
+	dst->flags = (moved.flags & ~SLOT_MASK) | slot;
+	AttachValue(dst);
+}
+
+void SwapValue(jsonValue* lhs, jsonValue* rhs)
+{
+	assert(lhs && rhs);
+	if (lhs != rhs)
+	{
+		unsigned lslot = lhs->flags & SLOT_MASK, rslot = rhs->flags & SLOT_MASK;
+		jsonValue temp;
+		memcpy(&temp, lhs, sizeof(jsonValue));
+		memcpy(lhs, rhs, sizeof(jsonValue));
+		memcpy(rhs, &temp, sizeof(jsonValue));
+		lhs->flags = (lhs->flags & ~SLOT_MASK) | lslot;
+		rhs->flags = (rhs->flags & ~SLOT_MASK) | rslot;
+		AttachValue(lhs);
+		AttachValue(rhs);
+	}
+}
+
+// adds v's own payload to out, sizes of the bytes that sit in a compact block go to *fixed as well
+static void MeasurePayload(const jsonValue* v, jsonFootprint* out, size_t* fixed)
+{
+	size_t* category;
+	size_t bytes, header = 0;
+	if (HasText(v))
+	{
+		if (v->flags & VALUE_BORROWED)
+		{
+			return;
+		}
+		category = &out->strings;
+		bytes = v->str.len + 1;
+	}
+	else if (IsPacked(v))
+	{
+		category = &out->arrays;
+		bytes = v->nums.size * sizeof(double);
+		header = sizeof(packedHeader);
+	}
+	else if (IsContainer(v) && (v->type == TYPE_ARRAY ? v->arr.values : (void*)v->obj.maps))
+	{
+		bool array = v->type == TYPE_ARRAY;
+		category = array ? &out->arrays : &out->objects;
+		bytes = array ? v->arr.size * sizeof(jsonValue) : v->obj.size * sizeof(jsonMap);
+		if (v->flags & VALUE_SHARED)
+		{
+			header = sizeof(sharedHeader);
+		}
+		else if (v->flags & VALUE_CACHED)
+		{
+			blockHeader* h = BlockHeader(v);
+			header = sizeof(blockHeader);
+			if (h->json)
+			{
+				out->overhead += h->len;
+				out->allocations++;
+			}
+		}
+	}
+	else
+	{
+		return;
+	}
+	*category += bytes;
+	out->overhead += header;
+	if (v->flags & VALUE_FIXED)
+		*fixed += bytes + header;
+	else
+		out->allocations++;
+}
+
+void MeasureValue(const jsonValue* v, jsonFootprint* out)
+{
+	assert(v && out);
+	walkStack<walkFrame> s(defaultAllocator);
+	size_t fixed = 0;
+	memset(out, 0, sizeof(jsonFootprint));
+	MeasurePayload(v, out, &fixed);
+	if (IsContainer(v))
+	{
+		*s.Push() = { v, 0 };
+	}
+	while (s.top)
+	{
+		walkFrame* f = &s.frames[s.top - 1];
+		const jsonValue* p = f->v;
+		const jsonValue* e;
+		if (f->next == (p->type == TYPE_ARRAY ? p->arr.size : p->obj.size))
+		{
+			s.top--;
+			continue;
+		}
+		if (p->type == TYPE_ARRAY)
+		{
+			e = &p->arr.values[f->next++];
+		}
+		else
+		{
+			const jsonMap* m = &p->obj.maps[f->next++];
+			e = &m->value;
+			if (!(p->flags & VALUE_BORROWED))
+			{
+				out->keys += m->keyLen + 1;
+				if (p->flags & (VALUE_FIXED | VALUE_SHARED))
+					fixed += m->keyLen + 1;
+				else
+					out->allocations++;
+			}
+		}
+		if (e->flags & (VALUE_COMPACT | VALUE_SHARED))
+		{
+			jsonFootprint sub; // a compacted tree moved in, or a shared one, with blocks of its own
+			MeasureValue(e, &sub);
+			out->strings += sub.strings;
+			out->keys += sub.keys;
+			out->arrays += sub.arrays;
+			out->objects += sub.objects;
+			out->overhead += sub.overhead;
+			out->allocations += sub.allocations;
+			continue;
+		}
+		MeasurePayload(e, out, &fixed);
+		if (IsContainer(e))
+		{
+			*s.Push() = { e, 0 };
+		}
+	}
+	if (v->flags & VALUE_COMPACT)
+	{
+		// the header, alignment, and whatever the tree has replaced since
+		out->overhead += CompactBlock(v)->size - fixed;
+		out->allocations++;
+	}
+}
+
+struct compactFrame {
+	const jsonValue* src;
+	jsonValue* dst; // nullptr while measuring
+	size_t next;
+};
+
+// reserves size bytes at *used, nullptr while measuring
+static inline char* CompactPlace(char* base, size_t* used, size_t size, size_t align)
+{
+	size_t at = (*used + align - 1) & ~(align - 1);
+	*used = at + size;
+	return base ? base + at : nullptr;
+}
+
+// dst gets src with its own payload copied into base, the elements of a container are left to the caller
+static void CompactPayload(jsonValue* dst, const jsonValue* src, char* base, size_t* used, const jsonAllocator* alloc)
+{
+	if (base)
+	{
+		memcpy(dst, src, sizeof(jsonValue));
+		dst->flags = (src->flags & (VALUE_RAW | VALUE_PACKED)) | VALUE_FIXED;
+	}
+	if (HasText(src))
+	{
+		bool escaped = (src->flags & VALUE_ESCAPED) != 0;
+		size_t len = TextLength(src);
+		char* s = CompactPlace(base, used, len + 1, 1);
+		if (s)
+		{
+			if (escaped)
+				DecodeString(src->lazy.raw, RawLength(src), s);
+			else
+				memcpy(s, src->str.s, len);
+			s[len] = '\0';
+			dst->str.s = s;
+			dst->str.len = len;
+		}
+	}
+	else if (IsPacked(src))
+	{
+		size_t bytes = src->nums.size * sizeof(double);
+		packedHeader* h = (packedHeader*)CompactPlace(base, used, sizeof(packedHeader) + bytes, alignof(jsonValue));
+		if (h)
+		{
+			h->alloc = alloc;
+			dst->nums.values = (double*)(h + 1);
+			memcpy(dst->nums.values, src->nums.values, bytes);
+		}
+	}
+	else if (IsContainer(src) && (src->type == TYPE_ARRAY ? src->arr.size : src->obj.size))
+	{
+		bool array = src->type == TYPE_ARRAY;
+		char* block = CompactPlace(base, used, array ? src->arr.size * sizeof(jsonValue) : src->obj.size * sizeof(jsonMap), alignof(jsonValue));
+		if (block && array)
+			dst->arr.values = (jsonValue*)block;
+		else if (block)
+			dst->obj.maps = (jsonMap*)block;
+	}
+}
+
+// lays src out from *used on: a container's elements, then per element its key and everything below it
+static void CompactTree(jsonValue* dst, const jsonValue* src, char* base, size_t* used, const jsonAllocator* alloc)
+{
+	walkStack<compactFrame> s(alloc);
+	CompactPayload(dst, src, base, used, alloc);
+	if (IsContainer(src))
+	{
+		*s.Push() = { src, dst, 0 };
+	}
+	while (s.top)
+	{
+		compactFrame* f = &s.frames[s.top - 1];
+		const jsonValue* p = f->src;
+		size_t i = f->next++;
+		const jsonValue* e;
+		jsonValue* d = nullptr;
+		if (i == (p->type == TYPE_ARRAY ? p->arr.size : p->obj.size))
+		{
+			s.top--;
+			continue;
+		}
+		if (p->type == TYPE_ARRAY)
+		{
+			e = &p->arr.values[i];
+			if (base)
+				d = &f->dst->arr.values[i];
+		}
+		else
+		{
+			const jsonMap* m = &p->obj.maps[i];
+			char* key = CompactPlace(base, used, m->keyLen + 1, 1);
+			e = &m->value;
+			if (base)
+			{
+				jsonMap* dm = &f->dst->obj.maps[i];
+				memcpy(key, m->key, m->keyLen);
+				key[m->keyLen] = '\0';
+				dm->key = key;
+				dm->keyLen = m->keyLen;
+				d = &dm->value;
+			}
+		}
+		CompactPayload(d, e, base, used, alloc);
+		if (IsContainer(e))
+		{
+			*s.Push() = { e, d, 0 };
+		}
+	}
+}
+
+// measures the layout once, then copies into a block of exactly that size
+void CompactValue(jsonValue* v, const jsonAllocator* alloc)
+{
+	assert(v);
+	if ((v->flags & (VALUE_COMPACT | VALUE_FIXED)) == VALUE_FIXED)
+	{
+		return; // already inside a compacted tree
+	}
+	alloc = ResolveAllocator(alloc);
+	size_t size = sizeof(compactHeader);
+	CompactTree(nullptr, v, nullptr, &size, alloc);
+	if (size == sizeof(compactHeader))
+	{
+		return; // nothing on the heap
+	}
+
+	compactHeader* h = (compactHeader*)JsonMalloc(alloc, size);
+	size_t used = sizeof(compactHeader);
+	jsonValue compact;
+	h->size = size;
+	CompactTree(&compact, v, (char*)h, &used, alloc);
+	assert(used == size);
+
+	FreeValue(v, alloc);
+	unsigned slot = v->flags;
+	memcpy(v, &compact, sizeof(jsonValue));
+	v->flags |= VALUE_COMPACT | slot;
+}
+
+
+// a non-empty container not shared yet, which ShareTree() gives a block of its own
+static inline bool NeedsShareBlock(const jsonValue* v)
+{
+	return !(v->flags & VALUE_SHARED) && ((v->type == TYPE_ARRAY && v->arr.size) || (v->type == TYPE_OBJECT && v->obj.size));
+}
+
+struct shareFrame {
+	const jsonValue* src;
+	jsonValue* dst;
+	size_t next;
+};
+
+// dst is uninitialized storage; it gets a block with src's elements, keys and text,
+// and the elements needing a block of their own are left to the caller
+static void ShareLevel(jsonValue* dst, const jsonValue* src, const jsonAllocator* alloc)
+{
+	bool array = src->type == TYPE_ARRAY;
+	bool packed = IsPacked(src);
+	size_t size = array ? src->arr.size : src->obj.size;
+	size_t fixed = sizeof(sharedHeader) + (array ? size * sizeof(jsonValue) : size * sizeof(jsonMap));
+	size_t bytes = fixed;
+	for (size_t i = 0; i < size && !packed; i++)
+	{
+		const jsonValue* e = array ? &src->arr.values[i] : &src->obj.maps[i].value;
+		if (!array)
+		{
+			bytes += src->obj.maps[i].keyLen + 1;
+		}
+		if (HasText(e))
+		{
+			bytes += TextLength(e) + 1;
+		}
+	}
+
+	sharedHeader* h = new (JsonMalloc(alloc, bytes)) sharedHeader;
+	h->refs.store(1, std::memory_order_relaxed);
+	h->size = bytes;
+	h->alloc = alloc;
+	char* text = (char*)h + fixed;
+	for (size_t i = 0; i < size; i++)
+	{
+		jsonValue* d;
+		const jsonValue* e;
+		if (array)
+		{
+			d = (jsonValue*)(h + 1) + i;
+			e = packed ? nullptr : &src->arr.values[i];
+		}
+		else
+		{
+			const jsonMap* m = &src->obj.maps[i];
+			jsonMap* dm = (jsonMap*)(h + 1) + i;
+			memcpy(text, m->key, m->keyLen);
+			text[m->keyLen] = '\0';
+			dm->key = text;
+			dm->keyLen = m->keyLen;
+			text += m->keyLen + 1;
+			d = &dm->value;
+			e = &m->value;
+		}
+
+		if (!e)
+		{
+			d->type = TYPE_NUMBER;
+			d->flags = 0;
+			d->num = src->nums.values[i];
+		}
+		else if (HasText(e))
+		{
+			size_t len = TextLength(e);
+			if (e->flags & VALUE_ESCAPED)
+			{
+				DecodeString(e->lazy.raw, RawLength(e), text);
+			}
+			else
+			{
+				memcpy(text, e->str.s, len);
+			}
+			text[len] = '\0';
+			d->type = e->type;
+			d->flags = (e->flags & VALUE_RAW) | VALUE_FIXED;
+			d->str.s = text;
+			d->str.len = len;
+			text += len + 1;
+		}
+		else if (e->flags & VALUE_SHARED)
+		{
+			CopyValueRaw(d, e, alloc);
+		}
+		else if (NeedsShareBlock(e))
+		{
+			d->type = TYPE_NULL; // filled in by ShareTree()
+			d->flags = 0;
+		}
+		else
+		{
+			d->type = e->type;
+			d->flags = 0;
+			d->arr.values = nullptr; // empty containers own nothing
+			d->arr.size = 0;
+			if (e->type == TYPE_NUMBER)
+			{
+				d->num = e->num;
+			}
+		}
+	}
+	assert(text == (char*)h + bytes);
+
+	dst->type = src->type;
+	dst->flags = VALUE_SHARED;
+	if (array)
+		dst->arr.values = (jsonValue*)(h + 1);
+	else
+		dst->obj.maps = (jsonMap*)(h + 1);
+	dst->arr.size = size;
+}
+
+// src is a container NeedsShareBlock() accepts; every level gets its block before the ones below it
+static void ShareTree(jsonValue* dst, const jsonValue* src, const jsonAllocator* alloc)
+{
+	walkStack<shareFrame> s(alloc);
+	ShareLevel(dst, src, alloc);
+	*s.Push() = { src, dst, 0 };
+	while (s.top)
+	{
+		shareFrame* f = &s.frames[s.top - 1];
+		bool array = f->src->type == TYPE_ARRAY;
+		size_t size = IsPacked(f->src) ? 0 : array ? f->src->arr.size : f->src->obj.size;
+		const jsonValue* e = nullptr;
+		jsonValue* d = nullptr;
+		while (!e && f->next < size)
+		{
+			size_t i = f->next++;
+			const jsonValue* child = array ? &f->src->arr.values[i] : &f->src->obj.maps[i].value;
+			if (NeedsShareBlock(child))
+			{
+				e = child;
+				d = array ? &f->dst->arr.values[i] : &f->dst->obj.maps[i].value;
+			}
+		}
+		if (e)
+		{
+			ShareLevel(d, e, alloc);
+			*s.Push() = { e, d, 0 };
+		}
+		else
+		{
+			s.top--;
+		}
+	}
+}
+
+void ShareValue(jsonValue* v, const jsonAllocator* alloc)
+{
+	assert(v);
+	if (!NeedsShareBlock(v))
+	{
+		return; // already shared, or nothing to share
+	}
+	alloc = ResolveAllocator(alloc);
+	jsonValue shared;
+	ShareTree(&shared, v, alloc);
+	FreeValue(v, alloc);
+	unsigned slot = v->flags;
+	memcpy(v, &shared, sizeof(jsonValue));
+	v->flags |= slot;
+}
+
+jsonValue* UnshareValue(jsonValue* v, const jsonAllocator* alloc)
+{
+	assert(v);
+	if (v->flags & VALUE_SHARED)
+	{
+		jsonValue own;
+		CopyValueRaw(&own, v, ResolveAllocator(alloc), false);
+		ReleaseShared(v);
+		unsigned slot = v->flags & SLOT_MASK;
+		memcpy(v, &own, sizeof(jsonValue));
+		v->flags |= slot;
+	}
+	return v;
+}
+
+static bool PointerTokenEquals(const char* token, size_t tokenLen, const char* key, size_t keyLen);
+
+// path copying: each container on the way gets a level of its own, the siblings stay shared
+jsonValue* EditValue(jsonValue* root, const char* pointer, const jsonAllocator* alloc)
+{
+	assert(root && pointer);
+	if (*pointer && *pointer != '/')
+	{
+		return nullptr;
+	}
+	jsonValue* v = UnshareValue(root, alloc);
+	while (*pointer == '/')
+	{
+		const char* token = ++pointer;
+		while (*pointer && *pointer != '/')
+		{
+			pointer++;
+		}
+		size_t tokenLen = pointer - token;
+		jsonValue* next = nullptr;
+		if (v->type == TYPE_OBJECT)
+		{
+			for (size_t i = 0; i < v->obj.size && !next; i++)
+			{
+				if (PointerTokenEquals(token, tokenLen, v->obj.maps[i].key, v->obj.maps[i].keyLen))
+					next = &v->obj.maps[i].value;
+			}
+		}
+		else if (v->type == TYPE_ARRAY && tokenLen && (token[0] != '0' || tokenLen == 1))
+		{
+			// a decimal index without leading zeros, stopping as soon as it is out of range
+			size_t index = 0, i = 0;
+			while (i < tokenLen && ISDIGIT(token[i]) && (index = index * 10 + (token[i] - '0')) < v->arr.size)
+			{
+				i++;
+			}
+			if (i == tokenLen)
+				next = GetValueArrayElement(v, index);
+		}
+		if (!next)
+		{
+			return nullptr;
+		}
+		v = UnshareValue(next, alloc);
+	}
+	return v;
+}
+
+static inline uint64_t HashMix(uint64_t h, uint64_t x)
+{
+	h = (h ^ x) * 0x9e3779b97f4a7c15ULL;
+	return h ^ (h >> 29);
+}
+
+static uint64_t HashBytes(uint64_t h, const char* s, size_t len)
+{
+	h = HashMix(h, len);
+	for (; len >= 8; s += 8, len -= 8)
+	{
+		uint64_t w;
+		memcpy(&w, s, 8);
+		h = HashMix(h, w);
+	}
+	if (len)
+	{
+		uint64_t w = 0;
+		memcpy(&w, s, len);
+		h = HashMix(h, w);
+	}
+	return h;
+}
+
+static inline uint64_t HashFinish(uint64_t h)
+{
+	h ^= h >> 32;
+	h *= 0xd6e8feb86659fd93ULL;
+	return h ^ (h >> 32);
+}
+
+static inline uint64_t HashNumber(double n)
+{
+	uint64_t bits;
+	n = n == 0.0 ? 0.0 : n; // -0 == 0
+	memcpy(&bits, &n, sizeof(bits));
+	return HashFinish(HashMix(HashMix(0, TYPE_NUMBER), bits));
+}
+
+// everything but containers, which are combined from their children's hashes
+static uint64_t HashLeaf(const jsonValue* v)
+{
+	uint64_t h = HashMix(0, v->type);
+	if (v->type == TYPE_NUMBER)
+	{
+		return HashNumber(GetValueNumber(v));
+	}
+	else if (IsPacked(v))
+	{
+		// folded the way HashValue() folds an unpacked array
+		h = HashMix(h, v->nums.size);
+		for (size_t i = 0; i < v->nums.size; i++)
+		{
+			h = HashMix(h, HashNumber(v->nums.values[i]));
+		}
+	}
+	else if (v->type == TYPE_STRING)
+	{
+		h = HashBytes(h, GetValueString(v), GetValueStringLength(v));
+	}
+	return HashFinish(h);
+}
+
+struct hashFrame {
+	const jsonValue* v;
+	size_t next;
+	uint64_t hash;
+};
+
+// members are summed, so their order does not matter
+size_t HashValue(const jsonValue* v)
+{
+	assert(v);
+	walkStack<hashFrame> s(defaultAllocator);
+	uint64_t h;
+
+	for (;;)
+	{
+		if (!IsContainer(v))
+		{
+			h = HashLeaf(v);
+		}
+		else if ((v->flags & VALUE_CACHED) && (BlockHeader(v)->state & BLOCK_HASHED))
+		{
+			h = BlockHeader(v)->hash;
+		}
+		else
+		{
+			*s.Push() = { v, 0, HashMix(HashMix(0, v->type), v->type == TYPE_ARRAY ? v->arr.size : v->obj.size) };
+			h = 0;
+		}
+
+		// fold h into the innermost open container, closing finished ones, until there is a child to hash
+		v = nullptr;
+		while (!v && s.top)
+		{
+			hashFrame* f = &s.frames[s.top - 1];
+			const jsonValue* p = f->v;
+			if (f->next)
+			{
+				if (p->type == TYPE_ARRAY)
+				{
+					f->hash = HashMix(f->hash, h);
+				}
+				else
+				{
+					const jsonMap* m = &p->obj.maps[f->next - 1];
+					f->hash += HashFinish(HashMix(HashBytes(0, m->key, m->keyLen), h));
+				}
+			}
+			if (f->next < (p->type == TYPE_ARRAY ? p->arr.size : p->obj.size))
+			{
+				v = p->type == TYPE_ARRAY ? &p->arr.values[f->next] : &p->obj.maps[f->next].value;
+				f->next++;
+			}
+			else
+			{
+				h = HashFinish(f->hash);
+				if (p->flags & VALUE_CACHED)
+				{
+					blockHeader* bh = BlockHeader(p);
+					bh->hash = (size_t)h;
+					bh->state |= BLOCK_HASHED;
+				}
+				s.top--;
+			}
+		}
+		if (!v)
+		{
+			return (size_t)h;
+		}
+	}
+}
+
+// element i of an array as a number, false if it is not one
+static inline bool ElementNumber(const jsonValue* v, size_t i, double* n)
+{
+	if (v->flags & VALUE_PACKED)
+	{
+		*n = v->nums.values[i];
+		return true;
+	}
+	if (v->arr.values[i].type != TYPE_NUMBER)
+	{
+		return false;
+	}
+	*n = GetValueNumber(&v->arr.values[i]);
+	return true;
+}
+
+struct equalFrame {
+	const jsonValue* a;
+	const jsonValue* b;
+	size_t next;
+	size_t used;  // objects: where the bits of b's members already matched start
+	size_t index; // objects over EQUAL_SCAN_MEMBERS: where the hashed index of b's keys starts
+};
+
+// -1 unequal, 0 equal, 1 same type and size, the children remain to compare
+static int EqualShallow(const jsonValue* a, const jsonValue* b)
+{
+	if (a->type != b->type)
+	{
+		return -1;
+	}
+	switch (a->type) {
+	case TYPE_NUMBER:
+		return GetValueNumber(a) == GetValueNumber(b) ? 0 : -1;
+	case TYPE_STRING:
+		if (GetValueStringLength(a) != GetValueStringLength(b))
+		{
+			return -1;
+		}
+		return memcmp(GetValueString(a), GetValueString(b), GetValueStringLength(a)) ? -1 : 0;
+	case TYPE_ARRAY:
+	case TYPE_OBJECT:
+	{
+		size_t size = a->type == TYPE_ARRAY ? a->arr.size : a->obj.size;
+		if (size != (a->type == TYPE_ARRAY ? b->arr.size : b->obj.size))
+		{
+			return -1;
+		}
+		if (IsPacked(a) || IsPacked(b))
+		{
+			for (size_t i = 0; i < size; i++)
+			{
+				double x, y;
+				if (!ElementNumber(a, i, &x) || !ElementNumber(b, i, &y) || x != y)
+				{
+					return -1;
+				}
+			}
+			return 0;
+		}
+		if ((a->flags & b->flags & VALUE_CACHED) && (BlockHeader(a)->state & BlockHeader(b)->state & BLOCK_HASHED)
+			&& BlockHeader(a)->hash != BlockHeader(b)->hash)
+		{
+			return -1;
+		}
+		return size && a != b ? 1 : 0;
+	}
+	default:
+		return 0;
+	}
+}
+
+// b's member j is still unmatched and has m's key
+static inline bool MemberCandidate(const jsonValue* b, size_t j, const jsonMap* m, const unsigned char* used)
+{
+	const jsonMap* bm = &b->obj.maps[j];
+	return !(used[j / 8] & (1u << (j % 8))) && bm->keyLen == m->keyLen && memcmp(bm->key, m->key, m->keyLen) == 0;
+}
+
+// slots of the hashed index of an object's keys, a power of two at least twice its members
+static inline size_t MemberIndexSize(size_t members)
+{
+	size_t size = 2 * EQUAL_SCAN_MEMBERS;
+	while (size < 2 * members)
+	{
+		size *= 2;
+	}
+	return size;
+}
+
+static inline size_t MemberHash(const char* key, size_t len)
+{
+	return (size_t)HashFinish(HashBytes(0, key, len));
+}
+
+// each slot holds the position of one of b's members plus one, 0 when empty; linear probing
+static void IndexMembers(const jsonValue* b, size_t* index)
+{
+	size_t mask = MemberIndexSize(b->obj.size) - 1;
+	memset(index, 0, (mask + 1) * sizeof(size_t));
+	for (size_t j = 0; j < b->obj.size; j++)
+	{
+		size_t h = MemberHash(b->obj.maps[j].key, b->obj.maps[j].keyLen) & mask;
+		while (index[h])
+		{
+			h = (h + 1) & mask;
+		}
+		index[h] = j + 1;
+	}
+}
+
+// the next unmatched member of b with m's key, b->obj.size once there is none; *k counts the members
+// tried from position start on, or with an index the slots probed from start, the hash of the key
+static size_t NextCandidate(const jsonValue* b, size_t start, const jsonMap* m, const unsigned char* used, const size_t* index, size_t* k)
+{
+	size_t size = b->obj.size;
+	if (!index)
+	{
+		while (*k < size)
+		{
+			size_t j = (start + (*k)++) % size;
+			if (MemberCandidate(b, j, m, used))
+			{
+				return j;
+			}
+		}
+		return size;
+	}
+	size_t mask = MemberIndexSize(size) - 1;
+	for (size_t slot; (slot = index[(start + *k) & mask]) != 0; )
+	{
+		(*k)++;
+		if (MemberCandidate(b, slot - 1, m, used))
+		{
+			return slot - 1;
+		}
+	}
+	return size;
+}
+
+// the unmatched member of b for a's member i, tried at the same position first, or looked up in
+// index when b has one; when several of b's members have its key their values decide, compared
+// here, and *compared says so
+static const jsonValue* FindMember(const jsonValue* b, size_t i, const jsonMap* m, unsigned char* used, const size_t* index, bool* compared)
+{
+	size_t size = b->obj.size, k = 0;
+	size_t start = index ? MemberHash(m->key, m->keyLen) : i;
+	size_t found = NextCandidate(b, start, m, used, index, &k);
+	*compared = found < size && NextCandidate(b, start, m, used, index, &k) < size;
+	if (*compared)
+	{
+		k = 0;
+		do
+		{
+			found = NextCandidate(b, start, m, used, index, &k);
+		} while (found < size && !EqualValue(&m->value, &b->obj.maps[found].value));
+	}
+	if (found == size)
+	{
+		return nullptr;
+	}
+	used[found / 8] |= 1u << (found % 8);
+	return &b->obj.maps[found].value;
+}
+
+// objects compare as unordered, each member of b matching once; cached hashes reject mismatching containers early
+bool EqualValue(const jsonValue* a, const jsonValue* b)
+{
+	assert(a && b);
+	walkStack<equalFrame> s(defaultAllocator);
+	walkStack<unsigned char> used(defaultAllocator);
+	walkStack<size_t> index(defaultAllocator);
+
+	for (;;)
+	{
+		int ret = EqualShallow(a, b);
+		if (ret < 0)
+		{
+			return false;
+		}
+		if (ret > 0)
+		{
+			*s.Push() = { a, b, 0, used.top, index.top };
+			for (size_t i = 0; a->type == TYPE_OBJECT && i < (a->obj.size + 7) / 8; i++)
+			{
+				*used.Push() = 0;
+			}
+			if (a->type == TYPE_OBJECT && a->obj.size > EQUAL_SCAN_MEMBERS)
+			{
+				for (size_t i = MemberIndexSize(b->obj.size); i; i--)
+				{
+					index.Push();
+				}
+				IndexMembers(b, index.frames + s.frames[s.top - 1].index);
+			}
+		}
+
+		a = nullptr;
+		while (!a && s.top)
+		{
+			equalFrame* f = &s.frames[s.top - 1];
+			if (f->next == (f->a->type == TYPE_ARRAY ? f->a->arr.size : f->a->obj.size))
+			{
+				used.top = f->used;
+				index.top = f->index;
+				s.top--;
+			}
+			else if (f->a->type == TYPE_ARRAY)
+			{
+				a = &f->a->arr.values[f->next];
+				b = &f->b->arr.values[f->next];
+				f->next++;
+			}
+			else
+			{
+				const jsonMap* m = &f->a->obj.maps[f->next];
+				bool compared;
+				const size_t* keys = f->a->obj.size > EQUAL_SCAN_MEMBERS ? index.frames + f->index : nullptr;
+				b = FindMember(f->b, f->next, m, used.frames + f->used, keys, &compared);
+				f->next++;
+				if (!b)
+				{
+					return false;
+				}
+				a = compared ? nullptr : &m->value;
+			}
+		}
+		if (!a)
+		{
+			return true;
+		}
+	}
+}
+
+void SetValueString(jsonValue* v, const char* s, size_t len, const jsonAllocator* alloc)
+{
+	assert(v && (s || len == 0));
+	alloc = ResolveAllocator(alloc);
+	FreeValue(v, alloc);
+	v->str.s = (char*)JsonMalloc(alloc, len + 1);
+	memcpy(v->str.s, s, len);
+	v->str.s[len] = '\0';
+	v->str.len = len;
+	v->type = TYPE_STRING;
+}
+
+static void ParseWhitespace(parserContext* c) {
+	const char* p = c->json;
+	while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')
+		p++;
+	c->json = p;
+}
+
+static const char* ParseHex4(const char* p, unsigned* u)
+{
+	*u = 0;
+	for (int i = 0; i < 4; i++) {
+		char c = *p;
+		p++;
+		*u <<= 4;
+		if (c >= '0' && c <= '9') {
+			*u |= c - '0';
+		}
+		else if (c >= 'A' && c <= 'F') {
+			*u |= c - ('A' - 10);
+		}
+		else if (c >= 'a' && c <= 'f') {
+			*u |= c - ('a' - 10);
+		}
+		else return nullptr;
+	}
+	return p;
+}
+
+// returns the number of bytes, out may be null to only count them
+static size_t EncodeUtf8To(char* out, unsigned u) {
+	char buf[4];
+	char* p = out ? out : buf;
+	if (u <= 0x7F) {
+		p[0] = u & 0xff;
+		return 1;
+	}
+	else if (u <= 0x7FF) {
+		p[0] = 0xC0 | ((u >> 6) & 0xFF);
+		p[1] = 0x80 | (u & 0x3F);
+		return 2;
+	}
+	else if (u <= 0xFFFF) {
+		p[0] = 0xE0 | ((u >> 12) & 0xFF);
+		p[1] = 0x80 | ((u >> 6) & 0x3F);
+		p[2] = 0x80 | (u & 0x3F);
+		return 3;
+	}
+	assert(u <= 0x10FFFF);
+	p[0] = 0xF0 | ((u >> 18) & 0xFF);
+	p[1] = 0x80 | ((u >> 12) & 0x3F);
+	p[2] = 0x80 | ((u >> 6) & 0x3F);
+	p[3] = 0x80 | (u & 0x3F);
+	return 4;
+}
+
+static void EncodeUtf8(parserContext* c, unsigned u) {
+	c->top -= 4 - EncodeUtf8To((char*)c->PushSz(4), u);
+}
+
+static inline bool IsStringSpecial(char ch)
+{
+	return (unsigned char)ch < 0x20 || ch == '"' || ch == '\\';
+}
+
+// the first byte at or after p that ends a run of plain string bytes: a quote, a backslash or a control character
+NO_SANITIZE_ADDRESS static inline const char* SkipPlain(const char* p)
+{
+#ifdef __SSE2__
+	// aligned loads never cross into another page, so reading past the terminator is harmless
+	for (; (uintptr_t)p & 15; p++)
+	{
+		if (IsStringSpecial(*p))
+		{
+			return p;
+		}
+	}
+	const __m128i quote = _mm_set1_epi8('"'), backslash = _mm_set1_epi8('\\'), control = _mm_set1_epi8(0x1f);
+	for (;; p += 16)
+	{
+		__m128i x = _mm_load_si128((const __m128i*)p);
+		__m128i special = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(x, quote), _mm_cmpeq_epi8(x, backslash)),
+			_mm_cmpeq_epi8(_mm_max_epu8(x, control), control));
+		int mask = _mm_movemask_epi8(special);
+		if (mask)
+		{
+			return p + __builtin_ctz(mask);
+		}
+	}
+#else
+	while (!IsStringSpecial(*p))
+	{
+		p++;
+	}
+	return p;
+#endif
+}
+
+// RFC 3629: no overlong forms, no surrogates, nothing above U+10FFFF
+static bool ValidUtf8Scalar(const unsigned char* s, size_t n)
+{
+	size_t i = 0;
+	while (i < n)
+	{
+		uint64_t w;
+		if (i + 8 <= n && (memcpy(&w, s + i, 8), !(w & 0x8080808080808080ULL)))
+		{
+			i += 8;
+			continue;
+		}
+		unsigned char b = s[i];
+		if (b < 0x80)
+		{
+			i++;
+			continue;
+		}
+		size_t len = b < 0xC2 ? 0 : b < 0xE0 ? 2 : b < 0xF0 ? 3 : b < 0xF5 ? 4 : 0;
+		if (!len || i + len > n)
+		{
+			return false;
+		}
+		for (size_t k = 1; k < len; k++)
+		{
+			if ((s[i + k] & 0xC0) != 0x80)
+			{
+				return false;
+			}
+		}
+		unsigned char b1 = s[i + 1];
+		if ((b == 0xE0 && b1 < 0xA0) || (b == 0xED && b1 >= 0xA0) || (b == 0xF0 && b1 < 0x90) || (b == 0xF4 && b1 >= 0x90))
+		{
+			return false;
+		}
+		i += len;
+	}
+	return true;
+}
+
+#ifdef TINYJSON_X86_DISPATCH
+/*
+ * Keiser and Lemire's lookup algorithm: three 16-entry tables indexed by the
+ * nibbles of each byte and its predecessor flag every two-byte error class,
+ * the third and fourth bytes of long sequences are checked separately.
+ */
+#define UTF8_TOO_SHORT  (1 << 0)
+#define UTF8_TOO_LONG   (1 << 1)
+#define UTF8_OVERLONG_3 (1 << 2)
+#define UTF8_TOO_LARGE  (1 << 3)
+#define UTF8_SURROGATE  (1 << 4)
+#define UTF8_OVERLONG_2 (1 << 5)
+#define UTF8_TOO_LARGE_1000 (1 << 6)
+#define UTF8_OVERLONG_4 (1 << 6)
+#define UTF8_TWO_CONTS  (1 << 7)
+#define UTF8_CARRY (UTF8_TOO_SHORT | UTF8_TOO_LONG | UTF8_TWO_CONTS)
+
+struct utf8Checker {
+	__m128i error, prev, incomplete;
+};
+
+__attribute__((target("ssse3"))) static inline void Utf8CheckBlock(utf8Checker* u, __m128i input)
+{
+	if (!_mm_movemask_epi8(input))
+	{
+		// ASCII only: just make sure the previous block did not end inside a sequence
+		u->error = _mm_or_si128(u->error, u->incomplete);
+		u->prev = input;
+		u->incomplete = _mm_setzero_si128();
+		return;
+	}
+
+	const __m128i nibble = _mm_set1_epi8(0x0f);
+	const __m128i byte1High = _mm_setr_epi8(
+		UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+		UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+		UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS,
+		UTF8_TOO_SHORT | UTF8_OVERLONG_2,
+		UTF8_TOO_SHORT,
+		UTF8_TOO_SHORT | UTF8_OVERLONG_3 | UTF8_SURROGATE,
+		(char)(UTF8_TOO_SHORT | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4));
+	const __m128i byte1Low = _mm_setr_epi8(
+		(char)(UTF8_CARRY | UTF8_OVERLONG_3 | UTF8_OVERLONG_2 | UTF8_OVERLONG_4),
+		(char)(UTF8_CARRY | UTF8_OVERLONG_2),
+		(char)UTF8_CARRY,
+		(char)UTF8_CARRY,
+		(char)(UTF8_CARRY | UTF8_TOO_LARGE),
+		(char)(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),
+		(char)(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),
+		(char)(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),
+		(char)(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),
+		(char)(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),
+		(char)(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),
+		(char)(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),
+		(char)(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),
+		(char)(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_SURROGATE),
+		(char)(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),
+		(char)(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000));
+	const __m128i byte2High = _mm_setr_epi8(
+		UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+		UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+		(char)(UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4),
+		(char)(UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE),
+		(char)(UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE),
+		(char)(UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE),
+		UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT);
+
+	__m128i prev1 = _mm_alignr_epi8(input, u->prev, 15);
+	__m128i special = _mm_and_si128(
+		_mm_and_si128(_mm_shuffle_epi8(byte1High, _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble)),
+			_mm_shuffle_epi8(byte1Low, _mm_and_si128(prev1, nibble))),
+		_mm_shuffle_epi8(byte2High, _mm_and_si128(_mm_srli_epi16(input, 4), nibble)));
+
+	// a continuation is required two bytes after 111_____ and three after 1111____
+	__m128i third = _mm_subs_epu8(_mm_alignr_epi8(input, u->prev, 14), _mm_set1_epi8((char)(0xe0 - 1)));
+	__m128i fourth = _mm_subs_epu8(_mm_alignr_epi8(input, u->prev, 13), _mm_set1_epi8((char)(0xf0 - 1)));
+	__m128i must23 = _mm_cmpgt_epi8(_mm_or_si128(third, fourth), _mm_setzero_si128());
+	u->error = _mm_or_si128(u->error, _mm_xor_si128(_mm_and_si128(must23, _mm_set1_epi8((char)0x80)), special));
+
+	// lead bytes in the last three positions that the block ends too early for
+	const __m128i maxValue = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		(char)(0xf0 - 1), (char)(0xe0 - 1), (char)(0xc0 - 1));
+	u->incomplete = _mm_subs_epu8(input, maxValue);
+	u->prev = input;
+}
+
+__attribute__((target("ssse3"))) static bool ValidUtf8Ssse3(const unsigned char* s, size_t n)
+{
+	utf8Checker u = { _mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128() };
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16)
+	{
+		Utf8CheckBlock(&u, _mm_loadu_si128((const __m128i*)(s + i)));
+	}
+	if (i < n)
+	{
+		unsigned char tail[16] = { 0 };
+		memcpy(tail, s + i, n - i);
+		Utf8CheckBlock(&u, _mm_loadu_si128((const __m128i*)tail));
+	}
+	u.error = _mm_or_si128(u.error, u.incomplete);
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(u.error, _mm_setzero_si128())) == 0xffff;
+}
+#endif
+
+// picks the vector validator once, if the CPU has it; short runs are not worth it
+static bool ValidUtf8(const char* s, size_t n)
+{
+#ifdef TINYJSON_X86_DISPATCH
+	static const bool ssse3 = __builtin_cpu_supports("ssse3");
+	if (ssse3 && n >= 16)
+	{
+		return ValidUtf8Ssse3((const unsigned char*)s, n);
+	}
+#endif
+	return ValidUtf8Scalar((const unsigned char*)s, n);
+}
+
+// validates a string like ParseStringRaw() but only records where its raw contents are
+static parseStatus ScanString(parserContext* c, const char** str, size_t* len, bool* escaped)
+{
+	assert(*c->json == '\"');
+	const char* p = ++c->json;
+
+	*escaped = false;
+	while (1) {
+		const char* run = p;
+		p = SkipPlain(p);
+		if ((c->flags & PARSE_STRICT_UTF8) && !ValidUtf8(run, p - run))
+			return PARSE_ERR_INVALID_UTF8;
+		char ch = *(p++);
+		switch (ch) {
+		case '\\':
+			*escaped = true;
+			switch (*(p++)) {
+			case 'n': case '\"': case '\\': case '/': case 'b': case 'f': case 'r': case 't':
+				break;
+			case 'u':
+			{
+				unsigned H = 0, L = 0;
+				if (!(p = ParseHex4(p, &H)))
+					return PARSE_ERR_INVALID_UNICODE_HEX;
+				if (H >= 0xD800 && H <= 0xDBFF) { /* surrogate pair */
+					if (*p++ != '\\' || *p++ != 'u')
+						return PARSE_ERR_INVALID_UNICODE_SURROGATE;
+					if (!(p = ParseHex4(p, &L)))
+						return PARSE_ERR_INVALID_UNICODE_HEX;
+					if (L < 0xDC00 || L > 0xDFFF)
+						return PARSE_ERR_INVALID_UNICODE_SURROGATE;
+				}
+				else if (H >= 0xDC00 && H <= 0xDFFF && (c->flags & PARSE_STRICT_UTF8))
+					return PARSE_ERR_INVALID_UNICODE_SURROGATE;
+				break;
+			}
+			default:
+				return PARSE_ERR_INVALID_ESCAPE_CHAR;
+			}
+			break;
+		case '\"':
+			*str = c->json;
+			*len = p - 1 - c->json;
+			c->json = p;
+			return PARSE_OK;
+		case '\0':
+			return PARSE_ERR_MISS_QUOTATION_MARK;
+		default:
+			return PARSE_ERR_CONTROL_CHAR;
+		}
+	}
+}
+
+// decodes a slice ScanString() accepted, out may be null to only measure it
+static size_t DecodeString(const char* p, size_t len, char* out)
+{
+	const char* end = p + len;
+	size_t n = 0;
+	while (p < end) {
+		char ch = *(p++);
+		if (ch == '\\') {
+			switch (ch = *(p++)) {
+			case 'b': ch = '\b'; break;
+			case 'f': ch = '\f'; break;
+			case 'n': ch = '\n'; break;
+			case 'r': ch = '\r'; break;
+			case 't': ch = '\t'; break;
+			case 'u':
+			{
+				unsigned H, L;
+				p = ParseHex4(p, &H);
+				if (H >= 0xD800 && H <= 0xDBFF) {
+					p = ParseHex4(p + 2, &L);
+					H = (((H - 0xD800) << 10) | (L - 0xDC00)) + 0x10000;
+				}
+				n += EncodeUtf8To(out ? out + n : nullptr, H);
+				continue;
+			}
+			default:
+				break;
+			}
+		}
+		if (out)
+			out[n] = ch;
+		n++;
+	}
+	return n;
+}
+
+static parseStatus ParseStringRaw(parserContext* c, char** str, size_t& len)
+{
+	assert(*c->json == '\"');
+	c->json++;
+
+	size_t head = c->top;
+
+	const char* p = c->json;
+	while (1) {
+		// plain bytes go over in one copy, up to the next quote, escape or control character
+		const char* run = p;
+		p = SkipPlain(p);
+		if ((c->flags & PARSE_STRICT_UTF8) && !ValidUtf8(run, p - run))
+			STRING_ERROR(PARSE_ERR_INVALID_UTF8);
+		if (p != run)
+			c->PushStr(run, p - run);
+		char ch = *(p++);
+		switch (ch) {
+		case '\\':
+			switch (*(p++)) {
+			case 'n':  c->PushChar('\n'); break;
+			case '\"': c->PushChar('\"'); break;
+			case '\\': c->PushChar('\\'); break;
+			case '/':  c->PushChar('/');  break;
+			case 'b':  c->PushChar('\b'); break;
+			case 'f':  c->PushChar('\f'); break;
+			case 'r':  c->PushChar('\r'); break;
+			case 't':  c->PushChar('\t'); break;
+			case 'u':
+			{
+				unsigned H = 0, L = 0, codePoint = 0;
+				if (!(p = ParseHex4(p, &H)))
+					STRING_ERROR(PARSE_ERR_INVALID_UNICODE_HEX);
+				if (H >= 0xD800 && H <= 0xDBFF) { /* surrogate pair */
+					if (*p++ != '\\')
+						STRING_ERROR(PARSE_ERR_INVALID_UNICODE_SURROGATE);
+					if (*p++ != 'u')
+						STRING_ERROR(PARSE_ERR_INVALID_UNICODE_SURROGATE);
+					if (!(p = ParseHex4(p, &L)))
+						STRING_ERROR(PARSE_ERR_INVALID_UNICODE_HEX);
+					if (L < 0xDC00 || L > 0xDFFF)
+						STRING_ERROR(PARSE_ERR_INVALID_UNICODE_SURROGATE);
+					codePoint = (((H - 0xD800) << 10) | (L - 0xDC00)) + 0x10000;
+					//EncodeUtf8(c, codePoint);
+				}
+				else if (H >= 0xDC00 && H <= 0xDFFF && (c->flags & PARSE_STRICT_UTF8)) {
+					STRING_ERROR(PARSE_ERR_INVALID_UNICODE_SURROGATE);
+				}
+				else {
+					codePoint = H;
+				}
+				EncodeUtf8(c, codePoint);
+				break;
+			}
+			default:
+				STRING_ERROR(PARSE_ERR_INVALID_ESCAPE_CHAR);
+			}
+			break;
+		case '\"':
+			len = c->top - head;
+			c->json = p;
+			*str = (char*)c->Pop(len);
+			return PARSE_OK;
+		case '\0':
+			STRING_ERROR(PARSE_ERR_MISS_QUOTATION_MARK);
+		default:
+			// SkipPlain() only stops early at control characters
+			STRING_ERROR(PARSE_ERR_CONTROL_CHAR);
+		}
+	}
+}
+
+static parseStatus ParseLiteral(parserContext* c, jsonValue* v, const char* literal, valueType type)
+{
+	assert(*c->json == literal[0]);
+	c->json++;
+
+	size_t i;
 	for (i = 0; literal[i + 1] != '\0'; i++) {
 		if (c->json[i] != literal[i + 1]) {
 			return PARSE_ERR_INVALID_VALUE;
 		}
 	}
-	c->json += i;
-	v->type = type;
+	c->json += i;
+	v->type = type;
+	return PARSE_OK;
+}
+
+static parseStatus ParseNumber(parserContext* c, jsonValue* v) {
+	const char* p = c->json;
+
+	bool isPositive = true;
+	if (*p == '-') {
+		isPositive = false;
+		p++;
+	}
+
+	if (!ISDIGIT(*p)) {
+		return PARSE_ERR_INVALID_VALUE;
+	}
+
+	if (*p == '0') {
+		p++;
+	}
+	else {
+		if (!ISDIGIT(*p)) {
+			return PARSE_ERR_INVALID_VALUE;
+		}
+		for (p++; ISDIGIT(*p); p++) {
+		}
+	}
+
+	if (*p == '.') {
+		p++;
+		if (!ISDIGIT(*p)) {
+			return PARSE_ERR_INVALID_VALUE;
+		}
+		for (p++; ISDIGIT(*p); p++) {
+		}
+	}
+
+	if (*p == 'e' || *p == 'E') {
+		p++;
+		if (*p == '+' || *p == '-') {
+			p++;
+		}
+		if (!ISDIGIT(*p)) {
+			return PARSE_ERR_INVALID_VALUE;
+		}
+		for (p++; ISDIGIT(*p); p++) {
+		}
+	}
+
+	if (c->flags & PARSE_RAW_NUMBERS) {
+		v->str.s = (char*)c->json;
+		v->str.len = p - c->json;
+		v->flags = VALUE_BORROWED | VALUE_RAW;
+		c->json = p;
+		v->type = TYPE_NUMBER;
+		return PARSE_OK;
+	}
+
+	errno = 0;
+	v->num = strtod(c->json, NULL);
+	if (errno == ERANGE && (v->num == HUGE_VAL || v->num == -HUGE_VAL)) {
+		return PARSE_ERR_NUMBER_OVERFLOW;
+	}
+	c->json = p;
+	v->type = TYPE_NUMBER;
+	return PARSE_OK;
+}
+
+// an array or object being parsed; its finished elements sit on the stack above it
+struct parseFrame {
+	size_t parent;   // stack offset of the enclosing frame
+	size_t size;
+	valueType type;
+	void* elements;  // PARSE_EXACT_SIZE: the final block, parsed into in place
+	size_t capacity; // and its element count
+};
+
+#define NO_FRAME ((size_t)-1)
+
+// where the value being parsed goes: the last element of the innermost frame, or the root
+static jsonValue* ParseSlot(parserContext* c, size_t frame, jsonValue* root)
+{
+	if (frame == NO_FRAME)
+	{
+		return root;
+	}
+	parseFrame* f = (parseFrame*)(c->stack + frame);
+	if (f->elements)
+	{
+		return f->type == TYPE_ARRAY ? (jsonValue*)f->elements + f->size - 1 : &((jsonMap*)f->elements + f->size - 1)->value;
+	}
+	if (f->type == TYPE_ARRAY)
+	{
+		return (jsonValue*)(c->stack + c->top) - 1;
+	}
+	return &((jsonMap*)(c->stack + c->top) - 1)->value;
+}
+
+// pushes the next element of the frame; for objects that means parsing its key and colon
+static parseStatus ParseNextSlot(parserContext* c, size_t frame)
+{
+	parseFrame* f = (parseFrame*)(c->stack + frame);
+	if (f->elements && f->size == f->capacity)
+	{
+		return PARSE_ERR_INVALID_VALUE; // more elements than counted, the input cannot be valid
+	}
+	if (f->type == TYPE_ARRAY)
+	{
+		InitValue(f->elements ? (jsonValue*)f->elements + f->size : (jsonValue*)c->PushSz(sizeof(jsonValue)));
+	}
+	else
+	{
+		parseStatus ret;
+		char* str;
+		size_t len;
+
+		if (*c->json != '"')
+		{
+			return PARSE_ERR_MISS_KEY;
+		}
+		if ((ret = ParseStringRaw(c, &str, len)) != PARSE_OK)
+		{
+			return ret;
+		}
+		ParseWhitespace(c);
+		if (*c->json != ':')
+		{
+			return PARSE_ERR_MISS_COLON;
+		}
+		c->json++;
+		ParseWhitespace(c);
+
+		// the key is still above top, copy it out before pushing over it
+		char* key = (char*)c->Malloc(len + 1);
+		memcpy(key, str, len);
+		key[len] = '\0';
+		f = (parseFrame*)(c->stack + frame);
+		jsonMap* m = f->elements ? (jsonMap*)f->elements + f->size : (jsonMap*)c->PushSz(sizeof(jsonMap));
+		m->key = key;
+		m->keyLen = len;
+		InitValue(&m->value);
+	}
+	((parseFrame*)(c->stack + frame))->size++;
+	return PARSE_OK;
+}
+
+// a packed copy of the elements if they are all plain numbers, nullptr otherwise
+static double* PackNumbers(parserContext* c, const jsonValue* values, size_t size)
+{
+	for (size_t i = 0; i < size; i++)
+	{
+		if (values[i].type != TYPE_NUMBER || (values[i].flags & VALUE_RAW))
+		{
+			return nullptr;
+		}
+	}
+	STATS_ALLOC(c, sizeof(packedHeader) + size * sizeof(double));
+	double* nums = NewPacked(c->alloc, size);
+	for (size_t i = 0; i < size; i++)
+	{
+		nums[i] = values[i].num;
+	}
+	return nums;
+}
+
+// frees the elements of every open frame after an error
+static void ParseUnwind(parserContext* c, size_t frame)
+{
+	while (frame != NO_FRAME)
+	{
+		parseFrame* f = (parseFrame*)(c->stack + frame);
+		for (size_t i = f->size; i-- > 0;)
+		{
+			if (f->type == TYPE_ARRAY)
+			{
+				FreeValue(f->elements ? (jsonValue*)f->elements + i : (jsonValue*)c->Pop(sizeof(jsonValue)), c->alloc);
+			}
+			else
+			{
+				jsonMap* m = f->elements ? (jsonMap*)f->elements + i : (jsonMap*)c->Pop(sizeof(jsonMap));
+				JsonFree(c->alloc, m->key, m->keyLen + 1);
+				FreeValue(&m->value, c->alloc);
+			}
+		}
+		JsonFree(c->alloc, f->elements, f->capacity * (f->type == TYPE_ARRAY ? sizeof(jsonValue) : sizeof(jsonMap)));
+		frame = f->parent;
+		c->Pop(sizeof(parseFrame));
+	}
+}
+
+// bytes CountElements() has to look at, outside of strings and inside them
+struct countStopTable {
+	bool stop[256];
+	bool stringStop[256];
+
+	constexpr countStopTable() : stop(), stringStop()
+	{
+		stop[0] = stop['"'] = stop[','] = stop['['] = stop[']'] = stop['{'] = stop['}'] = true;
+		stringStop[0] = stringStop['"'] = stringStop['\\'] = true;
+	}
+};
+
+static constexpr countStopTable countStop;
+
+/*
+ * Pushes the element count of every array and object of the value at c->json
+ * onto c->stack, in the order they open. Nothing is validated: on valid input
+ * the counts are exact, on anything else the parse fails on its own.
+ */
+static void CountElements(parserContext* c)
+{
+	size_t base = c->top;
+	walkStack<size_t> open(c->alloc);
+	const char* p = c->json;
+
+	do {
+		while (!countStop.stop[(unsigned char)*p])
+		{
+			p++;
+		}
+		switch (*p++) {
+		case '\0':
+			return;
+		case '"':
+			for (;;)
+			{
+				while (!countStop.stringStop[(unsigned char)*p])
+				{
+					p++;
+				}
+				if (*p != '\\' || !p[1])
+				{
+					break;
+				}
+				p += 2;
+			}
+			p += *p == '"';
+			break;
+		case ',':
+			if (open.top)
+			{
+				((size_t*)(c->stack + base))[open.frames[open.top - 1]]++;
+			}
+			break;
+		case '[':
+		case '{':
+		{
+			const char* q = p;
+			while (*q == ' ' || *q == '\t' || *q == '\n' || *q == '\r')
+			{
+				q++;
+			}
+			*open.Push() = (c->top - base) / sizeof(size_t);
+			*(size_t*)c->PushSz(sizeof(size_t)) = *q != ']' && *q != '}';
+			break;
+		}
+		default: // ']' or '}'
+			if (open.top)
+			{
+				open.top--;
+			}
+			break;
+		}
+	} while (open.top);
+}
+
+/*
+ * Iterative: every open array or object is a parseFrame on c->stack, so the
+ * nesting depth costs heap, not thread stack, and is capped by c->maxDepth.
+ * With PARSE_EXACT_SIZE the element counts are gathered up front and every
+ * block is allocated once and parsed into; otherwise elements gather on the
+ * stack and are copied out when their container closes.
+ */
+static parseStatus ParseValue(parserContext* c, jsonValue* v) {
+	parseStatus ret = PARSE_OK;
+	size_t base = c->top;
+	size_t frame = NO_FRAME;
+	size_t depth = 0;
+
+	// the reader keeps scope bytes below, frames and elements need alignment
+	if (c->top % alignof(jsonMap))
+	{
+		c->PushSz(alignof(jsonMap) - c->top % alignof(jsonMap));
+	}
+
+	size_t counts = c->top, nextCount = 0;
+	bool exact = (c->flags & PARSE_EXACT_SIZE) && (*c->json == '[' || *c->json == '{');
+	if (exact)
+	{
+		CountElements(c);
+	}
+	size_t countsEnd = c->top;
+
+	while (1)
+	{
+		char ch = *c->json;
+		if (ch == '[' || ch == '{')
+		{
+			if (c->maxDepth && depth == c->maxDepth)
+			{
+				ret = PARSE_ERR_DEPTH_EXCEEDED;
+				break;
+			}
+			depth++;
+			STATS(c, if (depth > c->stats->maxDepth) c->stats->maxDepth = depth);
+			c->json++;
+			ParseWhitespace(c);
+
+			parseFrame* f = (parseFrame*)c->PushSz(sizeof(parseFrame));
+			f->parent = frame;
+			f->size = 0;
+			f->type = ch == '[' ? TYPE_ARRAY : TYPE_OBJECT;
+			f->elements = nullptr;
+			f->capacity = 0;
+			if (exact && counts + nextCount * sizeof(size_t) < countsEnd)
+			{
+				f->capacity = ((size_t*)(c->stack + counts))[nextCount++];
+				if (f->capacity)
+				{
+					f->elements = c->Malloc(f->capacity * (f->type == TYPE_ARRAY ? sizeof(jsonValue) : sizeof(jsonMap)));
+				}
+			}
+			frame = (char*)f - c->stack;
+			if (*c->json != (ch == '[' ? ']' : '}'))
+			{
+				if ((ret = ParseNextSlot(c, frame)) != PARSE_OK)
+				{
+					break;
+				}
+				continue;
+			}
+		}
+		else
+		{
+			switch (ch) {
+			case 't':  ret = ParseLiteral(c, ParseSlot(c, frame, v), "true", TYPE_TRUE); break;
+			case 'f':  ret = ParseLiteral(c, ParseSlot(c, frame, v), "false", TYPE_FALSE); break;
+			case 'n':  ret = ParseLiteral(c, ParseSlot(c, frame, v), "null", TYPE_NULL); break;
+			case '\0': ret = PARSE_ERR_EXPECT_VALUE; break;
+			case '"':
+			{
+				char* str;
+				size_t len;
+				if (c->flags & PARSE_LAZY_STRINGS)
+				{
+					const char* raw;
+					bool escaped;
+					if ((ret = ScanString(c, &raw, &len, &escaped)) == PARSE_OK)
+					{
+						jsonValue* d = ParseSlot(c, frame, v);
+						d->type = TYPE_STRING;
+						if (escaped)
+						{
+							// the length is found again on decoding, its room keeps the allocator to decode into
+							d->flags = VALUE_BORROWED | VALUE_ESCAPED;
+							d->lazy.raw = raw;
+							d->lazy.alloc = c->alloc;
+						}
+						else
+						{
+							d->flags = VALUE_BORROWED;
+							d->str.s = (char*)raw;
+							d->str.len = len;
+						}
+					}
+				}
+				// the slot is looked up afterwards, decoding may move the stack
+				else if ((ret = ParseStringRaw(c, &str, len)) == PARSE_OK)
+				{
+					SetValueString(ParseSlot(c, frame, v), str, len, c->alloc);
+					STATS_ALLOC(c, len + 1);
+				}
+				break;
+			}
+			default:   ret = ParseNumber(c, ParseSlot(c, frame, v)); break;
+			}
+			if (ret != PARSE_OK)
+			{
+				break;
+			}
+			STATS(c, c->stats->values[ParseSlot(c, frame, v)->type]++);
+		}
+
+		// a value just ended: close every frame the input closes, or move on to the next element
+		while (frame != NO_FRAME)
+		{
+			parseFrame* f = (parseFrame*)(c->stack + frame);
+			bool isArray = f->type == TYPE_ARRAY;
+			ParseWhitespace(c);
+			if (*c->json == ',')
+			{
+				c->json++;
+				ParseWhitespace(c);
+				ret = ParseNextSlot(c, frame);
+				break;
+			}
+			if (*c->json != (isArray ? ']' : '}'))
+			{
+				ret = isArray ? PARSE_ERR_MISS_COMMA_OR_SQUARE_BRACKET : PARSE_ERR_MISS_COMMA_OR_CURLY_BRACKET;
+				break;
+			}
+			if (f->size != f->capacity && exact)
+			{
+				ret = PARSE_ERR_INVALID_VALUE; // fewer elements than counted
+				break;
+			}
+			c->json++;
+
+			size_t size = f->size;
+			size_t bytes = size * (isArray ? sizeof(jsonValue) : sizeof(jsonMap));
+			void* elements = f->elements;
+			double* packed = nullptr;
+			frame = f->parent;
+			if (isArray && size && (c->flags & PARSE_PACKED_NUMBERS))
+			{
+				packed = PackNumbers(c, elements ? (jsonValue*)elements : (jsonValue*)(c->stack + c->top - bytes), size);
+				if (packed && elements)
+				{
+					JsonFree(c->alloc, elements, bytes);
+				}
+				else if (packed)
+				{
+					c->Pop(bytes);
+				}
+			}
+			if (size && !elements && !packed)
+			{
+				elements = c->Malloc(bytes);
+				memcpy(elements, c->Pop(bytes), bytes);
+			}
+			c->Pop(sizeof(parseFrame));
+			depth--;
+
+			jsonValue* d = ParseSlot(c, frame, v);
+			if (packed)
+			{
+				d->type = TYPE_ARRAY;
+				d->flags |= VALUE_PACKED;
+				d->nums.values = packed;
+				d->nums.size = size;
+			}
+			else if (isArray)
+			{
+				d->type = TYPE_ARRAY;
+				d->arr.values = (jsonValue*)elements;
+				d->arr.size = size;
+			}
+			else
+			{
+				d->type = TYPE_OBJECT;
+				d->obj.maps = (jsonMap*)elements;
+				d->obj.size = size;
+			}
+			STATS(c, c->stats->values[d->type]++);
+		}
+
+		if (ret != PARSE_OK || frame == NO_FRAME)
+		{
+			break;
+		}
+	}
+
+	if (ret != PARSE_OK)
+	{
+		ParseUnwind(c, frame);
+	}
+	c->top = base;
+	return ret;
+}
+
+#ifdef TINYJSON_STATS
+static unsigned long long StatsNanosSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+#endif
+
+// the tree is built with c->alloc, the stack is trimmed afterwards
+static parseStatus ParseRoot(parserContext* c, jsonValue* v, const char* json, jsonStats* stats) {
+	assert(v != NULL);
+
+#ifdef TINYJSON_STATS
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+#endif
+	c->json = json;
+	c->top = 0;
+	c->stats = stats;
+
+	InitValue(v);
+
+	parseStatus ret;
+
+	ParseWhitespace(c);
+	if ((ret = ParseValue(c, v)) == PARSE_OK) {
+		ParseWhitespace(c);
+		if (*c->json != '\0') {
+			FreeValue(v, c->alloc);
+			ret = PARSE_ERR_ROOT_NOT_SINGULAR;
+		}
+	}
+	assert(!c->top);
+	STATS(c, c->stats->parseBytes += c->json - json; c->stats->parseNanos += StatsNanosSince(start));
+	c->stats = nullptr;
+	c->Trim();
+	return ret;
+}
+
+parseStatus ParseJsonString(jsonValue* v, const char* json, jsonStats* stats, const jsonAllocator* alloc) {
+	parserContext local;
+	return ParseRoot(ScratchContext(ResolveAllocator(alloc), &local), v, json, stats);
+}
+
+valueType GetValueType(const jsonValue* v) {
+	assert(v != NULL);
+	return v->type;
+}
+
+double GetValueNumber(const jsonValue* v) {
+	assert(v && v->type == TYPE_NUMBER);
+	if (v->flags & VALUE_RAW) {
+		// the text was validated as a JSON number and ends at a delimiter or NUL
+		return strtod(v->str.s, NULL);
+	}
+	return v->num;
+}
+
+const char* GetValueNumberText(const jsonValue* v, size_t* length) {
+	assert(v && v->type == TYPE_NUMBER && length);
+	if (!(v->flags & VALUE_RAW)) {
+		return nullptr;
+	}
+	*length = v->str.len;
+	return v->str.s;
+}
+
+void SetValueNumber(jsonValue* v, double n, const jsonAllocator* alloc) {
+	FreeValue(v, alloc);
+	v->num = n;
+	v->type = TYPE_NUMBER;
+}
+
+// the first access to an escaped lazy string decodes it into the tree's allocator
+static void DecodeLazyString(const jsonValue* v)
+{
+	jsonValue* w = const_cast<jsonValue*>(v);
+	size_t raw = RawLength(v);
+	size_t len = DecodeString(v->lazy.raw, raw, nullptr);
+	char* s = (char*)JsonMalloc(v->lazy.alloc, len + 1);
+	DecodeString(v->lazy.raw, raw, s);
+	s[len] = '\0';
+	w->str.s = s;
+	w->str.len = len;
+	w->flags = (w->flags & SLOT_MASK) | VALUE_DECODED;
+}
+
+const char* GetValueString(const jsonValue* v)
+{
+	assert(v && v->type == TYPE_STRING);
+	if (v->flags & VALUE_ESCAPED)
+	{
+		DecodeLazyString(v);
+	}
+	return v->str.s;
+}
+
+size_t GetValueStringLength(const jsonValue* v)
+{
+	assert(v && v->type == TYPE_STRING);
+	if (v->flags & VALUE_ESCAPED)
+	{
+		DecodeLazyString(v);
+	}
+	return v->str.len;
+}
+
+void SetValueBoolean(jsonValue* v, bool b, const jsonAllocator* alloc)
+{
+	FreeValue(v, alloc);
+	v->type = b ? TYPE_TRUE : TYPE_FALSE;
+}
+
+bool GetValueBoolean(const jsonValue* v)
+{
+	assert(v && (v->type == TYPE_TRUE || v->type == TYPE_FALSE));
+	return v->type == TYPE_TRUE;
+}
+
+size_t GetValueArraySize(const jsonValue* v)
+{
+	assert(v && v->type == TYPE_ARRAY);
+	return v->arr.size;
+}
+
+// turns a packed array back into jsonValues, with the allocator it was built with
+static void UnpackArray(jsonValue* v)
+{
+	packedHeader* h = (packedHeader*)v->nums.values - 1;
+	const jsonAllocator* alloc = h->alloc;
+	size_t size = v->nums.size;
+	jsonValue* values = (jsonValue*)JsonMalloc(alloc, size * sizeof(jsonValue));
+	for (size_t i = 0; i < size; i++)
+	{
+		values[i].type = TYPE_NUMBER;
+		values[i].flags = 0;
+		values[i].num = v->nums.values[i];
+	}
+	if (v->flags & VALUE_COMPACT)
+	{
+		compactHeader* block = CompactBlock(v); // the array was all there was in it
+		JsonFree(alloc, block, block->size);
+	}
+	else if (!(v->flags & VALUE_FIXED))
+	{
+		JsonFree(alloc, h, sizeof(packedHeader) + size * sizeof(double));
+	}
+	v->arr.values = values;
+	v->flags &= ~(VALUE_PACKED | VALUE_COMPACT | VALUE_FIXED);
+	MarkDirty(v); // a cached parent cannot see changes to the new elements, it has to write them from now on
+}
+
+jsonValue* GetValueArrayElement(const jsonValue* v, size_t index)
+{
+	assert(v && v->type == TYPE_ARRAY && index < v->arr.size);
+	if (v->flags & VALUE_PACKED)
+	{
+		UnpackArray(const_cast<jsonValue*>(v));
+	}
+	return &v->arr.values[index];
+}
+
+const double* GetValueArrayNumbers(const jsonValue* v)
+{
+	assert(v && v->type == TYPE_ARRAY);
+	return (v->flags & VALUE_PACKED) ? v->nums.values : nullptr;
+}
+
+size_t GetValueObjectSize(const jsonValue* v)
+{
+	assert(v && v->type == TYPE_OBJECT);
+	return v->obj.size;
+}
+
+const char* GetValueObjectKey(const jsonValue* v, size_t index)
+{
+	assert(v && v->type == TYPE_OBJECT);
+	assert(index < v->obj.size);
+	return v->obj.maps[index].key;
+}
+
+size_t GetValueObjectKeyLength(const jsonValue* v, size_t index)
+{
+	assert(v && v->type == TYPE_OBJECT);
+	assert(index < v->obj.size);
+	return v->obj.maps[index].keyLen;
+}
+
+jsonValue* GetValueObjectValue(const jsonValue* v, size_t index)
+{
+	assert(v && v->type == TYPE_OBJECT);
+	assert(index < v->obj.size);
+	return &v->obj.maps[index].value;
+}
+
+static const char hex_digits[] = { '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F' };
+
+static inline bool NeedsEscape(char ch)
+{
+	return (unsigned char)ch < 0x20 || ch == '\"' || ch == '\\';
+}
+
+static inline void Stringify_char(parserContext* c, char ch)
+{
+	switch (ch)
+	{
+	case '\n': c->PushChar('\\'); c->PushChar('n'); break;
+	case '\r': c->PushChar('\\'); c->PushChar('r'); break;
+	case '\b': c->PushChar('\\'); c->PushChar('b'); break;
+	case '\f': c->PushChar('\\'); c->PushChar('f'); break;
+	case '\t': c->PushChar('\\'); c->PushChar('t'); break;
+	case '\"': c->PushChar('\\'); c->PushChar('\"'); break;
+	case '\\': c->PushChar('\\'); c->PushChar('\\'); break;
+		
+	default:
+		if ((unsigned char)ch < 0x20)
+		{
+			c->PushChar('\\');
+			c->PushChar('u');
+			c->PushChar('0');
+			c->PushChar('0');
+			c->PushChar(hex_digits[ch >> 4]);
+			c->PushChar(hex_digits[ch & 0xf]);
+		}
+		else
+		{
+			c->PushChar(ch);
+		}
+		break;
+	}
+}
+
+static void Gather_string(parserContext* c, const char* s, size_t len);
+
+static void Stringify_string(parserContext* c, const char* s, size_t len)
+{
+	assert(s);
+
+	if (c->gather)
+	{
+		Gather_string(c, s, len);
+		return;
+	}
+	c->PushChar('\"');
+	for (size_t i = 0; i < len; i++)
+	{
+		Stringify_char(c, s[i]);
+	}
+	c->PushChar('\"');
+}
+
+static void Stringify_number(parserContext* c, double n)
+{
+	c->top -= static_cast<size_t>(32) - sprintf((char*)c->PushSz(32), "%.17g", n);
+}
+
+// StringifyIovec() in progress: pieces of v in between runs of the scratch buffer
+struct gatherState {
+	jsonWriter* w;
+	size_t count;
+	size_t cut;     // the scratch up to here is covered by pieces
+	size_t inPlace; // shortest run referenced instead of copied
+};
+
+static jsonIovec* GatherSlot(parserContext* c)
+{
+	gatherState* g = c->gather;
+	jsonWriter* w = g->w;
+	if (g->count == w->pieceCapacity)
+	{
+		size_t capacity = w->pieceCapacity ? w->pieceCapacity * 2 : 64;
+		w->pieces = (jsonIovec*)JsonRealloc(c->alloc, w->pieces, w->pieceCapacity * sizeof(jsonIovec), capacity * sizeof(jsonIovec));
+		w->pieceCapacity = capacity;
+	}
+	return &w->pieces[g->count++];
+}
+
+// the scratch written since the last piece becomes one, its address is filled in at the end
+static void GatherCut(parserContext* c)
+{
+	gatherState* g = c->gather;
+	if (c->top > g->cut)
+	{
+		jsonIovec* p = GatherSlot(c);
+		p->base = nullptr;
+		p->len = c->top - g->cut;
+		g->cut = c->top;
+	}
+}
+
+static void GatherPiece(parserContext* c, const void* base, size_t len)
+{
+	GatherCut(c);
+	jsonIovec* p = GatherSlot(c);
+	p->base = base;
+	p->len = len;
+}
+
+// text that needs no escaping, referenced if it is long enough
+static inline void Gather_run(parserContext* c, const char* s, size_t len)
+{
+	if (len >= c->gather->inPlace)
+		GatherPiece(c, s, len);
+	else if (len)
+		c->PushStr(s, len);
+}
+
+static void Gather_string(parserContext* c, const char* s, size_t len)
+{
+	size_t run = 0;
+	c->PushChar('\"');
+	for (size_t i = 0; i < len; i++)
+	{
+		if (NeedsEscape(s[i]))
+		{
+			Gather_run(c, s + run, i - run);
+			Stringify_char(c, s[i]);
+			run = i + 1;
+		}
+	}
+	Gather_run(c, s + run, len - run);
+	c->PushChar('\"');
+}
+
+// everything but a non-empty array or object, packed arrays included
+static void Stringify_leaf(parserContext* c, const jsonValue* v)
+{
+	switch (v->type) {
+	case TYPE_NULL:   c->PushStr("null", 4); break;
+	case TYPE_FALSE:  c->PushStr("false", 5); break;
+	case TYPE_TRUE:   c->PushStr("true", 4); break;
+	case TYPE_NUMBER:
+		if (v->flags & VALUE_RAW)
+		{
+			c->PushStr(v->str.s, v->str.len);
+		}
+		else
+		{
+			Stringify_number(c, v->num);
+		}
+		break;
+	case TYPE_STRING:
+		if (v->flags & VALUE_BORROWED)
+		{
+			// never decoded: the raw slice is already valid JSON
+			const char* s = (v->flags & VALUE_ESCAPED) ? v->lazy.raw : v->str.s;
+			size_t len = (v->flags & VALUE_ESCAPED) ? RawLength(v) : v->str.len;
+			c->PushChar('"');
+			if (c->gather)
+			{
+				Gather_run(c, s, len);
+			}
+			else if (len)
+			{
+				c->PushStr(s, len);
+			}
+			c->PushChar('"');
+		}
+		else
+		{
+			Stringify_string(c, v->str.s, v->str.len);
+		}
+		break;
+	case TYPE_ARRAY:
+		c->PushChar('[');
+		if (v->flags & VALUE_PACKED)
+		{
+			for (size_t i = 0; i < v->nums.size; i++)
+			{
+				if (i)
+				{
+					c->PushChar(',');
+				}
+				Stringify_number(c, v->nums.values[i]);
+			}
+		}
+		c->PushChar(']');
+		break;
+	case TYPE_OBJECT: c->PushStr("{}", 2); break;
+	}
+}
+
+static int Stringify_value(parserContext* c, const jsonValue* v);
+
+struct cacheFrame {
+	const jsonValue* v;
+	size_t next;
+	size_t start;     // where this fragment begins in the output
+	size_t oldStart;  // and where it began in the last one
+	bool oldValid;    // the last output holds this fragment at oldStart
+	bool cacheable;   // no uncached container below
+};
+
+/*
+ * Like Stringify_value, but clean cached containers are copied from the last
+ * output instead of being walked, and the offsets and lengths of everything
+ * written are recorded for the next call.
+ */
+static void Stringify_cached(parserContext* c, const jsonValue* v)
+{
+	blockHeader* root = BlockHeader(v);
+	if (!(root->state & BLOCK_DIRTY) && root->json)
+	{
+		c->PushStr(root->json, root->len);
+		return;
+	}
+
+	char* old = root->json;
+	size_t oldLen = root->len;
+	walkStack<cacheFrame> s(c->alloc);
+	*s.Push() = { v, 0, c->top, 0, old && !(root->state & BLOCK_STALE), true };
+	c->PushChar(v->type == TYPE_ARRAY ? '[' : '{');
+
+	while (s.top)
+	{
+		cacheFrame* f = &s.frames[s.top - 1];
+		const jsonValue* p = f->v;
+		size_t size = p->type == TYPE_ARRAY ? p->arr.size : p->obj.size;
+		if (f->next == size)
+		{
+			blockHeader* h = BlockHeader(p);
+			c->PushChar(p->type == TYPE_ARRAY ? ']' : '}');
+			h->offset = s.top > 1 ? f->start - s.frames[s.top - 2].start : 0;
+			h->len = c->top - f->start;
+			h->state = (h->state & BLOCK_HASHED) | (f->cacheable ? 0 : BLOCK_DIRTY);
+			if (--s.top && !f->cacheable)
+			{
+				s.frames[s.top - 1].cacheable = false;
+			}
+			continue;
+		}
+
+		if (f->next)
+		{
+			c->PushChar(',');
+		}
+		const jsonValue* e;
+		if (p->type == TYPE_ARRAY)
+		{
+			e = &p->arr.values[f->next++];
+		}
+		else
+		{
+			const jsonMap* m = &p->obj.maps[f->next++];
+			Stringify_string(c, m->key, m->keyLen);
+			c->PushChar(':');
+			e = &m->value;
+		}
+
+		if (!IsContainer(e) || !(e->type == TYPE_ARRAY ? e->arr.size : e->obj.size))
+		{
+			Stringify_leaf(c, e);
+		}
+		else if (!(e->flags & VALUE_CACHED))
+		{
+			f->cacheable = false;
+			Stringify_value(c, e);
+		}
+		else
+		{
+			blockHeader* h = BlockHeader(e);
+			if (f->oldValid && !(h->state & (BLOCK_DIRTY | BLOCK_STALE)))
+			{
+				size_t from = f->oldStart + h->offset;
+				h->offset = c->top - f->start;
+				c->PushStr(old + from, h->len);
+			}
+			else
+			{
+				bool oldValid = f->oldValid && !(h->state & BLOCK_STALE);
+				*s.Push() = { e, 0, c->top, oldValid ? f->oldStart + h->offset : 0, oldValid, true };
+				c->PushChar(e->type == TYPE_ARRAY ? '[' : '{');
+			}
+		}
+	}
+
+	// the new output replaces the old one only now, the copies above came from it
+	JsonFree(root->alloc, old, oldLen);
+	root->json = (char*)JsonMalloc(root->alloc, root->len);
+	memcpy(root->json, c->stack + c->top - root->len, root->len);
+}
+
+// depth-first with an explicit stack, one frame per open array or object
+static int Stringify_value(parserContext* c, const jsonValue* v)
+{
+	int ret = 0;
+	walkStack<walkFrame> s(c->alloc);
+
+	if (IsContainer(v) && (v->flags & VALUE_CACHED) && !BlockHeader(v)->parent)
+	{
+		blockHeader* h = BlockHeader(v);
+		if (!c->gather)
+		{
+			Stringify_cached(c, v);
+			return ret;
+		}
+		if (!(h->state & BLOCK_DIRTY) && h->json)
+		{
+			GatherPiece(c, h->json, h->len);
+			return ret;
+		}
+		// a gather list has no offsets to record, so a dirty cache is written the plain way and stays dirty
+	}
+
+	while (v)
+	{
+		if (IsContainer(v) && (v->type == TYPE_ARRAY ? v->arr.size : v->obj.size))
+		{
+			c->PushChar(v->type == TYPE_ARRAY ? '[' : '{');
+			*s.Push() = { v, 0 };
+		}
+		else
+		{
+			Stringify_leaf(c, v);
+		}
+
+		// descend into the next child of the innermost open container, closing finished ones
+		v = nullptr;
+		while (!v && s.top)
+		{
+			walkFrame* f = &s.frames[s.top - 1];
+			const jsonValue* p = f->v;
+			if (p->type == TYPE_ARRAY)
+			{
+				if (f->next < p->arr.size)
+				{
+					if (f->next)
+					{
+						c->PushChar(',');
+					}
+					v = &p->arr.values[f->next++];
+				}
+				else
+				{
+					c->PushChar(']');
+					s.top--;
+				}
+			}
+			else
+			{
+				if (f->next < p->obj.size)
+				{
+					const jsonMap* m = &p->obj.maps[f->next++];
+					if (f->next > 1)
+					{
+						c->PushChar(',');
+					}
+					Stringify_string(c, m->key, m->keyLen);
+					c->PushChar(':');
+					v = &m->value;
+				}
+				else
+				{
+					c->PushChar('}');
+					s.top--;
+				}
+			}
+		}
+	}
+
+	return ret;
+}
+
+int Stringify(const jsonValue* v, char** json, size_t* length, jsonStats* stats, const jsonAllocator* alloc)
+{
+	assert(v);
+	assert(json);
+
+#ifdef TINYJSON_STATS
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+#endif
+	int ret = STRINGIFY_OK;
+	parserContext local;
+	alloc = ResolveAllocator(alloc);
+	parserContext* c = ScratchContext(alloc, &local);
+	c->stats = stats;
+	c->top = 0;
+
+	if ((ret = Stringify_value(c, v) != STRINGIFY_OK)) {
+		*json = nullptr;
+		c->stats = nullptr;
+		c->Trim();
+		return ret;
+	}
+
+	// copied out at its exact size, the scratch stays with the context
+	*length = c->top;
+	*json = (char*)JsonMalloc(alloc, *length + 1);
+	memcpy(*json, c->stack, *length);
+	(*json)[*length] = '\0';
+	STATS_ALLOC(c, *length + 1);
+	STATS(c, c->stats->stringifyBytes += *length; c->stats->stringifyNanos += StatsNanosSince(start));
+	c->stats = nullptr;
+	c->Trim();
+	return ret;
+}
+
+// moves the element block of v behind a fresh header and numbers its children
+static void AttachHeader(jsonValue* v, blockHeader* parent, const jsonAllocator* alloc)
+{
+	bool array = v->type == TYPE_ARRAY;
+	size_t size = array ? v->arr.size * sizeof(jsonValue) : v->obj.size * sizeof(jsonMap);
+	blockHeader* h = (blockHeader*)JsonMalloc(alloc, sizeof(blockHeader) + size);
+	void* block = array ? (void*)v->arr.values : (void*)v->obj.maps;
+	memcpy(h + 1, block, size);
+	JsonFree(alloc, block, size);
+	h->parent = parent;
+	h->alloc = alloc;
+	h->json = nullptr;
+	h->offset = h->len = h->hash = 0;
+	h->state = BLOCK_DIRTY | BLOCK_STALE;
+	if (array)
+	{
+		v->arr.values = (jsonValue*)(h + 1);
+	}
+	else
+	{
+		v->obj.maps = (jsonMap*)(h + 1);
+	}
+	v->flags |= VALUE_CACHED;
+
+	for (size_t i = 0; i < (array ? v->arr.size : v->obj.size); i++)
+	{
+		jsonValue* e = array ? &v->arr.values[i] : &v->obj.maps[i].value;
+		e->flags = (e->flags & ~SLOT_MASK) | SLOT_BIT | (array ? 0 : SLOT_IN_OBJECT) | ((unsigned)i << SLOT_INDEX_SHIFT);
+	}
+}
+
+void EnableStringifyCache(jsonValue* root, const jsonAllocator* alloc)
+{
+	assert(root);
+	alloc = ResolveAllocator(alloc);
+	walkStack<walkFrame> s(alloc);
+	*s.Push() = { root, 0 };
+
+	while (s.top)
+	{
+		jsonValue* v = const_cast<jsonValue*>(s.frames[--s.top].v);
+		size_t size = v->type == TYPE_ARRAY ? v->arr.size : v->obj.size;
+		if (!IsContainer(v) || !size)
+		{
+			continue;
+		}
+		if (v->flags & (VALUE_FIXED | VALUE_SHARED))
+		{
+			continue; // no room for a header in a CompactValue() block, or read-only, left uncached along with everything below
+		}
+		blockHeader* parent = (v->flags & SLOT_BIT) ? SlotHeader(v) : nullptr;
+		if (v->flags & VALUE_CACHED)
+		{
+			BlockHeader(v)->parent = parent;
+		}
+		else if (size - 1 <= SLOT_INDEX_MAX)
+		{
+			AttachHeader(v, parent, alloc);
+			MarkDirty(v);
+		}
+		else
+		{
+			continue; // too wide to number its children, left uncached along with everything below
+		}
+		for (size_t i = 0; i < size; i++)
+		{
+			jsonValue* e = v->type == TYPE_ARRAY ? &v->arr.values[i] : &v->obj.maps[i].value;
+			if (IsContainer(e))
+			{
+				*s.Push() = { e, 0 };
+			}
+		}
+	}
+}
+
+/*
+ * Binary layout: the magic, then one value. A value is a binaryTag byte
+ * followed by
+ *   BIN_DOUBLE       8 bytes, native byte order, finite
+ *   BIN_INT          zigzag varint
+ *   BIN_NUMBER_TEXT  varint length, the raw number text, NUL
+ *   BIN_STRING*      varint length, the decoded text, NUL
+ *   BIN_ARRAY        varint count, the elements
+ *   BIN_OBJECT       varint count, then per member a varint key length, the key, NUL and the value
+ */
+enum binaryTag {
+	BIN_NULL,
+	BIN_FALSE,
+	BIN_TRUE,
+	BIN_DOUBLE,
+	BIN_INT,
+	BIN_NUMBER_TEXT,
+	BIN_STRING,        // nothing to escape, safe to borrow
+	BIN_STRING_ESCAPE, // holds characters Stringify() must escape
+	BIN_ARRAY,
+	BIN_OBJECT
+};
+
+static void Binary_varint(parserContext* c, uint64_t n)
+{
+	char* p = (char*)c->PushSz(10);
+	size_t i = 0;
+	for (; n >= 0x80; n >>= 7)
+	{
+		p[i++] = (char)(n | 0x80);
+	}
+	p[i++] = (char)n;
+	c->top -= 10 - i;
+}
+
+static void Binary_text(parserContext* c, binaryTag tag, const char* s, size_t len)
+{
+	c->PushChar(tag);
+	Binary_varint(c, len);
+	if (len)
+	{
+		c->PushStr(s, len);
+	}
+	c->PushChar('\0');
+}
+
+static bool NeedsEscape(const char* s, size_t len)
+{
+	for (size_t i = 0; i < len; i++)
+	{
+		unsigned char ch = (unsigned char)s[i];
+		if (ch < 0x20 || ch == '"' || ch == '\\')
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+// integral doubles that are exact go as varints
+static void Binary_number(parserContext* c, double n)
+{
+	if (n == std::floor(n) && std::fabs(n) <= BINARY_INT_LIMIT && !(n == 0.0 && std::signbit(n)))
+	{
+		int64_t i = (int64_t)n;
+		c->PushChar(BIN_INT);
+		Binary_varint(c, ((uint64_t)i << 1) ^ (uint64_t)(i >> 63));
+	}
+	else
+	{
+		c->PushChar(BIN_DOUBLE);
+		memcpy(c->PushSz(sizeof(double)), &n, sizeof(double));
+	}
+}
+
+static void Binary_value(parserContext* c, const jsonValue* v)
+{
+	walkStack<walkFrame> s(c->alloc);
+
+	while (v)
+	{
+		switch (v->type) {
+		case TYPE_NULL:  c->PushChar(BIN_NULL); break;
+		case TYPE_FALSE: c->PushChar(BIN_FALSE); break;
+		case TYPE_TRUE:  c->PushChar(BIN_TRUE); break;
+		case TYPE_NUMBER:
+			if (v->flags & VALUE_RAW)
+			{
+				Binary_text(c, BIN_NUMBER_TEXT, v->str.s, v->str.len);
+			}
+			else
+			{
+				Binary_number(c, v->num);
+			}
+			break;
+		case TYPE_STRING:
+		{
+			const char* str = GetValueString(v);
+			size_t len = GetValueStringLength(v);
+			Binary_text(c, NeedsEscape(str, len) ? BIN_STRING_ESCAPE : BIN_STRING, str, len);
+			break;
+		}
+		case TYPE_ARRAY:
+			c->PushChar(BIN_ARRAY);
+			Binary_varint(c, v->arr.size);
+			if (v->flags & VALUE_PACKED)
+			{
+				for (size_t i = 0; i < v->nums.size; i++)
+				{
+					Binary_number(c, v->nums.values[i]);
+				}
+			}
+			else
+			{
+				*s.Push() = { v, 0 };
+			}
+			break;
+		case TYPE_OBJECT:
+			c->PushChar(BIN_OBJECT);
+			Binary_varint(c, v->obj.size);
+			*s.Push() = { v, 0 };
+			break;
+		}
+
+		v = nullptr;
+		while (!v && s.top)
+		{
+			walkFrame* f = &s.frames[s.top - 1];
+			const jsonValue* p = f->v;
+			if (f->next == (p->type == TYPE_ARRAY ? p->arr.size : p->obj.size))
+			{
+				s.top--;
+			}
+			else if (p->type == TYPE_ARRAY)
+			{
+				v = &p->arr.values[f->next++];
+			}
+			else
+			{
+				const jsonMap* m = &p->obj.maps[f->next++];
+				Binary_varint(c, m->keyLen);
+				if (m->keyLen)
+				{
+					c->PushStr(m->key, m->keyLen);
+				}
+				c->PushChar('\0');
+				v = &m->value;
+			}
+		}
+	}
+}
+
+int EncodeBinary(const jsonValue* v, char** data, size_t* length, const jsonAllocator* alloc)
+{
+	assert(v && data && length);
+	parserContext local;
+	alloc = ResolveAllocator(alloc);
+	parserContext* c = ScratchContext(alloc, &local);
+	c->top = 0;
+	c->PushStr(BINARY_MAGIC, BINARY_MAGIC_SIZE);
+	Binary_value(c, v);
+
+	*length = c->top;
+	*data = (char*)JsonMalloc(alloc, *length);
+	memcpy(*data, c->stack, *length);
+	c->Trim();
+	return STRINGIFY_OK;
+}
+
+struct binaryInput {
+	const char* p;
+	const char* end;
+
+	bool Varint(uint64_t* n)
+	{
+		*n = 0;
+		for (unsigned shift = 0; shift < 64 && this->p != this->end; shift += 7)
+		{
+			unsigned char b = (unsigned char)*this->p++;
+			*n |= (uint64_t)(b & 0x7f) << shift;
+			if (!(b & 0x80))
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// a length followed by that many bytes and a NUL
+	const char* Text(size_t* len)
+	{
+		uint64_t n;
+		if (!this->Varint(&n) || n >= (uint64_t)(this->end - this->p) || this->p[n] != '\0')
+		{
+			return nullptr;
+		}
+		const char* s = this->p;
+		this->p += n + 1;
+		*len = (size_t)n;
+		return s;
+	}
+};
+
+// the whole of s is one number by the JSON grammar, as ParseNumber() takes it
+static bool IsNumberText(const char* s, size_t len)
+{
+	const char* end = s + len;
+	const char* p = s + (len && *s == '-');
+	if (p == end || !ISDIGIT(*p))
+	{
+		return false;
+	}
+	if (*p++ != '0')
+	{
+		while (p != end && ISDIGIT(*p))
+		{
+			p++;
+		}
+	}
+	if (p != end && *p == '.')
+	{
+		if (++p == end || !ISDIGIT(*p))
+		{
+			return false;
+		}
+		while (p != end && ISDIGIT(*p))
+		{
+			p++;
+		}
+	}
+	if (p != end && (*p == 'e' || *p == 'E'))
+	{
+		if (++p != end && (*p == '+' || *p == '-'))
+		{
+			p++;
+		}
+		if (p == end || !ISDIGIT(*p))
+		{
+			return false;
+		}
+		while (p != end && ISDIGIT(*p))
+		{
+			p++;
+		}
+	}
+	return p == end;
+}
+
+static char* CopyText(const jsonAllocator* alloc, const char* s, size_t len)
+{
+	char* copy = (char*)JsonMalloc(alloc, len + 1);
+	memcpy(copy, s, len);
+	copy[len] = '\0';
+	return copy;
+}
+
+// one value into d, whose children are left zeroed for the caller to fill in
+static parseStatus DecodeBinaryValue(binaryInput* in, jsonValue* d, unsigned flags, const jsonAllocator* alloc)
+{
+	if (in->p == in->end)
+	{
+		return PARSE_ERR_INVALID_VALUE;
+	}
+	unsigned char tag = (unsigned char)*in->p++;
+	const char* text;
+	size_t len;
+	uint64_t n;
+
+	switch (tag) {
+	case BIN_NULL:  d->type = TYPE_NULL; break;
+	case BIN_FALSE: d->type = TYPE_FALSE; break;
+	case BIN_TRUE:  d->type = TYPE_TRUE; break;
+	case BIN_DOUBLE:
+		if (in->end - in->p < (ptrdiff_t)sizeof(double))
+		{
+			return PARSE_ERR_INVALID_VALUE;
+		}
+		memcpy(&d->num, in->p, sizeof(double));
+		if (!std::isfinite(d->num))
+		{
+			return PARSE_ERR_INVALID_VALUE;
+		}
+		in->p += sizeof(double);
+		d->type = TYPE_NUMBER;
+		break;
+	case BIN_INT:
+		if (!in->Varint(&n))
+		{
+			return PARSE_ERR_INVALID_VALUE;
+		}
+		d->num = (double)(int64_t)((n >> 1) ^ (0 - (n & 1)));
+		d->type = TYPE_NUMBER;
+		break;
+	case BIN_NUMBER_TEXT:
+	case BIN_STRING:
+	case BIN_STRING_ESCAPE:
+		if (!(text = in->Text(&len)) || (tag == BIN_NUMBER_TEXT && !IsNumberText(text, len)))
+		{
+			return PARSE_ERR_INVALID_VALUE; // raw numbers are written out verbatim, so they must be numbers
+		}
+		// strings to escape are never borrowed, Stringify() would copy them verbatim; the tag alone is not trusted
+		if ((flags & PARSE_LAZY_STRINGS) && (tag == BIN_NUMBER_TEXT || (tag == BIN_STRING && !NeedsEscape(text, len))))
+		{
+			d->str.s = const_cast<char*>(text);
+			d->flags = VALUE_BORROWED;
+		}
+		else
+		{
+			d->str.s = CopyText(alloc, text, len);
+		}
+		d->str.len = len;
+		d->type = tag == BIN_NUMBER_TEXT ? TYPE_NUMBER : TYPE_STRING;
+		d->flags |= tag == BIN_NUMBER_TEXT ? VALUE_RAW : 0;
+		break;
+	case BIN_ARRAY:
+	case BIN_OBJECT:
+	{
+		// every element takes at least a byte, which bounds the allocation
+		size_t size = tag == BIN_ARRAY ? sizeof(jsonValue) : sizeof(jsonMap);
+		if (!in->Varint(&n) || n > (uint64_t)(in->end - in->p))
+		{
+			return PARSE_ERR_INVALID_VALUE;
+		}
+		void* block = n ? JsonMalloc(alloc, (size_t)n * size) : nullptr;
+		if (n)
+		{
+			memset(block, 0, (size_t)n * size);
+		}
+		if (tag == BIN_ARRAY)
+		{
+			d->arr.values = (jsonValue*)block;
+			d->arr.size = (size_t)n;
+			d->type = TYPE_ARRAY;
+		}
+		else
+		{
+			d->obj.maps = (jsonMap*)block;
+			d->obj.size = (size_t)n;
+			d->type = TYPE_OBJECT;
+			d->flags = flags & PARSE_LAZY_STRINGS ? VALUE_BORROWED : 0;
+		}
+		break;
+	}
+	default:
+		return PARSE_ERR_INVALID_VALUE;
+	}
+	return PARSE_OK;
+}
+
+// blocks are allocated zeroed at their final size, so a failed decode frees like any tree
+parseStatus DecodeBinary(jsonValue* v, const char* data, size_t length, unsigned flags, const jsonAllocator* alloc)
+{
+	assert(v && (data || !length));
+	alloc = ResolveAllocator(alloc);
+	InitValue(v);
+	if (length < BINARY_MAGIC_SIZE || memcmp(data, BINARY_MAGIC, BINARY_MAGIC_SIZE) != 0)
+	{
+		return PARSE_ERR_INVALID_VALUE;
+	}
+
+	binaryInput in = { data + BINARY_MAGIC_SIZE, data + length };
+	walkStack<walkFrame> s(alloc);
+	parseStatus ret;
+	jsonValue* d = v;
+
+	while (d)
+	{
+		if ((ret = DecodeBinaryValue(&in, d, flags, alloc)) != PARSE_OK)
+		{
+			FreeValue(v, alloc);
+			return ret;
+		}
+		if (IsContainer(d))
+		{
+			*s.Push() = { d, 0 };
+		}
+
+		d = nullptr;
+		while (!d && s.top)
+		{
+			walkFrame* f = &s.frames[s.top - 1];
+			jsonValue* p = const_cast<jsonValue*>(f->v);
+			if (f->next == (p->type == TYPE_ARRAY ? p->arr.size : p->obj.size))
+			{
+				s.top--;
+			}
+			else if (p->type == TYPE_ARRAY)
+			{
+				d = &p->arr.values[f->next++];
+			}
+			else
+			{
+				jsonMap* m = &p->obj.maps[f->next++];
+				size_t len;
+				const char* key = in.Text(&len);
+				if (!key)
+				{
+					FreeValue(v, alloc);
+					return PARSE_ERR_MISS_KEY;
+				}
+				m->key = p->flags & VALUE_BORROWED ? const_cast<char*>(key) : CopyText(alloc, key, len);
+				m->keyLen = len;
+				d = &m->value;
+			}
+		}
+	}
+
+	if (in.p != in.end)
+	{
+		FreeValue(v, alloc);
+		return PARSE_ERR_ROOT_NOT_SINGULAR;
+	}
+	return PARSE_OK;
+}
+
+/*
+ * jsonBox layout: a number is its double, with NaNs made the positive quiet
+ * NaN. Anything else sets the top 13 bits, which no such double does, keeps
+ * its valueType in bits 48-50 and, for strings and containers, the arena
+ * offset of its data in the low 48 bits:
+ *   strings  uint64 length, the text, NUL, padded to 8 bytes
+ *   arrays   uint64 count, a box per element
+ *   objects  uint64 count, then a key box (a string) and a value box per member
+ * Keys come first, each distinct one once, then the values depth-first.
+ */
+#define BOX_TAGGED 0xFFF8000000000000ULL
+#define BOX_TYPE_SHIFT 48
+#define BOX_OFFSET_MASK 0x0000FFFFFFFFFFFFULL
+
+static inline jsonBox MakeBox(valueType type, size_t offset)
+{
+	return BOX_TAGGED | ((uint64_t)type << BOX_TYPE_SHIFT) | offset;
+}
+
+static inline const uint64_t* BoxData(const jsonBoxedDoc* d, jsonBox b)
+{
+	return (const uint64_t*)(d->arena + (b & BOX_OFFSET_MASK));
+}
+
+static inline size_t BoxStringSize(size_t len)
+{
+	return (sizeof(uint64_t) + len + 1 + 7) & ~(size_t)7;
+}
+
+static jsonBox BoxNumber(double n)
+{
+	jsonBox b;
+	if (n != n)
+	{
+		return 0x7FF8000000000000ULL;
+	}
+	memcpy(&b, &n, sizeof(b));
+	return b;
+}
+
+static jsonBox BoxString(jsonBoxedDoc* d, size_t* top, const char* s, size_t len)
+{
+	size_t size = BoxStringSize(len);
+	char* p = d->arena + *top;
+	uint64_t n = len;
+	memcpy(p, &n, sizeof(n));
+	memcpy(p + sizeof(n), s, len);
+	memset(p + sizeof(n) + len, 0, size - sizeof(n) - len);
+	jsonBox b = MakeBox(TYPE_STRING, *top);
+	*top += size;
+	return b;
+}
+
+// the distinct keys of the tree being boxed, open addressing on their hashes
+struct boxKeys {
+	struct entry {
+		const char* key; // nullptr for a free slot
+		size_t len;
+		size_t offset;
+	};
+	entry* slots;
+	size_t capacity, count;
+	size_t size; // arena bytes the keys take
+	const jsonAllocator* alloc;
+
+	boxKeys(const jsonAllocator* a) : slots(nullptr), capacity(0), count(0), size(0), alloc(a) {}
+
+	~boxKeys()
+	{
+		JsonFree(this->alloc, this->slots, this->capacity * sizeof(entry));
+	}
+
+	entry* Find(const char* key, size_t len)
+	{
+		size_t mask = this->capacity - 1;
+		for (size_t i = (size_t)HashFinish(HashBytes(0, key, len)) & mask;; i = (i + 1) & mask)
+		{
+			entry* e = &this->slots[i];
+			if (!e->key || (e->len == len && memcmp(e->key, key, len) == 0))
+			{
+				return e;
+			}
+		}
+	}
+
+	// the arena offset of key, which is laid out after the others the first time it is seen
+	size_t Intern(const char* key, size_t len)
+	{
+		assert(key);
+		if (2 * (this->count + 1) > this->capacity)
+		{
+			entry* old = this->slots;
+			size_t oldCapacity = this->capacity;
+			this->capacity = oldCapacity ? oldCapacity * 2 : 64;
+			this->slots = (entry*)JsonMalloc(this->alloc, this->capacity * sizeof(entry));
+			memset(this->slots, 0, this->capacity * sizeof(entry));
+			for (size_t i = 0; i < oldCapacity; i++)
+			{
+				if (old[i].key)
+				{
+					*Find(old[i].key, old[i].len) = old[i];
+				}
+			}
+			JsonFree(this->alloc, old, oldCapacity * sizeof(entry));
+		}
+		entry* e = Find(key, len);
+		if (!e->key)
+		{
+			*e = { key, len, this->size };
+			this->size += BoxStringSize(len);
+			this->count++;
+		}
+		return e->offset;
+	}
+};
+
+// arena bytes the values of the boxed copy of v take; the offset of every key goes to offsets, in order
+static size_t BoxedSize(const jsonValue* v, boxKeys* keys, walkStack<size_t>* offsets)
+{
+	walkStack<walkFrame> s(keys->alloc);
+	size_t size = 0;
+
+	for (;;)
+	{
+		if (v->type == TYPE_STRING)
+		{
+			size += BoxStringSize(GetValueStringLength(v));
+		}
+		else if (v->type == TYPE_ARRAY || v->type == TYPE_OBJECT)
+		{
+			size += sizeof(jsonBox) * (1 + (v->type == TYPE_ARRAY ? v->arr.size : 2 * v->obj.size));
+			if (IsContainer(v))
+			{
+				*s.Push() = { v, 0 };
+			}
+		}
+
+		v = nullptr;
+		while (!v && s.top)
+		{
+			walkFrame* f = &s.frames[s.top - 1];
+			const jsonValue* p = f->v;
+			if (f->next == (p->type == TYPE_ARRAY ? p->arr.size : p->obj.size))
+			{
+				s.top--;
+			}
+			else if (p->type == TYPE_ARRAY)
+			{
+				v = &p->arr.values[f->next++];
+			}
+			else
+			{
+				const jsonMap* m = &p->obj.maps[f->next++];
+				*offsets->Push() = keys->Intern(m->key, m->keyLen);
+				v = &m->value;
+			}
+		}
+		if (!v)
+		{
+			return size;
+		}
+	}
+}
+
+struct boxFrame {
+	const jsonValue* v;
+	size_t next;
+	size_t block; // arena offset of its count
+};
+
+// one pass to size the arena and lay out the keys, one to fill it
+void BoxValue(jsonBoxedDoc* d, const jsonValue* v, const jsonAllocator* alloc)
+{
+	assert(d && v);
+	d->alloc = ResolveAllocator(alloc);
+	boxKeys keys(d->alloc);
+	walkStack<size_t> offsets(d->alloc);
+	d->size = BoxedSize(v, &keys, &offsets);
+	d->size += keys.size;
+	assert(d->size <= BOX_OFFSET_MASK);
+	d->arena = d->size ? (char*)JsonMalloc(d->alloc, d->size) : nullptr;
+	for (size_t i = 0; i < keys.capacity; i++)
+	{
+		if (keys.slots[i].key)
+		{
+			size_t top = keys.slots[i].offset;
+			BoxString(d, &top, keys.slots[i].key, keys.slots[i].len);
+		}
+	}
+
+	walkStack<boxFrame> s(d->alloc);
+	jsonBox* slot = &d->root;
+	size_t top = keys.size, key = 0;
+
+	while (v)
+	{
+		switch (v->type) {
+		case TYPE_NUMBER: *slot = BoxNumber(GetValueNumber(v)); break;
+		case TYPE_STRING: *slot = BoxString(d, &top, GetValueString(v), GetValueStringLength(v)); break;
+		case TYPE_ARRAY:
+		case TYPE_OBJECT:
+		{
+			uint64_t size = v->type == TYPE_ARRAY ? v->arr.size : v->obj.size;
+			memcpy(d->arena + top, &size, sizeof(size));
+			*slot = MakeBox(v->type, top);
+			if (v->flags & VALUE_PACKED)
+			{
+				jsonBox* boxes = (jsonBox*)(d->arena + top) + 1;
+				for (size_t i = 0; i < v->nums.size; i++)
+				{
+					boxes[i] = BoxNumber(v->nums.values[i]);
+				}
+			}
+			else
+			{
+				*s.Push() = { v, 0, top };
+			}
+			top += sizeof(jsonBox) * (1 + (v->type == TYPE_ARRAY ? size : 2 * size));
+			break;
+		}
+		default:
+			*slot = MakeBox(v->type, 0);
+			break;
+		}
+
+		v = nullptr;
+		while (!v && s.top)
+		{
+			boxFrame* f = &s.frames[s.top - 1];
+			const jsonValue* p = f->v;
+			jsonBox* boxes = (jsonBox*)(d->arena + f->block) + 1;
+			if (f->next == (p->type == TYPE_ARRAY ? p->arr.size : p->obj.size))
+			{
+				s.top--;
+			}
+			else if (p->type == TYPE_ARRAY)
+			{
+				slot = &boxes[f->next];
+				v = &p->arr.values[f->next++];
+			}
+			else
+			{
+				const jsonMap* m = &p->obj.maps[f->next];
+				boxes[2 * f->next] = MakeBox(TYPE_STRING, offsets.frames[key++]);
+				slot = &boxes[2 * f->next + 1];
+				v = &m->value;
+				f->next++;
+			}
+		}
+	}
+	assert(top == d->size);
+}
+
+struct unboxFrame {
+	const jsonBox* boxes;
+	size_t next;
+	jsonValue* v;
+};
+
+void UnboxValue(jsonValue* v, const jsonBoxedDoc* d, jsonBox b, const jsonAllocator* alloc)
+{
+	assert(v && d);
+	alloc = ResolveAllocator(alloc);
+	walkStack<unboxFrame> s(alloc);
+	jsonValue* dst = v;
+
+	while (dst)
+	{
+		valueType type = GetBoxType(b);
+		dst->type = type;
+		dst->flags = 0;
+		if (type == TYPE_NUMBER)
+		{
+			dst->num = GetBoxNumber(b);
+		}
+		else if (type == TYPE_STRING)
+		{
+			size_t len;
+			const char* str = GetBoxString(d, b, &len);
+			dst->str.s = CopyText(alloc, str, len);
+			dst->str.len = len;
+		}
+		else if (type == TYPE_ARRAY || type == TYPE_OBJECT)
+		{
+			size_t size = (size_t)*BoxData(d, b);
+			size_t bytes = size * (type == TYPE_ARRAY ? sizeof(jsonValue) : sizeof(jsonMap));
+			void* block = size ? JsonMalloc(alloc, bytes) : nullptr;
+			if (type == TYPE_ARRAY)
+			{
+				dst->arr.values = (jsonValue*)block;
+				dst->arr.size = size;
+			}
+			else
+			{
+				dst->obj.maps = (jsonMap*)block;
+				dst->obj.size = size;
+			}
+			*s.Push() = { (const jsonBox*)BoxData(d, b) + 1, 0, dst };
+		}
+
+		dst = nullptr;
+		while (!dst && s.top)
+		{
+			unboxFrame* f = &s.frames[s.top - 1];
+			jsonValue* p = f->v;
+			if (f->next == (p->type == TYPE_ARRAY ? p->arr.size : p->obj.size))
+			{
+				s.top--;
+			}
+			else if (p->type == TYPE_ARRAY)
+			{
+				b = f->boxes[f->next];
+				dst = &p->arr.values[f->next++];
+			}
+			else
+			{
+				jsonMap* m = &p->obj.maps[f->next];
+				const char* key = GetBoxString(d, f->boxes[2 * f->next], &m->keyLen);
+				m->key = CopyText(alloc, key, m->keyLen);
+				b = f->boxes[2 * f->next + 1];
+				dst = &m->value;
+				f->next++;
+			}
+		}
+	}
+}
+
+void FreeBoxedDoc(jsonBoxedDoc* d)
+{
+	assert(d);
+	JsonFree(d->alloc, d->arena, d->size);
+	d->arena = nullptr;
+	d->size = 0;
+	d->root = MakeBox(TYPE_NULL, 0);
+}
+
+valueType GetBoxType(jsonBox b)
+{
+	return (b & BOX_TAGGED) == BOX_TAGGED ? (valueType)((b >> BOX_TYPE_SHIFT) & 7) : TYPE_NUMBER;
+}
+
+double GetBoxNumber(jsonBox b)
+{
+	assert(GetBoxType(b) == TYPE_NUMBER);
+	double n;
+	memcpy(&n, &b, sizeof(n));
+	return n;
+}
+
+const char* GetBoxString(const jsonBoxedDoc* d, jsonBox b, size_t* length)
+{
+	assert(d && length && GetBoxType(b) == TYPE_STRING);
+	const uint64_t* p = BoxData(d, b);
+	*length = (size_t)p[0];
+	return (const char*)(p + 1);
+}
+
+size_t GetBoxSize(const jsonBoxedDoc* d, jsonBox b)
+{
+	assert(d && (GetBoxType(b) == TYPE_ARRAY || GetBoxType(b) == TYPE_OBJECT));
+	return (size_t)*BoxData(d, b);
+}
+
+jsonBox GetBoxElement(const jsonBoxedDoc* d, jsonBox b, size_t index)
+{
+	assert(GetBoxType(b) == TYPE_ARRAY && index < GetBoxSize(d, b));
+	return BoxData(d, b)[1 + index];
+}
+
+const char* GetBoxKey(const jsonBoxedDoc* d, jsonBox b, size_t index, size_t* length)
+{
+	assert(GetBoxType(b) == TYPE_OBJECT && index < GetBoxSize(d, b));
+	return GetBoxString(d, BoxData(d, b)[1 + 2 * index], length);
+}
+
+jsonBox GetBoxMember(const jsonBoxedDoc* d, jsonBox b, size_t index)
+{
+	assert(GetBoxType(b) == TYPE_OBJECT && index < GetBoxSize(d, b));
+	return BoxData(d, b)[2 + 2 * index];
+}
+
+static parserContext* NewContext(const char* json, const jsonAllocator* alloc)
+{
+	alloc = ResolveAllocator(alloc);
+	parserContext* c = new (JsonMalloc(alloc, sizeof(parserContext))) parserContext;
+	c->alloc = alloc;
+	c->json = json;
+	c->stack = nullptr;
+	c->size = c->top = 0;
+	c->state = READER_VALUE;
+	c->stats = nullptr;
+	c->maxDepth = PARSE_MAX_DEPTH;
+	c->flags = 0;
+	c->trimSize = SCRATCH_TRIM_SIZE;
+	return c;
+}
+
+static void DeleteContext(parserContext* c)
+{
+	const jsonAllocator* alloc = c->alloc;
+	c->~parserContext();
+	JsonFree(alloc, c, sizeof(parserContext));
+}
+
+void InitReader(jsonReader* r, const char* json, const jsonAllocator* alloc)
+{
+	assert(r && json);
+	r->context = NewContext(json, alloc);
+}
+
+void FreeReader(jsonReader* r)
+{
+	assert(r);
+	DeleteContext(r->context);
+	r->context = nullptr;
+}
+
+// consumes separators up to the next token and reports its type
+static parseStatus ReaderPeek(parserContext* c, tokenType* type)
+{
+	ParseWhitespace(c);
+
+	if (c->state == READER_NEXT)
+	{
+		if (c->top == 0)
+		{
+			if (*c->json != '\0')
+			{
+				return PARSE_ERR_ROOT_NOT_SINGULAR;
+			}
+			*type = TOKEN_END;
+			return PARSE_OK;
+		}
+
+		bool inArray = c->stack[c->top - 1] == '[';
+		if (*c->json == ',')
+		{
+			c->json++;
+			ParseWhitespace(c);
+			c->state = inArray ? READER_VALUE : READER_KEY;
+		}
+		else if (*c->json == (inArray ? ']' : '}'))
+		{
+			*type = inArray ? TOKEN_ARRAY_END : TOKEN_OBJECT_END;
+			return PARSE_OK;
+		}
+		else
+		{
+			return inArray ? PARSE_ERR_MISS_COMMA_OR_SQUARE_BRACKET : PARSE_ERR_MISS_COMMA_OR_CURLY_BRACKET;
+		}
+	}
+	else if (c->state == READER_FIRST_VALUE && *c->json == ']')
+	{
+		*type = TOKEN_ARRAY_END;
+		return PARSE_OK;
+	}
+	else if (c->state == READER_FIRST_KEY && *c->json == '}')
+	{
+		*type = TOKEN_OBJECT_END;
+		return PARSE_OK;
+	}
+
+	if (c->state == READER_KEY || c->state == READER_FIRST_KEY)
+	{
+		if (*c->json != '"')
+		{
+			return PARSE_ERR_MISS_KEY;
+		}
+		*type = TOKEN_KEY;
+		return PARSE_OK;
+	}
+
+	switch (*c->json) {
+	case '[':  *type = TOKEN_ARRAY_BEGIN; break;
+	case '{':  *type = TOKEN_OBJECT_BEGIN; break;
+	case '"':  *type = TOKEN_STRING; break;
+	case 't':  *type = TOKEN_TRUE; break;
+	case 'f':  *type = TOKEN_FALSE; break;
+	case 'n':  *type = TOKEN_NULL; break;
+	case '\0': return PARSE_ERR_EXPECT_VALUE;
+	default:   *type = TOKEN_NUMBER; break;
+	}
+	return PARSE_OK;
+}
+
+parseStatus PeekToken(jsonReader* r, tokenType* type)
+{
+	assert(r && type);
+	return ReaderPeek(r->context, type);
+}
+
+parseStatus ReadToken(jsonReader* r, jsonToken* t)
+{
+	assert(r && t);
+
+	parserContext* c = r->context;
+	parseStatus ret;
+	char* s;
+
+	if ((ret = ReaderPeek(c, &t->type)) != PARSE_OK)
+	{
+		return ret;
+	}
+
+	switch (t->type) {
+	case TOKEN_END:
+		break;
+	case TOKEN_ARRAY_END:
+	case TOKEN_OBJECT_END:
+		c->json++;
+		c->top--;
+		c->state = READER_NEXT;
+		break;
+	case TOKEN_ARRAY_BEGIN:
+	case TOKEN_OBJECT_BEGIN:
+		c->PushChar(*c->json++);
+		c->state = t->type == TOKEN_ARRAY_BEGIN ? READER_FIRST_VALUE : READER_FIRST_KEY;
+		break;
+	case TOKEN_KEY:
+		if ((ret = ParseStringRaw(c, &s, t->str.len)) != PARSE_OK)
+		{
+			return ret;
+		}
+		t->str.s = s;
+		ParseWhitespace(c);
+		if (*c->json != ':')
+		{
+			return PARSE_ERR_MISS_COLON;
+		}
+		c->json++;
+		c->state = READER_VALUE;
+		break;
+	case TOKEN_STRING:
+		if ((ret = ParseStringRaw(c, &s, t->str.len)) != PARSE_OK)
+		{
+			return ret;
+		}
+		t->str.s = s;
+		c->state = READER_NEXT;
+		break;
+	default:
+	{
+		jsonValue v;
+		InitValue(&v);
+		if ((ret = ParseValue(c, &v)) != PARSE_OK)
+		{
+			return ret;
+		}
+		t->num = v.type == TYPE_NUMBER ? v.num : 0.0;
+		c->state = READER_NEXT;
+		break;
+	}
+	}
+	return PARSE_OK;
+}
+
+parseStatus SkipValue(jsonReader* r)
+{
+	assert(r);
+
+	parserContext* c = r->context;
+	parseStatus ret;
+	jsonToken t;
+	size_t depth = 0;
+
+	do {
+		if ((ret = ReaderPeek(c, &t.type)) != PARSE_OK)
+		{
+			return ret;
+		}
+		if (t.type == TOKEN_STRING || t.type == TOKEN_KEY)
+		{
+			// validated, but not decoded onto the stack
+			const char* s;
+			size_t len;
+			bool escaped;
+			if ((ret = ScanString(c, &s, &len, &escaped)) != PARSE_OK)
+			{
+				return ret;
+			}
+			c->state = READER_NEXT;
+			if (t.type == TOKEN_KEY)
+			{
+				ParseWhitespace(c);
+				if (*c->json != ':')
+				{
+					return PARSE_ERR_MISS_COLON;
+				}
+				c->json++;
+				c->state = READER_VALUE;
+			}
+			continue;
+		}
+		if (t.type == TOKEN_NUMBER)
+		{
+			// validated as raw text; only an exponent or a very long integer can overflow, which needs strtod()
+			jsonValue v;
+			unsigned flags = c->flags;
+			c->flags |= PARSE_RAW_NUMBERS;
+			ret = ParseNumber(c, &v);
+			c->flags = flags;
+			if (ret != PARSE_OK)
+			{
+				return ret;
+			}
+			if ((v.str.len > DBL_MAX_10_EXP || memchr(v.str.s, 'e', v.str.len) || memchr(v.str.s, 'E', v.str.len))
+				&& (errno = 0, fabs(strtod(v.str.s, NULL)) == HUGE_VAL) && errno == ERANGE)
+			{
+				return PARSE_ERR_NUMBER_OVERFLOW;
+			}
+			c->state = READER_NEXT;
+			continue;
+		}
+		if ((ret = ReadToken(r, &t)) != PARSE_OK)
+		{
+			return ret;
+		}
+		switch (t.type) {
+		case TOKEN_ARRAY_BEGIN:
+		case TOKEN_OBJECT_BEGIN:
+			depth++;
+			break;
+		case TOKEN_ARRAY_END:
+		case TOKEN_OBJECT_END:
+		case TOKEN_END:
+			if (depth == 0)
+			{
+				return PARSE_ERR_EXPECT_VALUE;
+			}
+			depth--;
+			break;
+		default:
+			break;
+		}
+	} while (depth > 0);
+
+	return PARSE_OK;
+}
+
+parseStatus ReadValue(jsonReader* r, jsonValue* v)
+{
+	assert(r && v);
+
+	parserContext* c = r->context;
+	parseStatus ret;
+	tokenType type;
+
+	InitValue(v);
+	if ((ret = ReaderPeek(c, &type)) != PARSE_OK)
+	{
+		return ret;
+	}
+	if (type == TOKEN_END || type == TOKEN_ARRAY_END || type == TOKEN_OBJECT_END || type == TOKEN_KEY)
+	{
+		return PARSE_ERR_EXPECT_VALUE;
+	}
+	if ((ret = ParseValue(c, v)) == PARSE_OK)
+	{
+		c->state = READER_NEXT;
+	}
+	return ret;
+}
+
+static inline size_t BitmapSize(size_t rows)
+{
+	return (rows + 7) / 8;
+}
+
+static inline bool BitmapGet(const uint8_t* bits, size_t i)
+{
+	return (bits[i / 8] >> (i % 8)) & 1;
+}
+
+// bytes of the per-row array of a column of this type
+static size_t ColumnDataSize(columnType type, size_t rows)
+{
+	switch (type) {
+	case COLUMN_BOOLEAN: return BitmapSize(rows);
+	case COLUMN_NUMBER:  return rows * sizeof(double);
+	case COLUMN_STRING:  return (rows + 1) * sizeof(size_t);
+	case COLUMN_VALUE:   return rows * sizeof(jsonValue);
+	default:             return 0;
+	}
+}
+
+static void* ColumnData(const jsonColumn* col)
+{
+	switch (col->type) {
+	case COLUMN_BOOLEAN: return col->booleans;
+	case COLUMN_NUMBER:  return col->numbers;
+	case COLUMN_STRING:  return col->strings.offsets;
+	case COLUMN_VALUE:   return col->values;
+	default:             return nullptr;
+	}
+}
+
+// the per-row array of col, resized from `from` rows to `to`, new bytes zeroed
+static void ResizeColumnData(jsonColumn* col, size_t from, size_t to, const jsonAllocator* alloc)
+{
+	size_t fromSize = from ? ColumnDataSize(col->type, from) : 0, toSize = ColumnDataSize(col->type, to);
+	char* data = (char*)JsonRealloc(alloc, ColumnData(col), fromSize, toSize);
+	if (toSize > fromSize)
+	{
+		memset(data + fromSize, 0, toSize - fromSize);
+	}
+	switch (col->type) {
+	case COLUMN_BOOLEAN: col->booleans = (uint8_t*)data; break;
+	case COLUMN_NUMBER:  col->numbers = (double*)data; break;
+	case COLUMN_STRING:  col->strings.offsets = (size_t*)data; break;
+	case COLUMN_VALUE:   col->values = (jsonValue*)data; break;
+	default:             break;
+	}
+}
+
+// a column being filled, its arrays have room for capacity rows
+struct columnBuilder {
+	jsonColumn col;
+	size_t filled;        // rows settled so far, the ones after are null until written
+	size_t capacity;
+	size_t textCapacity;
+};
+
+static void ResizeColumn(columnBuilder* b, size_t capacity, const jsonAllocator* alloc)
+{
+	jsonColumn* col = &b->col;
+	col->nulls = (uint8_t*)JsonRealloc(alloc, col->nulls, BitmapSize(b->capacity), BitmapSize(capacity));
+	if (capacity > b->capacity)
+	{
+		memset(col->nulls + BitmapSize(b->capacity), 0xff, BitmapSize(capacity) - BitmapSize(b->capacity));
+	}
+	if (col->type != COLUMN_NULL)
+	{
+		ResizeColumnData(col, b->capacity, capacity, alloc);
+	}
+	b->capacity = capacity;
+}
+
+static void FreeColumnBuilder(columnBuilder* b, const jsonAllocator* alloc)
+{
+	jsonColumn* col = &b->col;
+	if (col->type == COLUMN_VALUE)
+	{
+		for (size_t i = 0; i < b->filled; i++)
+		{
+			FreeValue(&col->values[i], alloc);
+		}
+	}
+	else if (col->type == COLUMN_STRING)
+	{
+		JsonFree(alloc, col->strings.text, b->textCapacity);
+	}
+	JsonFree(alloc, ColumnData(col), ColumnDataSize(col->type, b->capacity));
+	JsonFree(alloc, col->nulls, BitmapSize(b->capacity));
+	JsonFree(alloc, col->name, col->nameLen + 1);
+}
+
+// string rows from the last settled one up to `to` that were never written are empty
+static void FillOffsets(columnBuilder* b, size_t to)
+{
+	size_t* offsets = b->col.strings.offsets;
+	for (size_t i = b->filled + 1; i <= to; i++)
+	{
+		offsets[i] = offsets[b->filled];
+	}
+}
+
+static void AppendText(columnBuilder* b, size_t row, const char* s, size_t len, const jsonAllocator* alloc)
+{
+	size_t* offsets = b->col.strings.offsets;
+	FillOffsets(b, row);
+	size_t end = offsets[row] + len;
+	if (end > b->textCapacity)
+	{
+		size_t capacity = b->textCapacity ? b->textCapacity : 64;
+		while (capacity < end)
+		{
+			capacity += capacity / 2;
+		}
+		b->col.strings.text = (char*)JsonRealloc(alloc, b->col.strings.text, b->textCapacity, capacity);
+		b->textCapacity = capacity;
+	}
+	if (len)
+	{
+		memcpy(b->col.strings.text + offsets[row], s, len);
+	}
+	offsets[row + 1] = end;
+}
+
+// a column that meets a second type holds jsonValues from then on
+static void PromoteColumn(columnBuilder* b, const jsonAllocator* alloc)
+{
+	jsonColumn* col = &b->col;
+	jsonValue* values = (jsonValue*)JsonMalloc(alloc, b->capacity * sizeof(jsonValue));
+	memset(values, 0, b->capacity * sizeof(jsonValue));
+	for (size_t i = 0; i < b->filled; i++)
+	{
+		jsonValue* v = &values[i];
+		if (BitmapGet(col->nulls, i))
+		{
+			continue;
+		}
+		switch (col->type) {
+		case COLUMN_BOOLEAN:
+			v->type = BitmapGet(col->booleans, i) ? TYPE_TRUE : TYPE_FALSE;
+			break;
+		case COLUMN_NUMBER:
+			v->type = TYPE_NUMBER;
+			v->num = col->numbers[i];
+			break;
+		default:
+			v->type = TYPE_STRING;
+			v->str.len = col->strings.offsets[i + 1] - col->strings.offsets[i];
+			v->str.s = CopyText(alloc, col->strings.text + col->strings.offsets[i], v->str.len);
+			break;
+		}
+	}
+	if (col->type == COLUMN_STRING)
+	{
+		JsonFree(alloc, col->strings.text, b->textCapacity);
+		b->textCapacity = 0;
+	}
+	JsonFree(alloc, ColumnData(col), ColumnDataSize(col->type, b->capacity));
+	col->type = COLUMN_VALUE;
+	col->values = values;
+}
+
+static columnType CellType(const jsonValue* v)
+{
+	switch (v->type) {
+	case TYPE_NULL:   return COLUMN_NULL;
+	case TYPE_FALSE:
+	case TYPE_TRUE:   return COLUMN_BOOLEAN;
+	case TYPE_NUMBER: return COLUMN_NUMBER;
+	case TYPE_STRING: return COLUMN_STRING;
+	default:          return COLUMN_VALUE;
+	}
+}
+
+static void AppendCell(columnBuilder* b, size_t row, const jsonValue* v, const jsonAllocator* alloc)
+{
+	jsonColumn* col = &b->col;
+	if (row < b->filled)
+	{
+		return; // a repeated key, the first one wins
+	}
+	if (row >= b->capacity)
+	{
+		ResizeColumn(b, row >= 2 * b->capacity ? row + 1 : 2 * b->capacity, alloc);
+	}
+
+	columnType type = CellType(v);
+	if (type == COLUMN_NULL)
+	{
+		if (col->type == COLUMN_STRING)
+		{
+			FillOffsets(b, row + 1);
+		}
+		b->filled = row + 1;
+		return;
+	}
+	if (col->type == COLUMN_NULL)
+	{
+		col->type = type;
+		ResizeColumnData(col, 0, b->capacity, alloc);
+	}
+	else if (col->type != type && col->type != COLUMN_VALUE)
+	{
+		PromoteColumn(b, alloc);
+	}
+
+	switch (col->type) {
+	case COLUMN_BOOLEAN:
+		if (v->type == TYPE_TRUE)
+		{
+			col->booleans[row / 8] |= 1u << (row % 8);
+		}
+		break;
+	case COLUMN_NUMBER:
+		col->numbers[row] = GetValueNumber(v);
+		break;
+	case COLUMN_STRING:
+		AppendText(b, row, GetValueString(v), GetValueStringLength(v), alloc);
+		break;
+	default:
+		CopyValueRaw(&col->values[row], v, alloc);
+		break;
+	}
+	col->nulls[row / 8] &= ~(1u << (row % 8));
+	b->filled = row + 1;
+}
+
+// the column for key, tried at the member's position first since records tend to share a layout
+static columnBuilder* ColumnFor(walkStack<columnBuilder>* cols, size_t position, const char* key, size_t len, const jsonAllocator* alloc)
+{
+	for (size_t k = 0; k < cols->top; k++)
+	{
+		columnBuilder* b = &cols->frames[(position + k) % cols->top];
+		if (b->col.nameLen == len && memcmp(b->col.name, key, len) == 0)
+		{
+			return b;
+		}
+	}
+	columnBuilder* b = cols->Push();
+	memset(b, 0, sizeof(columnBuilder));
+	b->col.name = CopyText(alloc, key, len);
+	b->col.nameLen = len;
+	b->col.type = COLUMN_NULL;
+	return b;
+}
+
+// trims every column to rows and hands them over to out
+static void FinishColumns(jsonColumns* out, walkStack<columnBuilder>* cols, size_t rows, const jsonAllocator* alloc)
+{
+	out->rows = rows;
+	out->count = cols->top;
+	out->alloc = alloc;
+	out->columns = cols->top ? (jsonColumn*)JsonMalloc(alloc, cols->top * sizeof(jsonColumn)) : nullptr;
+	for (size_t i = 0; i < cols->top; i++)
+	{
+		columnBuilder* b = &cols->frames[i];
+		ResizeColumn(b, rows, alloc); // first: a column that started late may not have room for all rows yet
+		if (b->col.type == COLUMN_STRING)
+		{
+			FillOffsets(b, rows);
+			size_t size = b->col.strings.offsets[rows];
+			if (!size)
+			{
+				JsonFree(alloc, b->col.strings.text, b->textCapacity);
+				b->col.strings.text = nullptr;
+			}
+			else if (size != b->textCapacity)
+			{
+				b->col.strings.text = (char*)JsonRealloc(alloc, b->col.strings.text, b->textCapacity, size);
+			}
+		}
+		out->columns[i] = b->col;
+	}
+	cols->top = 0;
+}
+
+static void ColumnsError(jsonColumns* out, walkStack<columnBuilder>* cols, const jsonAllocator* alloc)
+{
+	for (size_t i = 0; i < cols->top; i++)
+	{
+		FreeColumnBuilder(&cols->frames[i], alloc);
+	}
+	out->columns = nullptr;
+	out->count = out->rows = 0;
+	out->alloc = alloc;
+}
+
+parseStatus ColumnsFromValue(jsonColumns* out, const jsonValue* records, const jsonAllocator* alloc)
+{
+	assert(out && records);
+	alloc = ResolveAllocator(alloc);
+	walkStack<columnBuilder> cols(alloc);
+
+	if (records->type != TYPE_ARRAY || IsPacked(records))
+	{
+		ColumnsError(out, &cols, alloc);
+		return PARSE_ERR_TYPE_MISMATCH;
+	}
+	for (size_t row = 0; row < records->arr.size; row++)
+	{
+		const jsonValue* r = &records->arr.values[row];
+		if (r->type != TYPE_OBJECT)
+		{
+			ColumnsError(out, &cols, alloc);
+			return PARSE_ERR_TYPE_MISMATCH;
+		}
+		for (size_t i = 0; i < r->obj.size; i++)
+		{
+			const jsonMap* m = &r->obj.maps[i];
+			AppendCell(ColumnFor(&cols, i, m->key, m->keyLen, alloc), row, &m->value, alloc);
+		}
+	}
+	FinishColumns(out, &cols, records->arr.size, alloc);
+	return PARSE_OK;
+}
+
+// the rows go straight from the reader into the columns, only nested values become trees
+parseStatus ParseColumns(jsonColumns* out, const char* json, const jsonAllocator* alloc)
+{
+	assert(out && json);
+	alloc = ResolveAllocator(alloc);
+	walkStack<columnBuilder> cols(alloc);
+	jsonReader r;
+	jsonToken t;
+	tokenType next;
+	size_t rows = 0;
+
+	InitReader(&r, json, alloc);
+	parseStatus ret = ReadToken(&r, &t);
+	if (ret == PARSE_OK && t.type != TOKEN_ARRAY_BEGIN)
+	{
+		ret = PARSE_ERR_TYPE_MISMATCH;
+	}
+	while (ret == PARSE_OK && (ret = ReadToken(&r, &t)) == PARSE_OK && t.type != TOKEN_ARRAY_END)
+	{
+		if (t.type != TOKEN_OBJECT_BEGIN)
+		{
+			ret = PARSE_ERR_TYPE_MISMATCH;
+			break;
+		}
+		for (size_t i = 0; (ret = ReadToken(&r, &t)) == PARSE_OK && t.type == TOKEN_KEY; i++)
+		{
+			columnBuilder* b = ColumnFor(&cols, i, t.str.s, t.str.len, alloc);
+			jsonValue v;
+			if ((ret = PeekToken(&r, &next)) != PARSE_OK)
+			{
+				break;
+			}
+			if (next == TOKEN_ARRAY_BEGIN || next == TOKEN_OBJECT_BEGIN)
+			{
+				if ((ret = ReadValue(&r, &v)) != PARSE_OK)
+				{
+					break;
+				}
+				AppendCell(b, rows, &v, alloc);
+				FreeValue(&v, alloc);
+				continue;
+			}
+			if ((ret = ReadToken(&r, &t)) != PARSE_OK)
+			{
+				break;
+			}
+			// scalars are looked at in place, the string borrows the reader's scratch
+			v.flags = 0;
+			switch (t.type) {
+			case TOKEN_NUMBER: v.type = TYPE_NUMBER; v.num = t.num; break;
+			case TOKEN_STRING:
+				v.type = TYPE_STRING;
+				v.flags = VALUE_BORROWED;
+				v.str.s = const_cast<char*>(t.str.s);
+				v.str.len = t.str.len;
+				break;
+			default: v.type = t.type == TOKEN_TRUE ? TYPE_TRUE : t.type == TOKEN_FALSE ? TYPE_FALSE : TYPE_NULL; break;
+			}
+			AppendCell(b, rows, &v, alloc);
+		}
+		rows++;
+	}
+	if (ret == PARSE_OK && (ret = ReadToken(&r, &t)) == PARSE_OK && t.type != TOKEN_END)
+	{
+		ret = PARSE_ERR_ROOT_NOT_SINGULAR;
+	}
+	FreeReader(&r);
+
+	if (ret != PARSE_OK)
+	{
+		ColumnsError(out, &cols, alloc);
+		return ret;
+	}
+	FinishColumns(out, &cols, rows, alloc);
+	return PARSE_OK;
+}
+
+void FreeColumns(jsonColumns* c)
+{
+	assert(c);
+	for (size_t i = 0; i < c->count; i++)
+	{
+		columnBuilder b = { c->columns[i], c->rows, c->rows, 0 };
+		if (b.col.type == COLUMN_STRING)
+		{
+			b.textCapacity = b.col.strings.offsets[c->rows];
+		}
+		FreeColumnBuilder(&b, c->alloc);
+	}
+	JsonFree(c->alloc, c->columns, c->count * sizeof(jsonColumn));
+	c->columns = nullptr;
+	c->count = c->rows = 0;
+}
+
+const jsonColumn* FindColumn(const jsonColumns* c, const char* name, size_t len)
+{
+	assert(c && (name || !len));
+	for (size_t i = 0; i < c->count; i++)
+	{
+		if (c->columns[i].nameLen == len && memcmp(c->columns[i].name, name, len) == 0)
+		{
+			return &c->columns[i];
+		}
+	}
+	return nullptr;
+}
+
+bool IsColumnNull(const jsonColumn* col, size_t row)
+{
+	assert(col);
+	return BitmapGet(col->nulls, row);
+}
+
+const char* GetColumnString(const jsonColumn* col, size_t row, size_t* length)
+{
+	assert(col && col->type == COLUMN_STRING && length);
+	*length = col->strings.offsets[row + 1] - col->strings.offsets[row];
+	return col->strings.text + col->strings.offsets[row];
+}
+
+enum pathStepKind {
+	STEP_KEY,
+	STEP_INDEX,
+	STEP_ANY,
+	STEP_FILTER
+};
+
+struct pathStep {
+	pathStepKind kind;
+	bool descendant; // written after .., tried at every depth below
+	char* key;       // STEP_KEY
+	size_t len;
+	size_t index;    // STEP_INDEX, or the root expression of a STEP_FILTER
+};
+
+enum exprOp {
+	EXPR_OR,
+	EXPR_AND,
+	EXPR_NOT,
+	EXPR_EXISTS,
+	EXPR_EQ,
+	EXPR_NE,
+	EXPR_LT,
+	EXPR_LE,
+	EXPR_GT,
+	EXPR_GE,
+	EXPR_PATH,
+	EXPR_LITERAL
+};
+
+// a filter node; the terms of || and && are chained through next
+struct pathExpr {
+	exprOp op;
+	size_t a, b;   // operands, the first term of a chain, or EXPR_PATH's first operand step and step count
+	size_t next;
+	jsonValue literal;
+};
+
+struct jsonPath {
+	pathStep* steps;        // the path itself, state i has matched the first i
+	size_t length, stepCapacity;
+	pathStep* operands;     // the relative paths in filters, keys and indices only
+	size_t operandCount, operandCapacity;
+	pathExpr* exprs;
+	size_t exprCount, exprCapacity;
+	uint64_t filterStates;  // states whose next step is a filter
+	const jsonAllocator* alloc;
+};
+
+// appends an item to a growable array, left for the caller to fill in
+template <class T>
+static T* GrowItems(const jsonAllocator* alloc, T** items, size_t* count, size_t* capacity)
+{
+	if (*count == *capacity)
+	{
+		size_t size = *capacity ? *capacity * 2 : 8;
+		*items = (T*)JsonRealloc(alloc, *items, *capacity * sizeof(T), size * sizeof(T));
+		*capacity = size;
+	}
+	return &(*items)[(*count)++];
+}
+
+struct pathCompiler {
+	const char* p;
+	jsonPath* path;
+	unsigned nesting; // open parentheses and !
+};
+
+static inline bool IsNameChar(unsigned char ch)
+{
+	return ISDIGIT(ch) || (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || ch == '_' || ch == '-' || ch == '$' || ch >= 0x80;
+}
+
+static void PathWhitespace(pathCompiler* pc)
+{
+	while (*pc->p == ' ' || *pc->p == '\t' || *pc->p == '\n' || *pc->p == '\r')
+	{
+		pc->p++;
+	}
+}
+
+static size_t NewExpr(jsonPath* path, exprOp op)
+{
+	pathExpr* e = GrowItems(path->alloc, &path->exprs, &path->exprCount, &path->exprCapacity);
+	e->op = op;
+	e->a = e->b = e->next = PATH_NONE;
+	InitValue(&e->literal);
+	return path->exprCount - 1;
+}
+
+// "double quoted" with the JSON escapes, or 'single quoted' where \ only escapes ' and itself
+static parseStatus PathQuoted(pathCompiler* pc, char** s, size_t* len)
+{
+	const jsonAllocator* alloc = pc->path->alloc;
+	if (*pc->p == '"')
+	{
+		parserContext* c = NewContext(pc->p, alloc);
+		char* text;
+		parseStatus ret = ParseStringRaw(c, &text, *len);
+		if (ret == PARSE_OK)
+		{
+			*s = CopyText(alloc, text, *len);
+			pc->p = c->json;
+		}
+		DeleteContext(c);
+		return ret == PARSE_OK ? PARSE_OK : PARSE_ERR_INVALID_PATH;
+	}
+
+	const char* p = ++pc->p;
+	size_t n = 0;
+	for (; *p != '\''; p++, n++)
+	{
+		if (*p == '\0')
+		{
+			return PARSE_ERR_INVALID_PATH;
+		}
+		if (*p == '\\' && (p[1] == '\'' || p[1] == '\\'))
+		{
+			p++;
+		}
+	}
+	char* text = (char*)JsonMalloc(alloc, n + 1);
+	for (p = pc->p, n = 0; *p != '\''; p++)
+	{
+		if (*p == '\\' && (p[1] == '\'' || p[1] == '\\'))
+		{
+			p++;
+		}
+		text[n++] = *p;
+	}
+	text[n] = '\0';
+	*s = text;
+	*len = n;
+	pc->p = p + 1;
+	return PARSE_OK;
+}
+
+// .name or .*, after the dot
+static parseStatus PathName(pathCompiler* pc, pathStep* step)
+{
+	const char* s = pc->p;
+	if (*s == '*')
+	{
+		pc->p++;
+		step->kind = STEP_ANY;
+		return PARSE_OK;
+	}
+	while (IsNameChar(*pc->p))
+	{
+		pc->p++;
+	}
+	if (pc->p == s)
+	{
+		return PARSE_ERR_INVALID_PATH;
+	}
+	step->kind = STEP_KEY;
+	step->len = pc->p - s;
+	step->key = CopyText(pc->path->alloc, s, step->len);
+	return PARSE_OK;
+}
+
+static parseStatus PathOr(pathCompiler* pc, size_t* node);
+
+// [n], ['name'], [*] or [?(filter)] after the bracket; relative paths take the first two only
+static parseStatus PathBracket(pathCompiler* pc, pathStep* step, bool relative)
+{
+	parseStatus ret = PARSE_OK;
+	PathWhitespace(pc);
+	if (*pc->p == '\'' || *pc->p == '"')
+	{
+		step->kind = STEP_KEY;
+		ret = PathQuoted(pc, &step->key, &step->len);
+	}
+	else if (ISDIGIT(*pc->p))
+	{
+		step->kind = STEP_INDEX;
+		step->index = 0;
+		for (; ISDIGIT(*pc->p); pc->p++)
+		{
+			if (step->index > (PATH_NONE - 9) / 10)
+			{
+				return PARSE_ERR_INVALID_PATH;
+			}
+			step->index = step->index * 10 + (*pc->p - '0');
+		}
+	}
+	else if (*pc->p == '*' && !relative)
+	{
+		pc->p++;
+		step->kind = STEP_ANY;
+	}
+	else if (pc->p[0] == '?' && pc->p[1] == '(' && !relative)
+	{
+		pc->p += 2;
+		step->kind = STEP_FILTER;
+		if ((ret = PathOr(pc, &step->index)) == PARSE_OK)
+		{
+			PathWhitespace(pc);
+			ret = *pc->p++ == ')' ? PARSE_OK : PARSE_ERR_INVALID_PATH;
+		}
+	}
+	else
+	{
+		return PARSE_ERR_INVALID_PATH;
+	}
+	if (ret != PARSE_OK)
+	{
+		return ret;
+	}
+
+	PathWhitespace(pc);
+	if (*pc->p != ']')
+	{
+		if (step->kind == STEP_KEY)
+		{
+			JsonFree(pc->path->alloc, step->key, step->len + 1);
+		}
+		return PARSE_ERR_INVALID_PATH;
+	}
+	pc->p++;
+	return PARSE_OK;
+}
+
+// @ and its keys and indices, or a JSON literal
+static parseStatus PathOperand(pathCompiler* pc, size_t* node)
+{
+	jsonPath* path = pc->path;
+	parseStatus ret = PARSE_OK;
+	PathWhitespace(pc);
+	if (*pc->p == '\'')
+	{
+		*node = NewExpr(path, EXPR_LITERAL);
+		jsonValue* v = &path->exprs[*node].literal;
+		if ((ret = PathQuoted(pc, &v->str.s, &v->str.len)) == PARSE_OK)
+		{
+			v->type = TYPE_STRING;
+		}
+		return ret;
+	}
+	if (*pc->p != '@')
+	{
+		*node = NewExpr(path, EXPR_LITERAL);
+		parserContext* c = NewContext(pc->p, path->alloc);
+		ret = ParseValue(c, &path->exprs[*node].literal);
+		pc->p = c->json;
+		DeleteContext(c);
+		return ret == PARSE_OK ? PARSE_OK : PARSE_ERR_INVALID_PATH;
+	}
+
+	size_t first = path->operandCount;
+	pc->p++;
+	while (ret == PARSE_OK && (*pc->p == '.' || *pc->p == '['))
+	{
+		pathStep step;
+		step.descendant = false;
+		if (*pc->p++ == '.')
+		{
+			ret = *pc->p == '*' ? PARSE_ERR_INVALID_PATH : PathName(pc, &step);
+		}
+		else
+		{
+			ret = PathBracket(pc, &step, true);
+		}
+		if (ret == PARSE_OK)
+		{
+			*GrowItems(path->alloc, &path->operands, &path->operandCount, &path->operandCapacity) = step;
+		}
+	}
+	*node = NewExpr(path, EXPR_PATH);
+	path->exprs[*node].a = first;
+	path->exprs[*node].b = path->operandCount - first;
+	return ret;
+}
+
+static parseStatus PathComparison(pathCompiler* pc, size_t* node)
+{
+	static const struct { char text[3]; exprOp op; } ops[] = {
+		{ "==", EXPR_EQ }, { "!=", EXPR_NE }, { "<=", EXPR_LE }, { ">=", EXPR_GE }, { "<", EXPR_LT }, { ">", EXPR_GT }
+	};
+	jsonPath* path = pc->path;
+	size_t left, right;
+	parseStatus ret;
+
+	if ((ret = PathOperand(pc, &left)) != PARSE_OK)
+	{
+		return ret;
+	}
+	PathWhitespace(pc);
+	for (size_t i = 0; i < sizeof(ops) / sizeof(ops[0]); i++)
+	{
+		size_t len = strlen(ops[i].text);
+		if (strncmp(pc->p, ops[i].text, len) == 0)
+		{
+			pc->p += len;
+			if ((ret = PathOperand(pc, &right)) != PARSE_OK)
+			{
+				return ret;
+			}
+			*node = NewExpr(path, ops[i].op);
+			path->exprs[*node].a = left;
+			path->exprs[*node].b = right;
+			return PARSE_OK;
+		}
+	}
+	if (path->exprs[left].op != EXPR_PATH)
+	{
+		return PARSE_ERR_INVALID_PATH;
+	}
+	*node = NewExpr(path, EXPR_EXISTS);
+	path->exprs[*node].a = left;
+	return PARSE_OK;
+}
+
+static parseStatus PathUnary(pathCompiler* pc, size_t* node)
+{
+	parseStatus ret;
+	size_t operand;
+
+	PathWhitespace(pc);
+	if (*pc->p != '!' && *pc->p != '(')
+	{
+		return PathComparison(pc, node);
+	}
+	if (++pc->nesting > PATH_MAX_NESTING)
+	{
+		return PARSE_ERR_INVALID_PATH;
+	}
+	if (*pc->p++ == '!')
+	{
+		if ((ret = PathUnary(pc, &operand)) == PARSE_OK)
+		{
+			*node = NewExpr(pc->path, EXPR_NOT);
+			pc->path->exprs[*node].a = operand;
+		}
+	}
+	else if ((ret = PathOr(pc, node)) == PARSE_OK)
+	{
+		PathWhitespace(pc);
+		ret = *pc->p++ == ')' ? PARSE_OK : PARSE_ERR_INVALID_PATH;
+	}
+	pc->nesting--;
+	return ret;
+}
+
+// terms joined by || (of terms joined by &&), a single term stands for itself
+static parseStatus PathChain(pathCompiler* pc, size_t* node, exprOp op)
+{
+	const char* token = op == EXPR_OR ? "||" : "&&";
+	size_t term, last;
+	parseStatus ret = op == EXPR_OR ? PathChain(pc, &term, EXPR_AND) : PathUnary(pc, &term);
+
+	if (ret != PARSE_OK)
+	{
+		return ret;
+	}
+	PathWhitespace(pc);
+	if (strncmp(pc->p, token, 2) != 0)
+	{
+		*node = term;
+		return PARSE_OK;
+	}
+	*node = NewExpr(pc->path, op);
+	pc->path->exprs[*node].a = last = term;
+	while (PathWhitespace(pc), strncmp(pc->p, token, 2) == 0)
+	{
+		pc->p += 2;
+		if ((ret = op == EXPR_OR ? PathChain(pc, &term, EXPR_AND) : PathUnary(pc, &term)) != PARSE_OK)
+		{
+			return ret;
+		}
+		pc->path->exprs[last].next = term;
+		last = term;
+	}
 	return PARSE_OK;
 }
 
-static parseStatus ParseNumber(parserContext* c, jsonValue* v) {
-	const char* p = c->json;
+static parseStatus PathOr(pathCompiler* pc, size_t* node)
+{
+	return PathChain(pc, node, EXPR_OR);
+}
+
+parseStatus CompilePath(jsonPath** out, const char* expr, const jsonAllocator* alloc)
+{
+	assert(out && expr);
+	alloc = ResolveAllocator(alloc);
+	jsonPath* path = (jsonPath*)JsonMalloc(alloc, sizeof(jsonPath));
+	memset(path, 0, sizeof(jsonPath));
+	path->alloc = alloc;
+
+	pathCompiler pc = { expr, path, 0 };
+	parseStatus ret = PARSE_ERR_INVALID_PATH;
+	if (*pc.p == '$')
+	{
+		pc.p++;
+		ret = PARSE_OK;
+	}
+	while (ret == PARSE_OK && *pc.p != '\0')
+	{
+		pathStep step;
+		step.descendant = false;
+		if (pc.p[0] == '.' && pc.p[1] == '.')
+		{
+			pc.p += 2;
+			step.descendant = true;
+			ret = *pc.p == '[' ? (pc.p++, PathBracket(&pc, &step, false)) : PathName(&pc, &step);
+		}
+		else if (*pc.p == '.')
+		{
+			pc.p++;
+			ret = PathName(&pc, &step);
+		}
+		else if (*pc.p == '[')
+		{
+			pc.p++;
+			ret = PathBracket(&pc, &step, false);
+		}
+		else
+		{
+			ret = PARSE_ERR_INVALID_PATH;
+		}
+		if (ret == PARSE_OK && path->length == PATH_MAX_STEPS)
+		{
+			if (step.kind == STEP_KEY)
+			{
+				JsonFree(alloc, step.key, step.len + 1);
+			}
+			ret = PARSE_ERR_INVALID_PATH;
+		}
+		if (ret == PARSE_OK)
+		{
+			if (step.kind == STEP_FILTER)
+			{
+				path->filterStates |= (uint64_t)1 << path->length;
+			}
+			*GrowItems(alloc, &path->steps, &path->length, &path->stepCapacity) = step;
+		}
+	}
+
+	if (ret != PARSE_OK)
+	{
+		FreePath(path);
+		path = nullptr;
+	}
+	*out = path;
+	return ret;
+}
+
+static void FreeSteps(const jsonAllocator* alloc, pathStep* steps, size_t count, size_t capacity)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		if (steps[i].kind == STEP_KEY)
+		{
+			JsonFree(alloc, steps[i].key, steps[i].len + 1);
+		}
+	}
+	JsonFree(alloc, steps, capacity * sizeof(pathStep));
+}
+
+void FreePath(jsonPath* path)
+{
+	if (!path)
+	{
+		return;
+	}
+	const jsonAllocator* alloc = path->alloc;
+	FreeSteps(alloc, path->steps, path->length, path->stepCapacity);
+	FreeSteps(alloc, path->operands, path->operandCount, path->operandCapacity);
+	for (size_t i = 0; i < path->exprCount; i++)
+	{
+		FreeValue(&path->exprs[i].literal, alloc);
+	}
+	JsonFree(alloc, path->exprs, path->exprCapacity * sizeof(pathExpr));
+	JsonFree(alloc, path, sizeof(jsonPath));
+}
+
+// child of an array or object selected by a key or index step, nullptr if there is none; packed elements go to tmp
+static const jsonValue* SelectChild(const jsonValue* v, const pathStep* step, jsonValue* tmp)
+{
+	if (step->kind == STEP_KEY && v->type == TYPE_OBJECT)
+	{
+		for (size_t i = 0; i < v->obj.size; i++)
+		{
+			const jsonMap* m = &v->obj.maps[i];
+			if (m->keyLen == step->len && memcmp(m->key, step->key, step->len) == 0)
+			{
+				return &m->value;
+			}
+		}
+	}
+	else if (step->kind == STEP_INDEX && v->type == TYPE_ARRAY && step->index < v->arr.size)
+	{
+		if (IsPacked(v))
+		{
+			tmp->type = TYPE_NUMBER;
+			tmp->flags = 0;
+			tmp->num = v->nums.values[step->index];
+			return tmp;
+		}
+		return &v->arr.values[step->index];
+	}
+	return nullptr;
+}
+
+static const jsonValue* FilterOperand(const jsonPath* path, size_t node, const jsonValue* at, jsonValue* tmp)
+{
+	const pathExpr* e = &path->exprs[node];
+	if (e->op == EXPR_LITERAL)
+	{
+		return &e->literal;
+	}
+	for (size_t i = 0; i < e->b && at; i++)
+	{
+		at = SelectChild(at, &path->operands[e->a + i], tmp);
+	}
+	return at;
+}
+
+static bool FilterCompare(exprOp op, const jsonValue* x, const jsonValue* y)
+{
+	int order;
+	if (x->type == TYPE_NUMBER && y->type == TYPE_NUMBER)
+	{
+		double a = GetValueNumber(x), b = GetValueNumber(y);
+		order = a < b ? -1 : a > b ? 1 : 0;
+	}
+	else if (x->type == TYPE_STRING && y->type == TYPE_STRING)
+	{
+		size_t xlen = GetValueStringLength(x), ylen = GetValueStringLength(y);
+		order = memcmp(GetValueString(x), GetValueString(y), xlen < ylen ? xlen : ylen);
+		if (order == 0)
+		{
+			order = xlen < ylen ? -1 : xlen > ylen ? 1 : 0;
+		}
+	}
+	else if (op == EXPR_EQ || op == EXPR_NE)
+	{
+		return EqualValue(x, y) == (op == EXPR_EQ);
+	}
+	else
+	{
+		return false;
+	}
+
+	switch (op) {
+	case EXPR_EQ: return order == 0;
+	case EXPR_NE: return order != 0;
+	case EXPR_LT: return order < 0;
+	case EXPR_LE: return order <= 0;
+	case EXPR_GT: return order > 0;
+	default:      return order >= 0;
+	}
+}
+
+// recurses only as deep as the filter's parentheses and !, see PATH_MAX_NESTING
+static bool FilterHolds(const jsonPath* path, size_t node, const jsonValue* at)
+{
+	const pathExpr* e = &path->exprs[node];
+	jsonValue tx, ty;
+
+	switch (e->op) {
+	case EXPR_OR:
+	case EXPR_AND:
+		for (size_t k = e->a; k != PATH_NONE; k = path->exprs[k].next)
+		{
+			if (FilterHolds(path, k, at) == (e->op == EXPR_OR))
+			{
+				return e->op == EXPR_OR;
+			}
+		}
+		return e->op == EXPR_AND;
+	case EXPR_NOT:
+		return !FilterHolds(path, e->a, at);
+	case EXPR_EXISTS:
+		return FilterOperand(path, e->a, at, &tx) != nullptr;
+	default:
+	{
+		const jsonValue* x = FilterOperand(path, e->a, at, &tx);
+		const jsonValue* y = FilterOperand(path, e->b, at, &ty);
+		return x && y && FilterCompare(e->op, x, y);
+	}
+	}
+}
+
+/*
+ * The states a child enters from its parent's, the bit past the last step
+ * marking a match. key is nullptr for array elements. Filters are only tried
+ * when the child itself is given.
+ */
+static uint64_t ChildStates(const jsonPath* path, uint64_t states, const char* key, size_t len, size_t index, const jsonValue* child)
+{
+	uint64_t next = 0;
+	for (size_t i = 0; i < path->length && (states >> i); i++)
+	{
+		if (!((states >> i) & 1))
+		{
+			continue;
+		}
+		const pathStep* step = &path->steps[i];
+		bool hit;
+		switch (step->kind) {
+		case STEP_KEY:    hit = key && len == step->len && memcmp(key, step->key, len) == 0; break;
+		case STEP_INDEX:  hit = !key && index == step->index; break;
+		case STEP_ANY:    hit = true; break;
+		default:          hit = child && FilterHolds(path, step->index, child); break;
+		}
+		if (step->descendant)
+		{
+			next |= (uint64_t)1 << i;
+		}
+		if (hit)
+		{
+			next |= (uint64_t)1 << (i + 1);
+		}
+	}
+	return next;
+}
+
+// where the matches go: to the callback, or copied into a slice that runs on its own thread
+struct queryOutput {
+	jsonQueryCallback cb;
+	void* userData;
+	size_t record;
+	bool stopped;
+	struct ndjsonSlice* slice;
+};
+
+struct ndjsonMatch {
+	size_t record;
+	jsonValue value;
+};
+
+struct ndjsonSlice {
+	const jsonPath* path;
+	const char* begin;
+	const char* end;              // just past a line break, or the end of the text
+	size_t index;
+	std::atomic<size_t>* limit;   // slices after this one are no longer needed
+	ndjsonMatch* matches;
+	size_t count, capacity;
+	size_t records;
+	parseStatus status;
+};
+
+static bool Emit(queryOutput* out, const jsonValue* v)
+{
+	if (out->slice)
+	{
+		ndjsonSlice* s = out->slice;
+		ndjsonMatch* m = GrowItems(s->path->alloc, &s->matches, &s->count, &s->capacity);
+		m->record = out->record;
+		CopyValueRaw(&m->value, v, s->path->alloc);
+		return true;
+	}
+	out->stopped = !out->cb(out->userData, out->record, v);
+	return !out->stopped;
+}
+
+struct queryFrame {
+	const jsonValue* v;
+	uint64_t states;
+	size_t next;
+};
+
+// v and the nodes below it in pre-order, as far as they have states left
+static void QueryTree(const jsonPath* path, const jsonValue* v, uint64_t states, queryOutput* out)
+{
+	const uint64_t match = (uint64_t)1 << path->length;
+	walkStack<queryFrame> s(path->alloc);
+
+	if ((states & match) && !Emit(out, v))
+	{
+		return;
+	}
+	if ((states & (match - 1)) && (v->type == TYPE_ARRAY || v->type == TYPE_OBJECT))
+	{
+		queryFrame* f = s.Push();
+		f->v = v;
+		f->states = states;
+		f->next = 0;
+	}
+	while (s.top)
+	{
+		queryFrame* f = &s.frames[s.top - 1];
+		const jsonValue* p = f->v;
+		if (f->next == (p->type == TYPE_ARRAY ? p->arr.size : p->obj.size))
+		{
+			s.top--;
+			continue;
+		}
+
+		size_t i = f->next++;
+		const char* key = nullptr;
+		size_t len = 0;
+		jsonValue tmp;
+		const jsonValue* child;
+		if (p->type == TYPE_OBJECT)
+		{
+			key = p->obj.maps[i].key;
+			len = p->obj.maps[i].keyLen;
+			child = &p->obj.maps[i].value;
+		}
+		else if (IsPacked(p))
+		{
+			tmp.type = TYPE_NUMBER;
+			tmp.flags = 0;
+			tmp.num = p->nums.values[i];
+			child = &tmp;
+		}
+		else
+		{
+			child = &p->arr.values[i];
+		}
+
+		uint64_t next = ChildStates(path, f->states, key, len, i, child);
+		if ((next & match) && !Emit(out, child))
+		{
+			return;
+		}
+		if ((next & (match - 1)) && (child->type == TYPE_ARRAY || child->type == TYPE_OBJECT))
+		{
+			f = s.Push();
+			f->v = child;
+			f->states = next;
+			f->next = 0;
+		}
+	}
+}
+
+void QueryValue(const jsonPath* path, const jsonValue* root, jsonQueryCallback cb, void* userData)
+{
+	assert(path && root && cb);
+	queryOutput out = { cb, userData, 0, false, nullptr };
+	QueryTree(path, root, 1, &out);
+}
+
+struct streamFrame {
+	uint64_t states;
+	size_t next; // index of the next element, arrays only
+	bool array;
+};
+
+// only matches and the children a filter tests are built, everything else is read past
+static parseStatus QueryStream(const jsonPath* path, jsonReader* r, queryOutput* out)
+{
+	const uint64_t match = (uint64_t)1 << path->length;
+	const jsonAllocator* alloc = r->context->alloc;
+	walkStack<streamFrame> s(path->alloc);
+	uint64_t states = 1;
+	parseStatus ret;
+	jsonToken t;
+	tokenType type;
+
+	for (;;)
+	{
+		// states belong to the value at the reader's position
+		if (!states)
+		{
+			ret = SkipValue(r);
+		}
+		else if (states & match)
+		{
+			jsonValue v;
+			if ((ret = ReadValue(r, &v)) == PARSE_OK)
+			{
+				QueryTree(path, &v, states, out);
+				FreeValue(&v, alloc);
+			}
+		}
+		else if ((ret = PeekToken(r, &type)) == PARSE_OK)
+		{
+			if (type == TOKEN_END || type == TOKEN_ARRAY_END || type == TOKEN_OBJECT_END || type == TOKEN_KEY)
+			{
+				return PARSE_ERR_EXPECT_VALUE;
+			}
+			if ((ret = ReadToken(r, &t)) == PARSE_OK && (type == TOKEN_ARRAY_BEGIN || type == TOKEN_OBJECT_BEGIN))
+			{
+				streamFrame* f = s.Push();
+				f->states = states;
+				f->next = 0;
+				f->array = type == TOKEN_ARRAY_BEGIN;
+			}
+		}
+		if (ret != PARSE_OK || out->stopped)
+		{
+			return ret;
+		}
+
+		// on to the next child that is not settled right away
+		for (;;)
+		{
+			if (!s.top)
+			{
+				return PARSE_OK;
+			}
+			streamFrame* f = &s.frames[s.top - 1];
+			const char* key = nullptr;
+			size_t len = 0, index = 0;
+			if (f->array)
+			{
+				if ((ret = PeekToken(r, &type)) != PARSE_OK)
+				{
+					return ret;
+				}
+				if (type == TOKEN_ARRAY_END)
+				{
+					ReadToken(r, &t);
+					s.top--;
+					continue;
+				}
+				index = f->next++;
+			}
+			else
+			{
+				if ((ret = ReadToken(r, &t)) != PARSE_OK)
+				{
+					return ret;
+				}
+				if (t.type == TOKEN_OBJECT_END)
+				{
+					s.top--;
+					continue;
+				}
+				key = t.str.s;
+				len = t.str.len;
+			}
+
+			states = ChildStates(path, f->states, key, len, index, nullptr);
+			if (!(f->states & path->filterStates))
+			{
+				break;
+			}
+			// a filter has to see the child, which is then queried as a tree
+			jsonValue child;
+			if ((ret = ReadValue(r, &child)) != PARSE_OK)
+			{
+				return ret;
+			}
+			states |= ChildStates(path, f->states & path->filterStates, nullptr, 0, index, &child);
+			QueryTree(path, &child, states, out);
+			FreeValue(&child, alloc);
+			if (out->stopped)
+			{
+				return PARSE_OK;
+			}
+		}
+	}
+}
+
+parseStatus QueryReader(const jsonPath* path, jsonReader* r, jsonQueryCallback cb, void* userData)
+{
+	assert(path && r && cb);
+	queryOutput out = { cb, userData, 0, false, nullptr };
+	return QueryStream(path, r, &out);
+}
+
+static void QuerySlice(ndjsonSlice* s, queryOutput* out)
+{
+	jsonReader r;
+	InitReader(&r, s->begin, s->path->alloc);
+	parserContext* c = r.context;
+
+	s->status = PARSE_OK;
+	for (;;)
+	{
+		ParseWhitespace(c);
+		if (c->json >= s->end || *c->json == '\0' || s->index > s->limit->load(std::memory_order_relaxed))
+		{
+			break;
+		}
+		const char* eol = (const char*)memchr(c->json, '\n', s->end - c->json);
+		c->state = READER_VALUE;
+		out->record = s->records;
+		if ((s->status = QueryStream(s->path, &r, out)) != PARSE_OK || out->stopped)
+		{
+			break;
+		}
+		while (*c->json == ' ' || *c->json == '\t' || *c->json == '\r')
+		{
+			c->json++;
+		}
+		if (c->json != (eol ? eol : s->end))
+		{
+			s->status = PARSE_ERR_ROOT_NOT_SINGULAR;
+			break;
+		}
+		s->records++;
+	}
+	FreeReader(&r);
+}
+
+static void QuerySliceCopies(ndjsonSlice* s)
+{
+	queryOutput out = { nullptr, nullptr, 0, false, s };
+	QuerySlice(s, &out);
+}
 
-	bool isPositive = true;
-	if (*p == '-') {
-		isPositive = false;
-		p++;
+parseStatus QueryNdjson(const jsonPath* path, const char* ndjson, unsigned threads, jsonQueryCallback cb, void* userData, size_t* records)
+{
+	assert(path && ndjson && cb);
+	const jsonAllocator* alloc = path->alloc;
+	size_t length = strlen(ndjson);
+	size_t n = threads ? threads : std::thread::hardware_concurrency();
+	if (n > length / NDJSON_MIN_SLICE)
+	{
+		n = length / NDJSON_MIN_SLICE;
 	}
-
-	if (!ISDIGIT(*p)) {
-		return PARSE_ERR_INVALID_VALUE;
+	if (n == 0)
+	{
+		n = 1;
 	}
 
-	if (*p == '0') {
-		p++;
-	}
-	else {
-		if (!ISDIGIT(*p)) {
-			return PARSE_ERR_INVALID_VALUE;
+	std::atomic<size_t> limit(n);
+	ndjsonSlice* slices = (ndjsonSlice*)JsonMalloc(alloc, n * sizeof(ndjsonSlice));
+	const char* begin = ndjson;
+	for (size_t k = 0; k < n; k++)
+	{
+		const char* end = ndjson + length;
+		const char* cut = ndjson + length / n * (k + 1);
+		if (k + 1 < n && cut > begin)
+		{
+			const char* eol = (const char*)memchr(cut, '\n', end - cut);
+			end = eol ? eol + 1 : end;
 		}
-		for (p++; ISDIGIT(*p); p++) {
+		else if (k + 1 < n)
+		{
+			end = begin;
 		}
+		ndjsonSlice* s = &slices[k];
+		s->path = path;
+		s->begin = begin;
+		s->end = end;
+		s->index = k;
+		s->limit = &limit;
+		s->matches = nullptr;
+		s->count = s->capacity = 0;
+		s->records = 0;
+		begin = end;
 	}
 
-	if (*p == '.') {
-		p++;
-		if (!ISDIGIT(*p)) {
-			return PARSE_ERR_INVALID_VALUE;
+	std::thread* workers = n > 1 ? (std::thread*)JsonMalloc(alloc, (n - 1) * sizeof(std::thread)) : nullptr;
+	for (size_t k = 1; k < n; k++)
+	{
+		new (&workers[k - 1]) std::thread(QuerySliceCopies, &slices[k]);
+	}
+
+	queryOutput out = { cb, userData, 0, false, nullptr };
+	QuerySlice(&slices[0], &out);
+	parseStatus ret = slices[0].status;
+	size_t done = slices[0].records;
+	bool stopped = ret != PARSE_OK || out.stopped;
+	if (stopped)
+	{
+		limit.store(0, std::memory_order_relaxed);
+	}
+
+	// the other slices are handed over in order as their threads finish
+	for (size_t k = 1; k < n; k++)
+	{
+		ndjsonSlice* s = &slices[k];
+		workers[k - 1].join();
+		workers[k - 1].~thread();
+		for (size_t i = 0; i < s->count; i++)
+		{
+			if (!stopped && !cb(userData, done + s->matches[i].record, &s->matches[i].value))
+			{
+				stopped = true;
+				done += s->matches[i].record;
+				limit.store(k, std::memory_order_relaxed);
+			}
+			FreeValue(&s->matches[i].value, alloc);
 		}
-		for (p++; ISDIGIT(*p); p++) {
+		JsonFree(alloc, s->matches, s->capacity * sizeof(ndjsonMatch));
+		if (!stopped)
+		{
+			done += s->records;
+			if (s->status != PARSE_OK)
+			{
+				ret = s->status;
+				stopped = true;
+				limit.store(k, std::memory_order_relaxed);
+			}
 		}
 	}
+	JsonFree(alloc, workers, (n - 1) * sizeof(std::thread));
+	JsonFree(alloc, slices, n * sizeof(ndjsonSlice));
 
-	if (*p == 'e' || *p == 'E') {
-		p++;
-		if (*p == '+' || *p == '-') {
-			p++;
+	if (records)
+	{
+		*records = done;
+	}
+	return ret;
+}
+
+// a window onto the input: all of it for buffers and mappings, a buffer refilled from fd otherwise
+struct elementStream {
+	const jsonAllocator* alloc;
+	parserContext* parser;  // parses the elements and pointer keys, its scratch is kept between them
+	const char* data;
+	size_t pos, end;        // next byte to look at, end of the bytes available
+	size_t mark;            // a refill keeps the bytes from here on
+	char* buffer;           // fd input only, NUL-terminated at end
+	size_t capacity;
+	int fd;                 // -1 once there is nothing more to read
+	int ownedFd;            // closed by CloseElements()
+	bool ioError;
+	void* map;              // OpenElementsFile(): the whole file
+	size_t mapSize;
+	size_t released;        // mapped bytes before this were handed back
+	bool root;              // the array is the document, only whitespace may follow it
+	bool first, done;
+	parseStatus status;     // sticky
+};
+
+static long ReadFd(int fd, char* buf, size_t n)
+{
+#ifdef TINYJSON_POSIX
+	ssize_t ret;
+	do {
+		ret = read(fd, buf, n);
+	} while (ret < 0 && errno == EINTR);
+	return (long)ret;
+#else
+	return _read(fd, buf, (unsigned)(n > INT_MAX ? INT_MAX : n));
+#endif
+}
+
+// reads on, moving the bytes from mark on to the front of the buffer first
+static bool FillElements(elementStream* s)
+{
+	if (s->fd < 0)
+	{
+		return false;
+	}
+	memmove(s->buffer, s->buffer + s->mark, s->end - s->mark);
+	s->end -= s->mark;
+	s->pos -= s->mark;
+	s->mark = 0;
+	if (s->capacity - s->end < ELEMENTS_READ_SIZE / 2)
+	{
+		s->buffer = (char*)JsonRealloc(s->alloc, s->buffer, s->capacity, s->capacity * 2);
+		s->data = s->buffer;
+		s->capacity *= 2;
+	}
+
+	long n = ReadFd(s->fd, s->buffer + s->end, s->capacity - 1 - s->end);
+	if (n <= 0)
+	{
+		s->ioError = n < 0;
+		s->fd = -1;
+		return false;
+	}
+	s->end += n;
+	s->buffer[s->end] = '\0';
+	return true;
+}
+
+// the next byte that is not whitespace, '\0' at the end of the input
+static char PeekElements(elementStream* s)
+{
+	for (;;)
+	{
+		while (s->pos < s->end && (s->data[s->pos] == ' ' || s->data[s->pos] == '\t' || s->data[s->pos] == '\n' || s->data[s->pos] == '\r'))
+		{
+			s->pos++;
 		}
-		if (!ISDIGIT(*p)) {
-			return PARSE_ERR_INVALID_VALUE;
+		if (s->pos < s->end)
+		{
+			return s->data[s->pos];
 		}
-		for (p++; ISDIGIT(*p); p++) {
+		s->mark = s->pos;
+		if (!FillElements(s))
+		{
+			return '\0';
 		}
 	}
+}
 
-	errno = 0;
-	v->num = strtod(c->json, NULL);
-	if (errno == ERANGE && (v->num == HUGE_VAL || v->num == -HUGE_VAL)) {
-		return PARSE_ERR_NUMBER_OVERFLOW;
+/*
+ * Finds where the value at pos ends by its brackets and quotes alone, reading
+ * on as needed, and moves mark to its start. Once the whole value is known to
+ * be in the window the parser can run over it without a NUL after it.
+ */
+static parseStatus ScanElement(elementStream* s, size_t* length)
+{
+	s->mark = s->pos;
+	size_t i = s->pos, depth = 0;
+	char first = s->data[i];
+	bool scalar = first != '"' && first != '[' && first != '{';
+	bool inString = first == '"', escaped = false;
+
+	if (!scalar)
+	{
+		depth = first == '"' ? 0 : 1;
+		i++;
 	}
-	c->json = p;
-	v->type = TYPE_NUMBER;
+	for (;; i++)
+	{
+		if (i == s->end)
+		{
+			size_t offset = i - s->mark;
+			if (!FillElements(s))
+			{
+				// even a scalar cannot end the input, the array is still open
+				return inString ? PARSE_ERR_MISS_QUOTATION_MARK
+					: first == '{' ? PARSE_ERR_MISS_COMMA_OR_CURLY_BRACKET : PARSE_ERR_MISS_COMMA_OR_SQUARE_BRACKET;
+			}
+			i = s->mark + offset;
+		}
+		char ch = s->data[i];
+		if (scalar)
+		{
+			if (ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r' || ch == ',' || ch == ']' || ch == '}' || ch == ':')
+			{
+				break;
+			}
+		}
+		else if (inString)
+		{
+			if (escaped)
+			{
+				escaped = false;
+			}
+			else if (ch == '\\')
+			{
+				escaped = true;
+			}
+			else if (ch == '"')
+			{
+				inString = false;
+				if (depth == 0)
+				{
+					i++;
+					break;
+				}
+			}
+		}
+		else if (ch == '"')
+		{
+			inString = true;
+		}
+		else if (ch == '[' || ch == '{')
+		{
+			depth++;
+		}
+		else if ((ch == ']' || ch == '}') && --depth == 0)
+		{
+			i++;
+			break;
+		}
+	}
+	*length = i - s->mark;
 	return PARSE_OK;
 }
 
-static parseStatus ParseArray(parserContext* c, jsonValue* v)
+static void SkipScanned(elementStream* s, size_t length)
 {
-	assert(*c->json == '[');
-	c->json++;
+	s->pos = s->mark + length;
+}
 
-	parseStatus ret;
+// a reference token of a JSON pointer against a decoded key, ~1 standing for / and ~0 for ~
+static bool PointerTokenEquals(const char* token, size_t tokenLen, const char* key, size_t keyLen)
+{
+	size_t k = 0;
+	for (size_t i = 0; i < tokenLen; i++, k++)
+	{
+		char ch = token[i];
+		if (ch == '~' && i + 1 < tokenLen && (token[i + 1] == '0' || token[i + 1] == '1'))
+		{
+			ch = token[++i] == '0' ? '~' : '/';
+		}
+		if (k == keyLen || key[k] != ch)
+		{
+			return false;
+		}
+	}
+	return k == keyLen;
+}
 
-	size_t size = 0;
+// walks to the array the pointer names, skipping everything before it unparsed
+static parseStatus SeekElements(elementStream* s, const char* pointer)
+{
+	parserContext* c = s->parser;
+	parseStatus ret;
+	size_t length;
+	char ch;
 
-	ParseWhitespace(c);
-	if (*c->json == ']')
+	if (*pointer && *pointer != '/')
 	{
-		c->json++;
-		v->type = TYPE_ARRAY;
-		v->arr.size = 0;
-		v->arr.values = nullptr;
-		return PARSE_OK;
+		return PARSE_ERR_INVALID_PATH;
 	}
-	while (1)
+	s->root = !*pointer;
+	while (*pointer == '/')
 	{
-		jsonValue e;
-		InitValue(&e);
-		ParseWhitespace(c);
-		if ((ret = ParseValue(c, &e)) != PARSE_OK)
+		const char* token = ++pointer;
+		while (*pointer && *pointer != '/')
 		{
-			break;
+			pointer++;
 		}
-		memcpy(c->PushSz(sizeof(jsonValue)), &e, sizeof(jsonValue));
-		size++;
+		size_t tokenLen = pointer - token;
 
-		ParseWhitespace(c);
-
-		if (*c->json == ',')
+		if ((ch = PeekElements(s)) == '{')
 		{
-			c->json++;
+			s->pos++;
+			for (bool first = true;; first = false)
+			{
+				if ((ch = PeekElements(s)) == '}')
+				{
+					return PARSE_ERR_INVALID_PATH;
+				}
+				if (!first)
+				{
+					if (ch != ',')
+					{
+						return PARSE_ERR_MISS_COMMA_OR_CURLY_BRACKET;
+					}
+					s->pos++;
+					ch = PeekElements(s);
+				}
+				if (ch != '"')
+				{
+					return PARSE_ERR_MISS_KEY;
+				}
+				if ((ret = ScanElement(s, &length)) != PARSE_OK)
+				{
+					return ret;
+				}
+				char* key;
+				size_t keyLen;
+				c->json = s->data + s->mark;
+				if ((ret = ParseStringRaw(c, &key, keyLen)) != PARSE_OK)
+				{
+					return ret;
+				}
+				bool match = PointerTokenEquals(token, tokenLen, key, keyLen);
+				SkipScanned(s, length);
+				if (PeekElements(s) != ':')
+				{
+					return PARSE_ERR_MISS_COLON;
+				}
+				s->pos++;
+				if (match)
+				{
+					break;
+				}
+				if (PeekElements(s) == '\0')
+				{
+					return PARSE_ERR_EXPECT_VALUE;
+				}
+				if ((ret = ScanElement(s, &length)) != PARSE_OK)
+				{
+					return ret;
+				}
+				SkipScanned(s, length);
+			}
 		}
-		else if (*c->json == ']')
+		else if (ch == '[')
 		{
-			c->json++;
-			v->type = TYPE_ARRAY;
-			v->arr.size = size;
-			v->arr.values = (jsonValue*)malloc(size * sizeof(jsonValue));
-			memcpy(v->arr.values, c->Pop(size * sizeof(jsonValue)), size * sizeof(jsonValue));
-			return PARSE_OK;
+			// a decimal index without leading zeros
+			size_t index = 0;
+			if (tokenLen == 0 || (token[0] == '0' && tokenLen > 1))
+			{
+				return PARSE_ERR_INVALID_PATH;
+			}
+			for (size_t i = 0; i < tokenLen; i++)
+			{
+				if (!ISDIGIT(token[i]) || index > (PATH_NONE - 9) / 10)
+				{
+					return PARSE_ERR_INVALID_PATH;
+				}
+				index = index * 10 + (token[i] - '0');
+			}
+			s->pos++;
+			for (size_t i = 0;; i++)
+			{
+				if ((ch = PeekElements(s)) == ']')
+				{
+					return PARSE_ERR_INVALID_PATH;
+				}
+				if (i > 0)
+				{
+					if (ch != ',')
+					{
+						return PARSE_ERR_MISS_COMMA_OR_SQUARE_BRACKET;
+					}
+					s->pos++;
+					ch = PeekElements(s);
+				}
+				if (ch == '\0')
+				{
+					return PARSE_ERR_EXPECT_VALUE;
+				}
+				if (i == index)
+				{
+					break;
+				}
+				if ((ret = ScanElement(s, &length)) != PARSE_OK)
+				{
+					return ret;
+				}
+				SkipScanned(s, length);
+			}
 		}
 		else
 		{
-			ret = PARSE_ERR_MISS_COMMA_OR_SQUARE_BRACKET;
-			break;
+			return ch == '\0' ? PARSE_ERR_EXPECT_VALUE : PARSE_ERR_INVALID_PATH;
 		}
 	}
 
-	for (size_t i = 0; i < size; i++) {
-		FreeValue((jsonValue*)c->Pop(sizeof(jsonValue)));
+	if ((ch = PeekElements(s)) != '[')
+	{
+		return ch == '\0' ? PARSE_ERR_EXPECT_VALUE : PARSE_ERR_TYPE_MISMATCH;
+	}
+	s->pos++;
+	s->first = true;
+	return PARSE_OK;
+}
+
+static parseStatus ReadElement(elementStream* s, jsonValue* v, bool* end)
+{
+	parserContext* c = s->parser;
+	parseStatus ret;
+	size_t length;
+	char ch = PeekElements(s);
+
+	if (ch == ']')
+	{
+		s->pos++;
+		s->done = *end = true;
+		return s->root && PeekElements(s) != '\0' ? PARSE_ERR_ROOT_NOT_SINGULAR : PARSE_OK;
+	}
+	if (!s->first)
+	{
+		if (ch != ',')
+		{
+			return PARSE_ERR_MISS_COMMA_OR_SQUARE_BRACKET;
+		}
+		s->pos++;
+		ch = PeekElements(s);
+	}
+	if (ch == '\0')
+	{
+		return PARSE_ERR_EXPECT_VALUE;
+	}
+	s->first = false;
+	if ((ret = ScanElement(s, &length)) != PARSE_OK)
+	{
+		return ret;
 	}
 
+	const char* start = s->data + s->mark;
+	c->json = start;
+	c->top = 0;
+	if ((ret = ParseValue(c, v)) == PARSE_OK && c->json != start + length)
+	{
+		FreeValue(v, s->alloc);
+		ret = PARSE_ERR_MISS_COMMA_OR_SQUARE_BRACKET;
+	}
+	c->Trim();
+	SkipScanned(s, length);
 	return ret;
 }
 
-static parseStatus ParseValue(parserContext* c, jsonValue* v) {
-	switch (*c->json) {
-	case 't':  return ParseLiteral(c, v, "true", TYPE_TRUE);
-	case 'f':  return ParseLiteral(c, v, "false", TYPE_FALSE);
-	case 'n':  return ParseLiteral(c, v, "null", TYPE_NULL);
-	case '\0': return PARSE_ERR_EXPECT_VALUE;
-	case '"':  return ParseString(c, v);
-	case '[':  return ParseArray(c, v);
-	case '{':  return ParseObject(c, v);
-	default:   return ParseNumber(c, v);
+// hands the mapped pages already parsed back, so the file costs no more resident memory than a read buffer
+static void ReleaseMapped(elementStream* s)
+{
+#ifdef TINYJSON_POSIX
+	size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	size_t upto = s->pos / page * page;
+	if (s->map && upto - s->released >= ELEMENTS_RELEASE_SIZE)
+	{
+		madvise((char*)s->map + s->released, upto - s->released, MADV_DONTNEED);
+		s->released = upto;
+	}
+#else
+	(void)s;
+#endif
+}
+
+static void DeleteElementStream(elementStream* s)
+{
+	const jsonAllocator* alloc = s->alloc;
+	DeleteContext(s->parser);
+	JsonFree(alloc, s->buffer, s->capacity);
+#ifdef TINYJSON_POSIX
+	if (s->map)
+	{
+		munmap(s->map, s->mapSize);
+	}
+	if (s->ownedFd >= 0)
+	{
+		close(s->ownedFd);
+	}
+#else
+	if (s->ownedFd >= 0)
+	{
+		_close(s->ownedFd);
+	}
+#endif
+	JsonFree(alloc, s, sizeof(elementStream));
+}
+
+static elementStream* NewElementStream(const jsonAllocator* alloc)
+{
+	alloc = ResolveAllocator(alloc);
+	elementStream* s = (elementStream*)JsonMalloc(alloc, sizeof(elementStream));
+	memset(s, 0, sizeof(elementStream));
+	s->alloc = alloc;
+	s->parser = NewContext(nullptr, alloc);
+	s->data = "";
+	s->fd = s->ownedFd = -1;
+	s->status = PARSE_OK;
+	return s;
+}
+
+// reads from fd through a buffer of its own
+static void UseFd(elementStream* s, int fd)
+{
+	s->fd = fd;
+	s->capacity = ELEMENTS_READ_SIZE;
+	s->buffer = (char*)JsonMalloc(s->alloc, s->capacity);
+	s->buffer[0] = '\0';
+	s->data = s->buffer;
+}
+
+static parseStatus StartElements(jsonElements* e, elementStream* s, const char* pointer)
+{
+	parseStatus ret = SeekElements(s, pointer ? pointer : "");
+	if (ret != PARSE_OK)
+	{
+		ret = s->ioError ? PARSE_ERR_IO : ret;
+		DeleteElementStream(s);
+		e->state = nullptr;
+		return ret;
+	}
+	e->state = s;
+	return PARSE_OK;
+}
+
+parseStatus OpenElements(jsonElements* e, const char* json, size_t length, const char* pointer, const jsonAllocator* alloc)
+{
+	assert(e && (json || !length));
+	elementStream* s = NewElementStream(alloc);
+	if (json)
+	{
+		s->data = json;
+	}
+	s->end = length;
+	return StartElements(e, s, pointer);
+}
+
+parseStatus OpenElementsFd(jsonElements* e, int fd, const char* pointer, const jsonAllocator* alloc)
+{
+	assert(e && fd >= 0);
+	elementStream* s = NewElementStream(alloc);
+	UseFd(s, fd);
+	return StartElements(e, s, pointer);
+}
+
+parseStatus OpenElementsFile(jsonElements* e, const char* path, const char* pointer, const jsonAllocator* alloc)
+{
+	assert(e && path);
+#ifdef TINYJSON_POSIX
+	int fd = open(path, O_RDONLY);
+#else
+	int fd = _open(path, _O_RDONLY | _O_BINARY);
+#endif
+	if (fd < 0)
+	{
+		e->state = nullptr;
+		return PARSE_ERR_IO;
+	}
+
+	elementStream* s = NewElementStream(alloc);
+#ifdef TINYJSON_POSIX
+	// regular files are mapped, anything else (a pipe, say) is read like a descriptor
+	struct stat st;
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+	{
+		void* map = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map != MAP_FAILED)
+		{
+			madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+			close(fd);
+			s->map = map;
+			s->mapSize = (size_t)st.st_size;
+			s->data = (const char*)map;
+			s->end = s->mapSize;
+			return StartElements(e, s, pointer);
+		}
+	}
+#endif
+	s->ownedFd = fd;
+	UseFd(s, fd);
+	return StartElements(e, s, pointer);
+}
+
+parseStatus NextElement(jsonElements* e, jsonValue* v, bool* end)
+{
+	assert(e && e->state && v && end);
+	elementStream* s = e->state;
+
+	FreeValue(v, s->alloc);
+	*end = s->done;
+	if (s->status != PARSE_OK || s->done)
+	{
+		return s->status;
+	}
+	parseStatus ret = ReadElement(s, v, end);
+	if (ret != PARSE_OK)
+	{
+		s->status = s->ioError ? PARSE_ERR_IO : ret;
+	}
+	ReleaseMapped(s);
+	return s->status;
+}
+
+void CloseElements(jsonElements* e)
+{
+	assert(e);
+	if (e->state)
+	{
+		DeleteElementStream(e->state);
+		e->state = nullptr;
+	}
+}
+
+void InitWriter(jsonWriter* w, const jsonAllocator* alloc)
+{
+	assert(w);
+	w->context = NewContext(nullptr, alloc);
+	w->pieces = nullptr;
+	w->pieceCapacity = 0;
+}
+
+void FreeWriter(jsonWriter* w)
+{
+	assert(w);
+	JsonFree(w->context->alloc, w->pieces, w->pieceCapacity * sizeof(jsonIovec));
+	DeleteContext(w->context);
+	w->context = nullptr;
+	w->pieces = nullptr;
+	w->pieceCapacity = 0;
+}
+
+void ResetWriter(jsonWriter* w)
+{
+	assert(w);
+	w->context->Trim();
+}
+
+void SetWriterTrimSize(jsonWriter* w, size_t bytes)
+{
+	assert(w);
+	w->context->trimSize = bytes;
+}
+
+void WriteRaw(jsonWriter* w, const char* s, size_t len)
+{
+	assert(w && s);
+	if (len)
+	{
+		w->context->PushStr(s, len);
 	}
 }
 
-parseStatus ParseJsonString(jsonValue* v, const char* json) {
-	assert(v != NULL);
-
-	parserContext c;
-	c.json = json;
-	c.stack = nullptr;
-	c.size = c.top = 0;
-
-	InitValue(v);
-
-	parseStatus ret;
+void WriteString(jsonWriter* w, const char* s, size_t len)
+{
+	assert(w);
+	Stringify_string(w->context, s, len);
+}
 
-	ParseWhitespace(&c);
-	if ((ret = ParseValue(&c, v)) == PARSE_OK) {
-		ParseWhitespace(&c);
-		if (*c.json != '\0') {
-			v->type = TYPE_NULL;
-			ret = PARSE_ERR_ROOT_NOT_SINGULAR;
-		}
-	}
-	assert(!c.top);
-	return ret;
+void WriteNumber(jsonWriter* w, double n)
+{
+	assert(w);
+	Stringify_number(w->context, n);
 }
 
-valueType GetValueType(const jsonValue* v) {
-	assert(v != NULL);
-	return v->type;
+void WriteValue(jsonWriter* w, const jsonValue* v)
+{
+	assert(w && v);
+	Stringify_value(w->context, v);
 }
 
-double GetValueNumber(const jsonValue* v) {
-	assert(v && v->type == TYPE_NUMBER);
-	return v->num;
+const char* GetWriterOutput(jsonWriter* w, size_t* length)
+{
+	assert(w && length);
+	parserContext* c = w->context;
+	c->PushChar('\0');
+	*length = --c->top;
+	return c->stack;
 }
 
-void SetValueNumber(jsonValue* v, double n) {
-	FreeValue(v);
-	v->num = n;
-	v->type = TYPE_NUMBER;
+char* TakeWriterOutput(jsonWriter* w, size_t* length)
+{
+	GetWriterOutput(w, length);
+	parserContext* c = w->context;
+	char* ret = (char*)JsonRealloc(c->alloc, c->stack, c->size, *length + 1);
+	c->stack = nullptr;
+	c->size = c->top = 0;
+	return ret;
 }
 
-const char* GetValueString(const jsonValue* v)
+const char* StringifyWith(jsonWriter* w, const jsonValue* v, size_t* length, jsonStats* stats)
 {
-	assert(v && v->type == TYPE_STRING);
-	return v->str.s;
+	assert(w && v && length);
+#ifdef TINYJSON_STATS
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+#endif
+	parserContext* c = w->context;
+	ResetWriter(w);
+	c->stats = stats;
+	Stringify_value(c, v);
+	const char* ret = GetWriterOutput(w, length);
+	STATS(c, c->stats->stringifyBytes += *length; c->stats->stringifyNanos += StatsNanosSince(start));
+	c->stats = nullptr;
+	return ret;
 }
 
-size_t GetValueStringLength(const jsonValue* v)
+#ifdef TINYJSON_POSIX
+static_assert(sizeof(jsonIovec) == sizeof(struct iovec) && offsetof(jsonIovec, base) == offsetof(struct iovec, iov_base) &&
+	offsetof(jsonIovec, len) == offsetof(struct iovec, iov_len), "jsonIovec must match struct iovec");
+#endif
+
+const jsonIovec* StringifyIovec(jsonWriter* w, const jsonValue* v, size_t* count, size_t* length, size_t inPlace)
 {
-	assert(v && v->type == TYPE_STRING);
-	return v->str.len;
+	assert(w && v && count);
+	parserContext* c = w->context;
+	gatherState g = { w, 0, 0, inPlace ? inPlace : 1 };
+	ResetWriter(w);
+	c->gather = &g;
+	Stringify_value(c, v);
+	GatherCut(c);
+	c->gather = nullptr;
+
+	// the scratch has stopped moving, its pieces get their addresses
+	size_t offset = 0, total = 0;
+	for (size_t i = 0; i < g.count; i++)
+	{
+		if (!w->pieces[i].base)
+		{
+			w->pieces[i].base = c->stack + offset;
+			offset += w->pieces[i].len;
+		}
+		total += w->pieces[i].len;
+	}
+	*count = g.count;
+	if (length)
+	{
+		*length = total;
+	}
+	return w->pieces;
 }
 
-void SetValueBoolean(jsonValue* v, bool b)
+// MessagePack, with lengths and counts big-endian in the smallest form that fits
+
+static void PutBigEndian(char* p, uint64_t n, size_t bytes)
 {
-	FreeValue(v);
-	v->type = b ? TYPE_TRUE : TYPE_FALSE;
+	for (size_t i = bytes; i--; n >>= 8)
+	{
+		p[i] = (char)n;
+	}
 }
 
-bool GetValueBoolean(const jsonValue* v)
+static void MsgPack_tag(parserContext* c, unsigned char tag, uint64_t n, size_t bytes)
 {
-	assert(v && (v->type == TYPE_TRUE || v->type == TYPE_FALSE));
-	return v->type == TYPE_TRUE;
+	char* p = (char*)c->PushSz(1 + bytes);
+	p[0] = (char)tag;
+	PutBigEndian(p + 1, n, bytes);
 }
 
-size_t GetValueArraySize(const jsonValue* v)
+static void MsgPack_number(parserContext* c, double n)
 {
-	assert(v && v->type == TYPE_ARRAY);
-	return v->arr.size;
+	if (n != std::floor(n) || std::fabs(n) > BINARY_INT_LIMIT || (n == 0.0 && std::signbit(n)))
+	{
+		uint64_t bits;
+		memcpy(&bits, &n, sizeof(bits));
+		MsgPack_tag(c, 0xcb, bits, 8);
+	}
+	else if (n >= 0)
+	{
+		uint64_t u = (uint64_t)n;
+		if (u < 0x80)            c->PushChar((char)u);
+		else if (u <= 0xff)      MsgPack_tag(c, 0xcc, u, 1);
+		else if (u <= 0xffff)    MsgPack_tag(c, 0xcd, u, 2);
+		else if (u <= 0xffffffff) MsgPack_tag(c, 0xce, u, 4);
+		else                     MsgPack_tag(c, 0xcf, u, 8);
+	}
+	else
+	{
+		int64_t i = (int64_t)n;
+		if (i >= -32)              c->PushChar((char)i);
+		else if (i >= INT8_MIN)    MsgPack_tag(c, 0xd0, (uint64_t)i, 1);
+		else if (i >= INT16_MIN)   MsgPack_tag(c, 0xd1, (uint64_t)i, 2);
+		else if (i >= INT32_MIN)   MsgPack_tag(c, 0xd2, (uint64_t)i, 4);
+		else                       MsgPack_tag(c, 0xd3, (uint64_t)i, 8);
+	}
 }
 
-jsonValue* GetValueArrayElement(const jsonValue* v, size_t index)
+static void MsgPack_string(parserContext* c, const char* s, size_t len)
 {
-	assert(v && v->type == TYPE_ARRAY && index < v->arr.size);
-	return &v->arr.values[index];
+	assert(len <= 0xffffffff);
+	if (len < 32)          c->PushChar((char)(0xa0 | len));
+	else if (len <= 0xff)   MsgPack_tag(c, 0xd9, len, 1);
+	else if (len <= 0xffff) MsgPack_tag(c, 0xda, len, 2);
+	else                    MsgPack_tag(c, 0xdb, len, 4);
+	if (len)
+	{
+		c->PushStr(s, len);
+	}
 }
 
-size_t GetValueObjectSize(const jsonValue* v)
+// fixarray/fixmap, then the 16 and 32 bit forms
+static void MsgPack_container(parserContext* c, bool array, size_t n)
 {
-	assert(v && v->type == TYPE_OBJECT);
-	return v->obj.size;
+	assert(n <= 0xffffffff);
+	if (n < 16)            c->PushChar((char)((array ? 0x90 : 0x80) | n));
+	else if (n <= 0xffff)  MsgPack_tag(c, array ? 0xdc : 0xde, n, 2);
+	else                   MsgPack_tag(c, array ? 0xdd : 0xdf, n, 4);
 }
 
-const char* GetValueObjectKey(const jsonValue* v, size_t index)
+static void MsgPack_value(parserContext* c, const jsonValue* v)
 {
-	assert(v && v->type == TYPE_OBJECT);
-	assert(index < v->obj.size);
-	return v->obj.maps[index].key;
+	walkStack<walkFrame> s(c->alloc);
+
+	while (v)
+	{
+		switch (v->type) {
+		case TYPE_NULL:   c->PushChar((char)0xc0); break;
+		case TYPE_FALSE:  c->PushChar((char)0xc2); break;
+		case TYPE_TRUE:   c->PushChar((char)0xc3); break;
+		case TYPE_NUMBER: MsgPack_number(c, GetValueNumber(v)); break;
+		case TYPE_STRING: MsgPack_string(c, GetValueString(v), GetValueStringLength(v)); break;
+		case TYPE_ARRAY:
+		case TYPE_OBJECT:
+			MsgPack_container(c, v->type == TYPE_ARRAY, v->type == TYPE_ARRAY ? v->arr.size : v->obj.size);
+			if (v->flags & VALUE_PACKED)
+			{
+				for (size_t i = 0; i < v->nums.size; i++)
+				{
+					MsgPack_number(c, v->nums.values[i]);
+				}
+			}
+			else
+			{
+				*s.Push() = { v, 0 };
+			}
+			break;
+		}
+
+		v = nullptr;
+		while (!v && s.top)
+		{
+			walkFrame* f = &s.frames[s.top - 1];
+			const jsonValue* p = f->v;
+			if (f->next == (p->type == TYPE_ARRAY ? p->arr.size : p->obj.size))
+			{
+				s.top--;
+			}
+			else if (p->type == TYPE_ARRAY)
+			{
+				v = &p->arr.values[f->next++];
+			}
+			else
+			{
+				const jsonMap* m = &p->obj.maps[f->next++];
+				MsgPack_string(c, m->key, m->keyLen);
+				v = &m->value;
+			}
+		}
+	}
 }
 
-size_t GetValueObjectKeyLength(const jsonValue* v, size_t index)
+int EncodeMsgPack(const jsonValue* v, char** data, size_t* length, const jsonAllocator* alloc)
 {
-	assert(v && v->type == TYPE_OBJECT);
-	assert(index < v->obj.size);
-	return v->obj.maps[index].keyLen;
+	assert(v && data && length);
+	parserContext local;
+	alloc = ResolveAllocator(alloc);
+	parserContext* c = ScratchContext(alloc, &local);
+	c->top = 0;
+	MsgPack_value(c, v);
+
+	*length = c->top;
+	*data = (char*)JsonMalloc(alloc, *length);
+	memcpy(*data, c->stack, *length);
+	c->Trim();
+	return STRINGIFY_OK;
 }
 
-jsonValue* GetValueObjectValue(const jsonValue* v, size_t index)
+// one MessagePack item: a scalar, a string, or the element count of an array or map
+struct msgPackItem {
+	valueType type;
+	double num;
+	const char* s;
+	size_t len;      // string length or element count
+};
+
+static bool ReadBigEndian(binaryInput* in, size_t bytes, uint64_t* n)
 {
-	assert(v && v->type == TYPE_OBJECT);
-	assert(index < v->obj.size);
-	return &v->obj.maps[index].value;
+	if ((size_t)(in->end - in->p) < bytes)
+	{
+		return false;
+	}
+	*n = 0;
+	for (size_t i = 0; i < bytes; i++)
+	{
+		*n = *n << 8 | (unsigned char)*in->p++;
+	}
+	return true;
 }
 
-static void Stringify_string(parserContext* c, const char* s, size_t len)
+static parseStatus MsgPackItem(binaryInput* in, msgPackItem* it)
 {
-	assert(s);
+	if (in->p == in->end)
+	{
+		return PARSE_ERR_EXPECT_VALUE;
+	}
+	unsigned char b = (unsigned char)*in->p++;
+	uint64_t n = 0;
+	bool ok = true;
+
+	it->type = TYPE_NUMBER;
+	if (b <= 0x7f || b >= 0xe0)
+	{
+		it->num = (signed char)b;
+		return PARSE_OK;
+	}
+	else if (b <= 0x8f || (b >= 0x90 && b <= 0x9f))
+	{
+		it->type = b <= 0x8f ? TYPE_OBJECT : TYPE_ARRAY;
+		n = b & 0x0f;
+	}
+	else if (b <= 0xbf)
+	{
+		it->type = TYPE_STRING;
+		n = b & 0x1f;
+	}
+	else
+	{
+		switch (b) {
+		case 0xc0: it->type = TYPE_NULL; return PARSE_OK;
+		case 0xc2: it->type = TYPE_FALSE; return PARSE_OK;
+		case 0xc3: it->type = TYPE_TRUE; return PARSE_OK;
+		case 0xca:
+		{
+			uint32_t bits;
+			float f;
+			ok = ReadBigEndian(in, 4, &n);
+			bits = (uint32_t)n;
+			memcpy(&f, &bits, sizeof(f));
+			it->num = f;
+			break;
+		}
+		case 0xcb:
+			ok = ReadBigEndian(in, 8, &n);
+			memcpy(&it->num, &n, sizeof(it->num));
+			break;
+		case 0xcc: case 0xcd: case 0xce: case 0xcf:
+			ok = ReadBigEndian(in, (size_t)1 << (b - 0xcc), &n);
+			it->num = (double)n;
+			break;
+		case 0xd0: case 0xd1: case 0xd2: case 0xd3:
+		{
+			unsigned shift = 64 - 8 * (1u << (b - 0xd0));
+			ok = ReadBigEndian(in, (size_t)1 << (b - 0xd0), &n);
+			it->num = (double)((int64_t)(n << shift) >> shift);
+			break;
+		}
+		case 0xd9: case 0xda: case 0xdb:
+			it->type = TYPE_STRING;
+			ok = ReadBigEndian(in, (size_t)1 << (b - 0xd9), &n);
+			break;
+		case 0xdc: case 0xdd:
+			it->type = TYPE_ARRAY;
+			ok = ReadBigEndian(in, b == 0xdc ? 2 : 4, &n);
+			break;
+		case 0xde: case 0xdf:
+			it->type = TYPE_OBJECT;
+			ok = ReadBigEndian(in, b == 0xde ? 2 : 4, &n);
+			break;
+		default:
+			return PARSE_ERR_INVALID_VALUE; // bin, ext and the unused 0xc1 have no JSON counterpart
+		}
+		if (!ok)
+		{
+			return PARSE_ERR_EXPECT_VALUE;
+		}
+		if (it->type == TYPE_NUMBER && !std::isfinite(it->num))
+		{
+			return PARSE_ERR_INVALID_VALUE; // neither are NaN and the infinities
+		}
+	}
+
+	// every element and member takes at least a byte, which bounds the counts
+	uint64_t left = (uint64_t)(in->end - in->p);
+	if (it->type == TYPE_STRING)
+	{
+		if (n > left)
+		{
+			return PARSE_ERR_EXPECT_VALUE;
+		}
+		it->s = in->p;
+		in->p += n;
+	}
+	else if (it->type != TYPE_NUMBER && n > (it->type == TYPE_OBJECT ? left / 2 : left))
+	{
+		return PARSE_ERR_EXPECT_VALUE;
+	}
+	it->len = (size_t)n;
+	return PARSE_OK;
+}
 
-	static const char hex_digits[] = { '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F' };
+// map keys have to be strings
+parseStatus DecodeMsgPack(jsonValue* v, const char* data, size_t length, size_t* used, const jsonAllocator* alloc)
+{
+	assert(v && (data || !length));
+	alloc = ResolveAllocator(alloc);
+	InitValue(v);
 
-	c->PushChar('\"');
+	binaryInput in = { data, data + length };
+	walkStack<walkFrame> s(alloc);
+	msgPackItem it;
+	parseStatus ret = PARSE_OK;
+	jsonValue* d = v;
 
-	for (size_t i = 0; i < len; i++)
+	while (d)
 	{
-		switch (s[i])
+		if ((ret = MsgPackItem(&in, &it)) != PARSE_OK)
 		{
-		case '\n': c->PushChar('\\'); c->PushChar('n'); break;
-		case '\r': c->PushChar('\\'); c->PushChar('r'); break;
-		case '\b': c->PushChar('\\'); c->PushChar('b'); break;
-		case '\f': c->PushChar('\\'); c->PushChar('f'); break;
-		case '\t': c->PushChar('\\'); c->PushChar('t'); break;
-		case '\"': c->PushChar('\\'); c->PushChar('\"'); break;
-		case '\\': c->PushChar('\\'); c->PushChar('\\'); break;
-			
+			break;
+		}
+		switch (it.type) {
+		case TYPE_NUMBER:
+			d->num = it.num;
+			break;
+		case TYPE_STRING:
+			d->str.s = CopyText(alloc, it.s, it.len);
+			d->str.len = it.len;
+			break;
+		case TYPE_ARRAY:
+			d->arr.values = it.len ? (jsonValue*)JsonMalloc(alloc, it.len * sizeof(jsonValue)) : nullptr;
+			if (it.len)
+			{
+				memset(d->arr.values, 0, it.len * sizeof(jsonValue));
+			}
+			d->arr.size = it.len;
+			*s.Push() = { d, 0 };
+			break;
+		case TYPE_OBJECT:
+			d->obj.maps = it.len ? (jsonMap*)JsonMalloc(alloc, it.len * sizeof(jsonMap)) : nullptr;
+			if (it.len)
+			{
+				memset(d->obj.maps, 0, it.len * sizeof(jsonMap));
+			}
+			d->obj.size = it.len;
+			*s.Push() = { d, 0 };
+			break;
 		default:
-			if (s[i] < 0x20)
+			break;
+		}
+		d->type = it.type;
+
+		d = nullptr;
+		while (!d && s.top && ret == PARSE_OK)
+		{
+			walkFrame* f = &s.frames[s.top - 1];
+			jsonValue* p = const_cast<jsonValue*>(f->v);
+			if (f->next == (p->type == TYPE_ARRAY ? p->arr.size : p->obj.size))
+			{
+				s.top--;
+			}
+			else if (p->type == TYPE_ARRAY)
 			{
-				c->PushChar('\\');
-				c->PushChar('u');
-				c->PushChar('0');
-				c->PushChar('0');
-				c->PushChar(hex_digits[s[i] >> 4]);
-				c->PushChar(hex_digits[s[i] & 0xf]);
+				d = &p->arr.values[f->next++];
 			}
 			else
 			{
-				c->PushChar(s[i]);
+				jsonMap* m = &p->obj.maps[f->next++];
+				if ((ret = MsgPackItem(&in, &it)) == PARSE_OK && it.type != TYPE_STRING)
+				{
+					ret = PARSE_ERR_MISS_KEY;
+				}
+				if (ret == PARSE_OK)
+				{
+					m->key = CopyText(alloc, it.s, it.len);
+					m->keyLen = it.len;
+					d = &m->value;
+				}
 			}
+		}
+		if (ret != PARSE_OK)
+		{
 			break;
 		}
 	}
-	c->PushChar('\"');
+
+	if (ret == PARSE_OK && !used && in.p != in.end)
+	{
+		ret = PARSE_ERR_ROOT_NOT_SINGULAR;
+	}
+	if (ret != PARSE_OK)
+	{
+		FreeValue(v, alloc);
+		return ret;
+	}
+	if (used)
+	{
+		*used = (size_t)(in.p - data);
+	}
+	return PARSE_OK;
 }
 
-static int Stringify_value(parserContext* c, const jsonValue* v)
+struct transcodeFrame {
+	size_t header;   // JSON to MessagePack: where the container's tag was written
+	size_t done;     // items written, a map member counts as two
+	size_t total;    // MessagePack to JSON: items to write
+	bool object;
+};
+
+// containers get 32-bit counts, patched in when they close, so nothing is buffered
+parseStatus TranscodeJsonToMsgPack(jsonReader* r, jsonWriter* w)
 {
-	int ret = 0;
+	assert(r && w);
+	parserContext* c = w->context;
+	walkStack<transcodeFrame> s(c->alloc);
+	parseStatus ret;
+	jsonToken t;
 
-	switch (v->type) {
-	case TYPE_NULL:   c->PushStr("null", 4); break;
-	case TYPE_FALSE:  c->PushStr("false", 5); break;
-	case TYPE_TRUE:   c->PushStr("true", 4); break;
-	case TYPE_NUMBER: c->top -= static_cast<size_t>(32) - sprintf((char*)c->PushSz(32), "%.17g", v->num); break;
-	case TYPE_STRING:
-		Stringify_string(c, v->str.s, v->str.len);
-		break;
-	case TYPE_ARRAY: 
-		c->PushChar('[');
-		for (size_t i = 0; i < v->arr.size; i++)
+	do {
+		if ((ret = ReadToken(r, &t)) != PARSE_OK)
 		{
-			Stringify_value(c, &v->arr.values[i]);
-			if (i < v->arr.size - 1)
-			{
-				c->PushChar(',');
-			}
+			return ret;
 		}
-		c->PushChar(']');
-		break;
-	case TYPE_OBJECT:
-		c->PushChar('{');
-		for (size_t i = 0; i < v->obj.size; i++)
+		transcodeFrame* f = s.top ? &s.frames[s.top - 1] : nullptr;
+		bool closing = t.type == TOKEN_ARRAY_END || t.type == TOKEN_OBJECT_END;
+		if (f && !closing && (!f->object || t.type == TOKEN_KEY))
 		{
-			Stringify_string(c, v->obj.maps[i].key, v->obj.maps[i].keyLen);
-			c->PushChar(':');
-			Stringify_value(c, &v->obj.maps[i].value);
-			if (i < v->obj.size - 1)
+			f->done++;
+		}
+
+		switch (t.type) {
+		case TOKEN_NULL:   c->PushChar((char)0xc0); break;
+		case TOKEN_FALSE:  c->PushChar((char)0xc2); break;
+		case TOKEN_TRUE:   c->PushChar((char)0xc3); break;
+		case TOKEN_NUMBER: MsgPack_number(c, t.num); break;
+		case TOKEN_STRING:
+		case TOKEN_KEY:
+			MsgPack_string(c, t.str.s, t.str.len);
+			break;
+		case TOKEN_ARRAY_BEGIN:
+		case TOKEN_OBJECT_BEGIN:
+			*s.Push() = { c->top, 0, 0, t.type == TOKEN_OBJECT_BEGIN };
+			c->PushSz(5);
+			break;
+		case TOKEN_ARRAY_END:
+		case TOKEN_OBJECT_END:
+			c->stack[f->header] = (char)(f->object ? 0xdf : 0xdd);
+			PutBigEndian(c->stack + f->header + 1, f->done, 4);
+			s.top--;
+			break;
+		case TOKEN_END:
+			return PARSE_ERR_EXPECT_VALUE;
+		}
+	} while (s.top);
+
+	return PARSE_OK;
+}
+
+parseStatus TranscodeMsgPackToJson(const char* data, size_t length, size_t* used, jsonWriter* w)
+{
+	assert((data || !length) && w);
+	binaryInput in = { data, data + length };
+	walkStack<transcodeFrame> s(w->context->alloc);
+	parseStatus ret;
+	msgPackItem it;
+
+	do {
+		transcodeFrame* f = s.top ? &s.frames[s.top - 1] : nullptr;
+		if (f && f->done && (!f->object || !(f->done & 1)))
+		{
+			WriteRaw(w, ",", 1);
+		}
+		if ((ret = MsgPackItem(&in, &it)) != PARSE_OK)
+		{
+			return ret;
+		}
+
+		if (f && f->object && !(f->done & 1))
+		{
+			if (it.type != TYPE_STRING)
 			{
-				c->PushChar(',');
+				return PARSE_ERR_MISS_KEY;
 			}
+			WriteString(w, it.s, it.len);
+			WriteRaw(w, ":", 1);
+			f->done++;
+			continue;
+		}
+		if (f)
+		{
+			f->done++;
+		}
+
+		switch (it.type) {
+		case TYPE_NULL:   WriteRaw(w, "null", 4); break;
+		case TYPE_FALSE:  WriteRaw(w, "false", 5); break;
+		case TYPE_TRUE:   WriteRaw(w, "true", 4); break;
+		case TYPE_NUMBER: WriteNumber(w, it.num); break;
+		case TYPE_STRING: WriteString(w, it.s, it.len); break;
+		case TYPE_ARRAY:
+		case TYPE_OBJECT:
+			WriteRaw(w, it.type == TYPE_ARRAY ? "[" : "{", 1);
+			*s.Push() = { 0, 0, it.type == TYPE_ARRAY ? it.len : it.len * 2, it.type == TYPE_OBJECT };
+			break;
+		}
+
+		while (s.top && s.frames[s.top - 1].done == s.frames[s.top - 1].total)
+		{
+			WriteRaw(w, s.frames[s.top - 1].object ? "}" : "]", 1);
+			s.top--;
 		}
+	} while (s.top);
 
-		c->PushChar('}');
+	if (used)
+	{
+		*used = (size_t)(in.p - data);
+	}
+	else if (in.p != in.end)
+	{
+		return PARSE_ERR_ROOT_NOT_SINGULAR;
 	}
+	return PARSE_OK;
+}
 
-	return ret;
+void InitParser(jsonParser* p, const jsonAllocator* alloc)
+{
+	assert(p);
+	p->context = NewContext(nullptr, alloc);
 }
 
-int Stringify(const jsonValue* v, char** json, size_t* length)
+void FreeParser(jsonParser* p)
 {
-	assert(v);
-	assert(json);
+	assert(p);
+	DeleteContext(p->context);
+	p->context = nullptr;
+}
 
-	int ret = STRINGIFY_OK;
-	parserContext context;
-	context.stack = (char*)malloc(context.size = PARSE_STRINGIFY_INIT_SIZE);
-	context.top = 0;
+void SetParserTrimSize(jsonParser* p, size_t bytes)
+{
+	assert(p);
+	p->context->trimSize = bytes;
+}
 
-	if ((ret = Stringify_value(&context, v) != STRINGIFY_OK)) {
-		free(context.stack);
-		*json = nullptr;
-		return ret;
-	}
+parseStatus ParseJsonStringWith(jsonParser* p, jsonValue* v, const char* json, jsonStats* stats)
+{
+	assert(p);
+	return ParseRoot(p->context, v, json, stats);
+}
 
-	*length = context.top;
+void SetParserMaxDepth(jsonParser* p, size_t depth)
+{
+	assert(p);
+	p->context->maxDepth = depth;
+}
 
-	context.PushChar('\0');
-	*json = context.stack;
-	context.stack = nullptr;
-	return ret;
-}
\ No newline at end of file
+void SetParserFlags(jsonParser* p, unsigned flags)
+{
+	assert(p);
+	p->context->flags = flags;
+}
@@ -2,6 +2,7 @@
 #define JSON_PARSER_H__
 
 #include <stdio.h>
+#include <stdint.h>
 
 enum valueType
 {
@@ -28,7 +29,12 @@ enum parseStatus {
     PARSE_ERR_MISS_COLON,
     PARSE_ERR_MISS_COMMA_OR_CURLY_BRACKET,
     PARSE_ERR_INVALID_UNICODE_HEX,
-    PARSE_ERR_INVALID_UNICODE_SURROGATE
+    PARSE_ERR_INVALID_UNICODE_SURROGATE,
+    PARSE_ERR_TYPE_MISMATCH,
+    PARSE_ERR_DEPTH_EXCEEDED,
+    PARSE_ERR_INVALID_UTF8,
+    PARSE_ERR_INVALID_PATH,
+    PARSE_ERR_IO
 };
 
 enum stringifyStatus {
@@ -36,14 +42,31 @@ enum stringifyStatus {
     STRINGIFY_ERR
 };
 
+/* jsonValue::flags, zero for values that own their payload; bits 9 and up are reserved */
+enum valueFlag {
+    VALUE_BORROWED = 1 << 0,   /* payload, or an object's keys, point into the input, which must outlive it */
+    VALUE_ESCAPED  = 1 << 1,   /* borrowed string still holding its raw escapes */
+    VALUE_DECODED  = 1 << 2,   /* string decoded on first access, owned like any other */
+    VALUE_RAW      = 1 << 3,   /* number kept as its text in str, converted on every access */
+    VALUE_CACHED   = 1 << 4,   /* array or object remembering its last output, see EnableStringifyCache() */
+    VALUE_PACKED   = 1 << 5,   /* array of plain doubles in nums, see PARSE_PACKED_NUMBERS */
+    VALUE_COMPACT  = 1 << 6,   /* root of a CompactValue() tree, owns the block everything below sits in */
+    VALUE_FIXED    = 1 << 7,   /* payload inside a CompactValue() block, released with the block, or a compile-time literal */
+    VALUE_SHARED   = 1 << 8    /* array or object whose payload is a ShareValue() block, read-only, released with its last reference */
+};
+
 struct jsonMap;
+struct jsonAllocator;
 
 struct jsonValue {
     valueType type;
+    unsigned flags;            /* valueFlag */
     union {
         struct { jsonMap* maps; size_t size; } obj;
         struct { jsonValue* values; size_t size; } arr;
+        struct { double* values; size_t size; } nums;
         struct { char* s; size_t len; } str;
+        struct { const char* raw; const jsonAllocator* alloc; } lazy;   /* VALUE_ESCAPED: raw runs to its closing quote */
         double num;
     };
 };
@@ -54,30 +77,483 @@ struct jsonMap {
     jsonValue value;
 };
 
+/*
+ * Filled in by ParseJsonString(), Stringify() and their *With() variants
+ * when the library is built with TINYJSON_STATS, untouched otherwise.
+ * Counters accumulate across calls, zero the struct to start over.
+ */
+struct jsonStats {
+    size_t parseBytes;
+    size_t stringifyBytes;
+    size_t values[TYPE_OBJECT + 1];   /* parsed values, indexed by valueType */
+    size_t maxDepth;
+    size_t peakStack;                 /* parserContext stack high-water mark, bytes */
+    size_t stackGrowths;              /* PushSz reallocations */
+    size_t allocations;
+    size_t allocatedBytes;
+    unsigned long long parseNanos;
+    unsigned long long stringifyNanos;
+};
+
+/*
+ * Every allocation the library makes goes through one of these. Free and
+ * Realloc are always given the exact size the block was allocated with, so
+ * size-class pools need no headers. A tree must be freed with the allocator
+ * it was built with; nullptr anywhere below means the default allocator.
+ */
+struct jsonAllocator {
+    void* (*Malloc)(void* userData, size_t size);
+    void* (*Realloc)(void* userData, void* ptr, size_t oldSize, size_t newSize);
+    void  (*Free)(void* userData, void* ptr, size_t size);
+    void* userData;
+};
+
+/* process-wide, malloc/realloc/free unless replaced; nullptr restores those */
+void                 SetDefaultAllocator(const jsonAllocator* alloc);
+const jsonAllocator* GetDefaultAllocator();
+
 void InitValue(jsonValue* v);
-void FreeValue(jsonValue* v);
+void FreeValue(jsonValue* v, const jsonAllocator* alloc = nullptr);
+
+/* deep copy, each node allocated once at its exact size; shared containers are referenced, see ShareValue() */
+void CopyValue(jsonValue* dst, const jsonValue* src, const jsonAllocator* alloc = nullptr);
+/* O(1), src is left as TYPE_NULL; for both, src may be one of dst's own descendants */
+void MoveValue(jsonValue* dst, jsonValue* src, const jsonAllocator* alloc = nullptr);
+void SwapValue(jsonValue* lhs, jsonValue* rhs);
 
-parseStatus ParseJsonString(jsonValue* v, const char* json);
+/*
+ * Heap held by a tree, by what it holds. Borrowed text belongs to the input
+ * and is not counted. Sizes are the ones the library asks its allocator for,
+ * so the allocator's own cost per block comes on top: allocations times
+ * whatever that is. Blocks shared through ShareValue() count in full for
+ * every tree that refers to them.
+ */
+struct jsonFootprint {
+    size_t strings;       /* string and raw number text, NULs included */
+    size_t keys;
+    size_t arrays;        /* element blocks, and the doubles of packed arrays */
+    size_t objects;       /* member blocks */
+    size_t overhead;      /* library headers, stringify cache output, unused space in a CompactValue() block */
+    size_t allocations;   /* separate blocks, a CompactValue() block counts once when measured from its root */
+};
+void MeasureValue(const jsonValue* v, jsonFootprint* out);
+
+/*
+ * Moves the tree into a single block from alloc, laid out depth first so that
+ * a walk reads it front to back, and frees the blocks it came from. Borrowed
+ * and lazily decoded text is copied in, the tree no longer needs its input.
+ * It stays writable: values changed through the setters, FreeValue() or
+ * GetValueArrayElement() get payloads of their own, and the block is released
+ * with the root. Values inside must not be moved out of the tree, copy them
+ * instead. Values already inside a compacted tree are left as they are, and
+ * EnableStringifyCache() leaves compacted containers uncached.
+ */
+void CompactValue(jsonValue* v, const jsonAllocator* alloc = nullptr);
+
+/*
+ * Freezes the tree for sharing: every non-empty array and object moves into
+ * a read-only block of its own from alloc, holding its elements, their keys
+ * and their text, with an atomic count of the values that refer to it.
+ * CopyValue() of a shared container takes a reference instead of copying and
+ * FreeValue() drops one, so copies can be handed to other threads, then read
+ * and freed there concurrently; each jsonValue itself still belongs to one
+ * thread. Borrowed and lazy text is copied in and packed arrays are expanded,
+ * so that reading never writes. Containers that are already shared are kept,
+ * refreezing an edited copy costs only what was edited.
+ *
+ * Values inside a shared block must not be written or moved out. To change a
+ * copy, UnshareValue() gives a shared container a private copy of its own
+ * level, whose members go on sharing everything below them, and EditValue()
+ * does that for each container from the root down to the value a JSON
+ * pointer (RFC 6901) names, then returns it; nullptr if it names nothing.
+ * EnableStringifyCache() leaves shared containers uncached.
+ */
+void       ShareValue(jsonValue* v, const jsonAllocator* alloc = nullptr);
+jsonValue* UnshareValue(jsonValue* v, const jsonAllocator* alloc = nullptr);
+jsonValue* EditValue(jsonValue* root, const char* pointer, const jsonAllocator* alloc = nullptr);
+
+/*
+ * Structural hash and equality: object members compare regardless of order,
+ * numbers by value (1.0 equals 1, -0 equals 0), strings by their decoded
+ * text. Objects with duplicate keys compare as multisets of members: each
+ * member matches one member of the other with its key and an equal value,
+ * tried at its own position first. Containers under EnableStringifyCache()
+ * keep their hash until they change, so rehashing costs only the changed
+ * paths and EqualValue() rejects two hashed containers that differ at once.
+ */
+size_t HashValue(const jsonValue* v);
+bool   EqualValue(const jsonValue* a, const jsonValue* b);
+
+parseStatus ParseJsonString(jsonValue* v, const char* json, jsonStats* stats = nullptr, const jsonAllocator* alloc = nullptr);
 valueType   GetValueType(const jsonValue* v);
 
 double GetValueNumber(const jsonValue* v);
-void   SetValueNumber(jsonValue* v, double n);
+/* the original text of a raw number, nullptr if it is held as a double */
+const char* GetValueNumberText(const jsonValue* v, size_t* length);
+void   SetValueNumber(jsonValue* v, double n, const jsonAllocator* alloc = nullptr);
 
 const char* GetValueString(const jsonValue* v);
 size_t      GetValueStringLength(const jsonValue* v);
-void        SetValueString(jsonValue* v, const char* s, size_t len);
+void        SetValueString(jsonValue* v, const char* s, size_t len, const jsonAllocator* alloc = nullptr);
 
-void SetValueBoolean(jsonValue* v, bool b);
+void SetValueBoolean(jsonValue* v, bool b, const jsonAllocator* alloc = nullptr);
 bool GetValueBoolean(const jsonValue* v);
 
 size_t     GetValueArraySize(const jsonValue* v);
 jsonValue* GetValueArrayElement(const jsonValue* v, size_t index);
+/* the elements of a VALUE_PACKED array, contiguous, nullptr if it is not packed */
+const double* GetValueArrayNumbers(const jsonValue* v);
 
 size_t      GetValueObjectSize(const jsonValue* v);
 const char* GetValueObjectKey(const jsonValue* v, size_t index);
 size_t      GetValueObjectKeyLength(const jsonValue* v, size_t index);
 jsonValue*  GetValueObjectValue(const jsonValue* v, size_t index);
 
-int Stringify(const jsonValue* v, char** json, size_t* length);
+/* *json is length + 1 bytes from alloc, release it with alloc->Free(userData, *json, *length + 1) */
+int Stringify(const jsonValue* v, char** json, size_t* length, jsonStats* stats = nullptr, const jsonAllocator* alloc = nullptr);
+
+/*
+ * Makes every array and object under root keep the text it was last
+ * serialized to, so the next Stringify() of root copies unchanged subtrees
+ * instead of walking them. Changes made through the setters, FreeValue(),
+ * CopyValue(), MoveValue() and SwapValue() mark the path up to root dirty;
+ * writing to a jsonValue directly, or parsing into one, goes unnoticed.
+ * Containers added later are written the slow way until this is called
+ * again. Costs about one extra copy of the output; Stringify() then writes
+ * to the tree, so a cached tree must not be serialized by two threads at once.
+ * alloc must be the one the tree was built with.
+ */
+void EnableStringifyCache(jsonValue* root, const jsonAllocator* alloc = nullptr);
+
+/*
+ * Binary snapshot of a tree for fast reloads: length-prefixed strings, doubles
+ * in native byte order, integers as varints and element counts up front, so
+ * DecodeBinary() allocates every block once at its final size and never
+ * unescapes or converts. Raw numbers keep their text. The format is not
+ * portable across byte orders and carries no checksum; malformed input fails
+ * with PARSE_ERR_INVALID_VALUE. Content is checked only where Stringify()
+ * could not write it back as JSON: doubles must be finite, raw number text
+ * must be a number, and strings tagged as needing no escapes must need none.
+ * *data is length bytes from alloc.
+ */
+int         EncodeBinary(const jsonValue* v, char** data, size_t* length, const jsonAllocator* alloc = nullptr);
+/*
+ * flags takes PARSE_LAZY_STRINGS, which makes keys, strings and raw numbers
+ * borrow from data (a mapped file, say) instead of being copied; data must
+ * then outlive the tree. Everything borrowed is NUL-terminated, except strings
+ * that need escaping, which are always copied.
+ */
+parseStatus DecodeBinary(jsonValue* v, const char* data, size_t length, unsigned flags = 0, const jsonAllocator* alloc = nullptr);
+
+/*
+ * Read-only compact copy of a tree in one block. Every value is an 8-byte
+ * jsonBox: a number is its double, anything else a NaN whose spare bits hold
+ * the type and the offset of its data in arena. Arrays are a count followed
+ * by their boxes, objects a count followed by key and value boxes, strings
+ * their length followed by the NUL-terminated text, with each distinct key
+ * stored once. That is 8 bytes per element and 16 per member plus the text,
+ * against 24 and 40 plus a key allocation for jsonValue. Raw numbers become doubles, lazy strings are
+ * decoded. The arena holds offsets only, so it can be copied or written out
+ * and mapped back as is.
+ */
+typedef uint64_t jsonBox;
+
+struct jsonBoxedDoc {
+    char* arena;
+    size_t size;
+    jsonBox root;
+    const jsonAllocator* alloc;
+};
+
+void BoxValue(jsonBoxedDoc* d, const jsonValue* v, const jsonAllocator* alloc = nullptr);
+/* v is overwritten without being freed, like DecodeBinary() */
+void UnboxValue(jsonValue* v, const jsonBoxedDoc* d, jsonBox b, const jsonAllocator* alloc = nullptr);
+void FreeBoxedDoc(jsonBoxedDoc* d);
+
+valueType   GetBoxType(jsonBox b);
+double      GetBoxNumber(jsonBox b);
+const char* GetBoxString(const jsonBoxedDoc* d, jsonBox b, size_t* length);
+size_t      GetBoxSize(const jsonBoxedDoc* d, jsonBox b);
+jsonBox     GetBoxElement(const jsonBoxedDoc* d, jsonBox b, size_t index);
+const char* GetBoxKey(const jsonBoxedDoc* d, jsonBox b, size_t index, size_t* length);
+jsonBox     GetBoxMember(const jsonBoxedDoc* d, jsonBox b, size_t index);
+
+enum tokenType {
+    TOKEN_NULL,
+    TOKEN_FALSE,
+    TOKEN_TRUE,
+    TOKEN_NUMBER,
+    TOKEN_STRING,
+    TOKEN_KEY,
+    TOKEN_ARRAY_BEGIN,
+    TOKEN_ARRAY_END,
+    TOKEN_OBJECT_BEGIN,
+    TOKEN_OBJECT_END,
+    TOKEN_END
+};
+
+struct jsonToken {
+    tokenType type;
+    union {
+        /* decoded, valid until the next call on the reader */
+        struct { const char* s; size_t len; } str;
+        double num;
+    };
+};
+
+struct parserContext;
+
+/*
+ * Reusable parse context: the scratch stack stays allocated between calls,
+ * up to the trim size (64 KiB by default, 0 releases it every time).
+ * Nesting deeper than the max depth (1024 by default, 0 for no limit) fails
+ * with PARSE_ERR_DEPTH_EXCEEDED; the parser does not recurse either way.
+ * ParseJsonString() and Stringify() keep one such context per thread when
+ * they use the built-in allocator.
+ */
+struct jsonParser {
+    parserContext* context;
+};
+
+enum parseFlag {
+    /*
+     * Strings borrow their raw slice of the input instead of being copied.
+     * Slices without escapes are returned as is, so they are not
+     * NUL-terminated; escaped ones are decoded, through the allocator the
+     * tree was parsed with, on the first GetValueString() or
+     * GetValueStringLength(), and Stringify() copies undecoded slices
+     * verbatim. The input must outlive the tree, and since decoding writes
+     * to the value, threads sharing a tree must not read it unsynchronized.
+     */
+    PARSE_LAZY_STRINGS = 1 << 0,
+    /*
+     * Numbers are validated but kept as their text, borrowed from the input
+     * like lazy strings. GetValueNumber() converts on each call, Stringify()
+     * copies the text, so 1.0 or 12345678901234567890 survive a round trip.
+     * Out-of-range numbers are accepted and convert to +-HUGE_VAL.
+     */
+    PARSE_RAW_NUMBERS  = 1 << 1,
+    /*
+     * A quick pass over the input counts the elements of every array and
+     * object first, so each is allocated once at its exact size and parsed
+     * into directly instead of being gathered on the scratch stack and copied.
+     */
+    PARSE_EXACT_SIZE   = 1 << 2,
+    /*
+     * Strings and keys must be well-formed UTF-8 (RFC 3629: no overlong
+     * forms, no surrogates, nothing above U+10FFFF), anything else fails with
+     * PARSE_ERR_INVALID_UTF8. A \u escape of a lone low surrogate fails with
+     * PARSE_ERR_INVALID_UNICODE_SURROGATE. Without it bytes pass through as is.
+     */
+    PARSE_STRICT_UTF8  = 1 << 3,
+    /*
+     * Non-empty arrays of nothing but numbers are stored as VALUE_PACKED, a
+     * plain double per element instead of a jsonValue, about a third of the
+     * memory. GetValueArrayNumbers() hands them out as is; the first
+     * GetValueArrayElement() turns the array back into jsonValues for good,
+     * so like lazy strings, threads sharing such a tree must not read it
+     * unsynchronized. Raw numbers are never packed.
+     */
+    PARSE_PACKED_NUMBERS = 1 << 4
+};
+
+/* alloc is used for both the scratch stack and the trees it builds */
+void        InitParser(jsonParser* p, const jsonAllocator* alloc = nullptr);
+void        FreeParser(jsonParser* p);
+void        SetParserTrimSize(jsonParser* p, size_t bytes);
+void        SetParserMaxDepth(jsonParser* p, size_t depth);
+void        SetParserFlags(jsonParser* p, unsigned flags);
+parseStatus ParseJsonStringWith(jsonParser* p, jsonValue* v, const char* json, jsonStats* stats = nullptr);
+
+/* pull tokenizer, no tree is built; errors leave the reader unusable */
+struct jsonReader {
+    parserContext* context;
+};
+
+void        InitReader(jsonReader* r, const char* json, const jsonAllocator* alloc = nullptr);
+void        FreeReader(jsonReader* r);
+parseStatus ReadToken(jsonReader* r, jsonToken* t);
+parseStatus PeekToken(jsonReader* r, tokenType* type);
+parseStatus SkipValue(jsonReader* r);
+parseStatus ReadValue(jsonReader* r, jsonValue* v);
+
+/*
+ * Columnar copy of an array of objects, one column per key in order of first
+ * appearance. A column takes the type of its values; one that meets a second
+ * type, or holds arrays or objects, keeps jsonValues. Bitmaps hold row i in
+ * bit i % 8 of byte i / 8. A key repeated within a record keeps its first value.
+ */
+enum columnType {
+    COLUMN_NULL,               /* every row is null */
+    COLUMN_BOOLEAN,
+    COLUMN_NUMBER,
+    COLUMN_STRING,
+    COLUMN_VALUE
+};
+
+struct jsonColumn {
+    char* name;
+    size_t nameLen;
+    columnType type;
+    uint8_t* nulls;            /* set for rows where the key is null or missing */
+    union {
+        uint8_t* booleans;     /* a bitmap */
+        double* numbers;       /* 0 in null rows */
+        struct { size_t* offsets; char* text; } strings;   /* row i is text[offsets[i], offsets[i + 1]) */
+        jsonValue* values;     /* TYPE_NULL in null rows */
+    };
+};
+
+struct jsonColumns {
+    jsonColumn* columns;
+    size_t count;
+    size_t rows;
+    const jsonAllocator* alloc;
+};
+
+/* both fail with PARSE_ERR_TYPE_MISMATCH unless given an array of objects */
+parseStatus       ColumnsFromValue(jsonColumns* out, const jsonValue* records, const jsonAllocator* alloc = nullptr);
+/* straight from the text, no tree is built for the records */
+parseStatus       ParseColumns(jsonColumns* out, const char* json, const jsonAllocator* alloc = nullptr);
+void              FreeColumns(jsonColumns* c);
+const jsonColumn* FindColumn(const jsonColumns* c, const char* name, size_t len);
+bool              IsColumnNull(const jsonColumn* col, size_t row);
+const char*       GetColumnString(const jsonColumn* col, size_t row, size_t* length);
+
+/*
+ * Compiled JSONPath queries:
+ *
+ *     $  .key  ['key']  [3]  .*  [*]  ..key  ..*  ..[3]  [?(filter)]
+ *
+ * A filter keeps the children of the current node for which it holds. It
+ * compares @-relative paths (@, @.key, @[0], @['key']) with each other or
+ * with JSON literals ('single quoted' strings too) through == != < <= > >=,
+ * combined with !, &&, || and parentheses; a lone path tests that it exists.
+ * Numbers compare by value, strings bytewise; == and != fall back to
+ * EqualValue(), other operators on anything else are false, and so is every
+ * comparison with a path that does not exist. A plan holds at most 63 steps;
+ * anything else fails with PARSE_ERR_INVALID_PATH.
+ */
+struct jsonPath;
+
+/*
+ * Called for each match in document order, a node before its descendants;
+ * returning false stops the query. record is the NDJSON record, 0 otherwise.
+ * match is only valid during the call.
+ */
+typedef bool (*jsonQueryCallback)(void* userData, size_t record, const jsonValue* match);
+
+/* the plan keeps alloc for everything the queries allocate */
+parseStatus CompilePath(jsonPath** path, const char* expr, const jsonAllocator* alloc = nullptr);
+void        FreePath(jsonPath* path);
+void        QueryValue(const jsonPath* path, const jsonValue* root, jsonQueryCallback cb, void* userData);
+/*
+ * Runs on the next value of r without building it: only matches, and the
+ * children a filter has to test, become trees, everything else is read past
+ * token by token. Stopping leaves r inside the value.
+ */
+parseStatus QueryReader(const jsonPath* path, jsonReader* r, jsonQueryCallback cb, void* userData);
+/*
+ * Runs on every line of ndjson holding a value, blank lines are skipped. A
+ * value must end on its own line, or PARSE_ERR_ROOT_NOT_SINGULAR. threads
+ * splits the text at line breaks into that many slices (0 for one per
+ * core, fewer for short input); the first is queried on the calling thread
+ * as it is read, the others on their own threads into copies that are handed
+ * to cb in order once the first is done, so alloc must be thread-safe. On
+ * failure the matches before the bad value are delivered. *records receives
+ * the number of records queried in full, the index of the bad one on failure.
+ */
+parseStatus QueryNdjson(const jsonPath* path, const char* ndjson, unsigned threads, jsonQueryCallback cb, void* userData,
+                        size_t* records = nullptr);
+
+/*
+ * Pulls the elements of one array at a time, each parsed into its own tree,
+ * so memory stays at the largest element however long the array is. The
+ * array is the whole document, or the one a JSON pointer (RFC 6901, "/a/0")
+ * names; what comes after that one is not read. Only the array's extent is
+ * scanned ahead of each element, which is then parsed from the input in place.
+ * Input is a buffer (not necessarily NUL-terminated), a file descriptor read
+ * in chunks and left open, or a file mapped whole, with the pages already
+ * parsed handed back as it goes. A pointer that names nothing fails with
+ * PARSE_ERR_INVALID_PATH, one that names no array with PARSE_ERR_TYPE_MISMATCH,
+ * failing reads with PARSE_ERR_IO. Nothing is left to close when opening fails.
+ */
+struct elementStream;
+
+struct jsonElements {
+    elementStream* state;
+};
+
+parseStatus OpenElements(jsonElements* e, const char* json, size_t length, const char* pointer = nullptr,
+                         const jsonAllocator* alloc = nullptr);
+parseStatus OpenElementsFd(jsonElements* e, int fd, const char* pointer = nullptr, const jsonAllocator* alloc = nullptr);
+parseStatus OpenElementsFile(jsonElements* e, const char* path, const char* pointer = nullptr, const jsonAllocator* alloc = nullptr);
+/*
+ * Frees v, then parses the next element into it, or sets *end and leaves v
+ * null once the array is over. Errors stick, every later call repeats them.
+ */
+parseStatus NextElement(jsonElements* e, jsonValue* v, bool* end);
+void        CloseElements(jsonElements* e);
+
+/* one piece of gathered output, laid out like struct iovec so that a list of them goes to writev() as is */
+struct jsonIovec {
+    const void* base;
+    size_t len;
+};
+
+/* push serializer, the caller writes the punctuation between values */
+struct jsonWriter {
+    parserContext* context;
+    jsonIovec* pieces;      /* StringifyIovec() output */
+    size_t pieceCapacity;
+};
+
+void InitWriter(jsonWriter* w, const jsonAllocator* alloc = nullptr);
+void FreeWriter(jsonWriter* w);
+/* empties the buffer, releasing what it grew beyond the trim size */
+void ResetWriter(jsonWriter* w);
+void SetWriterTrimSize(jsonWriter* w, size_t bytes);
+void WriteRaw(jsonWriter* w, const char* s, size_t len);
+void WriteString(jsonWriter* w, const char* s, size_t len);
+void WriteNumber(jsonWriter* w, double n);
+void WriteValue(jsonWriter* w, const jsonValue* v);
+/* NUL-terminated, owned by the writer */
+const char* GetWriterOutput(jsonWriter* w, size_t* length);
+/* hands the buffer to the caller, who frees it like Stringify() output */
+char*       TakeWriterOutput(jsonWriter* w, size_t* length);
+/* Stringify() into the writer's buffer, valid until the next call on it */
+const char* StringifyWith(jsonWriter* w, const jsonValue* v, size_t* length, jsonStats* stats = nullptr);
+/*
+ * Stringify() as a gather list for writev() or sendmsg(), without copying
+ * long strings: runs of at least inPlace bytes that need no escaping are
+ * referenced where they are in v, and so is the output of a clean
+ * EnableStringifyCache() root. Punctuation, numbers, escapes and short
+ * strings go into the writer's buffer. The list belongs to the writer; it
+ * and the pieces stay valid until the next call on w or until v changes.
+ * writev() takes at most IOV_MAX pieces per call. length, if given, is the
+ * total size.
+ */
+const jsonIovec* StringifyIovec(jsonWriter* w, const jsonValue* v, size_t* count, size_t* length = nullptr,
+                                size_t inPlace = 256);
+
+/*
+ * MessagePack. Integral numbers up to 2^53 become the smallest integer type,
+ * everything else float64; raw numbers lose their text. Map keys must be
+ * strings, bin and ext types and non-finite floats are rejected with
+ * PARSE_ERR_INVALID_VALUE and truncated input fails with PARSE_ERR_EXPECT_VALUE. With used, decoding
+ * stops after one value and reports the bytes it took, for back-to-back
+ * messages; without it, trailing bytes are PARSE_ERR_ROOT_NOT_SINGULAR.
+ * *data is length bytes from alloc.
+ */
+int         EncodeMsgPack(const jsonValue* v, char** data, size_t* length, const jsonAllocator* alloc = nullptr);
+parseStatus DecodeMsgPack(jsonValue* v, const char* data, size_t length, size_t* used = nullptr, const jsonAllocator* alloc = nullptr);
+/*
+ * Streaming transcoders, no tree is built: the next value of r is appended
+ * to w as MessagePack, with every array and map written in its 32-bit form
+ * so counts can be filled in once it closes; or one MessagePack value is
+ * appended to w as JSON text. On error w holds a partial value.
+ */
+parseStatus TranscodeJsonToMsgPack(jsonReader* r, jsonWriter* w);
+parseStatus TranscodeMsgPackToJson(const char* data, size_t length, size_t* used, jsonWriter* w);
 
 #endif /* JSON_PARSER_H__ */
\ No newline at end of file
@@ -0,0 +1,451 @@
+#ifndef JSON_PARSER_HPP__
+#define JSON_PARSER_HPP__
+
+#include <assert.h>
+#include <string.h>
+#include <string_view>
+#include <utility>
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+#include <coroutine>
+#include <exception>
+#include <iterator>
+#define TINYJSON_COROUTINES
+#endif
+
+#include "tinyjson.h"
+
+namespace tinyjson {
+
+struct Member;
+
+/* non-owning handle to a node inside a Document, carries the Document's allocator for the setters */
+class Value {
+public:
+    Value() : v_(nullptr), alloc_(nullptr) {}
+    explicit Value(jsonValue* v, const jsonAllocator* alloc = nullptr) : v_(v), alloc_(alloc) {}
+
+    explicit operator bool() const { return v_ != nullptr; }
+    jsonValue* get() const { return v_; }
+
+    valueType type() const { assert(v_); return v_->type; }
+    bool isNull() const   { return type() == TYPE_NULL; }
+    bool isBool() const   { return type() == TYPE_TRUE || type() == TYPE_FALSE; }
+    bool isNumber() const { return type() == TYPE_NUMBER; }
+    bool isString() const { return type() == TYPE_STRING; }
+    bool isArray() const  { return type() == TYPE_ARRAY; }
+    bool isObject() const { return type() == TYPE_OBJECT; }
+
+    bool getBool() const { assert(isBool()); return v_->type == TYPE_TRUE; }
+    double getNumber() const { assert(isNumber()); return GetValueNumber(v_); }
+    std::string_view getString() const
+    {
+        assert(isString());
+        return std::string_view(GetValueString(v_), GetValueStringLength(v_));
+    }
+
+    size_t size() const
+    {
+        assert(isArray() || isObject());
+        return v_->type == TYPE_ARRAY ? v_->arr.size : v_->obj.size;
+    }
+
+    Value operator[](size_t index) const
+    {
+        assert(isArray() && index < v_->arr.size);
+        return Value(GetValueArrayElement(v_, index), alloc_);
+    }
+
+    /* the elements of a packed array, see PARSE_PACKED_NUMBERS; nullptr otherwise */
+    const double* numbers() const { assert(isArray()); return GetValueArrayNumbers(v_); }
+
+    /* linear lookup, returns an empty handle if the key is missing */
+    Value find(std::string_view key) const
+    {
+        assert(isObject());
+        for (size_t i = 0; i < v_->obj.size; i++) {
+            const jsonMap& m = v_->obj.maps[i];
+            if (m.keyLen == key.size() && memcmp(m.key, key.data(), key.size()) == 0)
+                return Value(&v_->obj.maps[i].value, alloc_);
+        }
+        return Value();
+    }
+
+    Value operator[](std::string_view key) const
+    {
+        Value ret = find(key);
+        assert(ret);
+        return ret;
+    }
+
+    size_t hash() const { return HashValue(v_); }
+    bool operator==(const Value& rhs) const { return EqualValue(v_, rhs.v_); }
+    bool operator!=(const Value& rhs) const { return !EqualValue(v_, rhs.v_); }
+
+    void setNull() const { FreeValue(v_, alloc_); }
+    void setBool(bool b) const { SetValueBoolean(v_, b, alloc_); }
+    void setNumber(double n) const { SetValueNumber(v_, n, alloc_); }
+    void setString(std::string_view s) const { SetValueString(v_, s.data(), s.size(), alloc_); }
+
+    class ArrayIterator {
+    public:
+        ArrayIterator(jsonValue* p, const jsonAllocator* alloc) : p_(p), alloc_(alloc) {}
+        Value operator*() const { return Value(p_, alloc_); }
+        ArrayIterator& operator++() { ++p_; return *this; }
+        bool operator!=(const ArrayIterator& rhs) const { return p_ != rhs.p_; }
+        bool operator==(const ArrayIterator& rhs) const { return p_ == rhs.p_; }
+    private:
+        jsonValue* p_;
+        const jsonAllocator* alloc_;
+    };
+
+    class ObjectIterator {
+    public:
+        ObjectIterator(jsonMap* p, const jsonAllocator* alloc) : p_(p), alloc_(alloc) {}
+        Member operator*() const;
+        ObjectIterator& operator++() { ++p_; return *this; }
+        bool operator!=(const ObjectIterator& rhs) const { return p_ != rhs.p_; }
+        bool operator==(const ObjectIterator& rhs) const { return p_ == rhs.p_; }
+    private:
+        jsonMap* p_;
+        const jsonAllocator* alloc_;
+    };
+
+    template <class It>
+    struct Range {
+        It first, last;
+        It begin() const { return first; }
+        It end() const { return last; }
+    };
+
+    /* for (Value e : v.elements()) */
+    Range<ArrayIterator> elements() const
+    {
+        assert(isArray());
+        jsonValue* first = v_->arr.size ? GetValueArrayElement(v_, 0) : nullptr; // unpacks a packed array
+        return { ArrayIterator(first, alloc_), ArrayIterator(first + v_->arr.size, alloc_) };
+    }
+
+    /* for (Member m : v.members()) */
+    Range<ObjectIterator> members() const
+    {
+        assert(isObject());
+        return { ObjectIterator(v_->obj.maps, alloc_), ObjectIterator(v_->obj.maps + v_->obj.size, alloc_) };
+    }
+
+private:
+    jsonValue* v_;
+    const jsonAllocator* alloc_;
+};
+
+struct Member {
+    std::string_view key;
+    Value value;
+};
+
+inline Member Value::ObjectIterator::operator*() const
+{
+    return Member{ std::string_view(p_->key, p_->keyLen), Value(&p_->value, alloc_) };
+}
+
+/* owns a tree built with one allocator; move-only, deep copies only through clone(), which references what share() froze */
+class Document {
+public:
+    explicit Document(const jsonAllocator* alloc = nullptr) : alloc_(alloc) { InitValue(&root_); }
+    ~Document() { FreeValue(&root_, alloc_); }
+
+    Document(const Document&) = delete;
+    Document& operator=(const Document&) = delete;
+
+    Document(Document&& rhs) noexcept : alloc_(rhs.alloc_)
+    {
+        memcpy(&root_, &rhs.root_, sizeof(jsonValue));
+        InitValue(&rhs.root_);
+    }
+
+    Document& operator=(Document&& rhs) noexcept
+    {
+        if (this != &rhs) {
+            FreeValue(&root_, alloc_);
+            alloc_ = rhs.alloc_;
+            MoveValue(&root_, &rhs.root_, alloc_);
+        }
+        return *this;
+    }
+
+    parseStatus parse(const char* json)
+    {
+        FreeValue(&root_, alloc_);
+        return ParseJsonString(&root_, json, nullptr, alloc_);
+    }
+
+    Document clone() const
+    {
+        Document ret(alloc_);
+        CopyValue(&ret.root_, &root_, alloc_);
+        return ret;
+    }
+
+    void swap(Document& rhs)
+    {
+        SwapValue(&root_, &rhs.root_);
+        std::swap(alloc_, rhs.alloc_);
+    }
+
+    void enableStringifyCache() { EnableStringifyCache(&root_, alloc_); }
+    void compact() { CompactValue(&root_, alloc_); }
+    void share() { ShareValue(&root_, alloc_); }
+    /* copies the path to what the pointer names, an empty handle if it names nothing */
+    Value edit(const char* pointer) { return Value(EditValue(&root_, pointer, alloc_), alloc_); }
+
+    jsonFootprint footprint() const
+    {
+        jsonFootprint f;
+        MeasureValue(&root_, &f);
+        return f;
+    }
+
+    const jsonAllocator* allocator() const { return alloc_; }
+    Value root() { return Value(&root_, alloc_); }
+    jsonValue* get() { return &root_; }
+    const jsonValue* get() const { return &root_; }
+
+    Value operator[](size_t index) { return root()[index]; }
+    Value operator[](std::string_view key) { return root()[key]; }
+
+private:
+    jsonValue root_;
+    const jsonAllocator* alloc_;
+};
+
+#ifdef TINYJSON_COROUTINES
+/* minimal lazy generator, the body runs up to its next co_yield as the loop steps */
+template <class T>
+class Generator {
+public:
+    struct promise_type {
+        T current;
+
+        Generator get_return_object() { return Generator(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        std::suspend_always yield_value(T value) noexcept
+        {
+            current = value;
+            return {};
+        }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+
+    class iterator {
+    public:
+        explicit iterator(std::coroutine_handle<promise_type> h) : h_(h) {}
+        iterator& operator++()
+        {
+            h_.resume();
+            return *this;
+        }
+        T operator*() const { return h_.promise().current; }
+        bool operator!=(std::default_sentinel_t) const { return !h_.done(); }
+
+    private:
+        std::coroutine_handle<promise_type> h_;
+    };
+
+    explicit Generator(std::coroutine_handle<promise_type> h) : h_(h) {}
+    Generator(Generator&& rhs) noexcept : h_(std::exchange(rhs.h_, {})) {}
+    ~Generator()
+    {
+        if (h_)
+            h_.destroy();
+    }
+
+    Generator(const Generator&) = delete;
+    Generator& operator=(const Generator&) = delete;
+
+    iterator begin()
+    {
+        h_.resume();
+        return iterator(h_);
+    }
+    std::default_sentinel_t end() const { return {}; }
+
+private:
+    std::coroutine_handle<promise_type> h_;
+};
+#endif
+
+/*
+ * Owns a jsonElements stream and the element it parsed last:
+ *
+ *     tinyjson::ElementStream s;
+ *     if (s.openFile("export.json", "/records") == PARSE_OK)
+ *         for (tinyjson::Value v : s.elements())
+ *             ...
+ *
+ * A Value is valid until the next one is produced; status() tells an error
+ * from the end of the array once the loop is over.
+ */
+class ElementStream {
+public:
+    explicit ElementStream(const jsonAllocator* alloc = nullptr) : alloc_(alloc), status_(PARSE_OK)
+    {
+        e_.state = nullptr;
+        InitValue(&v_);
+    }
+    ~ElementStream() { close(); }
+
+    ElementStream(const ElementStream&) = delete;
+    ElementStream& operator=(const ElementStream&) = delete;
+
+    parseStatus open(const char* json, size_t length, const char* pointer = nullptr)
+    {
+        close();
+        return status_ = OpenElements(&e_, json, length, pointer, alloc_);
+    }
+
+    parseStatus openFd(int fd, const char* pointer = nullptr)
+    {
+        close();
+        return status_ = OpenElementsFd(&e_, fd, pointer, alloc_);
+    }
+
+    parseStatus openFile(const char* path, const char* pointer = nullptr)
+    {
+        close();
+        return status_ = OpenElementsFile(&e_, path, pointer, alloc_);
+    }
+
+    /* false at the end of the array, or on an error */
+    bool next()
+    {
+        bool end = true;
+        if (!e_.state)
+            return false;
+        status_ = NextElement(&e_, &v_, &end);
+        return status_ == PARSE_OK && !end;
+    }
+
+    Value value() { return Value(&v_, alloc_); }
+    parseStatus status() const { return status_; }
+
+#ifdef TINYJSON_COROUTINES
+    Generator<Value> elements()
+    {
+        while (next())
+            co_yield value();
+    }
+#endif
+
+private:
+    void close()
+    {
+        FreeValue(&v_, alloc_);
+        CloseElements(&e_);
+    }
+
+    jsonElements e_;
+    jsonValue v_;
+    const jsonAllocator* alloc_;
+    parseStatus status_;
+};
+
+/* read-only handle into a BoxedDocument, with the read half of Value's interface */
+class BoxedValue {
+public:
+    BoxedValue() : d_(nullptr), b_(0) {}
+    BoxedValue(const jsonBoxedDoc* d, jsonBox b) : d_(d), b_(b) {}
+
+    explicit operator bool() const { return d_ != nullptr; }
+    jsonBox get() const { return b_; }
+
+    valueType type() const { assert(d_); return GetBoxType(b_); }
+    bool isNull() const   { return type() == TYPE_NULL; }
+    bool isBool() const   { return type() == TYPE_TRUE || type() == TYPE_FALSE; }
+    bool isNumber() const { return type() == TYPE_NUMBER; }
+    bool isString() const { return type() == TYPE_STRING; }
+    bool isArray() const  { return type() == TYPE_ARRAY; }
+    bool isObject() const { return type() == TYPE_OBJECT; }
+
+    bool getBool() const { assert(isBool()); return type() == TYPE_TRUE; }
+    double getNumber() const { return GetBoxNumber(b_); }
+    std::string_view getString() const
+    {
+        size_t len;
+        const char* s = GetBoxString(d_, b_, &len);
+        return std::string_view(s, len);
+    }
+
+    size_t size() const { return GetBoxSize(d_, b_); }
+    BoxedValue operator[](size_t index) const { return BoxedValue(d_, GetBoxElement(d_, b_, index)); }
+
+    std::string_view key(size_t index) const
+    {
+        size_t len;
+        const char* s = GetBoxKey(d_, b_, index, &len);
+        return std::string_view(s, len);
+    }
+    BoxedValue value(size_t index) const { return BoxedValue(d_, GetBoxMember(d_, b_, index)); }
+
+    /* linear lookup, returns an empty handle if the key is missing */
+    BoxedValue find(std::string_view k) const
+    {
+        assert(isObject());
+        for (size_t i = 0, n = size(); i < n; i++)
+            if (key(i) == k)
+                return value(i);
+        return BoxedValue();
+    }
+
+    BoxedValue operator[](std::string_view k) const
+    {
+        BoxedValue ret = find(k);
+        assert(ret);
+        return ret;
+    }
+
+private:
+    const jsonBoxedDoc* d_;
+    jsonBox b_;
+};
+
+/* owns the boxed copy of a tree; move-only */
+class BoxedDocument {
+public:
+    explicit BoxedDocument(const jsonValue* v, const jsonAllocator* alloc = nullptr) { BoxValue(&d_, v, alloc); }
+    explicit BoxedDocument(const Document& doc) { BoxValue(&d_, doc.get(), doc.allocator()); }
+    ~BoxedDocument() { FreeBoxedDoc(&d_); }
+
+    BoxedDocument(const BoxedDocument&) = delete;
+    BoxedDocument& operator=(const BoxedDocument&) = delete;
+
+    BoxedDocument(BoxedDocument&& rhs) noexcept : d_(rhs.d_) { rhs.d_.arena = nullptr; rhs.d_.size = 0; }
+
+    BoxedDocument& operator=(BoxedDocument&& rhs) noexcept
+    {
+        std::swap(d_, rhs.d_);
+        return *this;
+    }
+
+    /* a mutable tree again, built with the allocator the copy was made with */
+    Document unbox() const
+    {
+        Document ret(d_.alloc);
+        UnboxValue(ret.get(), &d_, d_.root, d_.alloc);
+        return ret;
+    }
+
+    BoxedValue root() const { return BoxedValue(&d_, d_.root); }
+    const jsonBoxedDoc* get() const { return &d_; }
+    size_t bytes() const { return d_.size; }
+
+    BoxedValue operator[](size_t index) const { return root()[index]; }
+    BoxedValue operator[](std::string_view key) const { return root()[key]; }
+
+private:
+    jsonBoxedDoc d_;
+};
+
+} // namespace tinyjson
+
+#endif /* JSON_PARSER_HPP__ */
@@ -0,0 +1,291 @@
+#ifndef JSON_BIND_HPP__
+#define JSON_BIND_HPP__
+
+#include <stdlib.h>
+#include <string.h>
+#include <cmath>
+#include <limits>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "tinyjson.h"
+
+/*
+ * Typed binding: reads JSON straight into C++ structs through jsonReader and
+ * writes them back through jsonWriter, without building a jsonValue tree.
+ *
+ *     struct Point { double x, y; };
+ *     template <> struct tinyjson::Binding<Point> {
+ *         static constexpr auto fields = std::make_tuple(JSON_FIELD(Point, x), JSON_FIELD(Point, y));
+ *     };
+ *
+ *     Point p;
+ *     tinyjson::ParseInto(p, "{\"x\":1,\"y\":2}");
+ *
+ * Unknown keys are skipped, missing keys leave the member untouched. Numbers
+ * out of the member's range, or with a fraction for an integer member, are
+ * PARSE_ERR_TYPE_MISMATCH.
+ */
+
+namespace tinyjson {
+
+template <class T, class M>
+struct Field {
+    const char* name;
+    size_t len;
+    M T::* member;
+};
+
+template <class T, class M, size_t N>
+constexpr Field<T, M> MakeField(const char (&name)[N], M T::* member)
+{
+    return Field<T, M>{ name, N - 1, member };
+}
+
+#define JSON_FIELD(Type, member) ::tinyjson::MakeField(#member, &Type::member)
+
+template <class T>
+struct Binding;
+
+template <class T, class = void>
+struct IsBound : std::false_type {};
+
+template <class T>
+struct IsBound<T, std::void_t<decltype(Binding<T>::fields)>> : std::true_type {};
+
+template <class T, class = void>
+struct Codec {
+    static_assert(IsBound<T>::value, "no tinyjson::Binding or Codec for this type");
+};
+
+namespace detail {
+
+constexpr bool SameName(const char* a, size_t alen, const char* b, size_t blen)
+{
+    if (alen != blen)
+        return false;
+    for (size_t i = 0; i < alen; i++)
+        if (a[i] != b[i])
+            return false;
+    return true;
+}
+
+template <class... F>
+constexpr bool UniqueNames(const F&... f)
+{
+    const char* names[] = { f.name..., nullptr };
+    size_t lens[] = { f.len..., 0 };
+    for (size_t i = 0; i < sizeof...(F); i++)
+        for (size_t j = i + 1; j < sizeof...(F); j++)
+            if (SameName(names[i], lens[i], names[j], lens[j]))
+                return false;
+    return true;
+}
+
+inline parseStatus Expect(jsonReader* r, jsonToken* t, tokenType type)
+{
+    parseStatus ret = ReadToken(r, t);
+    if (ret == PARSE_OK && t->type != type)
+        ret = PARSE_ERR_TYPE_MISMATCH;
+    return ret;
+}
+
+template <class T, class M>
+bool ReadMember(jsonReader* r, T& out, const Field<T, M>& f, const jsonToken& key, parseStatus* ret)
+{
+    if (f.len != key.str.len || memcmp(f.name, key.str.s, f.len) != 0)
+        return false;
+    *ret = Codec<M>::Read(r, out.*f.member);
+    return true;
+}
+
+template <class T, class M>
+void WriteMember(jsonWriter* w, const T& in, const Field<T, M>& f, bool* first)
+{
+    if (!*first)
+        WriteRaw(w, ",", 1);
+    *first = false;
+    WriteString(w, f.name, f.len);
+    WriteRaw(w, ":", 1);
+    Codec<M>::Write(w, in.*f.member);
+}
+
+} // namespace detail
+
+template <class T>
+struct Codec<T, std::enable_if_t<std::is_arithmetic<T>::value && !std::is_same<T, bool>::value>> {
+    static parseStatus Read(jsonReader* r, T& out)
+    {
+        jsonToken t;
+        parseStatus ret = detail::Expect(r, &t, TOKEN_NUMBER);
+        if (ret != PARSE_OK)
+            return ret;
+        if (!Fits(t.num))
+            return PARSE_ERR_TYPE_MISMATCH;
+        out = static_cast<T>(t.num);
+        return PARSE_OK;
+    }
+
+    /* the conversion is undefined outside T's range, integers also take only whole numbers */
+    static bool Fits(double n)
+    {
+        using limits = std::numeric_limits<T>;
+        if constexpr (std::is_integral<T>::value) {
+            double end = std::ldexp(1.0, limits::digits); // one past the largest, exact unlike max()
+            return n >= (limits::is_signed ? -end : 0.0) && n < end && std::trunc(n) == n;
+        }
+        else {
+            return n >= -static_cast<double>(limits::max()) && n <= static_cast<double>(limits::max());
+        }
+    }
+
+    static void Write(jsonWriter* w, T in) { WriteNumber(w, static_cast<double>(in)); }
+};
+
+template <>
+struct Codec<bool> {
+    static parseStatus Read(jsonReader* r, bool& out)
+    {
+        jsonToken t;
+        parseStatus ret = ReadToken(r, &t);
+        if (ret != PARSE_OK)
+            return ret;
+        if (t.type != TOKEN_TRUE && t.type != TOKEN_FALSE)
+            return PARSE_ERR_TYPE_MISMATCH;
+        out = t.type == TOKEN_TRUE;
+        return PARSE_OK;
+    }
+
+    static void Write(jsonWriter* w, bool in) { in ? WriteRaw(w, "true", 4) : WriteRaw(w, "false", 5); }
+};
+
+template <>
+struct Codec<std::string> {
+    static parseStatus Read(jsonReader* r, std::string& out)
+    {
+        jsonToken t;
+        parseStatus ret = detail::Expect(r, &t, TOKEN_STRING);
+        if (ret == PARSE_OK)
+            out.assign(t.str.s, t.str.len);
+        return ret;
+    }
+
+    static void Write(jsonWriter* w, const std::string& in) { WriteString(w, in.data(), in.size()); }
+};
+
+template <class E>
+struct Codec<std::vector<E>> {
+    static parseStatus Read(jsonReader* r, std::vector<E>& out)
+    {
+        jsonToken t;
+        tokenType next;
+        parseStatus ret = detail::Expect(r, &t, TOKEN_ARRAY_BEGIN);
+        out.clear();
+        while (ret == PARSE_OK && (ret = PeekToken(r, &next)) == PARSE_OK) {
+            if (next == TOKEN_ARRAY_END)
+                return ReadToken(r, &t);
+            out.emplace_back();
+            ret = Codec<E>::Read(r, out.back());
+        }
+        return ret;
+    }
+
+    static void Write(jsonWriter* w, const std::vector<E>& in)
+    {
+        WriteRaw(w, "[", 1);
+        for (size_t i = 0; i < in.size(); i++) {
+            if (i)
+                WriteRaw(w, ",", 1);
+            Codec<E>::Write(w, in[i]);
+        }
+        WriteRaw(w, "]", 1);
+    }
+};
+
+/* null <-> std::nullopt */
+template <class E>
+struct Codec<std::optional<E>> {
+    static parseStatus Read(jsonReader* r, std::optional<E>& out)
+    {
+        jsonToken t;
+        tokenType next;
+        parseStatus ret = PeekToken(r, &next);
+        if (ret != PARSE_OK)
+            return ret;
+        if (next == TOKEN_NULL) {
+            out.reset();
+            return ReadToken(r, &t);
+        }
+        return Codec<E>::Read(r, out.emplace());
+    }
+
+    static void Write(jsonWriter* w, const std::optional<E>& in)
+    {
+        if (in)
+            Codec<E>::Write(w, *in);
+        else
+            WriteRaw(w, "null", 4);
+    }
+};
+
+template <class T>
+struct Codec<T, std::enable_if_t<IsBound<T>::value>> {
+    static_assert(std::apply([](const auto&... f) { return detail::UniqueNames(f...); }, Binding<T>::fields),
+                  "duplicate JSON field name");
+
+    static parseStatus Read(jsonReader* r, T& out)
+    {
+        jsonToken t;
+        parseStatus ret = detail::Expect(r, &t, TOKEN_OBJECT_BEGIN);
+        while (ret == PARSE_OK && (ret = ReadToken(r, &t)) == PARSE_OK && t.type == TOKEN_KEY) {
+            /* length + memcmp chain, unrolled over the declared fields */
+            bool matched = std::apply([&](const auto&... f) {
+                return (detail::ReadMember(r, out, f, t, &ret) || ...);
+            }, Binding<T>::fields);
+            if (!matched)
+                ret = SkipValue(r);
+        }
+        return ret;
+    }
+
+    static void Write(jsonWriter* w, const T& in)
+    {
+        bool first = true;
+        WriteRaw(w, "{", 1);
+        std::apply([&](const auto&... f) { (detail::WriteMember(w, in, f, &first), ...); }, Binding<T>::fields);
+        WriteRaw(w, "}", 1);
+    }
+};
+
+template <class T>
+parseStatus ParseInto(T& out, const char* json)
+{
+    jsonReader r;
+    jsonToken t;
+    InitReader(&r, json);
+    parseStatus ret = Codec<T>::Read(&r, out);
+    if (ret == PARSE_OK)
+        ret = ReadToken(&r, &t);
+    FreeReader(&r);
+    return ret;
+}
+
+/* same contract as Stringify(): *json is NUL-terminated and allocated by the default allocator; free it like Stringify() output */
+template <class T>
+int StringifyFrom(const T& in, char** json, size_t* length)
+{
+    jsonWriter w;
+    InitWriter(&w);
+    Codec<T>::Write(&w, in);
+    *json = TakeWriterOutput(&w, length);
+    FreeWriter(&w);
+    return STRINGIFY_OK;
+}
+
+} // namespace tinyjson
+
+#endif /* JSON_BIND_HPP__ */
@@ -0,0 +1,486 @@
+#ifndef JSON_LITERAL_HPP__
+#define JSON_LITERAL_HPP__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "tinyjson.h"
+
+/*
+ * JSON documents parsed at compile time into static, read-only jsonValue
+ * graphs, for embedded defaults and templates:
+ *
+ *     using namespace tinyjson::literals;
+ *     const jsonValue* defaults = R"({"retries":3,"hosts":["a","b"]})"_json;
+ *     double retries = GetValueNumber(GetValueObjectValue(defaults, 0));
+ *
+ * Nothing is parsed or allocated at run time, and each distinct literal
+ * exists once in the program however often it is used. The graph is
+ * constant: never free or change it, CopyValue() it for a tree of your own.
+ * Malformed JSON fails to compile. Numbers that cannot be converted exactly
+ * at compile time keep their text, as under PARSE_RAW_NUMBERS.
+ *
+ * Needs C++20 (class-type template parameters, constexpr unions), defines
+ * TINYJSON_LITERALS where it is available.
+ */
+
+#if defined(__cpp_nontype_template_args) && __cpp_nontype_template_args >= 201911L && \
+    defined(__cpp_constexpr) && __cpp_constexpr >= 202002L
+#define TINYJSON_LITERALS
+
+namespace tinyjson {
+
+template <size_t N>
+struct LiteralText {
+    char text[N];
+
+    constexpr LiteralText(const char (&s)[N])
+    {
+        for (size_t i = 0; i < N; i++)
+            text[i] = s[i];
+    }
+};
+
+namespace detail {
+
+/* DBL_MAX and half an ulp, 2^1024 - 2^970: strtod() overflows from here on, the tie rounding up */
+inline constexpr char literalOverflow[] =
+    "179769313486231580793728971405303415079934132710037826936173778980444968"
+    "292764750946649017977587207096330286416692887910946555547851940402630657"
+    "488671505820681908902000708383676273854845817711531764475730270069855571"
+    "366959622842914819860834936475292719074168444365510704342711559699508093"
+    "042880177904174497792";
+
+/* jsonValues (the root and all array elements), members, and decoded text with its NULs */
+struct literalSizes {
+    size_t values, maps, chars;
+    parseStatus status;
+};
+
+template <size_t V, size_t M, size_t C>
+struct literalStorage {
+    jsonValue values[V];
+    jsonMap maps[M ? M : 1];
+    char chars[C ? C : 1];
+};
+
+/*
+ * Serves both passes: without out it validates and counts, with out it
+ * fills *out with pointers into *self, the static object *out becomes.
+ * Error codes are those ParseJsonString() would return.
+ */
+template <class Storage>
+struct literalParser {
+    const char* json;
+    size_t pos;
+    Storage* out;
+    const Storage* self;
+    literalSizes sizes;
+
+    constexpr void Whitespace()
+    {
+        while (json[pos] == ' ' || json[pos] == '\t' || json[pos] == '\n' || json[pos] == '\r')
+            pos++;
+    }
+
+    constexpr void Put(char ch)
+    {
+        if (out)
+            out->chars[sizes.chars] = ch;
+        sizes.chars++;
+    }
+
+    constexpr void PutUtf8(unsigned u)
+    {
+        if (u <= 0x7F) {
+            Put(static_cast<char>(u));
+        }
+        else if (u <= 0x7FF) {
+            Put(static_cast<char>(0xC0 | (u >> 6)));
+            Put(static_cast<char>(0x80 | (u & 0x3F)));
+        }
+        else if (u <= 0xFFFF) {
+            Put(static_cast<char>(0xE0 | (u >> 12)));
+            Put(static_cast<char>(0x80 | ((u >> 6) & 0x3F)));
+            Put(static_cast<char>(0x80 | (u & 0x3F)));
+        }
+        else {
+            Put(static_cast<char>(0xF0 | (u >> 18)));
+            Put(static_cast<char>(0x80 | ((u >> 12) & 0x3F)));
+            Put(static_cast<char>(0x80 | ((u >> 6) & 0x3F)));
+            Put(static_cast<char>(0x80 | (u & 0x3F)));
+        }
+    }
+
+    constexpr char* Text(size_t at) const { return out ? const_cast<char*>(&self->chars[at]) : nullptr; }
+
+    constexpr bool Hex4(unsigned* u)
+    {
+        *u = 0;
+        for (int i = 0; i < 4; i++) {
+            char c = json[pos++];
+            *u <<= 4;
+            if (c >= '0' && c <= '9')
+                *u |= c - '0';
+            else if (c >= 'A' && c <= 'F')
+                *u |= c - ('A' - 10);
+            else if (c >= 'a' && c <= 'f')
+                *u |= c - ('a' - 10);
+            else
+                return false;
+        }
+        return true;
+    }
+
+    /* decodes the string at pos into the text, NUL-terminated */
+    constexpr parseStatus String(char** s, size_t* len)
+    {
+        size_t start = sizes.chars;
+        pos++;
+        for (;;) {
+            char ch = json[pos++];
+            if (ch == '\"')
+                break;
+            if (ch == '\0')
+                return PARSE_ERR_MISS_QUOTATION_MARK;
+            if (static_cast<unsigned char>(ch) < 0x20)
+                return PARSE_ERR_CONTROL_CHAR;
+            if (ch != '\\') {
+                Put(ch);
+                continue;
+            }
+            switch (json[pos++]) {
+            case '\"': Put('\"'); break;
+            case '\\': Put('\\'); break;
+            case '/':  Put('/');  break;
+            case 'b':  Put('\b'); break;
+            case 'f':  Put('\f'); break;
+            case 'n':  Put('\n'); break;
+            case 'r':  Put('\r'); break;
+            case 't':  Put('\t'); break;
+            case 'u': {
+                unsigned H = 0, L = 0;
+                if (!Hex4(&H))
+                    return PARSE_ERR_INVALID_UNICODE_HEX;
+                if (H >= 0xD800 && H <= 0xDBFF) {
+                    if (json[pos] != '\\' || json[pos + 1] != 'u')
+                        return PARSE_ERR_INVALID_UNICODE_SURROGATE;
+                    pos += 2;
+                    if (!Hex4(&L))
+                        return PARSE_ERR_INVALID_UNICODE_HEX;
+                    if (L < 0xDC00 || L > 0xDFFF)
+                        return PARSE_ERR_INVALID_UNICODE_SURROGATE;
+                    H = 0x10000 + ((H - 0xD800) << 10) + (L - 0xDC00);
+                }
+                PutUtf8(H);
+                break;
+            }
+            default:
+                return PARSE_ERR_INVALID_ESCAPE_CHAR;
+            }
+        }
+        *len = sizes.chars - start;
+        *s = Text(start);
+        Put('\0');
+        return PARSE_OK;
+    }
+
+    constexpr parseStatus Word(jsonValue* v, const char* word, valueType type)
+    {
+        size_t i = 0;
+        for (; word[i]; i++)
+            if (json[pos + i] != word[i])
+                return PARSE_ERR_INVALID_VALUE;
+        pos += i;
+        if (v)
+            v->type = type;
+        return PARSE_OK;
+    }
+
+    static constexpr bool Digit(char c) { return c >= '0' && c <= '9'; }
+
+    /* a number below 1e309 with its first significant digit at 1e308, digit by digit against the bound */
+    constexpr bool Overflows(size_t i) const
+    {
+        size_t k = 0;
+        for (; Digit(json[i]) || json[i] == '-' || json[i] == '.'; i++) {
+            if (!Digit(json[i]) || (k == 0 && json[i] == '0'))
+                continue;
+            if (json[i] != literalOverflow[k])
+                return json[i] > literalOverflow[k];
+            if (!literalOverflow[++k])
+                return true; // every digit after this one only adds
+        }
+        return false; // the bound has no trailing zeros, a prefix of it is below
+    }
+
+    /*
+     * Up to 2^53 with a power of ten no larger than 1e22, both exact as
+     * doubles, a single multiplication or division rounds the way strtod()
+     * does. Everything else keeps its text and is converted when read.
+     */
+    constexpr parseStatus Number(jsonValue* v)
+    {
+        size_t start = pos;
+        uint64_t mantissa = 0;
+        bool fits = true;
+        long exponent = 0, magnitude = 0; // value = mantissa * 10^exponent, below 10^magnitude
+        long e = 0;
+        bool negative = json[pos] == '-';
+        if (negative)
+            pos++;
+        if (json[pos] == '0') {
+            pos++;
+        }
+        else if (json[pos] >= '1' && json[pos] <= '9') {
+            for (; Digit(json[pos]); pos++, magnitude++) {
+                if (mantissa < 100000000000000000ULL)
+                    mantissa = mantissa * 10 + (json[pos] - '0');
+                else
+                    fits = false;
+            }
+        }
+        else {
+            return PARSE_ERR_INVALID_VALUE;
+        }
+        if (json[pos] == '.') {
+            if (!Digit(json[++pos]))
+                return PARSE_ERR_INVALID_VALUE;
+            for (; Digit(json[pos]); pos++) {
+                if (mantissa == 0 && json[pos] == '0')
+                    magnitude--;
+                if (mantissa < 100000000000000000ULL)
+                    mantissa = mantissa * 10 + (json[pos] - '0'), exponent--;
+                else
+                    fits = false;
+            }
+        }
+        if (json[pos] == 'e' || json[pos] == 'E') {
+            bool minus = json[++pos] == '-';
+            if (json[pos] == '+' || json[pos] == '-')
+                pos++;
+            if (!Digit(json[pos]))
+                return PARSE_ERR_INVALID_VALUE;
+            for (; Digit(json[pos]); pos++)
+                if (e < 100000)
+                    e = e * 10 + (json[pos] - '0');
+            exponent += minus ? -e : e;
+            magnitude += minus ? -e : e;
+        }
+        if (mantissa && (magnitude > 309 || (magnitude == 309 && Overflows(start))))
+            return PARSE_ERR_NUMBER_OVERFLOW;
+
+        if (v) {
+            v->type = TYPE_NUMBER;
+            if (fits && mantissa <= (1ULL << 53) && exponent >= -22 && exponent <= 22) {
+                double scale = 1.0;
+                for (long i = 0; i < (exponent < 0 ? -exponent : exponent); i++)
+                    scale *= 10.0;
+                double n = exponent < 0 ? static_cast<double>(mantissa) / scale : static_cast<double>(mantissa) * scale;
+                v->num = negative ? -n : n;
+                return PARSE_OK;
+            }
+            v->flags |= VALUE_RAW;
+            v->str.s = Text(sizes.chars);
+            v->str.len = pos - start;
+        }
+        for (size_t i = start; i < pos; i++)
+            Put(json[i]);
+        Put('\0');
+        return PARSE_OK;
+    }
+
+    /* the elements of the array or members of the object at pos, which is not empty */
+    constexpr size_t Count() const
+    {
+        size_t count = 1, depth = 0;
+        for (size_t i = pos;; i++) {
+            char ch = json[i];
+            if (ch == '\"') {
+                for (i++; json[i] != '\"'; i++)
+                    if (json[i] == '\\')
+                        i++;
+            }
+            else if (ch == '[' || ch == '{') {
+                depth++;
+            }
+            else if (ch == ']' || ch == '}') {
+                if (depth-- == 0)
+                    return count;
+            }
+            else if (ch == ',' && depth == 0) {
+                count++;
+            }
+        }
+    }
+
+    constexpr parseStatus Array(jsonValue* v)
+    {
+        size_t block = sizes.values, size = 0;
+        pos++;
+        Whitespace();
+        if (json[pos] != ']') {
+            if (out)
+                sizes.values += Count();
+            for (;;) {
+                if (!out)
+                    sizes.values++;
+                parseStatus ret = Value(out ? &out->values[block + size] : nullptr);
+                if (ret != PARSE_OK)
+                    return ret;
+                size++;
+                Whitespace();
+                if (json[pos] == ']')
+                    break;
+                if (json[pos] != ',')
+                    return PARSE_ERR_MISS_COMMA_OR_SQUARE_BRACKET;
+                pos++;
+                Whitespace();
+            }
+        }
+        pos++;
+        if (v) {
+            v->type = TYPE_ARRAY;
+            v->arr.values = size ? const_cast<jsonValue*>(&self->values[block]) : nullptr;
+            v->arr.size = size;
+        }
+        return PARSE_OK;
+    }
+
+    constexpr parseStatus Object(jsonValue* v)
+    {
+        size_t block = sizes.maps, size = 0;
+        pos++;
+        Whitespace();
+        if (json[pos] != '}') {
+            if (out)
+                sizes.maps += Count();
+            for (;;) {
+                jsonMap* m = out ? &out->maps[block + size] : nullptr;
+                char* key = nullptr;
+                size_t keyLen = 0;
+                if (!out)
+                    sizes.maps++;
+                if (json[pos] != '\"')
+                    return PARSE_ERR_MISS_KEY;
+                parseStatus ret = String(&key, &keyLen);
+                if (ret != PARSE_OK)
+                    return ret;
+                Whitespace();
+                if (json[pos++] != ':')
+                    return PARSE_ERR_MISS_COLON;
+                Whitespace();
+                if (m) {
+                    m->key = key;
+                    m->keyLen = keyLen;
+                }
+                ret = Value(m ? &m->value : nullptr);
+                if (ret != PARSE_OK)
+                    return ret;
+                size++;
+                Whitespace();
+                if (json[pos] == '}')
+                    break;
+                if (json[pos] != ',')
+                    return PARSE_ERR_MISS_COMMA_OR_CURLY_BRACKET;
+                pos++;
+                Whitespace();
+            }
+        }
+        pos++;
+        if (v) {
+            v->type = TYPE_OBJECT;
+            v->obj.maps = size ? const_cast<jsonMap*>(&self->maps[block]) : nullptr;
+            v->obj.size = size;
+        }
+        return PARSE_OK;
+    }
+
+    constexpr parseStatus Value(jsonValue* v)
+    {
+        if (v)
+            v->flags = VALUE_FIXED;
+        switch (json[pos]) {
+        case 'n':  return Word(v, "null", TYPE_NULL);
+        case 't':  return Word(v, "true", TYPE_TRUE);
+        case 'f':  return Word(v, "false", TYPE_FALSE);
+        case '[':  return Array(v);
+        case '{':  return Object(v);
+        case '\0': return PARSE_ERR_EXPECT_VALUE;
+        case '\"': {
+            char* s = nullptr;
+            size_t len = 0;
+            parseStatus ret = String(&s, &len);
+            if (ret == PARSE_OK && v) {
+                v->type = TYPE_STRING;
+                v->str.s = s;
+                v->str.len = len;
+            }
+            return ret;
+        }
+        default:   return Number(v);
+        }
+    }
+};
+
+template <class Storage>
+constexpr literalSizes RunLiteral(const char* json, size_t length, Storage* out, const Storage* self)
+{
+    literalParser<Storage> p{ json, 0, out, self, { 1, 0, 0, PARSE_OK } };
+    p.Whitespace();
+    p.sizes.status = p.Value(out ? &out->values[0] : nullptr);
+    if (p.sizes.status == PARSE_OK) {
+        p.Whitespace();
+        if (p.pos != length)
+            p.sizes.status = PARSE_ERR_ROOT_NOT_SINGULAR;
+    }
+    return p.sizes;
+}
+
+template <size_t N>
+constexpr literalSizes MeasureLiteral(const LiteralText<N>& text)
+{
+    return RunLiteral<literalStorage<1, 1, 1>>(text.text, N - 1, nullptr, nullptr);
+}
+
+template <class Storage, size_t N>
+constexpr Storage BuildLiteral(const LiteralText<N>& text, const Storage* self)
+{
+    Storage s{};
+    RunLiteral(text.text, N - 1, &s, self);
+    return s;
+}
+
+} // namespace detail
+
+template <LiteralText Text>
+struct JsonLiteral {
+    static constexpr detail::literalSizes sizes = detail::MeasureLiteral(Text);
+    static_assert(sizes.status == PARSE_OK, "malformed JSON literal");
+
+    using storage = detail::literalStorage<sizes.values, sizes.maps, sizes.chars>;
+    static const storage data;
+    static constexpr const jsonValue* value = &data.values[0];
+};
+
+/* refers to itself: the graph points into the very object it is built for */
+template <LiteralText Text>
+constexpr typename JsonLiteral<Text>::storage JsonLiteral<Text>::data =
+    JsonLiteral<Text>::sizes.status == PARSE_OK ? detail::BuildLiteral(Text, &JsonLiteral<Text>::data)
+                                                : typename JsonLiteral<Text>::storage{};
+
+namespace literals {
+
+template <LiteralText Text>
+constexpr const jsonValue* operator""_json()
+{
+    return JsonLiteral<Text>::value;
+}
+
+} // namespace literals
+
+} // namespace tinyjson
+
+#endif /* TINYJSON_LITERALS */
+
+#endif /* JSON_LITERAL_HPP__ */